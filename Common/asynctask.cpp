@@ -0,0 +1,7 @@
+#include "asynctask.h"
+
+QThreadPool *Async::taskPool()
+{
+    static QThreadPool pool;
+    return &pool;
+}
@@ -0,0 +1,113 @@
+#ifndef ASYNCTASK_H
+#define ASYNCTASK_H
+#include <QtCore>
+#include <functional>
+/*
+ * Future based helpers for work that must not block the caller.
+ * Async::run starts a task on the shared task pool, Async::then schedules a
+ * continuation on the thread of a context object once the future finishes,
+ * so the calling thread never spins a nested event loop.
+ */
+class CancelToken
+{
+public:
+    CancelToken() : flag(new QAtomicInt(0)) {}
+    inline void cancel() { flag->storeRelease(1); }
+    inline bool isCancelled() const { return flag->loadAcquire() != 0; }
+private:
+    QSharedPointer<QAtomicInt> flag;
+};
+
+namespace Async
+{
+    enum Priority
+    {
+        Background = 0,
+        Interactive = 1
+    };
+
+    QThreadPool *taskPool();
+
+    class FunctionRunnable : public QRunnable
+    {
+    public:
+        explicit FunctionRunnable(std::function<void()> func) : task(func) { setAutoDelete(true); }
+        void run() override { task(); }
+    private:
+        std::function<void()> task;
+    };
+
+    template<typename T>
+    void reportTask(QFutureInterface<T> &futureInterface, const std::function<T()> &task, const CancelToken &token)
+    {
+        if(token.isCancelled() || futureInterface.isCanceled())
+        {
+            futureInterface.reportCanceled();
+        }
+        else
+        {
+            futureInterface.reportResult(task());
+        }
+        futureInterface.reportFinished();
+    }
+
+    template<typename Func>
+    auto runOn(QThreadPool *pool, Func task, Priority priority = Background, const CancelToken &token = CancelToken()) -> QFuture<decltype(task())>
+    {
+        typedef decltype(task()) T;
+        QFutureInterface<T> futureInterface;
+        futureInterface.reportStarted();
+        std::function<T()> func(task);
+        pool->start(new FunctionRunnable([futureInterface, func, token]() mutable {
+            reportTask(futureInterface, func, token);
+        }), priority);
+        return futureInterface.future();
+    }
+
+    template<typename Func>
+    auto run(Func task, Priority priority = Background, const CancelToken &token = CancelToken()) -> QFuture<decltype(task())>
+    {
+        return runOn(taskPool(), task, priority, token);
+    }
+
+    //an already finished future, for calls that have nothing to wait for
+    template<typename T>
+    QFuture<T> ready(const T &value)
+    {
+        QFutureInterface<T> futureInterface;
+        futureInterface.reportStarted();
+        futureInterface.reportResult(value);
+        futureInterface.reportFinished();
+        return futureInterface.future();
+    }
+
+    template<typename T, typename Callback>
+    void then(const QFuture<T> &future, QObject *context, Callback callback)
+    {
+        QFutureWatcher<T> *watcher = new QFutureWatcher<T>();
+        watcher->moveToThread(context->thread());
+        QObject::connect(context, &QObject::destroyed, watcher, &QObject::deleteLater);
+        //mutable, a callback may keep state such as a QFutureInterface it reports to
+        QObject::connect(watcher, &QFutureWatcher<T>::finished, context, [watcher, callback]() mutable {
+            if(!watcher->isCanceled() && watcher->future().resultCount() > 0)
+                callback(watcher->result());
+            watcher->deleteLater();
+        });
+        watcher->setFuture(future);
+    }
+
+    //like then, but also called for a cancelled future, the callback checks the future itself
+    template<typename T, typename Callback>
+    void finally(const QFuture<T> &future, QObject *context, Callback callback)
+    {
+        QFutureWatcher<T> *watcher = new QFutureWatcher<T>();
+        watcher->moveToThread(context->thread());
+        QObject::connect(context, &QObject::destroyed, watcher, &QObject::deleteLater);
+        QObject::connect(watcher, &QFutureWatcher<T>::finished, context, [watcher, callback]() mutable {
+            callback(watcher->future());
+            watcher->deleteLater();
+        });
+        watcher->setFuture(future);
+    }
+}
+#endif // ASYNCTASK_H
@@ -0,0 +1,146 @@
+#include "dbexecutor.h"
+#include "globalobjects.h"
+
+const char *DBExecutor::readerThreadPrefix = "dbReader";
+
+DBExecutor::DBExecutor(int readerCount, QObject *parent) : QObject(parent), nextReader(0)
+{
+    for(int i = 0; i < qMax(1, readerCount); ++i)
+    {
+        QThread *thread = new QThread();
+        thread->setObjectName(QString("%1%2").arg(readerThreadPrefix).arg(i));
+        thread->start(QThread::NormalPriority);
+        QObject *context = new QObject();
+        context->moveToThread(thread);
+        //queued before any task, so the connections are ready when tasks arrive
+        QMetaObject::invokeMethod(context, [thread](){
+            GlobalObjects::initReaderDatabase(thread->objectName());
+        }, Qt::QueuedConnection);
+        readers.append(thread);
+        readerContexts.append(context);
+    }
+}
+
+DBExecutor::~DBExecutor()
+{
+    shutdown();
+}
+
+void DBExecutor::shutdown()
+{
+    for(int i = 0; i < readers.size(); ++i)
+    {
+        readerContexts[i]->deleteLater();
+        readers[i]->quit();
+        readers[i]->wait();
+        delete readers[i];
+    }
+    readers.clear();
+    readerContexts.clear();
+}
+
+bool DBExecutor::isReaderThread()
+{
+    return QThread::currentThread()->objectName().startsWith(readerThreadPrefix);
+}
+
+QVariant DBExecutor::runRead(const QString &name, Priority priority, std::function<QVariant()> task)
+{
+    //workThread reads on its own connection, a wait here would let queued writes run inside its transaction
+    if(isReaderThread() || readers.isEmpty() || QThread::currentThread() == GlobalObjects::workThread)
+    {
+        return timed(name, 0, task);
+    }
+    //a gui thread waiting here stalls painting and input, gui code uses readAsync
+    Q_ASSERT_X(QThread::currentThread() != QCoreApplication::instance()->thread(), "DBExecutor::read", qPrintable(name));
+    QSemaphore done;
+    QVariant result;
+    submit(name, priority, [task, &result, &done](){
+        result = task();
+        done.release();
+    });
+    done.acquire();
+    return result;
+}
+
+QVariant DBExecutor::runWrite(const QString &name, std::function<QVariant()> task)
+{
+    if(QThread::currentThread() == GlobalObjects::workThread)
+    {
+        return timed(name, 0, task);
+    }
+    Q_ASSERT_X(QThread::currentThread() != QCoreApplication::instance()->thread(), "DBExecutor::write", qPrintable(name));
+    QSemaphore done;
+    QVariant result;
+    runWriteOnce(name, [task, &result, &done](){
+        result = task();
+        done.release();
+        return QVariant();
+    });
+    done.acquire();
+    return result;
+}
+
+void DBExecutor::runWriteOnce(const QString &name, std::function<QVariant()> task)
+{
+    if(QThread::currentThread() == GlobalObjects::workThread)
+    {
+        timed(name, 0, task);
+        return;
+    }
+    QElapsedTimer queued;
+    queued.start();
+    QObject *obj = new QObject();
+    obj->moveToThread(GlobalObjects::workThread);
+    QMetaObject::invokeMethod(obj, [this, name, task, queued, obj](){
+        timed(name, queued.elapsed(), task);
+        obj->deleteLater();
+    });
+}
+
+void DBExecutor::submit(const QString &name, Priority priority, std::function<void()> func)
+{
+    if(readerContexts.isEmpty())
+    {
+        timed(name, 0, [func](){ func(); return QVariant(); });
+        return;
+    }
+    QObject *context;
+    {
+        QMutexLocker locker(&taskLock);
+        Task task;
+        task.name = name;
+        task.func = func;
+        task.queued.start();
+        pendingTasks[priority].enqueue(task);
+        context = readerContexts[nextReader];
+        nextReader = (nextReader + 1) % readerContexts.size();
+    }
+    //one wakeup per task, the woken reader takes the most urgent pending task
+    QMetaObject::invokeMethod(context, [this](){ runNext(); }, Qt::QueuedConnection);
+}
+
+void DBExecutor::runNext()
+{
+    Task task;
+    {
+        QMutexLocker locker(&taskLock);
+        if(!pendingTasks[Interactive].isEmpty()) task = pendingTasks[Interactive].dequeue();
+        else if(!pendingTasks[Background].isEmpty()) task = pendingTasks[Background].dequeue();
+        else return;
+    }
+    const qint64 waitTime = task.queued.elapsed();
+    std::function<void()> func(task.func);
+    timed(task.name, waitTime, [func](){ func(); return QVariant(); });
+}
+
+QVariant DBExecutor::timed(const QString &name, qint64 waitTime, const std::function<QVariant()> &task)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QVariant result(task());
+    const qint64 runTime = timer.elapsed();
+    if(runTime + waitTime >= slowTaskTime)
+        qInfo() << "db task" << name << "on" << QThread::currentThread()->objectName() << "wait:" << waitTime << "ms, run:" << runTime << "ms";
+    return result;
+}
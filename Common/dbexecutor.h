@@ -0,0 +1,94 @@
+#ifndef DBEXECUTOR_H
+#define DBEXECUTOR_H
+#include <QtCore>
+#include <functional>
+#include "asynctask.h"
+/*
+ * Database task executor.
+ * Write tasks run on workThread in submit order (the "*_W" connections),
+ * read tasks run on a pool of reader threads, each with its own WAL reader connection.
+ * Pending reads are taken by priority, Interactive before Background.
+ * read/write block the caller until the task is done, tasks called from workThread or a reader run inline.
+ * The gui thread never blocks on them, gui code uses readAsync/writeAsync with Async::then, a blocking call there asserts.
+ */
+class DBExecutor : public QObject
+{
+public:
+    enum Priority
+    {
+        Interactive,
+        Background
+    };
+    explicit DBExecutor(int readerCount, QObject *parent = nullptr);
+    virtual ~DBExecutor();
+
+    template<typename Func>
+    QVariant read(const QString &name, Func task, Priority priority = Interactive)
+    {
+        return runRead(name, priority, std::function<QVariant()>(task));
+    }
+    template<typename Func>
+    QVariant write(const QString &name, Func task)
+    {
+        return runWrite(name, std::function<QVariant()>(task));
+    }
+    template<typename Func>
+    void writeOnce(const QString &name, Func task)
+    {
+        std::function<void()> func(task);
+        runWriteOnce(name, [func](){ func(); return QVariant(); });
+    }
+
+    template<typename Func>
+    auto readAsync(const QString &name, Func task, Priority priority = Interactive, const CancelToken &token = CancelToken()) -> QFuture<decltype(task())>
+    {
+        typedef decltype(task()) T;
+        QFutureInterface<T> futureInterface;
+        futureInterface.reportStarted();
+        std::function<T()> func(task);
+        submit(name, priority, [futureInterface, func, token]() mutable {
+            Async::reportTask(futureInterface, func, token);
+        });
+        return futureInterface.future();
+    }
+    template<typename Func>
+    auto writeAsync(const QString &name, Func task, const CancelToken &token = CancelToken()) -> QFuture<decltype(task())>
+    {
+        typedef decltype(task()) T;
+        QFutureInterface<T> futureInterface;
+        futureInterface.reportStarted();
+        std::function<T()> func(task);
+        runWriteOnce(name, [futureInterface, func, token]() mutable {
+            Async::reportTask(futureInterface, func, token);
+            return QVariant();
+        });
+        return futureInterface.future();
+    }
+
+    void shutdown();
+    static bool isReaderThread();
+    static const char *readerThreadPrefix;
+
+private:
+    struct Task
+    {
+        QString name;
+        std::function<void()> func;
+        QElapsedTimer queued;
+    };
+    QMutex taskLock;
+    QQueue<Task> pendingTasks[2];
+    QList<QThread *> readers;
+    QList<QObject *> readerContexts;
+    int nextReader;
+    const qint64 slowTaskTime = 100;
+
+    QVariant runRead(const QString &name, Priority priority, std::function<QVariant()> task);
+    QVariant runWrite(const QString &name, std::function<QVariant()> task);
+    void runWriteOnce(const QString &name, std::function<QVariant()> task);
+    void submit(const QString &name, Priority priority, std::function<void()> func);
+    void runNext();
+    QVariant timed(const QString &name, qint64 waitTime, const std::function<QVariant()> &task);
+};
+
+#endif // DBEXECUTOR_H
@@ -0,0 +1,216 @@
+#include "dbmaintenance.h"
+#include <QSqlQuery>
+#include <QSqlDatabase>
+#include <QTimer>
+#include <QDateTime>
+#include <QFileInfo>
+#include "dbexecutor.h"
+#include "globalobjects.h"
+namespace
+{
+    const char *dbNames[]={"comment","bangumi","download"};
+    const int dbCount=3;
+}
+
+DBMaintenance::DBMaintenance(QThread *thread) : QObject(nullptr),
+    checking(false), playing(0), running(0), vacuumSteps(0), pendingCount(0), reclaimedBytes(0)
+{
+    stepTimer = new QTimer(this);
+    stepTimer->setSingleShot(true);
+    QObject::connect(stepTimer, &QTimer::timeout, this, &DBMaintenance::step);
+    moveToThread(thread);
+}
+
+DBMaintenance::Stat DBMaintenance::stat()
+{
+    Stat s;
+    s.running = running.load() != 0;
+    s.paused = playing.load() != 0;
+    s.reclaimedBytes = reclaimedBytes.load();
+    s.vacuumSteps = vacuumSteps.load();
+    s.pendingSteps = pendingCount.load();
+    QMutexLocker locker(&resultLock);
+    s.checkResults = checkResults;
+    return s;
+}
+
+void DBMaintenance::setPlaying(bool on)
+{
+    //may be called from the main thread, the flag is seen by the next step at once
+    playing.store(on ? 1 : 0);
+    QMetaObject::invokeMethod(this, [this, on](){
+        if(on) stepTimer->stop();
+        else schedule();
+    }, Qt::QueuedConnection);
+}
+
+void DBMaintenance::schedule()
+{
+    if(playing.load() || checking) return;
+    stepTimer->start(idleDelay);
+}
+
+void DBMaintenance::step()
+{
+    if(playing.load() || checking) return;
+    if(!running.load())
+    {
+        startCycle();
+        if(!running.load())
+        {
+            stepTimer->start(retryInterval);
+            return;
+        }
+    }
+    if(pendingSteps.isEmpty())
+    {
+        finish();
+        stepTimer->start(retryInterval);
+        return;
+    }
+    const Step cur = pendingSteps.first();
+    QSqlQuery query(GlobalObjects::getDB(cur.db));
+    switch (cur.type)
+    {
+    case Convert:
+        if(convert(query, cur.db)) pendingSteps.removeFirst();
+        break;
+    case Vacuum:
+        if(!vacuum(query, cur.db)) pendingSteps.removeFirst();
+        break;
+    case Analyze:
+        analyze(query, cur.db);
+        pendingSteps.removeFirst();
+        break;
+    case Check:
+        pendingSteps.removeFirst();
+        check(cur.db);
+        break;
+    }
+    pendingCount.store(pendingSteps.size());
+    if(!checking) stepTimer->start(stepInterval);
+}
+
+void DBMaintenance::startCycle()
+{
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    if(now - GlobalObjects::appSetting->value("DB/LastMaintenance", 0).toLongLong() < cycleInterval) return;
+    const bool needCheck = now - GlobalObjects::appSetting->value("DB/LastIntegrityCheck", 0).toLongLong() >= checkInterval;
+    pendingSteps.clear();
+    for(int i = 0; i < dbCount; ++i)
+    {
+        pendingSteps.append({i, Convert});
+        pendingSteps.append({i, Vacuum});
+        pendingSteps.append({i, Analyze});
+        if(needCheck) pendingSteps.append({i, Check});
+    }
+    pendingCount.store(pendingSteps.size());
+    running.store(1);
+    qInfo() << "db maintenance started, steps:" << pendingSteps.size();
+}
+
+void DBMaintenance::finish()
+{
+    running.store(0);
+    GlobalObjects::appSetting->setValue("DB/LastMaintenance", QDateTime::currentSecsSinceEpoch());
+    qInfo() << "db maintenance finished, reclaimed:" << reclaimedBytes.load() << "bytes, vacuum steps:" << vacuumSteps.load();
+}
+
+bool DBMaintenance::convert(QSqlQuery &query, int db)
+{
+    //auto_vacuum of an existing database only changes with a full VACUUM, which holds workThread until it is done,
+    //so it is opt-in and limited to small files
+    if(!GlobalObjects::appSetting->value("DB/ConvertAutoVacuum", false).toBool()) return true;
+    if(pragma(query, "auto_vacuum") == 2) return true;
+    const qint64 fileSize = QFileInfo(GlobalObjects::dataPath + dbNames[db] + ".db").size();
+    const qint64 maxSize = GlobalObjects::appSetting->value("DB/MaxVacuumSize", 64).toLongLong() << 20;
+    if(fileSize > maxSize)
+    {
+        qInfo() << "db maintenance: skip converting" << dbNames[db] << ", size:" << fileSize;
+        return true;
+    }
+    const qint64 freeBytes = pragma(query, "freelist_count") * pragma(query, "page_size");
+    //playback may have started since the step was scheduled, retried when the player is idle again
+    if(playing.load()) return false;
+    query.exec("PRAGMA auto_vacuum = INCREMENTAL");
+    if(query.exec("VACUUM"))
+    {
+        reclaimedBytes.fetchAndAddRelaxed(freeBytes);
+        query.exec("PRAGMA wal_checkpoint(PASSIVE)");
+        qInfo() << "db maintenance: converted" << dbNames[db] << "to incremental auto_vacuum";
+    }
+    return true;
+}
+
+bool DBMaintenance::vacuum(QSqlQuery &query, int db)
+{
+    const qint64 freePages = pragma(query, "freelist_count");
+    if(freePages <= 0 || pragma(query, "auto_vacuum") != 2) return false;
+    //each sqlite step frees one page, run the statement to completion
+    query.exec(QString("PRAGMA incremental_vacuum(%1)").arg(pagesPerStep));
+    while(query.next());
+    query.finish();
+    const qint64 remainPages = pragma(query, "freelist_count");
+    const qint64 freed = freePages - remainPages;
+    reclaimedBytes.fetchAndAddRelaxed(freed * pragma(query, "page_size"));
+    vacuumSteps.ref();
+    if(freed > 0 && remainPages > 0) return true;
+    //the file is truncated when the wal is checkpointed
+    query.exec("PRAGMA wal_checkpoint(PASSIVE)");
+    qDebug() << "db maintenance: vacuumed" << dbNames[db] << ", free pages left:" << remainPages;
+    return false;
+}
+
+void DBMaintenance::analyze(QSqlQuery &query, int db)
+{
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    const QString key(QString("DB/LastAnalyze_%1").arg(dbNames[db]));
+    const bool hasStat = query.exec("select 1 from sqlite_master where name='sqlite_stat1'") && query.next();
+    query.finish();
+    //bounds the rows ANALYZE reads per index on sqlite >= 3.32, ignored before
+    query.exec("PRAGMA analysis_limit = 1000");
+    if(!hasStat || now - GlobalObjects::appSetting->value(key, 0).toLongLong() >= analyzeInterval)
+    {
+        query.exec("ANALYZE");
+        GlobalObjects::appSetting->setValue(key, now);
+    }
+    else
+    {
+        query.exec("PRAGMA optimize");
+    }
+}
+
+void DBMaintenance::check(int db)
+{
+    checking = true;
+    GlobalObjects::appSetting->setValue("DB/LastIntegrityCheck", QDateTime::currentSecsSinceEpoch());
+    //read-only, runs on a reader connection so the write queue is not held up
+    auto future = GlobalObjects::dbExecutor->readAsync("DBMaintenance::check", [db](){
+        QStringList result;
+        QSqlQuery query(GlobalObjects::getDB(db));
+        query.exec("PRAGMA quick_check");
+        while (query.next())
+            result << query.value(0).toString();
+        return result;
+    }, DBExecutor::Background);
+    Async::then(future, this, [this, db](const QStringList &result){
+        checking = false;
+        const bool ok = result.size() == 1 && result.first() == "ok";
+        if(!ok) qWarning() << "db maintenance: quick_check of" << dbNames[db] << "failed:" << result;
+        {
+            QMutexLocker locker(&resultLock);
+            checkResults.append(QString("%1: %2").arg(dbNames[db], ok ? "ok" : result.value(0)));
+            while(checkResults.size() > dbCount) checkResults.removeFirst();
+        }
+        if(!playing.load()) stepTimer->start(stepInterval);
+    });
+}
+
+qint64 DBMaintenance::pragma(QSqlQuery &query, const QString &name)
+{
+    qint64 val = -1;
+    if(query.exec(QString("PRAGMA %1").arg(name)) && query.next())
+        val = query.value(0).toLongLong();
+    query.finish();
+    return val;
+}
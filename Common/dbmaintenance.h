@@ -0,0 +1,78 @@
+#ifndef DBMAINTENANCE_H
+#define DBMAINTENANCE_H
+#include <QObject>
+#include <QAtomicInt>
+#include <QList>
+#include <QMutex>
+#include <QStringList>
+class QTimer;
+class QSqlQuery;
+/*
+ * Idle-time maintenance of the sqlite databases, runs on workThread in small steps.
+ * A cycle (at most once per cycleInterval) converts small databases to auto_vacuum=INCREMENTAL once if DB/ConvertAutoVacuum is on,
+ * frees pages with incremental_vacuum a few hundred pages per step, refreshes planner stats (ANALYZE/optimize)
+ * and, less often, runs quick_check on a db reader thread.
+ * Steps only run after the player has been idle for idleDelay, playback pauses the cycle before the next step.
+ */
+class DBMaintenance : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stat
+    {
+        bool running = false;
+        bool paused = false;
+        qint64 reclaimedBytes = 0;
+        int vacuumSteps = 0;
+        int pendingSteps = 0;
+        QStringList checkResults;
+    };
+    explicit DBMaintenance(QThread *thread);
+    Stat stat();
+    void setPlaying(bool on);
+
+public slots:
+    void schedule();
+
+private slots:
+    void step();
+
+private:
+    enum StepType
+    {
+        Convert,
+        Vacuum,
+        Analyze,
+        Check
+    };
+    struct Step
+    {
+        int db;
+        StepType type;
+    };
+    QTimer *stepTimer;
+    QList<Step> pendingSteps;
+    bool checking;
+    QAtomicInt playing, running, vacuumSteps, pendingCount;
+    QAtomicInteger<qint64> reclaimedBytes;
+    QMutex resultLock;
+    QStringList checkResults;
+
+    const int idleDelay = 120000;
+    const int stepInterval = 200;
+    const int retryInterval = 3600000;
+    const int pagesPerStep = 256;
+    const qint64 cycleInterval = 24*3600;
+    const qint64 checkInterval = 7*24*3600;
+    const qint64 analyzeInterval = 7*24*3600;
+
+    void startCycle();
+    void finish();
+    bool convert(QSqlQuery &query, int db);
+    bool vacuum(QSqlQuery &query, int db);
+    void analyze(QSqlQuery &query, int db);
+    void check(int db);
+    static qint64 pragma(QSqlQuery &query, const QString &name);
+};
+
+#endif // DBMAINTENANCE_H
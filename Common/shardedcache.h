@@ -0,0 +1,209 @@
+#ifndef SHARDEDCACHE_H
+#define SHARDEDCACHE_H
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QScopedArrayPointer>
+#include <functional>
+#include <list>
+/*
+ * Size-aware LRU cache.
+ * Each entry has a weight (comment count, bytes...) and the cache keeps the total weight under the budget.
+ * Keys are spread over shards with their own lock, so lookups in different shards do not contend.
+ * Pinned entries, the entry just put and entries the evictor refuses are never evicted.
+ */
+template <typename K, typename V>
+class ShardedLRUCache
+{
+public:
+    typedef std::function<qint64(const V &)> Weigher;
+    typedef std::function<bool(const V &)> Evictor;
+    struct Stats
+    {
+        qint64 hits = 0;
+        qint64 misses = 0;
+        qint64 evictions = 0;
+        qint64 weight = 0;
+        int count = 0;
+        int pinned = 0;
+    };
+
+    explicit ShardedLRUCache(qint64 budget, int shardCount = 8, Weigher weigher = nullptr, Evictor evictor = nullptr):
+        budget(budget), shardCount(qMax(1, shardCount)), shards(new Shard[qMax(1, shardCount)]),
+        weigher(weigher), evictor(evictor), totalWeight(0), nextShard(0) {}
+
+    inline qint64 capacity() const { return budget; }
+    void setCapacity(qint64 newBudget)
+    {
+        budget = newBudget;
+        shrink(nullptr);
+    }
+
+    bool contains(const K &key)
+    {
+        Shard &shard = shardOf(key);
+        QMutexLocker locker(&shard.lock);
+        return shard.hash.contains(key);
+    }
+    bool get(const K &key, V &value)
+    {
+        Shard &shard = shardOf(key);
+        QMutexLocker locker(&shard.lock);
+        auto iter = shard.hash.find(key);
+        if(iter == shard.hash.end())
+        {
+            ++shard.misses;
+            return false;
+        }
+        ++shard.hits;
+        shard.list.splice(shard.list.begin(), shard.list, iter.value());
+        value = iter.value()->value;
+        return true;
+    }
+    V value(const K &key, const V &defaultValue = V())
+    {
+        V val;
+        return get(key, val) ? val : defaultValue;
+    }
+    void put(const K &key, const V &value)
+    {
+        const qint64 weight = qMax<qint64>(1, weigher ? weigher(value) : 1);
+        Shard &shard = shardOf(key);
+        {
+            QMutexLocker locker(&shard.lock);
+            auto iter = shard.hash.find(key);
+            if(iter != shard.hash.end())
+            {
+                auto node = iter.value();
+                totalWeight.fetchAndAddOrdered(weight - node->weight);
+                node->value = value;
+                node->weight = weight;
+                shard.list.splice(shard.list.begin(), shard.list, node);
+            }
+            else
+            {
+                shard.list.push_front(Node(key, value, weight));
+                shard.hash.insert(key, shard.list.begin());
+                totalWeight.fetchAndAddOrdered(weight);
+            }
+        }
+        if(totalWeight.load() > budget) shrink(&key);
+    }
+    bool remove(const K &key)
+    {
+        Shard &shard = shardOf(key);
+        QMutexLocker locker(&shard.lock);
+        auto iter = shard.hash.find(key);
+        if(iter == shard.hash.end()) return false;
+        totalWeight.fetchAndAddOrdered(-iter.value()->weight);
+        shard.list.erase(iter.value());
+        shard.hash.erase(iter);
+        return true;
+    }
+    bool pin(const K &key)
+    {
+        Shard &shard = shardOf(key);
+        QMutexLocker locker(&shard.lock);
+        auto iter = shard.hash.find(key);
+        if(iter == shard.hash.end()) return false;
+        ++iter.value()->pins;
+        return true;
+    }
+    void unpin(const K &key)
+    {
+        Shard &shard = shardOf(key);
+        QMutexLocker locker(&shard.lock);
+        auto iter = shard.hash.find(key);
+        if(iter != shard.hash.end() && iter.value()->pins > 0) --iter.value()->pins;
+    }
+    void clear()
+    {
+        for(int i = 0; i < shardCount; ++i)
+        {
+            QMutexLocker locker(&shards[i].lock);
+            for(const Node &node : shards[i].list)
+                totalWeight.fetchAndAddOrdered(-node.weight);
+            shards[i].list.clear();
+            shards[i].hash.clear();
+        }
+    }
+    Stats stats()
+    {
+        Stats stat;
+        for(int i = 0; i < shardCount; ++i)
+        {
+            QMutexLocker locker(&shards[i].lock);
+            stat.hits += shards[i].hits;
+            stat.misses += shards[i].misses;
+            stat.evictions += shards[i].evictions;
+            stat.count += shards[i].hash.size();
+            for(const Node &node : shards[i].list)
+                if(node.pins > 0) ++stat.pinned;
+        }
+        stat.weight = totalWeight.load();
+        return stat;
+    }
+
+private:
+    struct Node
+    {
+        Node(const K &k, const V &v, qint64 w):key(k), value(v), weight(w), pins(0){}
+        K key;
+        V value;
+        qint64 weight;
+        int pins;
+    };
+    typedef typename std::list<Node>::iterator NodeIter;
+    struct Shard
+    {
+        QMutex lock;
+        std::list<Node> list;
+        QHash<K, NodeIter> hash;
+        qint64 hits = 0;
+        qint64 misses = 0;
+        qint64 evictions = 0;
+    };
+
+    qint64 budget;
+    const int shardCount;
+    QScopedArrayPointer<Shard> shards;
+    Weigher weigher;
+    Evictor evictor;
+    QAtomicInteger<qint64> totalWeight;
+    QAtomicInt nextShard;
+
+    inline Shard &shardOf(const K &key) { return shards[qHash(key) % shardCount]; }
+
+    void shrink(const K *recent)
+    {
+        //take the least recently used entry of each shard in turn, until the budget is met or nothing is evictable
+        int idle = 0;
+        while(totalWeight.load() > budget && idle < shardCount)
+        {
+            int i = (nextShard.fetchAndAddRelaxed(1) & 0x7fffffff) % shardCount;
+            if(evictOne(shards[i], recent)) idle = 0;
+            else ++idle;
+        }
+    }
+    bool evictOne(Shard &shard, const K *recent)
+    {
+        QMutexLocker locker(&shard.lock);
+        for(auto iter = shard.list.end(); iter != shard.list.begin();)
+        {
+            --iter;
+            if(iter->pins > 0 || (recent && iter->key == *recent)) continue;
+            if(evictor && !evictor(iter->value)) continue;
+            totalWeight.fetchAndAddOrdered(-iter->weight);
+            shard.hash.remove(iter->key);
+            shard.list.erase(iter);
+            ++shard.evictions;
+            return true;
+        }
+        return false;
+    }
+
+    ShardedLRUCache(const ShardedLRUCache &);
+    ShardedLRUCache &operator=(const ShardedLRUCache &);
+};
+
+#endif // SHARDEDCACHE_H
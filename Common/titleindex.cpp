@@ -0,0 +1,235 @@
+#include "titleindex.h"
+#include <QVector>
+#include <QRegExp>
+#include <QScopedArrayPointer>
+#include <algorithm>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+namespace
+{
+    //at least half of the query trigrams must appear in a title for a fuzzy hit
+    const double minFuzzyScore = 0.5;
+}
+
+void TitleIndex::add(const QString &key, const QString &text)
+{
+    if(key.isEmpty() || text.isEmpty()) return;
+    QWriteLocker locker(&lock);
+    auto iter = keyIds.find(key);
+    int id;
+    if(iter == keyIds.end())
+    {
+        id = nextId++;
+        keyIds.insert(key, id);
+        docs[id].key = key;
+    }
+    else
+    {
+        id = iter.value();
+        if(docs[id].texts.contains(text)) return;
+    }
+    Doc &doc = docs[id];
+    doc.texts.append(text);
+    doc.normTexts.append(normalize(text));
+    indexDoc(id, doc, true);
+}
+
+void TitleIndex::remove(const QString &key)
+{
+    QWriteLocker locker(&lock);
+    auto iter = keyIds.find(key);
+    if(iter == keyIds.end()) return;
+    const int id = iter.value();
+    indexDoc(id, docs[id], false);
+    docs.remove(id);
+    keyIds.erase(iter);
+}
+
+void TitleIndex::remove(const QString &key, const QString &text)
+{
+    QWriteLocker locker(&lock);
+    auto iter = keyIds.find(key);
+    if(iter == keyIds.end()) return;
+    const int id = iter.value();
+    Doc &doc = docs[id];
+    const int pos = doc.texts.indexOf(text);
+    if(pos < 0) return;
+    //grams may be shared with the other texts, so the doc is indexed again
+    indexDoc(id, doc, false);
+    doc.texts.removeAt(pos);
+    doc.normTexts.removeAt(pos);
+    if(doc.texts.isEmpty())
+    {
+        docs.remove(id);
+        keyIds.erase(iter);
+        return;
+    }
+    indexDoc(id, doc, true);
+}
+
+bool TitleIndex::contains(const QString &key) const
+{
+    QReadLocker locker(&lock);
+    return keyIds.contains(key);
+}
+
+int TitleIndex::size() const
+{
+    QReadLocker locker(&lock);
+    return keyIds.size();
+}
+
+void TitleIndex::clear()
+{
+    QWriteLocker locker(&lock);
+    docs.clear();
+    keyIds.clear();
+    postings.clear();
+}
+
+QStringList TitleIndex::search(const QString &query, int limit, bool fuzzy) const
+{
+    const QString normQuery(normalize(query));
+    if(normQuery.isEmpty()) return QStringList();
+    QReadLocker locker(&lock);
+    QVector<QPair<double, int>> hits;
+    if(normQuery.size() == 1)
+    {
+        for(auto iter = docs.cbegin(); iter != docs.cend(); ++iter)
+        {
+            double s = score(iter.value(), normQuery);
+            if(s > 0) hits.append(qMakePair(s, iter.key()));
+        }
+    }
+    else
+    {
+        QSet<quint64> queryGrams;
+        grams(normQuery, normQuery.size() == 2 ? 2 : 3, queryGrams);
+        const QSet<int> *shortest = nullptr;
+        QHash<int, int> gramHits;
+        bool missing = false;
+        for(quint64 gram : queryGrams)
+        {
+            auto iter = postings.constFind(gram);
+            if(iter == postings.cend())
+            {
+                missing = true;
+                continue;
+            }
+            if(!shortest || iter->size() < shortest->size()) shortest = &iter.value();
+            if(fuzzy && normQuery.size() > 3)
+            {
+                for(int id : iter.value()) ++gramHits[id];
+            }
+        }
+        //every query gram must be in a title that contains the query
+        if(shortest && !missing)
+        {
+            for(int id : *shortest)
+            {
+                double s = score(*docs.constFind(id), normQuery);
+                if(s > 0)
+                {
+                    hits.append(qMakePair(s, id));
+                    gramHits.remove(id);
+                }
+            }
+        }
+        for(auto iter = gramHits.cbegin(); iter != gramHits.cend(); ++iter)
+        {
+            double s = double(iter.value()) / queryGrams.size();
+            if(s >= minFuzzyScore) hits.append(qMakePair(s * 0.5, iter.key()));
+        }
+    }
+    std::sort(hits.begin(), hits.end(), [this](const QPair<double, int> &a, const QPair<double, int> &b){
+        if(a.first != b.first) return a.first > b.first;
+        const Doc &da = *docs.constFind(a.second), &db = *docs.constFind(b.second);
+        if(da.key.size() != db.key.size()) return da.key.size() < db.key.size();
+        return da.key < db.key;
+    });
+    QStringList results;
+    for(const auto &hit : hits)
+    {
+        if(limit >= 0 && results.size() >= limit) break;
+        results.append(docs.constFind(hit.second)->key);
+    }
+    return results;
+}
+
+QString TitleIndex::normalize(const QString &str)
+{
+    QString norm(str.normalized(QString::NormalizationForm_KC).toCaseFolded());
+    norm.remove(QRegExp("\\s"));
+    for(QChar &c : norm)
+    {
+        const ushort u = c.unicode();
+        if(u >= 0x30A1 && u <= 0x30F6) c = QChar(u - 0x60);
+    }
+#ifdef Q_OS_WIN
+    norm = stTrans(norm, true);
+#endif
+    return norm;
+}
+
+QString TitleIndex::stTrans(const QString &str, bool toSimplified)
+{
+#ifdef Q_OS_WIN
+    if(str.isEmpty()) return str;
+    WORD wLanguageID = MAKELANGID(LANG_CHINESE, SUBLANG_CHINESE_SIMPLIFIED);
+    LCID Locale = MAKELCID(wLanguageID, SORT_CHINESE_PRCP);
+    QScopedArrayPointer<QChar> buf(new QChar[str.length()]);
+    LCMapString(Locale,toSimplified?LCMAP_SIMPLIFIED_CHINESE:LCMAP_TRADITIONAL_CHINESE,reinterpret_cast<LPCWSTR>(str.constData()),str.length(),reinterpret_cast<LPWSTR>(buf.data()),str.length());
+    return QString(buf.data(), str.length());
+#else
+    Q_UNUSED(toSimplified)
+    return str;
+#endif
+}
+
+void TitleIndex::grams(const QString &normText, int n, QSet<quint64> &gramSet)
+{
+    for(int i = 0; i + n <= normText.size(); ++i)
+    {
+        quint64 gram = quint64(n) << 48;
+        for(int j = 0; j < n; ++j)
+            gram |= quint64(normText[i + j].unicode()) << (16 * (n - 1 - j));
+        gramSet.insert(gram);
+    }
+}
+
+void TitleIndex::indexDoc(int id, const Doc &doc, bool insert)
+{
+    QSet<quint64> docGrams;
+    for(const QString &normText : doc.normTexts)
+    {
+        grams(normText, 2, docGrams);
+        grams(normText, 3, docGrams);
+    }
+    for(quint64 gram : docGrams)
+    {
+        if(insert)
+        {
+            postings[gram].insert(id);
+        }
+        else
+        {
+            auto iter = postings.find(gram);
+            if(iter == postings.end()) continue;
+            iter->remove(id);
+            if(iter->isEmpty()) postings.erase(iter);
+        }
+    }
+}
+
+double TitleIndex::score(const TitleIndex::Doc &doc, const QString &normQuery) const
+{
+    double best = 0;
+    for(const QString &normText : doc.normTexts)
+    {
+        if(normText == normQuery) return 3;
+        if(normText.startsWith(normQuery)) best = qMax(best, 2.0);
+        else if(normText.contains(normQuery)) best = qMax(best, 1.0);
+    }
+    return best;
+}
@@ -0,0 +1,48 @@
+#ifndef TITLEINDEX_H
+#define TITLEINDEX_H
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QReadWriteLock>
+/*
+ * In-memory n-gram index over titles.
+ * Each key (anime title) can have several texts (title, aliases...), texts are normalized:
+ * NFKC(full/half width), case folded, katakana to hiragana, traditional to simplified(Windows), spaces removed.
+ * Queries of 2 chars use bigram postings, longer ones trigram postings, the shortest posting list is
+ * checked by substring. Results are ranked: exact > prefix > substring > fuzzy(shared trigrams),
+ * fuzzy hits are left out when fuzzy is false.
+ * All methods are thread-safe.
+ */
+class TitleIndex
+{
+public:
+    void add(const QString &key, const QString &text);
+    void remove(const QString &key);
+    void remove(const QString &key, const QString &text);
+    bool contains(const QString &key) const;
+    int size() const;
+    void clear();
+    QStringList search(const QString &query, int limit = -1, bool fuzzy = true) const;
+
+    static QString normalize(const QString &str);
+    static QString stTrans(const QString &str, bool toSimplified);
+
+private:
+    struct Doc
+    {
+        QString key;
+        QStringList texts;
+        QStringList normTexts;
+    };
+    QHash<int, Doc> docs;
+    QHash<QString, int> keyIds;
+    QHash<quint64, QSet<int>> postings;
+    int nextId = 0;
+    mutable QReadWriteLock lock;
+
+    static void grams(const QString &normText, int n, QSet<quint64> &gramSet);
+    void indexDoc(int id, const Doc &doc, bool insert);
+    double score(const Doc &doc, const QString &normQuery) const;
+};
+
+#endif // TITLEINDEX_H
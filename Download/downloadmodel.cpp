@@ -4,6 +4,7 @@
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include "Common/network.h"
+#include "Common/asynctask.h"
 #include "Play/Danmu/Manager/danmumanager.h"
 #include "Play/Danmu/Manager/pool.h"
 DownloadWorker *DownloadModel::downloadWorker=nullptr;
@@ -154,8 +155,10 @@ QString DownloadModel::processKikoPlayCode(const QString &code)
         double epIndex(array.takeAt(4).toDouble());
         QString file16MD5(array.takeAt(5).toString());
         QString pid = GlobalObjects::danmuManager->createPool(animeTitle,epType, epIndex, epTitle,file16MD5);
-        Pool *pool=GlobalObjects::danmuManager->getPool(pid,false);
-        pool->addPoolCode(array);
+        //an existing pool is loaded first, its sources are deduplicated in memory
+        Async::then(GlobalObjects::danmuManager->getPoolAsync(pid), this, [array](Pool *pool){
+            if(pool) pool->addPoolCode(array);
+        });
         return uri;
     } catch (Network::NetworkError &) {
         return QString();
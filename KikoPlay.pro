@@ -31,6 +31,10 @@ CONFIG += C++11
 
 SOURCES += \
     Common/notifier.cpp \
+    Common/dbexecutor.cpp \
+    Common/dbmaintenance.cpp \
+    Common/asynctask.cpp \
+    Common/titleindex.cpp \
     Download/autodownloadmanager.cpp \
     Download/peermodel.cpp \
     LANServer/mediahandler.cpp \
@@ -57,6 +61,7 @@ SOURCES += \
     UI/autodownloadwindow.cpp \
     UI/danmulaunch.cpp \
     UI/danmuview.cpp \
+    UI/danmusearch.cpp \
     UI/gifcapture.cpp \
     UI/inputdialog.cpp \
     UI/logwindow.cpp \
@@ -84,6 +89,9 @@ SOURCES += \
     Play/Danmu/Layouts/toplayout.cpp \
     Play/Danmu/danmupool.cpp \
     globalobjects.cpp \
+    Play/Playlist/folderscanner.cpp \
+    Play/Playlist/folderwatcher.cpp \
+    Play/Playlist/nextitemprefetcher.cpp \
     Play/Playlist/playlist.cpp \
     Play/Video/mpvplayer.cpp \
     UI/list.cpp \
@@ -121,10 +129,20 @@ SOURCES += \
     LANServer/lanserver.cpp \
     LANServer/httpserver.cpp \
     Play/Playlist/playlistitem.cpp \
+    Play/Playlist/playlistjournal.cpp \
     Play/Playlist/playlistprivate.cpp \
+    Play/Playlist/playprogress.cpp \
     Play/Danmu/Render/cacheworker.cpp \
     Play/Danmu/Render/danmurender.cpp \
     Play/Danmu/Manager/danmumanager.cpp \
+    Play/Danmu/Manager/danmufts.cpp \
+    Play/Danmu/Manager/danmusearchmodel.cpp \
+    Play/Danmu/Manager/danmupack.cpp \
+    Play/Danmu/Manager/poolsnapshot.cpp \
+    Play/Danmu/Manager/danmuwritequeue.cpp \
+    Play/Danmu/Manager/danmushardbalancer.cpp \
+    Play/Danmu/Manager/filehasher.cpp \
+    Play/Danmu/Manager/kdfile.cpp \
     Play/Danmu/Manager/nodeinfo.cpp \
     Play/Danmu/Manager/managermodel.cpp \
     MediaLibrary/animeworker.cpp \
@@ -142,7 +160,12 @@ SOURCES += \
 
 HEADERS += \
     Common/lrucache.h \
+    Common/shardedcache.h \
     Common/notifier.h \
+    Common/dbexecutor.h \
+    Common/dbmaintenance.h \
+    Common/asynctask.h \
+    Common/titleindex.h \
     Download/autodownloadmanager.h \
     Download/peerid.h \
     Download/peermodel.h \
@@ -170,6 +193,7 @@ HEADERS += \
     UI/autodownloadwindow.h \
     UI/danmulaunch.h \
     UI/danmuview.h \
+    UI/danmusearch.h \
     UI/gifcapture.h \
     UI/inputdialog.h \
     UI/logwindow.h \
@@ -198,6 +222,9 @@ HEADERS += \
     UI/widgets/fonticonbutton.h \
     UI/widgets/loadingicon.h \
     globalobjects.h \
+    Play/Playlist/folderscanner.h \
+    Play/Playlist/folderwatcher.h \
+    Play/Playlist/nextitemprefetcher.h \
     Play/Playlist/playlist.h \
     Play/Video/mpvplayer.h \
     UI/list.h \
@@ -238,10 +265,20 @@ HEADERS += \
     LANServer/lanserver.h \
     LANServer/httpserver.h \
     Play/Playlist/playlistitem.h \
+    Play/Playlist/playlistjournal.h \
     Play/Playlist/playlistprivate.h \
+    Play/Playlist/playprogress.h \
     Play/Danmu/Render/cacheworker.h \
     Play/Danmu/Render/danmurender.h \
     Play/Danmu/Manager/danmumanager.h \
+    Play/Danmu/Manager/danmufts.h \
+    Play/Danmu/Manager/danmusearchmodel.h \
+    Play/Danmu/Manager/danmupack.h \
+    Play/Danmu/Manager/poolsnapshot.h \
+    Play/Danmu/Manager/danmuwritequeue.h \
+    Play/Danmu/Manager/danmushardbalancer.h \
+    Play/Danmu/Manager/filehasher.h \
+    Play/Danmu/Manager/kdfile.h \
     Play/Danmu/Manager/nodeinfo.h \
     Play/Danmu/Manager/managermodel.h \
     MediaLibrary/animeworker.h \
@@ -15,9 +15,12 @@
 #include <QCoreApplication>
 #include <QMimeDatabase>
 #include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
 
 
-HttpServer::HttpServer(QObject *parent) : QObject(parent)
+HttpServer::HttpServer(QObject *parent) : QObject(parent),
+    serverTag(QByteArray::number(QDateTime::currentMSecsSinceEpoch(), 36))
 {
     MediaHandler *handler=new MediaHandler(&mediaHash,this);
     const QString strApp(QCoreApplication::applicationDirPath()+"/web");
@@ -84,15 +87,129 @@ void HttpServer::genLog(const QString &logInfo)
 
 void HttpServer::api_Playlist(QHttpEngine::Socket *socket)
 {
-    QMetaObject::invokeMethod(GlobalObjects::playlist,[this](){
-        GlobalObjects::playlist->dumpJsonPlaylist(playlistDoc,mediaHash);
+    QSharedPointer<const PlayListSnapshot> snapshot;
+    //the snapshot is only copied on the gui thread when the playlist has changed
+    QMetaObject::invokeMethod(GlobalObjects::playlist,[&snapshot](){
+        snapshot = GlobalObjects::playlist->snapshot();
     },Qt::BlockingQueuedConnection);
+    if(playlistHistory.isEmpty() || playlistHistory.last()->version != snapshot->version)
+        updatePlaylistCache(snapshot);
+
+    const QString since(socket->queryString().value("since"));
+    if(!since.isEmpty())
+    {
+        genLog(QString("[%1]Request:Playlist, since %2").arg(socket->peerAddress().toString(), since));
+        QByteArray compressedBytes;
+        Network::gzipCompress(QJsonDocument(playlistDelta(since.toULongLong())).toJson(QJsonDocument::Compact), compressedBytes);
+        replyJson(socket, compressedBytes);
+        return;
+    }
     genLog(QString("[%1]Request:Playlist").arg(socket->peerAddress().toString()));
+    socket->setHeader("ETag", playlistETag);
+    socket->setHeader("Cache-Control", "no-cache");
+    socket->setHeader("X-Playlist-Version", QByteArray::number(snapshot->version));
+    if(socket->headers().value("If-None-Match") == playlistETag)
+    {
+        socket->setStatusCode(304, "Not Modified");
+        socket->writeHeaders();
+        socket->close();
+        return;
+    }
+    replyJson(socket, playlistData);
+}
 
-    QByteArray data = playlistDoc.toJson();
-    QByteArray compressedBytes;
-    Network::gzipCompress(data,compressedBytes);
+void HttpServer::updatePlaylistCache(const QSharedPointer<const PlayListSnapshot> &snapshot)
+{
+    const QVector<PlayListSnapshot::Node> &nodes = snapshot->nodes;
+    QHash<QString,QString> newHash, newIds;
+    for(const PlayListSnapshot::Node &node : nodes)
+    {
+        if(node.isCollection) continue;
+        QString mediaId(mediaIds.value(node.path));
+        if(mediaId.isEmpty()) mediaId = QCryptographicHash::hash(node.path.toUtf8(),QCryptographicHash::Md5).toHex();
+        newIds.insert(node.path, mediaId);
+        newHash.insert(mediaId, node.path);
+    }
+    mediaIds.swap(newIds);
+    mediaHash.swap(newHash);
+    int pos = 0;
+    playlistArray = playlistLevel(*snapshot, pos, -1);
+    playlistData.clear();
+    Network::gzipCompress(QJsonDocument(playlistArray).toJson(QJsonDocument::Compact), playlistData);
+    playlistETag = QString("\"%1-%2\"").arg(QString(serverTag)).arg(snapshot->version).toUtf8();
+    playlistHistory.append(snapshot);
+    while(playlistHistory.size() > maxPlaylistHistory) playlistHistory.removeFirst();
+}
 
+QJsonArray HttpServer::playlistLevel(const PlayListSnapshot &snapshot, int &pos, int parent) const
+{
+    //nodes are in pre-order, the children of a collection follow it directly
+    QJsonArray array;
+    while(pos < snapshot.nodes.size() && snapshot.nodes[pos].parent == parent)
+    {
+        const int index = pos++;
+        QJsonObject itemObj(playlistItemObject(snapshot, index));
+        if(snapshot.nodes[index].isCollection) itemObj.insert("nodes", playlistLevel(snapshot, pos, index));
+        array.append(itemObj);
+    }
+    return array;
+}
+
+QJsonObject HttpServer::playlistItemObject(const PlayListSnapshot &snapshot, int index) const
+{
+    const PlayListSnapshot::Node &node = snapshot.nodes[index];
+    QJsonObject itemObj;
+    itemObj.insert("text",node.title);
+    if(node.isCollection) return itemObj;
+    itemObj.insert("mediaId",mediaIds.value(node.path));
+    itemObj.insert("danmuPool",node.poolID);
+    itemObj.insert("playTime",node.playTime);
+    itemObj.insert("playTimeState",node.playTimeState);
+    static QString nodeColors[3]={"#333","#428bca","#a4a2a2"};
+    itemObj.insert("color",nodeColors[node.playTimeState]);
+    return itemObj;
+}
+
+QJsonObject HttpServer::playlistDelta(quint64 since) const
+{
+    const PlayListSnapshot &cur = *playlistHistory.last();
+    QJsonObject resposeObj
+    {
+        {"version", double(cur.version)}
+    };
+    const PlayListSnapshot *old = nullptr;
+    for(const auto &snapshot : playlistHistory)
+    {
+        if(snapshot->version == since) old = snapshot.data();
+    }
+    bool sameTree = old && old->nodes.size() == cur.nodes.size();
+    for(int i = 0; sameTree && i < cur.nodes.size(); ++i)
+    {
+        const PlayListSnapshot::Node &n1 = old->nodes[i], &n2 = cur.nodes[i];
+        sameTree = n1.parent == n2.parent && n1.isCollection == n2.isCollection && n1.title == n2.title && n1.path == n2.path;
+    }
+    if(!sameTree)
+    {
+        //too old or the tree itself has changed
+        resposeObj.insert("full", true);
+        resposeObj.insert("data", playlistArray);
+        return resposeObj;
+    }
+    QJsonArray changedItems;
+    for(int i = 0; i < cur.nodes.size(); ++i)
+    {
+        const PlayListSnapshot::Node &n1 = old->nodes[i], &n2 = cur.nodes[i];
+        if(n2.isCollection) continue;
+        if(n1.poolID != n2.poolID || n1.playTime != n2.playTime || n1.playTimeState != n2.playTimeState)
+            changedItems.append(playlistItemObject(cur, i));
+    }
+    resposeObj.insert("full", false);
+    resposeObj.insert("data", changedItems);
+    return resposeObj;
+}
+
+void HttpServer::replyJson(QHttpEngine::Socket *socket, const QByteArray &compressedBytes)
+{
     socket->setHeader("Content-Length", QByteArray::number(compressedBytes.length()));
     socket->setHeader("Content-Type", "application/json");
     socket->setHeader("Content-Encoding", "gzip");
@@ -4,8 +4,12 @@
 #include <QObject>
 #include <QHash>
 #include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QSharedPointer>
 #include "qhttpengine/socket.h"
 #include "qhttpengine/server.h"
+struct PlayListSnapshot;
 class HttpServer : public QObject
 {
     Q_OBJECT
@@ -17,7 +21,21 @@ private:
     QHttpEngine::Server *server;
     QHash<QString,QString> mediaHash;
     void genLog(const QString &logInfo);
-    QJsonDocument playlistDoc;
+    /*
+     * The playlist json is built and compressed once per playlist version and served with an ETag.
+     * A few recent snapshots are kept, so /api/playlist?since=<version> can answer with the changed items only.
+     */
+    QList<QSharedPointer<const PlayListSnapshot> > playlistHistory;
+    QHash<QString,QString> mediaIds;
+    QJsonArray playlistArray;
+    QByteArray playlistData, playlistETag;
+    const QByteArray serverTag;
+    const int maxPlaylistHistory = 8;
+    void updatePlaylistCache(const QSharedPointer<const PlayListSnapshot> &snapshot);
+    QJsonArray playlistLevel(const PlayListSnapshot &snapshot, int &pos, int parent) const;
+    QJsonObject playlistItemObject(const PlayListSnapshot &snapshot, int index) const;
+    QJsonObject playlistDelta(quint64 since) const;
+    void replyJson(QHttpEngine::Socket *socket, const QByteArray &compressedBytes);
 signals:
     void showLog(const QString &logInfo);
 public slots:
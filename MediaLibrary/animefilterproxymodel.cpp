@@ -1,21 +1,49 @@
 #include "animefilterproxymodel.h"
 #include "animemodel.h"
 #include "labelmodel.h"
+#include "animeworker.h"
 #include "Common/notifier.h"
 #include "globalobjects.h"
 
 AnimeFilterProxyModel::AnimeFilterProxyModel(AnimeModel *srcModel, QObject *parent):QSortFilterProxyModel(parent),filterType(0)
 {
     QObject::connect(srcModel, &AnimeModel::animeCountInfo,this, &AnimeFilterProxyModel::refreshAnimeCount);
+    QObject::connect(srcModel, &AnimeModel::rowsAboutToBeInserted, this, [this](){
+        //new animes are already in the title index, match them before the new rows are filtered
+        refreshTitleMatches(filterRegExp().pattern());
+    });
+    QObject::connect(AnimeWorker::instance(), &AnimeWorker::titleIndexReady, this, [this](){
+        //searches before the index was read matched nothing by alias
+        refreshTitleMatches(filterRegExp().pattern());
+        if(filterType==0 && !filterRegExp().isEmpty()) invalidateFilter();
+    });
+    QObject::connect(AnimeWorker::instance(), &AnimeWorker::charactersLoaded, this, [this](){
+        if(filterType==3 && !filterRegExp().isEmpty()) invalidateFilter();
+    });
 }
 
 void AnimeFilterProxyModel::setFilter(int type, const QString &str)
 {
     filterType=type;
+    refreshTitleMatches(str);
+    if(type==3 && !str.isEmpty())
+    {
+        //characters are not part of the list query, fetch them for all loaded animes at once
+        AnimeWorker::instance()->loadCharacters(static_cast<AnimeModel *>(sourceModel())->animeList());
+    }
     setFilterRegExp(str);
     static_cast<AnimeModel *>(sourceModel())->showStatisMessage();
 }
 
+void AnimeFilterProxyModel::refreshTitleMatches(const QString &str)
+{
+    titleMatches.clear();
+    if(filterType!=0 || str.isEmpty()) return;
+    //alias lookups go through the library title index, fuzzy hits are not shown in the list
+    for(const QString &name : AnimeWorker::instance()->searchAnime(str, -1, false))
+        titleMatches.insert(name);
+}
+
 void AnimeFilterProxyModel::setTags(SelectedLabelInfo &&selectedLabels)
 {
     filterLabels = selectedLabels;
@@ -101,7 +129,7 @@ bool AnimeFilterProxyModel::filterAcceptsRow(int source_row, const QModelIndex &
      switch (filterType)
      {
      case 0://title
-         return anime->name().contains(filterRegExp());
+         return anime->name().contains(filterRegExp()) || titleMatches.contains(anime->name());
      case 1://summary
          return anime->description().contains(filterRegExp());
      case 2://staff
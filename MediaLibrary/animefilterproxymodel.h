@@ -16,7 +16,9 @@ signals:
 private:
     int filterType;
     SelectedLabelInfo filterLabels;
+    QSet<QString> titleMatches;
     void refreshAnimeCount(int cur, int total);
+    void refreshTitleMatches(const QString &str);
     // QSortFilterProxyModel interface
 protected:
     virtual bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const;
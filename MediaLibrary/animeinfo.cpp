@@ -1,15 +1,28 @@
 #include "animeinfo.h"
 #include "animeworker.h"
 
-Anime::Anime() : _addTime(0), _epCount(0), crtImagesLoaded(false), epLoaded(false), posterLoaded(false)
+Anime::Anime() : _addTime(0), _epCount(0), crtLoaded(true), crtImagesLoaded(false), epLoaded(false), posterLoaded(false),
+    coverLoaded(true)
 {
 
 }
 
+const QPixmap &Anime::cover()
+{
+    if(!coverLoaded)
+    {
+        //empty until AnimeWorker::coverLoaded
+        AnimeWorker::instance()->loadCover(this);
+        coverLoaded = true;
+    }
+    return _cover;
+}
+
 void Anime::setCover(const QByteArray &data)
 {
     AnimeWorker::instance()->updateCoverImage(_name, data);
     _cover.loadFromData(data);
+    coverLoaded = true;
 }
 
 void Anime::setCrtImage(const QString &name, const QByteArray &data)
@@ -35,11 +48,13 @@ void Anime::assign(const Anime *anime)
     _airDate = anime->_airDate;
     _coverURL = anime->_coverURL;
     _cover = anime->_cover;
+    coverLoaded = true;
     _scriptId = anime->_scriptId;
     _scriptData = anime->_scriptData;
     _epCount = anime->_epCount;
     staff = anime->staff;
     characters = anime->characters;
+    crtLoaded = true;
     crtImagesLoaded = anime->crtImagesLoaded;
 }
 
@@ -66,8 +81,7 @@ const QList<EpInfo> &Anime::epList()
 {
     if(!epLoaded)
     {
-        epInfoList.clear();
-        AnimeWorker::instance()->loadEpInfo(this);
+        epInfoList = AnimeWorker::instance()->readEpInfo(_name);
         epLoaded = true;
     }
     return epInfoList;
@@ -75,10 +89,12 @@ const QList<EpInfo> &Anime::epList()
 
 const QList<Character> &Anime::crList(bool loadImage)
 {
-    if(!crtImagesLoaded && loadImage)
+    if(!crtLoaded || (!crtImagesLoaded && loadImage))
     {
-        AnimeWorker::instance()->loadCrImages(this);
-        crtImagesLoaded = true;
+        //characters arrive later on the gui thread, AnimeWorker::charactersLoaded is emitted then
+        AnimeWorker::instance()->loadCharacters(this, loadImage);
+        crtLoaded = true;
+        if(loadImage) crtImagesLoaded = true;
     }
     return characters;
 }
@@ -179,8 +195,24 @@ QVariantMap Anime::toMap(bool fillEp)
         for(const auto &ep : epList())
             eps.append(ep.toMap());
     }
-    for(const auto &c : characters)
-        crts.append(c.toMap());
+    if(crtLoaded)
+    {
+        for(const auto &c : characters)
+            crts.append(c.toMap());
+    }
+    else
+    {
+        //called from script threads, read the rows directly instead of filling characters
+        for(const auto &row : AnimeWorker::instance()->readCharacters(_name))
+        {
+            crts.append(QVariantMap({
+                {"name", row.name},
+                {"actor", row.actor},
+                {"link", row.link},
+                {"imgurl", row.imgURL}
+            }));
+        }
+    }
     QVariantMap staffMap;
     for(const auto &p : staff)
         staffMap.insert(p.first, p.second);
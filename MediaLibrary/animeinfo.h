@@ -88,6 +88,7 @@ struct MatchResult
     QString scriptData;
     EpInfo ep;
 };
+Q_DECLARE_METATYPE(MatchResult)
 
 
 struct Character
@@ -144,9 +145,11 @@ class Anime
     QList<EpInfo> epInfoList;
     QList<Character> characters;
 
+    bool crtLoaded;
     bool crtImagesLoaded;
     bool epLoaded;
     bool posterLoaded;
+    bool coverLoaded;
 
 public:
     const QString &name() const {return _name;}
@@ -158,7 +161,7 @@ public:
     const QString &scriptData() const {return _scriptData;}
     qint64 addTime() const {return _addTime;}
     QString addTimeStr() const {return QDateTime::fromSecsSinceEpoch(_addTime).toString("yyyy-MM-dd hh:mm:ss");}
-    const QPixmap &cover() const {return _cover;}
+    const QPixmap &cover();
     const QString &coverURL() const {return _coverURL;}
 
 public:
@@ -168,6 +171,7 @@ public:
     void setCover(const QByteArray &data);
     void setCrtImage(const QString &name, const QByteArray &data);
     const QList<EpInfo> &epList();
+    bool epListLoaded() const {return epLoaded;}
     const QList<Character> &crList(bool loadImage = false);
     const QStringList &tagList();
     const QList<QPair<QString,QString>> &staffList() const {return staff;}
@@ -8,6 +8,8 @@
 #include <QMouseEvent>
 #include <QToolTip>
 #include "animeinfo.h"
+#include "animeworker.h"
+#include "Common/asynctask.h"
 #define AnimeRole Qt::UserRole+1
 namespace
 {
@@ -76,9 +78,13 @@ private:
 };
 }
 AnimeItemDelegate::AnimeItemDelegate(QObject *parent):QStyledItemDelegate(parent),
-    contentWidget(new AnimeItemWidget()),pixmap(ItemWidth,ItemHeight)
+    contentWidget(new AnimeItemWidget()),pixmap(ItemWidth,ItemHeight),
+    coverCache(32*1024*1024, 1, [](const QPixmap &pixmap){return qint64(pixmap.width())*pixmap.height()*pixmap.depth()/8;})
 {
-
+    QObject::connect(AnimeWorker::instance(), &AnimeWorker::coverUpdated, this, &AnimeItemDelegate::removeCover);
+    QObject::connect(AnimeWorker::instance(), &AnimeWorker::animeUpdated, this, [this](Anime *anime){
+        removeCover(anime->name());
+    });
 }
 
 
@@ -88,7 +94,9 @@ void AnimeItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opt
     initStyleOption(&viewOption,index);
     AnimeItemWidget *animeItemWidget=static_cast<AnimeItemWidget *>(contentWidget.data());
 	const Anime *anime = (const Anime *)index.data(AnimeRole).value<void *>();
-    animeItemWidget->setCover(anime->cover());
+    QPixmap cover;
+    if(!coverCache.get(anime->name(), cover)) loadCover(anime->name());
+    animeItemWidget->setCover(cover);
     animeItemWidget->setTitle(index.data(Qt::DisplayRole).toString());
     animeItemWidget->setSelected(viewOption.state.testFlag(QStyle::State_Selected));
     animeItemWidget->setHover(viewOption.state.testFlag(QStyle::State_MouseOver));
@@ -131,3 +139,30 @@ QSize AnimeItemDelegate::sizeHint(const QStyleOptionViewItem &option, const QMod
 {
     return QSize(ItemWidth,ItemHeight);
 }
+
+void AnimeItemDelegate::loadCover(const QString &animeName) const
+{
+    if(pendingCovers.contains(animeName)) return;
+    pendingCovers.insert(animeName);
+    AnimeItemDelegate *delegate = const_cast<AnimeItemDelegate *>(this);
+    const QSize size(QSize(ItemWidth, ItemHeight) * qApp->devicePixelRatio());
+    Async::then(AnimeWorker::instance()->fetchCover(animeName), delegate, [delegate, animeName, size](const QByteArray &data){
+        Async::then(Async::run([data, size](){
+            QImage image;
+            if(image.loadFromData(data)) image = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            return image;
+        }), delegate, [delegate, animeName](const QImage &image){
+            //dropped if the cover changed in the meantime
+            if(!delegate->pendingCovers.remove(animeName)) return;
+            //a null pixmap is kept too, items without a cover show the placeholder
+            delegate->coverCache.put(animeName, QPixmap::fromImage(image));
+            emit delegate->coverLoaded();
+        });
+    });
+}
+
+void AnimeItemDelegate::removeCover(const QString &animeName)
+{
+    pendingCovers.remove(animeName);
+    coverCache.remove(animeName);
+}
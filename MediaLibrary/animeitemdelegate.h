@@ -1,6 +1,7 @@
 #ifndef ANIMEITEMDELEGATE_H
 #define ANIMEITEMDELEGATE_H
 #include <QStyledItemDelegate>
+#include "Common/shardedcache.h"
 class AnimeItemDelegate : public QStyledItemDelegate
 {
     Q_OBJECT
@@ -14,9 +15,15 @@ public:
     virtual QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const;
 signals:
     void ItemClicked(const QModelIndex &index);
+    void coverLoaded();
 private:
     QScopedPointer<QWidget> contentWidget;
     mutable QPixmap pixmap;
+    //covers scaled to the item size, decoded off the gui thread
+    mutable ShardedLRUCache<QString, QPixmap> coverCache;
+    mutable QSet<QString> pendingCovers;
+    void loadCover(const QString &animeName) const;
+    void removeCover(const QString &animeName);
 
 };
 
@@ -8,7 +8,7 @@
 #include "globalobjects.h"
 #include "animeworker.h"
 #include "Common/network.h"
-#include "Common/threadtask.h"
+#include "Common/dbexecutor.h"
 #include "animemodel.h"
 #include "labelmodel.h"
 #define AnimeRole Qt::UserRole+1
@@ -228,8 +228,7 @@ void AnimeLibrary::fillAnimeInfo(Anime *anime)
 
 int AnimeLibrary::fetchAnimeCaptures(const QString &animeName, QList<CaptureItem *> &captureList, int offset, int limit)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    return task.Run([&animeName,&captureList,offset,limit](){
+    return GlobalObjects::dbExecutor->read("AnimeLibrary::fetchAnimeCaptures", [&animeName,&captureList,offset,limit](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("select Time,Info,Thumb from capture where Anime=? order by Time desc limit ? offset ?");
         query.bindValue(0,animeName);
@@ -269,8 +268,7 @@ QPixmap AnimeLibrary::getCapture(qint64 timeId)
 
 void AnimeLibrary::saveCapture(const QString &animeName, const QString &filePath, const QString &info, const QImage &image)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([animeName,info,filePath,image](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeLibrary::saveCapture", [animeName,info,filePath,image](){
         QByteArray imgBytes;
         QBuffer bufferImage(&imgBytes);
         bufferImage.open(QIODevice::WriteOnly);
@@ -328,8 +326,7 @@ void AnimeLibrary::saveCapture(const QString &animeName, const QString &filePath
 
 void AnimeLibrary::deleteCapture(qint64 timeId)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([timeId](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeLibrary::deleteCapture", [timeId](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("delete from capture where Time=?");
         query.bindValue(0,timeId);
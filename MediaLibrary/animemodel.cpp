@@ -2,13 +2,14 @@
 #include "globalobjects.h"
 #include "animeworker.h"
 #include "Common/notifier.h"
+#include "Common/asynctask.h"
 #define AnimeRole Qt::UserRole+1
 namespace
 {
 	static bool firstActive = true;
 }
 AnimeModel::AnimeModel(QObject *parent):QAbstractItemModel(parent),
-    currentOffset(0),active(false),hasMoreAnimes(false)
+    currentOffset(0),active(false),hasMoreAnimes(false),fetching(false)
 {
     QObject::connect(AnimeWorker::instance(), &AnimeWorker::animeAdded, this, &AnimeModel::addAnime);
     QObject::connect(AnimeWorker::instance(), &AnimeWorker::animeRemoved, this, &AnimeModel::removeAnime);
@@ -103,19 +104,22 @@ QVariant AnimeModel::data(const QModelIndex &index, int role) const
 
 void AnimeModel::fetchMore(const QModelIndex &)
 {
-    QList<Anime *> moreAnimes;
+    if(fetching) return;
+    fetching=true;
     hasMoreAnimes=false;
     Notifier::getNotifier()->showMessage(Notifier::LIBRARY_NOTIFY, tr("Fetching..."), NM_PROCESS | NM_DARKNESS_BACK);
-    AnimeWorker::instance()->fetchAnimes(&moreAnimes, currentOffset, limitCount);
-	hasMoreAnimes = moreAnimes.count() >= limitCount;
-    if(moreAnimes.count() > 0)
-    {
-        beginInsertRows(QModelIndex(),animes.count(),animes.count()+moreAnimes.count()-1);
-        animes.append(moreAnimes);
-        endInsertRows();
-        currentOffset+=moreAnimes.count();
-        showStatisMessage();
-    }
-    Notifier::getNotifier()->showMessage(Notifier::LIBRARY_NOTIFY, tr("Down"), NM_HIDE);
+    Async::then(AnimeWorker::instance()->fetchAnimes(currentOffset, limitCount), this, [this](const QList<Anime *> &moreAnimes){
+        hasMoreAnimes = moreAnimes.count() >= limitCount;
+        if(moreAnimes.count() > 0)
+        {
+            beginInsertRows(QModelIndex(),animes.count(),animes.count()+moreAnimes.count()-1);
+            animes.append(moreAnimes);
+            endInsertRows();
+            currentOffset+=moreAnimes.count();
+            showStatisMessage();
+        }
+        fetching=false;
+        Notifier::getNotifier()->showMessage(Notifier::LIBRARY_NOTIFY, tr("Down"), NM_HIDE);
+    });
 }
 
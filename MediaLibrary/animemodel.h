@@ -12,6 +12,7 @@ public:
     void setActive(bool isActive);
     void deleteAnime(const QModelIndex &index);
     Anime *getAnime(const QModelIndex &index);
+    const QList<Anime *> &animeList() const {return animes;}
     void showStatisMessage();
 signals:
     void animeCountInfo(int cur, int total);
@@ -29,6 +30,7 @@ private:
     QList<Anime *> animes, tmpAnimes;
     bool active;
     bool hasMoreAnimes;
+    bool fetching;
     void addAnime(Anime *anime);
     void removeAnime(Anime *anime);
 };
@@ -1,31 +1,63 @@
 #include "animeworker.h"
 #include "globalobjects.h"
 #include "Common/network.h"
-#include "Common/threadtask.h"
+#include "Common/dbexecutor.h"
 
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QSqlError>
 #include <QPainter>
 
+namespace
+{
+    QList<EpInfo> queryEpInfo(const QString &animeName)
+    {
+        QList<EpInfo> eps;
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
+        query.prepare("select * from episode where Anime=?");
+        query.bindValue(0,animeName);
+        query.exec();
+        int nameNo=query.record().indexOf("Name"),
+            epIndexNo=query.record().indexOf("EpIndex"),
+            typeNo=query.record().indexOf("Type"),
+            localFileNo=query.record().indexOf("LocalFile"),
+            finishTimeNo=query.record().indexOf("FinishTime"),
+            lastPlayTimeNo=query.record().indexOf("LastPlayTime");
+        while (query.next())
+        {
+            EpInfo ep;
+            ep.name=query.value(nameNo).toString();
+            ep.type=EpType(query.value(typeNo).toInt());
+            ep.index=query.value(epIndexNo).toDouble();
+            ep.localFile=query.value(localFileNo).toString();
+            ep.finishTime=query.value(finishTimeNo).toLongLong();
+            ep.lastPlayTime=query.value(lastPlayTimeNo).toLongLong();
+            eps.append(ep);
+        }
+        std::sort(eps.begin(), eps.end());
+        return eps;
+    }
+}
+
 void AnimeWorker::deleteAnime(Anime *anime)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([=](){
+    //the library lists are changed right away, only the rows are removed on the writer lane
+    const QString animeName(anime->_name);
+    animesMap.remove(animeName);
+    removeAlias(animeName);
+    titleIndex.remove(animeName);
+    delete anime;
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::deleteAnime", [animeName](){
         QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Bangumi_DB);
         db.transaction();
         QSqlQuery query(db);
         query.prepare("delete from anime where Anime=?");
-        query.bindValue(0,anime->_name);
+        query.bindValue(0,animeName);
         query.exec();
         query.prepare("delete from alias where Anime=?");
-        query.bindValue(0,anime->_name);
+        query.bindValue(0,animeName);
         query.exec();
-        animesMap.remove(anime->_name);
         db.commit();
-        removeAlias(anime->_name);
-        delete anime;
-        return 0;
     });
 }
 
@@ -34,7 +66,39 @@ Anime *AnimeWorker::getAnime(const QString &name)
     return animesMap.value(name, nullptr);
 }
 
-AnimeWorker::AnimeWorker(QObject *parent):QObject(parent)
+QStringList AnimeWorker::searchAnime(const QString &keyword, int limit, bool fuzzy)
+{
+    loadTitleIndex();
+    return titleIndex.search(keyword, limit, fuzzy);
+}
+
+void AnimeWorker::loadTitleIndex()
+{
+    QMutexLocker locker(&titleIndexLock);
+    if(titleIndexLoaded) return;
+    titleIndexLoaded = true;
+    //searches before it is filled only see titles added since, titleIndexReady is emitted when it is done
+    auto future = GlobalObjects::dbExecutor->readAsync("AnimeWorker::loadTitleIndex", [this](){
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
+        query.exec("select Anime from anime");
+        while (query.next())
+        {
+            QString name(query.value(0).toString());
+            titleIndex.add(name, name);
+        }
+        query.exec("select Alias, Anime from alias");
+        while (query.next())
+        {
+            titleIndex.add(query.value(1).toString(), query.value(0).toString());
+        }
+        return titleIndex.size();
+    });
+    Async::then(future, QCoreApplication::instance(), [this](int){
+        emit titleIndexReady();
+    });
+}
+
+AnimeWorker::AnimeWorker(QObject *parent):QObject(parent), titleIndexLoaded(false)
 {
     qRegisterMetaType<EpInfo>("EpInfo");
     qRegisterMetaType<AnimeImage>("AnimeImage");
@@ -48,12 +112,14 @@ AnimeWorker::~AnimeWorker()
     qDeleteAll(animesMap);
 }
 
-int AnimeWorker::fetchAnimes(QList<Anime *> *animes, int offset, int limit)
+QFuture<QList<Anime *> > AnimeWorker::fetchAnimes(int offset, int limit)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    return task.Run([=](){
+    QFuture<QList<Anime *> > future = GlobalObjects::dbExecutor->readAsync("AnimeWorker::fetchAnimes", [=](){
+        QList<Anime *> animes;
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
-        query.exec(QString("select * from anime order by AddTime desc limit %1 offset %2").arg(limit).arg(offset));
+        //only what the list shows and filters on, the cover blob and characters are loaded on demand
+        query.exec(QString("select Anime, Desc, AddTime, AirDate, EpCount, URL, ScriptId, ScriptData, Staff, CoverURL "
+                           "from anime order by AddTime desc limit %1 offset %2").arg(limit).arg(offset));
         int animeNo=query.record().indexOf("Anime"),
             descNo=query.record().indexOf("Desc"),
             timeNo=query.record().indexOf("AddTime"),
@@ -63,11 +129,7 @@ int AnimeWorker::fetchAnimes(QList<Anime *> *animes, int offset, int limit)
             scriptIdNo=query.record().indexOf("ScriptId"),
             scriptDataNo=query.record().indexOf("ScriptData"),
             staffNo=query.record().indexOf("Staff"),
-            coverURLNo=query.record().indexOf("CoverURL"),
-            coverNo=query.record().indexOf("Cover");
-        QSqlQuery crtQuery(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
-        crtQuery.prepare("select Name, Actor, Link, ImageURL from character where Anime=?");
-        int count=0;
+            coverURLNo=query.record().indexOf("CoverURL");
         while (query.next())
         {
             Anime *anime=new Anime;
@@ -81,29 +143,18 @@ int AnimeWorker::fetchAnimes(QList<Anime *> *animes, int offset, int limit)
             anime->_scriptData=query.value(scriptDataNo).toString();
             anime->setStaffs(query.value(staffNo).toString());
             anime->_coverURL=query.value(coverURLNo).toString();
-            anime->_cover.loadFromData(query.value(coverNo).toByteArray());
-
-            crtQuery.bindValue(0,anime->_name);
-            crtQuery.exec();
-            int nameNo=crtQuery.record().indexOf("Name"),
-                actorNo=crtQuery.record().indexOf("Actor"),
-                linkNo=crtQuery.record().indexOf("Link"),
-                imageURLNo=crtQuery.record().indexOf("ImageURL");
-            while (crtQuery.next())
-            {
-                Character crt;
-                crt.name=crtQuery.value(nameNo).toString();
-                crt.actor=crtQuery.value(actorNo).toString();
-                crt.link=crtQuery.value(linkNo).toString();
-                crt.imgURL=crtQuery.value(imageURLNo).toString();
-                anime->characters.append(crt);
-            }
-            animes->append(anime);
-            animesMap.insert(anime->_name,anime);
-            count++;
+            anime->coverLoaded=false;
+            anime->crtLoaded=false;
+            animes.append(anime);
         }
-        return count;
-    }).toInt();
+        return animes;
+    });
+    //animesMap belongs to the write thread, AnimeWorker lives there
+    Async::then(future, this, [this](const QList<Anime *> &animes){
+        for(Anime *anime:animes)
+            animesMap.insert(anime->_name,anime);
+    });
+    return future;
 }
 
 int AnimeWorker::animeCount()
@@ -117,101 +168,236 @@ int AnimeWorker::animeCount()
     return 0;
 }
 
-void AnimeWorker::loadCrImages(Anime *anime)
+void AnimeWorker::loadCharacters(Anime *anime, bool loadImage)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([anime](){
+    const QString animeName(anime->name());
+    auto future = GlobalObjects::dbExecutor->readAsync("AnimeWorker::loadCharacters", [animeName, loadImage](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
-        query.prepare("select Name, Image from character where Anime=?");
-        query.bindValue(0,anime->name());
+        query.prepare(QString("select Name, Actor, Link, ImageURL%1 from character where Anime=?").arg(loadImage?", Image":""));
+        query.bindValue(0,animeName);
         query.exec();
-        int nameNo=query.record().indexOf("Name"),
-            imgNo=query.record().indexOf("Image");
+        QList<CharacterRow> rows;
         while (query.next())
         {
-            for(Character &crt:anime->characters)
+            CharacterRow row;
+            row.anime=animeName;
+            row.name=query.value(0).toString();
+            row.actor=query.value(1).toString();
+            row.link=query.value(2).toString();
+            row.imgURL=query.value(3).toString();
+            if(loadImage) row.image=query.value(4).toByteArray();
+            rows.append(row);
+        }
+        return rows;
+    });
+    Async::then(future, QCoreApplication::instance(), [this, anime, animeName, loadImage](const QList<CharacterRow> &rows){
+        if(getAnime(animeName)!=anime) return;
+        if(!loadImage && anime->crtImagesLoaded) return;
+        setCharacters({anime}, rows, loadImage);
+    });
+}
+
+void AnimeWorker::loadCharacters(const QList<Anime *> &animes)
+{
+    QStringList names;
+    QList<Anime *> pendingAnimes;
+    for(Anime *anime : animes)
+    {
+        if(anime->crtLoaded) continue;
+        names.append(anime->_name);
+        pendingAnimes.append(anime);
+        anime->crtLoaded = true;
+    }
+    if(pendingAnimes.isEmpty()) return;
+    auto future = GlobalObjects::dbExecutor->readAsync("AnimeWorker::loadCharacters", [names](){
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
+        QList<CharacterRow> rows;
+        //stay below the bound parameter limit of sqlite
+        const int chunkSize = 500;
+        for(int i = 0; i < names.size(); i += chunkSize)
+        {
+            const QStringList chunk(names.mid(i, chunkSize));
+            query.prepare(QString("select Anime, Name, Actor, Link, ImageURL from character where Anime in (%1)")
+                          .arg(QString("?,").repeated(chunk.size()-1) + "?"));
+            for(int j = 0; j < chunk.size(); ++j)
+                query.bindValue(j, chunk[j]);
+            query.exec();
+            while (query.next())
             {
-                if(crt.name==query.value(nameNo).toString())
-                {
-                    crt.image.loadFromData(query.value(imgNo).toByteArray());
-                    break;
-                }
+                CharacterRow row;
+                row.anime=query.value(0).toString();
+                row.name=query.value(1).toString();
+                row.actor=query.value(2).toString();
+                row.link=query.value(3).toString();
+                row.imgURL=query.value(4).toString();
+                rows.append(row);
             }
         }
-        return 0;
+        return rows;
+    }, DBExecutor::Background);
+    Async::then(future, QCoreApplication::instance(), [this, pendingAnimes](const QList<CharacterRow> &rows){
+        QList<Anime *> loadedAnimes;
+        for(Anime *anime : pendingAnimes)
+        {
+            //a single load with images may have finished first
+            if(getAnime(anime->_name)==anime && !anime->crtImagesLoaded) loadedAnimes.append(anime);
+        }
+        setCharacters(loadedAnimes, rows, false);
     });
 }
 
-void AnimeWorker::loadEpInfo(Anime *anime)
+QList<AnimeWorker::CharacterRow> AnimeWorker::readCharacters(const QString &animeName)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([anime](){
+    QList<CharacterRow> rows;
+    GlobalObjects::dbExecutor->read("AnimeWorker::readCharacters", [&rows, &animeName](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
-        query.prepare("select * from episode where Anime=?");
-        query.bindValue(0,anime->name());
+        query.prepare("select Name, Actor, Link, ImageURL from character where Anime=?");
+        query.bindValue(0,animeName);
         query.exec();
-        int nameNo=query.record().indexOf("Name"),
-            epIndexNo=query.record().indexOf("EpIndex"),
-            typeNo=query.record().indexOf("Type"),
-            localFileNo=query.record().indexOf("LocalFile"),
-            finishTimeNo=query.record().indexOf("FinishTime"),
-            lastPlayTimeNo=query.record().indexOf("LastPlayTime");
         while (query.next())
         {
-            EpInfo ep;
-            ep.name=query.value(nameNo).toString();
-            ep.type=EpType(query.value(typeNo).toInt());
-            ep.index=query.value(epIndexNo).toDouble();
-            ep.localFile=query.value(localFileNo).toString();
-            ep.finishTime=query.value(finishTimeNo).toLongLong();
-            ep.lastPlayTime=query.value(lastPlayTimeNo).toLongLong();
-            anime->epInfoList.append(ep);
+            CharacterRow row;
+            row.anime=animeName;
+            row.name=query.value(0).toString();
+            row.actor=query.value(1).toString();
+            row.link=query.value(2).toString();
+            row.imgURL=query.value(3).toString();
+            rows.append(row);
         }
-        std::sort(anime->epInfoList.begin(), anime->epInfoList.end());
         return 0;
     });
+    return rows;
 }
 
-void AnimeWorker::addAnime(const MatchResult &match)
+void AnimeWorker::setCharacters(const QList<Anime *> &animes, const QList<CharacterRow> &rows, bool loadImage)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
-        QString alias = isAlias(match.name);
-        QString matchAnimeName = alias.isEmpty()?match.name:alias;
-        // If episode exists, update
-        if(checkEpExist(matchAnimeName, match.ep)) return;
-        // Or add anime & episode
-        Anime *anime = animesMap.value(matchAnimeName, nullptr);
-        //anime exists
-        if(anime || !alias.isEmpty() || checkAnimeExist(matchAnimeName))
-        {
-            addEp(matchAnimeName, match.ep);
-            return;
-        }
-        //anime not exist
-        anime=new Anime;
-        anime->_name=matchAnimeName;
-        anime->_scriptId=match.scriptId;
-        anime->_scriptData=match.scriptData;
-        anime->_addTime = QDateTime::currentDateTime().toSecsSinceEpoch();
+    if(animes.isEmpty()) return;
+    QHash<QString, QList<Character> > characters;
+    for(const CharacterRow &row : rows)
+    {
+        Character crt;
+        crt.name=row.name;
+        crt.actor=row.actor;
+        crt.link=row.link;
+        crt.imgURL=row.imgURL;
+        if(loadImage) crt.image.loadFromData(row.image);
+        characters[row.anime].append(crt);
+    }
+    for(Anime *anime : animes)
+        anime->characters = characters.value(anime->_name);
+    emit charactersLoaded(animes);
+}
+
+void AnimeWorker::loadCover(Anime *anime)
+{
+    //QPixmap belongs to the gui thread, only the blob is read on the reader thread
+    const QString animeName(anime->name());
+    auto future = GlobalObjects::dbExecutor->readAsync("AnimeWorker::loadCover", [animeName](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
-        query.prepare("insert into anime(Anime,AddTime,ScriptId,ScriptData) values(?,?,?,?)");
-        query.bindValue(0,anime->_name);
-        query.bindValue(1,anime->_addTime);
-        query.bindValue(2,anime->_scriptId);
-        query.bindValue(3,anime->_scriptData);
+        query.prepare("select Cover from anime where Anime=?");
+        query.bindValue(0,animeName);
         query.exec();
-        if(!anime->_scriptId.isEmpty()) emit addScriptTag(anime->_scriptId);
-        addEp(matchAnimeName, match.ep);
-        animesMap.insert(matchAnimeName,anime);
-        emit animeAdded(anime);
+        return query.first()?query.value(0).toByteArray():QByteArray();
+    });
+    Async::then(future, QCoreApplication::instance(), [this, anime, animeName](const QByteArray &data){
+        //removed, or a new cover is set in the meantime
+        if(getAnime(animeName)!=anime || !anime->_cover.isNull()) return;
+        anime->_cover.loadFromData(data);
+        if(!anime->_cover.isNull()) emit coverLoaded(anime);
+    });
+}
+
+QFuture<QByteArray> AnimeWorker::fetchCover(const QString &animeName)
+{
+    return GlobalObjects::dbExecutor->readAsync("AnimeWorker::fetchCover", [=](){
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
+        query.prepare("select Cover from anime where Anime=?");
+        query.bindValue(0,animeName);
+        query.exec();
+        return query.first()?query.value(0).toByteArray():QByteArray();
+    }, DBExecutor::Background);
+}
+
+QList<EpInfo> AnimeWorker::readEpInfo(const QString &animeName)
+{
+    QList<EpInfo> eps;
+    GlobalObjects::dbExecutor->read("AnimeWorker::readEpInfo", [&eps, &animeName](){
+        eps = queryEpInfo(animeName);
+        return 0;
+    });
+    return eps;
+}
+
+void AnimeWorker::loadEpInfo(Anime *anime)
+{
+    const QString animeName(anime->name());
+    auto future = GlobalObjects::dbExecutor->readAsync("AnimeWorker::loadEpInfo", [animeName](){
+        return queryEpInfo(animeName);
+    });
+    Async::then(future, QCoreApplication::instance(), [this, anime, animeName](const QList<EpInfo> &eps){
+        //removed, or loaded by epList in the meantime
+        if(getAnime(animeName)!=anime || anime->epLoaded) return;
+        anime->epInfoList = eps;
+        anime->epLoaded = true;
+        emit epInfoLoaded(anime);
+    });
+}
+
+void AnimeWorker::addAnime(const MatchResult &match)
+{
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::addAnime", [=](){
+        addMatch(match);
+    });
+}
+
+void AnimeWorker::addAnime(const QList<MatchResult> &matches)
+{
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::addAnime", [=](){
+        QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Bangumi_DB);
+        db.transaction();
+        for(const MatchResult &match : matches)
+            addMatch(match);
+        db.commit();
     });
 }
 
+void AnimeWorker::addMatch(const MatchResult &match)
+{
+    QString alias = isAlias(match.name);
+    QString matchAnimeName = alias.isEmpty()?match.name:alias;
+    // If episode exists, update
+    if(checkEpExist(matchAnimeName, match.ep)) return;
+    // Or add anime & episode
+    Anime *anime = animesMap.value(matchAnimeName, nullptr);
+    //anime exists
+    if(anime || !alias.isEmpty() || checkAnimeExist(matchAnimeName))
+    {
+        addEp(matchAnimeName, match.ep);
+        return;
+    }
+    //anime not exist
+    anime=new Anime;
+    anime->_name=matchAnimeName;
+    anime->_scriptId=match.scriptId;
+    anime->_scriptData=match.scriptData;
+    anime->_addTime = QDateTime::currentDateTime().toSecsSinceEpoch();
+    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
+    query.prepare("insert into anime(Anime,AddTime,ScriptId,ScriptData) values(?,?,?,?)");
+    query.bindValue(0,anime->_name);
+    query.bindValue(1,anime->_addTime);
+    query.bindValue(2,anime->_scriptId);
+    query.bindValue(3,anime->_scriptData);
+    query.exec();
+    if(!anime->_scriptId.isEmpty()) emit addScriptTag(anime->_scriptId);
+    addEp(matchAnimeName, match.ep);
+    animesMap.insert(matchAnimeName,anime);
+    titleIndex.add(matchAnimeName, matchAnimeName);
+    emit animeAdded(anime);
+}
+
 void AnimeWorker::addAnime(const QString &name)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::addAnime", [=](){
         if(!animesMap.contains(name) && !checkAnimeExist(name))
         {
             Anime *anime=new Anime;
@@ -223,15 +409,15 @@ void AnimeWorker::addAnime(const QString &name)
             query.bindValue(1,anime->_addTime);
             query.exec();
             animesMap.insert(name,anime);
+            titleIndex.add(name, name);
             emit animeAdded(anime);
         }
     });
 }
 
-bool AnimeWorker::addAnime(Anime *anime)
+QFuture<bool> AnimeWorker::addAnime(Anime *anime)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    return task.Run([=](){
+    return GlobalObjects::dbExecutor->writeAsync("AnimeWorker::addAnime", [=](){
         Anime *animeInMap = animesMap.value(anime->_name, nullptr);
         if(animeInMap || checkAnimeExist(anime->_name))  //anime exists
         {
@@ -249,18 +435,18 @@ bool AnimeWorker::addAnime(Anime *anime)
             query.exec();
             updateAnimeInfo(anime);
             animesMap.insert(anime->_name,anime);
+            titleIndex.add(anime->_name, anime->_name);
             emit animeAdded(anime);
             if(!anime->_airDate.isEmpty()) emit addTimeTag(anime->_airDate);
             if(!anime->_scriptId.isEmpty()) emit addScriptTag(anime->_scriptId);
             return true;
         }
-    }).toBool();
+    });
 }
 
-const QString AnimeWorker::addAnime(Anime *srcAnime, Anime *newAnime)
+QFuture<QString> AnimeWorker::addAnime(Anime *srcAnime, Anime *newAnime)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    return task.Run([=](){
+    return GlobalObjects::dbExecutor->writeAsync("AnimeWorker::addAnime", [=](){
         Q_ASSERT(animesMap.contains(srcAnime->_name));
         QString retAnimeName = srcAnime->_name;
         if(srcAnime->_name!=newAnime->_name)
@@ -282,6 +468,7 @@ const QString AnimeWorker::addAnime(Anime *srcAnime, Anime *newAnime)
                     emit epReset(animeInMap->_name);
                 }
                 animesMap.remove(srcAnime->_name);
+                titleIndex.remove(srcAnime->_name);
                 if(!srcAnime->_airDate.isEmpty()) emit removeTimeTag(srcAnime->_airDate);
                 if(!srcAnime->_scriptId.isEmpty()) emit removeScriptTag(srcAnime->_scriptId);
                 emit animeRemoved(srcAnime);
@@ -305,8 +492,10 @@ const QString AnimeWorker::addAnime(Anime *srcAnime, Anime *newAnime)
                         emit addScriptTag(newAnime->_scriptId);
                     }
                     animesMap.remove(srcAnime->_name);
+                    titleIndex.remove(srcAnime->_name);
                     srcAnime->_name=newAnime->_name;
                     animesMap.insert(srcAnime->_name, srcAnime);
+                    titleIndex.add(srcAnime->_name, srcAnime->_name);
                     srcAnime->assign(newAnime);
                     emit animeUpdated(srcAnime);
                 }
@@ -332,7 +521,7 @@ const QString AnimeWorker::addAnime(Anime *srcAnime, Anime *newAnime)
         }
         delete newAnime;
         return retAnimeName;
-    }).toString();
+    });
 }
 
 void AnimeWorker::addEp(const QString &animeName, const EpInfo &ep)
@@ -364,30 +553,55 @@ void AnimeWorker::removeEp(const QString &animeName, const QString &path)
 
 void AnimeWorker::updateEpTime(const QString &animeName, const QString &path, bool finished, qint64 epTime)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
-        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
-        if(finished)
-            query.prepare("update episode set FinishTime=? where LocalFile=?");
-        else
-            query.prepare("update episode set LastPlayTime=? where LocalFile=?");
-        qint64 time = epTime==0?QDateTime::currentDateTime().toSecsSinceEpoch():epTime;
-        query.bindValue(0,time);
-        query.bindValue(1,path);
-        query.exec();
-        Anime *anime = animesMap.value(animeName, nullptr);
-        if(anime && anime->epLoaded)
+    EpTime time;
+    time.animeName = animeName;
+    time.path = path;
+    if(epTime==0) epTime = QDateTime::currentDateTime().toSecsSinceEpoch();
+    if(finished) time.finishTime = epTime;
+    else time.lastPlayTime = epTime;
+    updateEpTimes({time});
+}
+
+void AnimeWorker::updateEpTimes(const QList<EpTime> &epTimes)
+{
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::updateEpTimes", [=](){
+        QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Bangumi_DB);
+        QSqlQuery playQuery(db), finishQuery(db);
+        playQuery.prepare("update episode set LastPlayTime=? where LocalFile=?");
+        finishQuery.prepare("update episode set FinishTime=? where LocalFile=?");
+        db.transaction();
+        for(const EpTime &epTime : epTimes)
         {
-            anime->updateEpTime(path, time, finished);
-            emit epUpdated(animeName, path);
+            if(epTime.lastPlayTime)
+            {
+                playQuery.bindValue(0,epTime.lastPlayTime);
+                playQuery.bindValue(1,epTime.path);
+                playQuery.exec();
+            }
+            if(epTime.finishTime)
+            {
+                finishQuery.bindValue(0,epTime.finishTime);
+                finishQuery.bindValue(1,epTime.path);
+                finishQuery.exec();
+            }
+        }
+        db.commit();
+        for(const EpTime &epTime : epTimes)
+        {
+            Anime *anime = animesMap.value(epTime.animeName, nullptr);
+            if(anime && anime->epLoaded)
+            {
+                if(epTime.lastPlayTime) anime->updateEpTime(epTime.path, epTime.lastPlayTime, false);
+                if(epTime.finishTime) anime->updateEpTime(epTime.path, epTime.finishTime, true);
+                emit epUpdated(epTime.animeName, epTime.path);
+            }
         }
     });
 }
 
 void AnimeWorker::updateEpInfo(const QString &animeName, const QString &path, const EpInfo &nEp)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::updateEpInfo", [=](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("update episode set Name=?, EpIndex=?, Type=? where LocalFile=?");
         query.bindValue(0,nEp.name);
@@ -403,8 +617,7 @@ void AnimeWorker::updateEpInfo(const QString &animeName, const QString &path, co
 
 void AnimeWorker::updateEpPath(const QString &animeName, const QString &path, const QString &nPath)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::updateEpPath", [=](){
         if(nPath==path) return;
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("select Anime episode where LocalFile=?");
@@ -423,8 +636,7 @@ void AnimeWorker::updateEpPath(const QString &animeName, const QString &path, co
 
 void AnimeWorker::updateCaptureInfo(const QString &animeName, qint64 timeId, const QString &newInfo)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::updateCaptureInfo", [=](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("update image set Info=? where Anime=? and TimeId=?");
         query.bindValue(0,newInfo);
@@ -436,20 +648,19 @@ void AnimeWorker::updateCaptureInfo(const QString &animeName, qint64 timeId, con
 
 void AnimeWorker::updateCoverImage(const QString &animeName, const QByteArray &imageContent)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::updateCoverImage", [=](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("update anime set Cover=? where Anime=?");
         query.bindValue(0,imageContent);
         query.bindValue(1,animeName);
         query.exec();
+        emit coverUpdated(animeName);
     });
 }
 
 void AnimeWorker::updateCrtImage(const QString &animeName, const QString &crtName, const QByteArray &imageContent)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::updateCrtImage", [=](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("update character set Image=? where Anime=? and Name=?");
         query.bindValue(0,imageContent);
@@ -461,8 +672,7 @@ void AnimeWorker::updateCrtImage(const QString &animeName, const QString &crtNam
 
 void AnimeWorker::saveCapture(const QString &animeName, const QString &info, const QImage &image)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::saveCapture", [=](){
         QByteArray imgBytes;
         QBuffer bufferImage(&imgBytes);
         bufferImage.open(QIODevice::WriteOnly);
@@ -502,8 +712,7 @@ void AnimeWorker::saveCapture(const QString &animeName, const QString &info, con
 
 void AnimeWorker::saveSnippet(const QString &animeName, const QString &info, qint64 timeId, const QImage &image)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::saveSnippet", [=](){
         QImage &&thumb=image.scaled(AnimeImage::thumbW, AnimeImage::thumbH, Qt::AspectRatioMode::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
         QPainter painter(&thumb);
         painter.setFont(QFont(GlobalObjects::normalFont, 8));
@@ -558,8 +767,7 @@ const QPixmap AnimeWorker::getAnimeImageData(const QString &animeName, AnimeImag
 
 void AnimeWorker::deleteAnimeImage(const QString &animeName, AnimeImage::ImageType type, qint64 timeId)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::deleteAnimeImage", [=](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("delete from image where Anime=? and Type=? and TimeId=?");
         query.bindValue(0,animeName);
@@ -569,10 +777,10 @@ void AnimeWorker::deleteAnimeImage(const QString &animeName, AnimeImage::ImageTy
     });
 }
 
-int AnimeWorker::fetchCaptures(const QString &animeName, QList<AnimeImage> &captureList, int offset, int limit)
+QFuture<QList<AnimeImage> > AnimeWorker::fetchCaptures(const QString &animeName, int offset, int limit)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    return task.Run([&](){
+    return GlobalObjects::dbExecutor->readAsync("AnimeWorker::fetchCaptures", [=](){
+        QList<AnimeImage> captureList;
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("select Type, TimeId,Info,Thumb from image where Anime=? and (Type=? or Type=?) order by TimeId desc limit ? offset ?");
         query.bindValue(0,animeName);
@@ -585,7 +793,6 @@ int AnimeWorker::fetchCaptures(const QString &animeName, QList<AnimeImage> &capt
             timeIdNo=query.record().indexOf("TimeId"),
             infoNo=query.record().indexOf("Info"),
             thumbNo=query.record().indexOf("Thumb");
-        int count=0;
         while (query.next())
         {
             AnimeImage img;
@@ -594,16 +801,14 @@ int AnimeWorker::fetchCaptures(const QString &animeName, QList<AnimeImage> &capt
             img.info = query.value(infoNo).toString();
             img.thumb.loadFromData(query.value(thumbNo).toByteArray());
             captureList.append(img);
-            ++count;
         }
-        return count;
-    }).toInt();
+        return captureList;
+    });
 }
 
 void AnimeWorker::loadAnimeInfoTag(AnimeInfoTag &animeInfoTags)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([&](){
+    GlobalObjects::dbExecutor->read("AnimeWorker::loadAnimeInfoTag", [&](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("select AirDate, ScriptId from anime");
         query.exec();
@@ -619,13 +824,12 @@ void AnimeWorker::loadAnimeInfoTag(AnimeInfoTag &animeInfoTags)
                 ++animeInfoTags.scriptIdCount[scriptId];
         }
         return 0;
-    });
+    }, DBExecutor::Background);
 }
 
 void AnimeWorker::loadEpInfoTag(QMap<QString, QSet<QString> > &epPathAnimes)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([&](){
+    GlobalObjects::dbExecutor->read("AnimeWorker::loadEpInfoTag", [&](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("select Anime, LocalFile from episode");
         query.exec();
@@ -638,13 +842,12 @@ void AnimeWorker::loadEpInfoTag(QMap<QString, QSet<QString> > &epPathAnimes)
             epPathAnimes[filePath].insert(query.value(animeNo).toString());
         }
         return 0;
-    });
+    }, DBExecutor::Background);
 }
 
 void AnimeWorker::loadCustomTags(QMap<QString, QSet<QString> > &tagAnimes)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([&](){
+    GlobalObjects::dbExecutor->read("AnimeWorker::loadCustomTags", [&](){
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
         query.prepare("select * from tag");
         query.exec();
@@ -655,13 +858,12 @@ void AnimeWorker::loadCustomTags(QMap<QString, QSet<QString> > &tagAnimes)
             tagAnimes[query.value(tagNo).toString()].insert(query.value(animeNo).toString());
         }
         return 0;
-    });
+    }, DBExecutor::Background);
 }
 
 void AnimeWorker::deleteTag(const QString &tag, const QString &animeTitle)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::deleteTag", [=](){
         QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Bangumi_DB);
         QSqlQuery query(db);
         db.transaction();
@@ -690,8 +892,7 @@ void AnimeWorker::deleteTag(const QString &tag, const QString &animeTitle)
 
 void AnimeWorker::deleteTags(const QStringList &tags)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::deleteTags", [=](){
         QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Bangumi_DB);
         QSqlQuery query(db);
         db.transaction();
@@ -708,8 +909,7 @@ void AnimeWorker::deleteTags(const QStringList &tags)
 
 void AnimeWorker::saveTags(const QString &animeName, const QStringList &tags)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([=](){
+    GlobalObjects::dbExecutor->writeOnce("AnimeWorker::saveTags", [=](){
         QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Bangumi_DB);
         db.transaction();
         QSqlQuery query(db);
@@ -827,6 +1027,7 @@ void AnimeWorker::addAlias(const QString &name, const QString &alias)
     if(aliasAnime.contains(alias)) return;
     animeAlias.insert(name, alias);
     aliasAnime.insert(alias, name);
+    titleIndex.add(name, alias);
     QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Bangumi_DB));
     query.prepare("insert into alias(Alias,Anime) values(?,?)");
     query.bindValue(0,alias);
@@ -839,12 +1040,15 @@ void AnimeWorker::removeAlias(const QString &name, const QString &alias)
 {
     if(alias.isEmpty())
     {
+        for(const QString &a : animeAlias.values(name))
+            aliasAnime.remove(a);
         animeAlias.remove(name);
     }
     else
     {
         animeAlias.remove(name, alias);
         aliasAnime.remove(alias);
+        titleIndex.remove(name, alias);
     }
 }
 
@@ -2,12 +2,19 @@
 #define ANIMEWORKER_H
 #include "animeinfo.h"
 #include "tagnode.h"
+#include "Common/titleindex.h"
+#include <QFuture>
 class AnimeWorker : public QObject
 {
     Q_OBJECT
 public:
     explicit AnimeWorker(QObject *parent=nullptr);
     ~AnimeWorker();
+    struct EpTime
+    {
+        QString animeName, path;
+        qint64 lastPlayTime = 0, finishTime = 0;  //0: unchanged
+    };
 
 public:
     static AnimeWorker *instance()
@@ -15,21 +22,36 @@ public:
         static AnimeWorker worker;
         return &worker;
     }
-    int fetchAnimes(QList<Anime *> *animes, int offset, int limit);
+    QFuture<QList<Anime *> > fetchAnimes(int offset, int limit);
     int animeCount();
-    void loadCrImages(Anime *anime);
+    //characters are read as plain rows on a reader thread, assigned and decoded on the gui thread
+    struct CharacterRow
+    {
+        QString anime, name, actor, link, imgURL;
+        QByteArray image;
+    };
+    void loadCharacters(Anime *anime, bool loadImage);
+    void loadCharacters(const QList<Anime *> &animes);
+    QList<CharacterRow> readCharacters(const QString &animeName);
+    void loadCover(Anime *anime);
+    QFuture<QByteArray> fetchCover(const QString &animeName);
+    //blocks, for script threads, gui code uses loadEpInfo and waits for epInfoLoaded
+    QList<EpInfo> readEpInfo(const QString &animeName);
     void loadEpInfo(Anime *anime);
 
     void addAnime(const MatchResult &match);
+    void addAnime(const QList<MatchResult> &matches);
     void addAnime(const QString &name);
-    bool addAnime(Anime *anime);
-    const QString addAnime(Anime *srcAnime, Anime *newAnime);
+    QFuture<bool> addAnime(Anime *anime);
+    QFuture<QString> addAnime(Anime *srcAnime, Anime *newAnime);
     void deleteAnime(Anime *anime);
     Anime *getAnime(const QString &name);
+    QStringList searchAnime(const QString &keyword, int limit = -1, bool fuzzy = true);
 
     void addEp(const QString &animeName, const EpInfo &ep);
     void removeEp(const QString &animeName, const QString &path);
     void updateEpTime(const QString &animeName, const QString &path, bool finished = false, qint64 epTime=0);
+    void updateEpTimes(const QList<EpTime> &epTimes);
     void updateEpInfo(const QString &animeName, const QString &path, const EpInfo &nEp);
     void updateEpPath(const QString &animeName, const QString &path, const QString &nPath);
     void updateCaptureInfo(const QString &animeName, qint64 timeId, const QString &newInfo);
@@ -40,7 +62,7 @@ public:
     void saveSnippet(const QString &animeName, const QString &info, qint64 timeId, const QImage &image);
     const QPixmap getAnimeImageData(const QString &animeName, AnimeImage::ImageType type, qint64 timeId);
     void deleteAnimeImage(const QString &animeName, AnimeImage::ImageType type, qint64 timeId);
-    int fetchCaptures(const QString &animeName, QList<AnimeImage> &captureList, int offset, int limit);
+    QFuture<QList<AnimeImage> > fetchCaptures(const QString &animeName, int offset, int limit);
 
     void loadAnimeInfoTag(AnimeInfoTag &animeInfoTags);
     void loadEpInfoTag(QMap<QString, QSet<QString>> &epPathAnimes);
@@ -61,10 +83,18 @@ private:
     void addAlias(const QString &name, const QString &alias);
     void removeAlias(const QString &name, const QString &alias = "");
 
+    //names and aliases of all animes in library, loaded on first search
+    TitleIndex titleIndex;
+    bool titleIndexLoaded;
+    QMutex titleIndexLock;
+    void loadTitleIndex();
+
     bool checkAnimeExist(const QString &name);
     bool checkEpExist(const QString &animeName, const EpInfo &ep);
+    void addMatch(const MatchResult &match);
 
     bool updateAnimeInfo(Anime *anime);
+    void setCharacters(const QList<Anime *> &animes, const QList<CharacterRow> &rows, bool loadImage);
 
     //QString downloadLabelInfo(Anime *anime);
     //QString isAlias(const QString &animeName);
@@ -73,6 +103,11 @@ signals:
     void animeAdded(Anime *anime);
     void animeUpdated(Anime *anime);
     void animeRemoved(Anime *anime);
+    void coverUpdated(const QString &animeName);
+    void coverLoaded(Anime *anime);
+    void charactersLoaded(const QList<Anime *> &animes);
+    void epInfoLoaded(Anime *anime);
+    void titleIndexReady();
 
     void epRemoved(const QString &animeName, const QString &epPath);
     void epUpdated(const QString &animeName, const QString &epPath);
@@ -1,8 +1,9 @@
 #include "capturelistmodel.h"
 #include "globalobjects.h"
 #include "animeworker.h"
+#include "Common/asynctask.h"
 
-CaptureListModel::CaptureListModel(const QString &animeName, QObject *parent) : QAbstractListModel(parent), currentOffset(0),hasMoreCaptures(true)
+CaptureListModel::CaptureListModel(const QString &animeName, QObject *parent) : QAbstractListModel(parent), currentOffset(0),hasMoreCaptures(true),isFetching(false)
 {
     this->animeName = animeName;
     if(animeName.isEmpty()) hasMoreCaptures = false;
@@ -51,6 +52,7 @@ void CaptureListModel::setAnimeName(const QString &name)
     captureList.clear();
     animeName = name;
     hasMoreCaptures = !name.isEmpty();
+    isFetching = false;
     currentOffset = 0;
     endResetModel();
 }
@@ -92,19 +94,25 @@ QVariant CaptureListModel::data(const QModelIndex &index, int role) const
 
 void CaptureListModel::fetchMore(const QModelIndex &)
 {
-    QList<AnimeImage> moreCaptures;
+    if(isFetching) return;
+    isFetching=true;
     hasMoreCaptures=false;
     emit fetching(true);
-    AnimeWorker::instance()->fetchCaptures(animeName,moreCaptures,currentOffset,limitCount);
-    if(moreCaptures.count()>0)
-    {
-        hasMoreCaptures=(moreCaptures.count()==limitCount);
-        beginInsertRows(QModelIndex(),captureList.count(),captureList.count()+moreCaptures.count()-1);
-        captureList.append(moreCaptures);
-        endInsertRows();
-        currentOffset+=moreCaptures.count();
-    }
-    emit fetching(false);
+    const QString name(animeName);
+    Async::then(AnimeWorker::instance()->fetchCaptures(animeName,currentOffset,limitCount), this, [this, name](const QList<AnimeImage> &moreCaptures){
+        isFetching=false;
+        emit fetching(false);
+        //anime changed while fetching
+        if(name!=animeName) return;
+        if(moreCaptures.count()>0)
+        {
+            hasMoreCaptures=(moreCaptures.count()==limitCount);
+            beginInsertRows(QModelIndex(),captureList.count(),captureList.count()+moreCaptures.count()-1);
+            captureList.append(moreCaptures);
+            endInsertRows();
+            currentOffset+=moreCaptures.count();
+        }
+    });
 }
 
 Qt::ItemFlags CaptureListModel::flags(const QModelIndex &index) const
@@ -20,6 +20,7 @@ private:
     const int limitCount=20;
     int currentOffset;
     bool hasMoreCaptures;
+    bool isFetching;
     QList<AnimeImage> captureList;
     // QAbstractItemModel interface
 public:
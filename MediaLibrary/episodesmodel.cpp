@@ -38,6 +38,9 @@ EpisodesModel::EpisodesModel(Anime *anime, QObject *parent) : QAbstractItemModel
          currentEps.removeAt(pos);
          endRemoveRows();
     });
+    QObject::connect(AnimeWorker::instance(), &AnimeWorker::epInfoLoaded, this, [=](Anime *anime){
+        if(anime==currentAnime) setAnime(anime);
+    });
 }
 
 void EpisodesModel::setAnime(Anime *anime)
@@ -46,7 +49,12 @@ void EpisodesModel::setAnime(Anime *anime)
     currentAnime = anime;
     currentEps.clear();
     epMap.clear();
-    if(anime)
+    //episodes are read on a db reader thread, the rows are filled again on epInfoLoaded
+    if(anime && !anime->epListLoaded())
+    {
+        AnimeWorker::instance()->loadEpInfo(anime);
+    }
+    else if(anime)
     {
         currentEps = anime->epList();
         for(int i=0; i<currentEps.size(); ++i)
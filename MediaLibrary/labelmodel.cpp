@@ -4,6 +4,7 @@
 #include "tagnode.h"
 #include "animeinfo.h"
 #include "Script/scriptmanager.h"
+#include "Common/dbexecutor.h"
 #include <QBrush>
 #define CountRole Qt::UserRole+1
 #define TypeRole Qt::UserRole+2
@@ -61,13 +62,26 @@ LabelModel::~LabelModel()
 
 void LabelModel::loadLabels()
 {
-    beginResetModel();
-    if(root) delete root;
-    root = new TagNode("root", nullptr, 0, TagNode::TAG_ROOT);
-    addAnimeInfoTag();
-    addEpPathTag();
-    addCustomTag();
-    endResetModel();
+    //the tag queries run inline on a db reader thread, the tree is built on the gui thread
+    auto future = GlobalObjects::dbExecutor->readAsync("LabelModel::loadLabels", [](){
+        LabelData data;
+        AnimeWorker::instance()->loadAnimeInfoTag(data.animeInfoTag);
+        AnimeWorker::instance()->loadEpInfoTag(data.epPathAnimes);
+        AnimeWorker::instance()->loadCustomTags(data.tagAnimes);
+        return data;
+    }, DBExecutor::Background);
+    Async::then(future, this, [this](const LabelData &data){
+        beginResetModel();
+        if(root) delete root;
+        root = new TagNode("root", nullptr, 0, TagNode::TAG_ROOT);
+        epPathAnimes = data.epPathAnimes;
+        tagAnimes = data.tagAnimes;
+        addAnimeInfoTag(data.animeInfoTag);
+        addEpPathTag();
+        addCustomTag();
+        endResetModel();
+        emit labelsLoaded();
+    });
 }
 
 void LabelModel::selectedLabelList(const QModelIndexList &indexes,  SelectedLabelInfo &selectLabels)
@@ -338,11 +352,8 @@ Qt::ItemFlags LabelModel::flags(const QModelIndex &index) const
     return defaultFlags;
 }
 
-void LabelModel::addAnimeInfoTag()
+void LabelModel::addAnimeInfoTag(const AnimeInfoTag &animeInfoTag)
 {
-    AnimeInfoTag animeInfoTag;
-    AnimeWorker::instance()->loadAnimeInfoTag(animeInfoTag);
-
     auto &scriptIdCount = animeInfoTag.scriptIdCount;
     TagNode *scriptCate = new TagNode(tr("Source"), root, 0, TagNode::TAG_ROOT_CATE);
     cateTags[CategoryTag::C_SCRIPT] = scriptCate;
@@ -375,7 +386,6 @@ void LabelModel::addAnimeInfoTag()
 
 void LabelModel::addEpPathTag()
 {
-    AnimeWorker::instance()->loadEpInfoTag(epPathAnimes);
     TagNode *epPathNode=new TagNode(tr("File"), root, 0, TagNode::TAG_ROOT_CATE);
     cateTags[CategoryTag::C_FILE] = epPathNode;
     for(auto iter=epPathAnimes.begin(); iter!=epPathAnimes.end();++iter)
@@ -387,7 +397,6 @@ void LabelModel::addEpPathTag()
 
 void LabelModel::addCustomTag()
 {
-    AnimeWorker::instance()->loadCustomTags(tagAnimes);
     TagNode *customNode=new TagNode(tr("Tag"), root, 0, TagNode::TAG_ROOT_CATE);
     cateTags[CategoryTag::C_CUSTOM] = customNode;
     for(auto iter=tagAnimes.begin(); iter!=tagAnimes.end();++iter)
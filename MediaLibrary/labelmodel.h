@@ -4,6 +4,7 @@
 #include <QtCore>
 #include <QColor>
 #include "tagnode.h"
+#include "animeinfo.h"
 struct SelectedLabelInfo
 {
     QStringList epPathTags, customTags, customPrefixTags;
@@ -49,6 +50,7 @@ public:
 signals:
     void tagRemoved(const QString &tag);
     void tagCheckedChanged();
+    void labelsLoaded();
 private:
     TagNode *root;
     QMap<QString, QSet<QString>> tagAnimes, epPathAnimes;
@@ -59,7 +61,12 @@ private:
     TagNode *cateTags[C_CUSTOM+1];
     QColor foregroundColor[2];
 
-    void addAnimeInfoTag();
+    struct LabelData
+    {
+        AnimeInfoTag animeInfoTag;
+        QMap<QString, QSet<QString>> tagAnimes, epPathAnimes;
+    };
+    void addAnimeInfoTag(const AnimeInfoTag &animeInfoTag);
     void addEpPathTag();
     void addCustomTag();
 
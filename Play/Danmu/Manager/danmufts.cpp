@@ -0,0 +1,175 @@
+#include "danmufts.h"
+#include <QSqlQuery>
+#include <QSqlDatabase>
+#include "globalobjects.h"
+namespace
+{
+    inline bool isCJK(ushort c)
+    {
+        return (c >= 0x3040 && c <= 0x30FF) || (c >= 0x3400 && c <= 0x4DBF) || (c >= 0x4E00 && c <= 0x9FFF) ||
+               (c >= 0xAC00 && c <= 0xD7AF) || (c >= 0xF900 && c <= 0xFAFF);
+    }
+
+    //a control character splits CJK tokens, unicode61 treats it as a separator and it is dropped again for display
+    const QChar tokenSeparator(0x1F);
+
+    //danmu_fts is filled by the triggers on danmu_fts_doc
+    template<typename List>
+    void addRows(QSqlQuery &query, const QString &pid, const List &danmuList)
+    {
+        query.prepare("insert into danmu_fts_doc(PoolID,Source,Time,Fingerprint,Tokens) values(?,?,?,?,?)");
+        for(const auto &danmu : danmuList)
+        {
+            if(danmu->text.isEmpty()) continue;
+            query.bindValue(0, pid);
+            query.bindValue(1, danmu->source);
+            query.bindValue(2, danmu->originTime);
+            query.bindValue(3, qint64(danmu->getFingerprint()));
+            query.bindValue(4, DanmuFts::tokenize(danmu->text));
+            query.exec();
+        }
+    }
+
+    void removeRows(QSqlQuery &query, const QString &where, const QVariantList &binds)
+    {
+        query.prepare(QString("delete from danmu_fts_doc where %1").arg(where));
+        for(int i = 0; i < binds.size(); ++i) query.bindValue(i, binds[i]);
+        query.exec();
+    }
+}
+
+bool DanmuFts::createTables(QSqlQuery &query)
+{
+    if(!query.exec("CREATE TABLE IF NOT EXISTS \"danmu_fts_doc\" ("
+               "\"RowID\"  INTEGER PRIMARY KEY,"
+               "\"PoolID\"  TEXT(32) NOT NULL,"
+               "\"Source\"  INTEGER,"
+               "\"Time\"  INTEGER,"
+               "\"Fingerprint\"  INTEGER,"
+               "\"Tokens\"  TEXT,"
+               "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE)"))
+        return false;
+    query.exec("CREATE INDEX IF NOT EXISTS \"PoolID_FTS\" ON \"danmu_fts_doc\" (\"PoolID\" ASC, \"Source\" ASC)");
+    if(!query.exec("CREATE VIRTUAL TABLE IF NOT EXISTS \"danmu_fts\" USING fts5(Tokens, content='danmu_fts_doc', content_rowid='RowID')"))
+        return false;
+    query.exec("CREATE TRIGGER IF NOT EXISTS \"danmu_fts_insert\" AFTER INSERT ON \"danmu_fts_doc\" BEGIN "
+               "insert into danmu_fts(rowid,Tokens) values(new.RowID,new.Tokens); END");
+    query.exec("CREATE TRIGGER IF NOT EXISTS \"danmu_fts_delete\" AFTER DELETE ON \"danmu_fts_doc\" BEGIN "
+               "insert into danmu_fts(danmu_fts,rowid,Tokens) values('delete',old.RowID,old.Tokens); END");
+    query.exec("CREATE TABLE IF NOT EXISTS \"fts_pool\" ("
+               "\"PoolID\"  TEXT(32) NOT NULL,"
+               "PRIMARY KEY (\"PoolID\"),"
+               "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE)");
+    return true;
+}
+
+void DanmuFts::dropTables(QSqlQuery &query)
+{
+    query.exec("DROP TABLE IF EXISTS \"danmu_fts\"");
+    query.exec("DROP TABLE IF EXISTS \"danmu_fts_doc\"");
+    query.exec("DROP TABLE IF EXISTS \"fts_pool\"");
+}
+
+QString DanmuFts::tokenize(const QString &text)
+{
+    const QString norm(text.normalized(QString::NormalizationForm_KC));
+    QString tokens;
+    tokens.reserve(norm.size() * 2);
+    for(QChar c : norm)
+    {
+        if(isCJK(c.unicode()))
+        {
+            tokens.append(tokenSeparator);
+            tokens.append(c);
+            tokens.append(tokenSeparator);
+        }
+        else
+        {
+            tokens.append(c);
+        }
+    }
+    return tokens;
+}
+
+QString DanmuFts::untokenize(const QString &tokens)
+{
+    QString text(tokens);
+    return text.remove(tokenSeparator);
+}
+
+QString DanmuFts::matchExpr(const QString &keyword)
+{
+    QString phrase(tokenize(keyword).replace(tokenSeparator, ' ').simplified());
+    if(phrase.isEmpty()) return phrase;
+    phrase.replace('"', "\"\"");
+    return QString("\"%1\"").arg(phrase);
+}
+
+void DanmuFts::addDanmu(QSqlQuery &query, const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList)
+{
+    addRows(query, pid, danmuList);
+}
+
+void DanmuFts::addDanmu(QSqlQuery &query, const QString &pid, const QList<DanmuComment *> &danmuList)
+{
+    addRows(query, pid, danmuList);
+}
+
+void DanmuFts::removeSource(QSqlQuery &query, const QString &pid, int sourceId)
+{
+    removeRows(query, "PoolID=? and Source=?", {pid, sourceId});
+}
+
+void DanmuFts::removeDanmu(QSqlQuery &query, const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList)
+{
+    //one document per deleted comment, identical copies keep theirs
+    query.prepare("delete from danmu_fts_doc where RowID=(select RowID from danmu_fts_doc where PoolID=? and Source=? and Fingerprint=? limit 1)");
+    for(const auto &danmu : danmuList)
+    {
+        query.bindValue(0, pid);
+        query.bindValue(1, danmu->source);
+        query.bindValue(2, qint64(danmu->getFingerprint()));
+        query.exec();
+    }
+}
+
+void DanmuFts::removePool(QSqlQuery &query, const QString &pid)
+{
+    removeRows(query, "PoolID=?", {pid});
+    query.prepare("delete from fts_pool where PoolID=?");
+    query.bindValue(0, pid);
+    query.exec();
+}
+
+void DanmuFts::setPoolIndexed(QSqlQuery &query, const QString &pid)
+{
+    query.prepare("insert or replace into fts_pool(PoolID) values(?)");
+    query.bindValue(0, pid);
+    query.exec();
+}
+
+QList<DanmuFts::Hit> DanmuFts::search(QSqlQuery &query, const QString &keyword, int offset, int limit)
+{
+    QList<Hit> hits;
+    const QString expr(matchExpr(keyword));
+    if(expr.isEmpty()) return hits;
+    query.prepare("select d.PoolID,pool.Anime,pool.EpType,pool.EpIndex,pool.EpName,d.Source,d.Time,d.Tokens "
+                  "from (select rowid,rank from danmu_fts where danmu_fts match ? order by rank limit ? offset ?) f "
+                  "join danmu_fts_doc d on d.RowID=f.rowid join pool on pool.PoolID=d.PoolID order by f.rank");
+    query.bindValue(0, expr);
+    query.bindValue(1, limit);
+    query.bindValue(2, offset);
+    query.exec();
+    while (query.next())
+    {
+        Hit hit;
+        hit.pid = query.value(0).toString();
+        hit.anime = query.value(1).toString();
+        hit.ep = EpInfo(EpType(query.value(2).toInt()), query.value(3).toDouble(), query.value(4).toString());
+        hit.source = query.value(5).toInt();
+        hit.time = query.value(6).toInt();
+        hit.text = untokenize(query.value(7).toString());
+        hits.append(hit);
+    }
+    return hits;
+}
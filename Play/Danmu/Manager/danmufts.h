@@ -0,0 +1,42 @@
+#ifndef DANMUFTS_H
+#define DANMUFTS_H
+#include <QtCore>
+#include "../common.h"
+#include "MediaLibrary/animeinfo.h"
+class QSqlQuery;
+/*
+ * Optional full-text index over comment text (SQLite FTS5).
+ * danmu_fts is an external-content FTS5 table over danmu_fts_doc, which keeps PoolID, Source, Time
+ * and the tokenized text of each indexed comment. Triggers on danmu_fts_doc keep danmu_fts in sync,
+ * so documents are added and removed with plain inserts and deletes.
+ * CJK characters are split into single tokens before indexing, a keyword is searched as one phrase,
+ * so any substring of a comment matches with the default tokenizer. Hits show the text untokenized,
+ * in NFKC form.
+ * The danmu write queue keeps the index up to date, fts_pool records the pools indexed in full.
+ */
+namespace DanmuFts
+{
+    struct Hit
+    {
+        QString pid;
+        QString anime;
+        EpInfo ep;
+        int source = 0;
+        int time = 0;
+        QString text;
+    };
+    bool createTables(QSqlQuery &query);
+    void dropTables(QSqlQuery &query);
+    QString tokenize(const QString &text);
+    QString untokenize(const QString &tokens);
+    QString matchExpr(const QString &keyword);
+
+    void addDanmu(QSqlQuery &query, const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList);
+    void addDanmu(QSqlQuery &query, const QString &pid, const QList<DanmuComment *> &danmuList);
+    void removeSource(QSqlQuery &query, const QString &pid, int sourceId);
+    void removeDanmu(QSqlQuery &query, const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList);
+    void removePool(QSqlQuery &query, const QString &pid);
+    void setPoolIndexed(QSqlQuery &query, const QString &pid);
+    QList<Hit> search(QSqlQuery &query, const QString &keyword, int offset, int limit);
+}
+#endif // DANMUFTS_H
@@ -7,35 +7,123 @@
 #include <QFileInfo>
 #include <QMessageBox>
 #include "pool.h"
-#include "Common/threadtask.h"
-#include "Common/network.h"
+#include "danmupack.h"
+#include "poolsnapshot.h"
+#include "danmuwritequeue.h"
+#include "danmushardbalancer.h"
+#include "filehasher.h"
+#include "kdfile.h"
+#include "Common/dbexecutor.h"
 #include "../common.h"
 #include "../blocker.h"
 #include "../danmupool.h"
 #include "../danmuprovider.h"
 #include "globalobjects.h"
 
+namespace
+{
+    void loadRowDanmu(const QString &pid, int tableId, QList<DanmuComment *> &danmuList)
+    {
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.setForwardOnly(true);
+        query.exec(QString("select rowid,* from danmu_%1 where PoolID='%2'").arg(tableId).arg(pid));
+        int timeNo = query.record().indexOf("Time"),
+            dateNo=query.record().indexOf("Date"),
+            colorNo=query.record().indexOf("Color"),
+            modeNo=query.record().indexOf("Mode"),
+            sizeNo=query.record().indexOf("Size"),
+            sourceNo=query.record().indexOf("Source"),
+            userNo=query.record().indexOf("User"),
+            textNo=query.record().indexOf("Text"),
+            hashNo=query.record().indexOf("Hash");
+        while (query.next())
+        {
+            QString text=query.value(textNo).toString();
+            if(text.isEmpty()) continue;
+            DanmuComment *danmu=new DanmuComment();
+            danmu->color=query.value(colorNo).toInt();
+            danmu->date=query.value(dateNo).toLongLong();
+            int fontSizeLevel(query.value(sizeNo).toInt());
+            danmu->fontSizeLevel=DanmuComment::FontSizeLevel(fontSizeLevel<3 && fontSizeLevel>=0?fontSizeLevel:0);
+            danmu->sender=query.value(userNo).toString();
+            int type(query.value(modeNo).toInt());
+            danmu->type=DanmuComment::DanmuType(type<3 && type>=0?type:0);
+            danmu->source=query.value(sourceNo).toInt();
+            danmu->text=text;
+            danmu->originTime=query.value(timeNo).toInt();
+            if(hashNo!=-1 && !query.value(hashNo).isNull()) danmu->fingerprint=quint64(query.value(hashNo).toLongLong());
+            else danmu->updateFingerprint();
+            danmu->rowId=query.value(0).toLongLong();
+            danmuList.append(danmu);
+        }
+    }
+    qint64 loadPackedDanmu(const QString &pid, QList<DanmuComment *> &danmuList, QHash<int, int> &chunkCount)
+    {
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.setForwardOnly(true);
+        query.prepare("select Source,Data from danmu_pack where PoolID=? order by Source,Chunk");
+        query.bindValue(0,pid);
+        query.exec();
+        qint64 blobSize=0;
+        while (query.next())
+        {
+            int src=query.value(0).toInt();
+            QByteArray blob(query.value(1).toByteArray());
+            blobSize+=blob.size();
+            if(DanmuPack::decode(blob, src, danmuList))
+                chunkCount[src]++;
+        }
+        return blobSize;
+    }
+}
+
 DanmuManager *PoolStateLock::manager=nullptr;
-DanmuManager::DanmuManager(QObject *parent) : QObject(parent),countInited(false)
+DanmuManager::DanmuManager(QObject *parent) : QObject(parent)
 {
-    poolCache.reset(new LRUCache<QString, Pool *>([](Pool *p){return !p->used && p->clean();}));
+    //weighted by comment count, pools in use are pinned by Pool::setUsed
+    qint64 cacheBudget=GlobalObjects::appSetting->value("DanmuManager/PoolCacheBudget",1000000).toLongLong();
+    poolCache.reset(new ShardedLRUCache<QString, Pool *>(cacheBudget, 4,
+                                                         [](Pool *p){return p->comments().size();},
+                                                         [](Pool *p){return !p->used && p->clean();}));
     PoolStateLock::manager=this;
-    loadAllPool();
+    packedStorage=GlobalObjects::appSetting->value("DanmuManager/PackedStorage",false).toBool();
+    useSnapshot=GlobalObjects::appSetting->value("DanmuManager/PoolSnapshot",false).toBool();
+    animeIndexLoaded=false;
+    fullTextIndex=GlobalObjects::appSetting->value("DanmuManager/FullTextIndex",false).toBool();
+    danmuShardCount=qBound(1,GlobalObjects::appSetting->value("DanmuManager/ShardCount",5).toInt(),64);
+    writeQueue=new DanmuWriteQueue(GlobalObjects::workThread);
+    shardBalancer=new DanmuShardBalancer(this, GlobalObjects::workThread);
+    int hashThreads=qBound(2,QThread::idealThreadCount()/2,4);
+    fileHasher=new FileHasher(GlobalObjects::appSetting->value("DanmuManager/HashThreads",hashThreads).toInt());
+    checkTables();
+    if(GlobalObjects::appSetting->value("DanmuManager/BalancedShardCount",5).toInt()!=danmuShardCount.load())
+        QMetaObject::invokeMethod(shardBalancer,"start",Qt::QueuedConnection);
+    //hashes of moved or deleted media files
+    fileHasher->prune();
+    //pools left unindexed by an interrupted build
+    if(fullTextIndex)
+        QMetaObject::invokeMethod(this,[this](){buildFullTextIndex();},Qt::QueuedConnection);
 }
 
 DanmuManager::~DanmuManager()
 {
     for(auto pool:pools) pool->deleteLater();
+    writeQueue->deleteLater();
+    shardBalancer->deleteLater();
+    delete fileHasher;
 }
 
 Pool *DanmuManager::getPool(const QString &pid, bool loadDanmu)
 {
     QMutexLocker locker(&poolsLock);
-    Pool *pool=pools.value(pid,nullptr);
+    Pool *pool=findPool(pid);
     if(pool && loadDanmu)
     {
+        Pool *cached=nullptr;
+        poolCache->get(pid, cached);
         pool->load();
-        poolCache->put(pool->pid, pool);
+        //put again to refresh the weight, the pool may grow after it is cached
+        poolCache->put(pid, pool);
     }
     return pool;
 }
@@ -45,225 +133,300 @@ Pool *DanmuManager::getPool(const QString &animeTitle, EpType epType, double epI
     return getPool(getPoolId(animeTitle, epType, epIndex),loadDanmu);
 }
 
-void DanmuManager::loadPoolInfo(QList<DanmuPoolNode *> &poolNodeList)
+QFuture<Pool *> DanmuManager::getPoolAsync(const QString &pid)
 {
-    if(!countInited)
-    {
-        ThreadTask task(GlobalObjects::workThread);
-        task.Run([this](){
-            //get danmu count
-            QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-            for (int i = 0; i < DanmuTableCount; ++i)
-            {
-                query.exec(QString("select PoolID,Source,count(PoolID) as DanmuCount from danmu_%1 group by PoolID,Source").arg(i));
-                int pidNo = query.record().indexOf("PoolID"),
-                    srcNo = query.record().indexOf("Source"),
-                    countNo=query.record().indexOf("DanmuCount");
-                while (query.next())
-                {
-                    Pool *pool = pools.value(query.value(pidNo).toString(),nullptr);
-                    Q_ASSERT(pool);
-                    int src_id=query.value(srcNo).toInt();
-                    if(pool->sourcesTable.contains(src_id))
-                    {
-                        pool->sourcesTable[src_id].count=query.value(countNo).toInt();
-                    }
-                }
+    Pool *pool=getPool(pid,false);
+    if(!pool) return Async::ready<Pool *>(nullptr);
+    QFutureInterface<Pool *> futureInterface;
+    futureInterface.reportStarted();
+    //the comments are read on a db reader thread, the pool is finished on its own thread like getPool does
+    Async::finally(pool->loadAsync(), pool, [this, pool, futureInterface](const QFuture<bool> &) mutable {
+        if(pool->isLoaded)
+        {
+            QMutexLocker locker(&poolsLock);
+            Pool *cached=nullptr;
+            poolCache->get(pool->id(), cached);
+            poolCache->put(pool->id(), pool);
+        }
+        GlobalObjects::blocker->checkDanmu(pool->commentList);
+        futureInterface.reportResult(pool);
+        futureInterface.reportFinished();
+    });
+    return futureInterface.future();
+}
 
-            }
+template<typename Func>
+auto DanmuManager::readAfterFlush(const QString &name, Func task) -> QFuture<decltype(task())>
+{
+    typedef decltype(task()) T;
+    QFutureInterface<T> futureInterface;
+    futureInterface.reportStarted();
+    std::function<T()> func(task);
+    auto read = [name, func, futureInterface]() mutable {
+        GlobalObjects::dbExecutor->readAsync(name, [func, futureInterface]() mutable {
+            Async::reportTask(futureInterface, func, CancelToken());
             return 0;
         });
-        countInited=true;
-    }
-    qDeleteAll(poolNodeList);
-    poolNodeList.clear();
-    QMap<QString,DanmuPoolNode *> animeMap;
-    for(Pool *pool:pools)
-    {
-        DanmuPoolNode *animeNode=animeMap.value(pool->anime,nullptr);
-        if(!animeNode)
+    };
+    //pending writes and the table migration are finished on workThread first, the read is submitted from there
+    if(!writeQueue->hasPending() && !tablesMigrating) read();
+    else GlobalObjects::dbExecutor->writeOnce("DanmuManager::flushWrites", [this, read]() mutable {
+        writeQueue->flush();
+        read();
+    });
+    return futureInterface.future();
+}
+
+QFuture<QList<DanmuPoolNode *> > DanmuManager::loadPoolInfo()
+{
+    //only anime nodes, episodes are loaded by loadAnimePools when the node is expanded
+    return readAfterFlush("DanmuManager::loadPoolInfo", [this](){
+        QList<DanmuPoolNode *> poolNodeList;
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.exec("select pool.Anime,count(distinct pool.PoolID),ifnull(sum(source_count.Count),0) "
+                   "from pool left join source_count on pool.PoolID=source_count.PoolID group by pool.Anime");
+        while (query.next())
         {
-            animeNode=new DanmuPoolNode(DanmuPoolNode::AnimeNode);
-            animeNode->title=pool->anime;
-            animeMap.insert(pool->anime,animeNode);
+            DanmuPoolNode *animeNode=new DanmuPoolNode(DanmuPoolNode::AnimeNode);
+            animeNode->title=query.value(0).toString();
+            animeNode->poolCount=query.value(1).toInt();
+            animeNode->danmuCount=query.value(2).toInt();
+            animeNode->childrenLoaded=false;
             poolNodeList.append(animeNode);
         }
-        EpInfo ep(pool->epType, pool->epIndex, pool->ep);
-        DanmuPoolEpNode *epNode=new DanmuPoolEpNode(ep,animeNode);
-        epNode->idInfo=pool->pid;
-        for(const auto &src:pool->sourcesTable)
+        return poolNodeList;
+    });
+}
+
+QFuture<QList<DanmuPoolNode *> > DanmuManager::loadAnimePools(const QString &animeTitle)
+{
+    return readAfterFlush("DanmuManager::loadAnimePools", [animeTitle](){
+        QList<DanmuPoolNode *> epNodeList;
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.prepare("select PoolID,EpType,EpIndex,EpName from pool where Anime=?");
+        query.bindValue(0,animeTitle);
+        query.exec();
+        QHash<QString, DanmuPoolNode *> epNodes;
+        while (query.next())
         {
+            EpInfo ep(EpType(query.value(1).toInt()), query.value(2).toDouble(), query.value(3).toString());
+            DanmuPoolEpNode *epNode=new DanmuPoolEpNode(ep);
+            epNode->idInfo=query.value(0).toString();
+            epNodes.insert(epNode->idInfo, epNode);
+            epNodeList.append(epNode);
+        }
+        query.prepare("select source.PoolID,source.ID,source.Title,source.ScriptId,source.ScriptData,source.Delay,ifnull(source_count.Count,0) "
+                      "from source join pool on source.PoolID=pool.PoolID "
+                      "left join source_count on source.PoolID=source_count.PoolID and source.ID=source_count.Source "
+                      "where pool.Anime=?");
+        query.bindValue(0,animeTitle);
+        query.exec();
+        while (query.next())
+        {
+            DanmuPoolNode *epNode=epNodes.value(query.value(0).toString(),nullptr);
+            if(!epNode) continue;
+            DanmuSource src;
+            src.id=query.value(1).toInt();
+            src.title=query.value(2).toString();
+            src.scriptId=query.value(3).toString();
+            src.scriptData=query.value(4).toString();
+            src.delay=query.value(5).toInt();
+            src.count=query.value(6).toInt();
             new DanmuPoolSourceNode(src, epNode);
         }
-    }
-    for(DanmuPoolNode *animeNode:poolNodeList)
+        for(DanmuPoolNode *epNode:epNodeList)
+            epNode->setCount();
+        return epNodeList;
+    });
+}
+
+QList<DanmuManager::CheckedPool> DanmuManager::checkedPools(const QList<DanmuPoolNode *> &nodeList)
+{
+    QList<CheckedPool> checked;
+    for(const DanmuPoolNode *animeNode:nodeList)
     {
-        animeNode->setCount();
+        if(animeNode->type!=DanmuPoolNode::AnimeNode || animeNode->checkStatus==Qt::Unchecked) continue;
+        for(const DanmuPoolNode *epNode:*animeNode->children)
+        {
+            if(epNode->checkStatus==Qt::Unchecked) continue;
+            CheckedPool pool;
+            pool.anime=animeNode->title;
+            pool.ep=epNode->title;
+            pool.pid=epNode->idInfo;
+            pool.whole=(epNode->checkStatus==Qt::Checked);
+            for(const DanmuPoolNode *srcNode:*epNode->children)
+            {
+                if(srcNode->checkStatus==Qt::Checked)
+                    pool.sources.append(qMakePair(static_cast<const DanmuPoolSourceNode *>(srcNode)->srcId, srcNode->title));
+            }
+            checked.append(pool);
+        }
     }
-    emit workerStateMessage("Done");
+    return checked;
 }
 
-void DanmuManager::exportPool(const QList<DanmuPoolNode *> &exportList, const QString &dir, bool useTimeline, bool applyBlockRule)
+QFuture<int> DanmuManager::exportPool(const QList<DanmuPoolNode *> &exportList, const QString &dir, bool useTimeline, bool applyBlockRule)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([this,&exportList,&dir,useTimeline,applyBlockRule](){
-        for(const DanmuPoolNode *node:exportList)
+    const QList<CheckedPool> checked(checkedPools(exportList));
+    return GlobalObjects::dbExecutor->writeAsync("DanmuManager::exportPool", [this,checked,dir,useTimeline,applyBlockRule](){
+        int exportCount=0;
+        for(const CheckedPool &checkedPool:checked)
         {
-            if(node->type==DanmuPoolNode::AnimeNode && node->checkStatus!=Qt::Unchecked)
+            QString animeTitle(checkedPool.anime), epTitle(checkedPool.ep);
+            animeTitle.replace(QRegExp("[\\\\/:*?\"<>|]"),"");
+            epTitle.replace(QRegExp("[\\\\/:*?\"<>|]"),"");
+            QFileInfo fi(dir,QString("%1-%2.xml").arg(animeTitle, epTitle));
+            emit workerStateMessage(tr("Exporting: %1").arg(fi.fileName()));
+            Pool *pool=getPool(checkedPool.pid);
+            if(!pool) continue;
+            QList<int> srcList;
+            if(!checkedPool.whole)
             {
-                QString animeTitle(node->title);
-                animeTitle.replace(QRegExp("[\\\\/:*?\"<>|]"),"");
-                for(DanmuPoolNode *epNode:*node->children)
-                {
-                    if(epNode->checkStatus==Qt::Unchecked)continue;
-                    QString epTitle(epNode->title);
-                    epTitle.replace(QRegExp("[\\\\/:*?\"<>|]"),"");
-                    QFileInfo fi(dir,QString("%1-%2.xml").arg(animeTitle, epTitle));
-                    emit workerStateMessage(tr("Exporting: %1").arg(fi.fileName()));
-                    Pool *pool=getPool(epNode->idInfo);
-                    QList<int> srcList;
-                    if(epNode->checkStatus!=Qt::Checked)
-                    {
-                        for(DanmuPoolNode *srcNode:*epNode->children)
-                        {
-                            if(srcNode->checkStatus==Qt::Checked)
-                                srcList<<static_cast<DanmuPoolSourceNode *>(srcNode)->srcId;
-                        }
-                    }
-                    pool->exportPool(fi.absoluteFilePath(),useTimeline,applyBlockRule,srcList);
-                }
+                for(const auto &src:checkedPool.sources)
+                    srcList<<src.first;
             }
+            pool->exportPool(fi.absoluteFilePath(),useTimeline,applyBlockRule,srcList);
+            ++exportCount;
         }
         emit workerStateMessage("Done");
-        return 0;
+        return exportCount;
     });
 }
 
-void DanmuManager::exportKdFile(const QList<DanmuPoolNode *> &exportList, const QString &dir, const QString &comment)
+QFuture<int> DanmuManager::exportKdFile(const QList<DanmuPoolNode *> &exportList, const QString &dir, const QString &comment)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([this,&exportList, dir,comment](){
-        for(const DanmuPoolNode *node:exportList)
+    const QList<CheckedPool> checked(checkedPools(exportList));
+    return GlobalObjects::dbExecutor->writeAsync("DanmuManager::exportKdFile", [this,checked,dir,comment](){
+        //one file per anime, the checked pools of an anime are adjacent
+        int exportCount=0;
+        for(int i=0;i<checked.size();)
         {
-            if(node->type==DanmuPoolNode::AnimeNode && node->checkStatus!=Qt::Unchecked)
+            const QString curAnime(checked.at(i).anime);
+            int end=i;
+            while(end<checked.size() && checked.at(end).anime==curAnime) ++end;
+            QString animeTitle(curAnime);
+            animeTitle.replace(QRegExp("[\\\\/:*?\"<>|]"),"");
+            QFileInfo fi(dir,QString("%1.kd").arg(animeTitle));
+            emit workerStateMessage(tr("Exporting: %1").arg(fi.fileName()));
+            QFile kdFile(fi.absoluteFilePath());
+            if(!kdFile.open(QIODevice::WriteOnly))
             {
-                QString animeTitle(node->title);
-                animeTitle.replace(QRegExp("[\\\\/:*?\"<>|]"),"");
-                QFileInfo fi(dir,QString("%1.kd").arg(animeTitle));
-                emit workerStateMessage(tr("Exporting: %1").arg(fi.fileName()));
-                QFile kdFile(fi.absoluteFilePath());
-                bool ret=kdFile.open(QIODevice::WriteOnly);
-                if(!ret)
-                {
-                    emit workerStateMessage(tr("Create File Failed: %1").arg(fi.fileName()));
-                    continue;
-                }
-                QByteArray content;
-                QBuffer buffer(&content);
-                buffer.open(QIODevice::WriteOnly);
-                QDataStream ds(&buffer);
-                for(DanmuPoolNode *epNode:*node->children)
+                emit workerStateMessage(tr("Create File Failed: %1").arg(fi.fileName()));
+                i=end;
+                continue;
+            }
+            KdFile::Writer writer(&kdFile, comment);
+            for(;i<end;++i)
+            {
+                const CheckedPool &checkedPool=checked.at(i);
+                Pool *pool=getPool(checkedPool.pid);
+                if(!pool) continue;
+                QList<int> srcList;
+                if(!checkedPool.whole)
                 {
-                    if(epNode->checkStatus==Qt::Unchecked)continue;
-                    Pool *pool=getPool(epNode->idInfo);
-                    QList<int> srcList;
-                    if(epNode->checkStatus!=Qt::Checked)
-                    {
-                        for(DanmuPoolNode *srcNode:*epNode->children)
-                        {
-                            if(srcNode->checkStatus==Qt::Checked)
-                                srcList<<static_cast<DanmuPoolSourceNode *>(srcNode)->srcId;
-                        }
-                    }
-                    ds<<int(0x23);
-                    pool->exportKdFile(ds,srcList);
+                    for(const auto &src:checkedPool.sources)
+                        srcList<<src.first;
                 }
-                QByteArray compressedContent;
-                Network::gzipCompress(content,compressedContent);
-                QDataStream fs(&kdFile);
-                fs<<QString("kd")<<comment<<compressedContent;
+                QByteArray record;
+                QDataStream ds(&record, QIODevice::WriteOnly);
+                ds<<int(0x23);
+                pool->exportKdFile(ds,srcList);
+                //busy pools write nothing after the flag
+                if(record.size()<=int(sizeof(int))) continue;
+                writer.addBlock(record, QString("%1 %2").arg(pool->anime, pool->ep));
             }
+            if(writer.finish()) ++exportCount;
+            else emit workerStateMessage(tr("Write File Failed: %1").arg(fi.fileName()));
         }
         emit workerStateMessage("Done");
-        return 0;
+        return exportCount;
     });
 }
 
-int DanmuManager::importKdFile(const QString &fileName, QWidget *parent)
+QFuture<int> DanmuManager::importKdFile(const QString &fileName, QWidget *parent)
 {
-    QFile kdFile(fileName);
-    bool ret=kdFile.open(QIODevice::ReadOnly);
-    if(!ret) return -1;
-    QDataStream fs(&kdFile);
-    QString head,comment;
-    fs>>head;
-    if(head!="kd") return -2;
-    fs>>comment;
-    bool readContent=comment.isEmpty();
+    //only the header is read here, the comment is confirmed before anything is written
+    QString comment;
+    {
+        QFile kdFile(fileName);
+        if(!kdFile.open(QIODevice::ReadOnly)) return Async::ready(-1);
+        KdFile::Reader reader(&kdFile);
+        if(!reader.readHeader(comment)) return Async::ready(-2);
+    }
     if(!comment.isEmpty())
     {
         QMessageBox::StandardButton btn =
                 QMessageBox::information(parent,tr("Kd Comment"),comment,
                                  QMessageBox::Ok|QMessageBox::Cancel,QMessageBox::Ok);
-        readContent=(btn==QMessageBox::Ok);
-    }
-    if(!readContent) return 0;
-    ThreadTask task(GlobalObjects::workThread);
-    return task.Run([this,&fs](){
-        QByteArray compressedConent,content;
-        fs>>compressedConent;
-        if(Network::gzipDecompress(compressedConent,content)!=0) return -2;
-        QBuffer buffer(&content);
-        buffer.open(QIODevice::ReadOnly);
-        QDataStream ds(&buffer);
-        while(true)
-        {
-            int poolFlag=0;
-            ds>>poolFlag;
-            if(poolFlag!=0x23) break;
-
-            QString curAnime,curEp,file16MD5;
-            EpType epType;
-            double epIndex;
-            QList<DanmuSource> srcInfoList;
-            QHash<int, QPair<DanmuSource,QList<DanmuComment *>>> danmuInfo;
-            int danmuConut=0;
-
-            ds>>curAnime>>epType>>epIndex>>curEp>>file16MD5>>srcInfoList>>danmuConut;
-            emit workerStateMessage(tr("Adding: %1-%2").arg(curAnime,curEp));
-            for(auto &src:srcInfoList)
-            {
-                danmuInfo[src.id].first=src;
-            }
-            while(danmuConut-- > 0)
-            {
-                DanmuComment *danmu=new DanmuComment;
-                ds>>*danmu;
-                if(danmu->type!=DanmuComment::UNKNOW)
-                {
-                    Q_ASSERT(danmuInfo.contains(danmu->source));
-                    danmuInfo[danmu->source].second.append(danmu);
-                }
-                else delete danmu;
-            }
-            QStringList file16Md5List(file16MD5.split(';',QString::SkipEmptyParts));
-            QString pid(this->createPool(curAnime,epType, epIndex, curEp,file16Md5List.count()==1?file16Md5List.first():""));
-            if(file16Md5List.count()>1)
-            {
-                for(const QString &md5:file16Md5List) this->setMatch(md5,pid);
-            }
-            Pool *pool=getPool(pid);
-			Q_ASSERT(pool);
-            int c = 1;
-            for(auto &srcItem:danmuInfo)
-            {
-                pool->addSource(srcItem.first,srcItem.second, c==danmuInfo.size());
-                ++c;
-            }
+        if(btn!=QMessageBox::Ok) return Async::ready(0);
+    }
+    return GlobalObjects::dbExecutor->writeAsync("DanmuManager::importKdFile", [this,fileName](){
+        QFile kdFile(fileName);
+        if(!kdFile.open(QIODevice::ReadOnly)) return -1;
+        KdFile::Reader reader(&kdFile);
+        QString comment;
+        if(!reader.readHeader(comment)) return -2;
+        QByteArray content;
+        const int blockCount=reader.blocks().size();
+        int blocks=0;
+        while(reader.next(content))
+        {
+            ++blocks;
+            if(blockCount>0)
+                emit workerStateMessage(tr("Importing(%1/%2)").arg(blocks).arg(blockCount));
+            QDataStream ds(content);
+            while(importKdPool(ds));
         }
         emit workerStateMessage("Done");
-        return 1;
-    }).toInt();
+        return reader.hasError()?-2:1;
+    });
+}
+
+bool DanmuManager::importKdPool(QDataStream &ds)
+{
+    int poolFlag=0;
+    ds>>poolFlag;
+    if(poolFlag!=0x23) return false;
+
+    QString curAnime,curEp,file16MD5;
+    EpType epType;
+    double epIndex;
+    QList<DanmuSource> srcInfoList;
+    QHash<int, QPair<DanmuSource,QList<DanmuComment *>>> danmuInfo;
+    int danmuConut=0;
+
+    ds>>curAnime>>epType>>epIndex>>curEp>>file16MD5>>srcInfoList>>danmuConut;
+    emit workerStateMessage(tr("Adding: %1-%2").arg(curAnime,curEp));
+    for(auto &src:srcInfoList)
+    {
+        danmuInfo[src.id].first=src;
+    }
+    while(danmuConut-- > 0)
+    {
+        DanmuComment *danmu=new DanmuComment;
+        ds>>*danmu;
+        if(danmu->type!=DanmuComment::UNKNOW)
+        {
+            Q_ASSERT(danmuInfo.contains(danmu->source));
+            danmuInfo[danmu->source].second.append(danmu);
+        }
+        else delete danmu;
+    }
+    QStringList file16Md5List(file16MD5.split(';',QString::SkipEmptyParts));
+    QString pid(this->createPool(curAnime,epType, epIndex, curEp,file16Md5List.count()==1?file16Md5List.first():""));
+    if(file16Md5List.count()>1)
+    {
+        for(const QString &md5:file16Md5List) this->setMatch(md5,pid);
+    }
+    Pool *pool=getPool(pid);
+    Q_ASSERT(pool);
+    int c = 1;
+    for(auto &srcItem:danmuInfo)
+    {
+        pool->addSource(srcItem.first,srcItem.second, c==danmuInfo.size());
+        ++c;
+    }
+    return true;
 }
 
 QStringList DanmuManager::getMatchedFile16Md5(const QString &pid)
@@ -278,54 +441,224 @@ QStringList DanmuManager::getMatchedFile16Md5(const QString &pid)
     return md5s;
 }
 
-QString DanmuManager::updateMatch(const QString &fileName, const MatchResult &newMatchInfo)
+void DanmuManager::removeMatch(const QString &fileName)
 {
-    return createPool(newMatchInfo.name, newMatchInfo.ep.type, newMatchInfo.ep.index, newMatchInfo.ep.name, getFileHash(fileName));
+    Async::then(getFileHashAsync(fileName), this, [](const QString &fileHash){
+        if(fileHash.isEmpty()) return;
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.prepare("delete from match where MD5=?");
+        query.bindValue(0,fileHash);
+        query.exec();
+    });
 }
 
-void DanmuManager::removeMatch(const QString &fileName)
+
+QString DanmuManager::getFileHash(const QString &fileName)
 {
-    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-    query.exec(QString("delete from match where MD5='%1'").arg(getFileHash(fileName)));
+    return fileHasher->hash(fileName);
 }
 
+QFuture<QString> DanmuManager::getFileHashAsync(const QString &fileName)
+{
+    return fileHasher->hashAsync(fileName);
+}
 
-QString DanmuManager::getFileHash(const QString &fileName)
+void DanmuManager::setPackedStorage(bool on)
 {
-    QFile mediaFile(fileName);
-    bool ret=mediaFile.open(QIODevice::ReadOnly);
-    if(!ret) return QString();
-    QByteArray file16MB = mediaFile.read(16*1024*1024);
-    return QCryptographicHash::hash(file16MB,QCryptographicHash::Md5).toHex();
+    packedStorage=on;
+    GlobalObjects::appSetting->setValue("DanmuManager/PackedStorage",on);
 }
 
-void DanmuManager::localSearch(const QString &keyword, QList<AnimeLite> &results)
+QFuture<int> DanmuManager::packAllPools()
 {
-    results.clear();
-    QHash<QString, QList<Pool *>> animePools;
-    for(Pool *pool:pools)
-    {
-        if(pool->anime.contains(keyword))
+    return GlobalObjects::dbExecutor->writeAsync("DanmuManager::packAllPools", [this](){
+        writeQueue->flush();
+        QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Comment_DB);
+        QSqlQuery query(db);
+        QStringList pidList;
+        for (int i = 0; i < tableCount; ++i)
         {
-            animePools[pool->anime].append(pool);
+            query.exec(QString("select distinct PoolID from danmu_%1").arg(i));
+            while (query.next())
+                pidList<<query.value(0).toString();
         }
-    }
-    for(auto iter=animePools.begin(); iter!=animePools.end(); ++iter)
-    {
-        AnimeLite anime;
-        anime.name = iter.key();
-        anime.epList.reset(new QList<EpInfo>);
-        for(auto p : iter.value())
+        int packedCount=0, i=0;
+        for(const QString &pid:pidList)
         {
-            EpInfo ep;
-            ep.name = p->ep;
-            ep.type = p->epType;
-            ep.index = p->epIndex;
-            anime.epList->append(ep);
+            Pool *pool=getPool(pid,false);
+            ++i;
+            if(!pool) continue;
+            PoolStateLock lock;
+            if(!lock.tryLock(pid)) continue;
+            emit workerStateMessage(tr("Packing(%1/%2): %3 %4").arg(i).arg(pidList.size()).arg(pool->anime, pool->ep));
+            QList<DanmuComment *> danmuList;
+            int tableId=tableOf(pid);
+            loadRowDanmu(pid, tableId, danmuList);
+            QHash<int, QList<DanmuComment *>> sourceDanmu;
+            for(DanmuComment *danmu:danmuList)
+                sourceDanmu[danmu->source].append(danmu);
+
+            db.transaction();
+            QSqlQuery chunkQuery(db);
+            chunkQuery.prepare("select max(Chunk) from danmu_pack where PoolID=? and Source=?");
+            QSqlQuery insertQuery(db);
+            insertQuery.prepare("insert into danmu_pack(PoolID,Source,Chunk,Count,Data) values(?,?,?,?,?)");
+            for(auto iter=sourceDanmu.cbegin();iter!=sourceDanmu.cend();++iter)
+            {
+                chunkQuery.bindValue(0,pid);
+                chunkQuery.bindValue(1,iter.key());
+                chunkQuery.exec();
+                int chunk=(chunkQuery.first() && !chunkQuery.value(0).isNull())?chunkQuery.value(0).toInt()+1:0;
+                insertQuery.bindValue(0,pid);
+                insertQuery.bindValue(1,iter.key());
+                insertQuery.bindValue(2,chunk);
+                insertQuery.bindValue(3,iter.value().size());
+                insertQuery.bindValue(4,DanmuPack::encode(iter.value()));
+                insertQuery.exec();
+            }
+            query.prepare(QString("delete from danmu_%1 where PoolID=?").arg(tableId));
+            query.bindValue(0,pid);
+            query.exec();
+            if(db.commit())
+            {
+                ++packedCount;
+                if(pool->isLoaded)
+                {
+                    for(auto iter=sourceDanmu.cbegin();iter!=sourceDanmu.cend();++iter)
+                        pool->packedSources.insert(iter.key());
+                }
+            }
+            else
+            {
+                db.rollback();
+            }
+            qDeleteAll(danmuList);
         }
-        std::sort(anime.epList->begin(), anime.epList->end());
-        results.append(anime);
-    }
+        emit workerStateMessage("Done");
+        return packedCount;
+    });
+}
+
+QFuture<QString> DanmuManager::benchmarkLoad(const QString &pid)
+{
+    return readAfterFlush("DanmuManager::benchmarkLoad", [this,pid](){
+        QElapsedTimer timer;
+        QList<DanmuComment *> rowList, packList;
+        QHash<int, int> chunkCount;
+
+        timer.start();
+        loadRowDanmu(pid, tableOf(pid), rowList);
+        qint64 rowTime=timer.elapsed();
+
+        timer.restart();
+        qint64 blobSize=loadPackedDanmu(pid, packList, chunkCount);
+        qint64 packTime=timer.elapsed();
+
+        QString inMemoryInfo;
+        if(!rowList.isEmpty())
+        {
+            QHash<int, QList<DanmuComment *>> sourceDanmu;
+            for(DanmuComment *danmu:rowList)
+                sourceDanmu[danmu->source].append(danmu);
+            QList<QPair<int, QByteArray>> blobs;
+            qint64 encodedSize=0;
+            timer.restart();
+            for(auto iter=sourceDanmu.cbegin();iter!=sourceDanmu.cend();++iter)
+            {
+                blobs.append(qMakePair(iter.key(), DanmuPack::encode(iter.value())));
+                encodedSize+=blobs.last().second.size();
+            }
+            qint64 encodeTime=timer.elapsed();
+            QList<DanmuComment *> decodedList;
+            timer.restart();
+            for(const auto &blob:blobs)
+                DanmuPack::decode(blob.second, blob.first, decodedList);
+            qint64 decodeTime=timer.elapsed();
+            inMemoryInfo=tr(", Rows Packed: encode %1ms, decode %2ms, %3KB").arg(encodeTime).arg(decodeTime).arg(encodedSize/1024);
+            qDeleteAll(decodedList);
+        }
+        const int rowCount=rowList.size(), packCount=packList.size();
+        QList<QSharedPointer<DanmuComment> > dbList;
+        for(DanmuComment *danmu:rowList) dbList.append(QSharedPointer<DanmuComment>(danmu));
+        for(DanmuComment *danmu:packList) dbList.append(QSharedPointer<DanmuComment>(danmu));
+        rowList.clear();
+        packList.clear();
+        QString snapshotFile(QString("%1snapshot/benchmark_%2.kds").arg(GlobalObjects::dataPath, pid));
+        PoolSnapshot::write(snapshotFile, 0, dbList);
+        QList<DanmuComment *> warmList;
+        timer.restart();
+        {
+            PoolSnapshot snapshot(snapshotFile);
+            snapshot.materialize(warmList);
+            qDeleteAll(warmList);
+        }
+        qint64 warmTime=timer.elapsed();
+        QFile::remove(snapshotFile);
+        const DanmuWriteQueue::Metrics metrics(writeQueue->metrics());
+        const ShardedLRUCache<QString, Pool *>::Stats cacheStat(poolCache->stats());
+        QString info(tr("Rows: %1 in %2ms, Packed: %3 in %4ms(%5 chunks, %6KB)%7, Cold Open: %8ms, Warm Open(snapshot): %9ms")
+                     .arg(rowCount).arg(rowTime).arg(packCount).arg(packTime)
+                     .arg(chunkCount.size()).arg(blobSize/1024).arg(inMemoryInfo).arg(rowTime+packTime).arg(warmTime));
+        info+=tr(", Write Queue: %1 flushes, %2 comments, last %3ms, max %4ms")
+                .arg(metrics.flushCount).arg(metrics.flushedComments).arg(metrics.lastFlushTime).arg(metrics.maxFlushTime);
+        info+=tr(", Pool Cache: %1 pools(%2 pinned), %3/%4 comments, hit %5, miss %6, evict %7")
+                .arg(cacheStat.count).arg(cacheStat.pinned).arg(cacheStat.weight).arg(poolCache->capacity())
+                .arg(cacheStat.hits).arg(cacheStat.misses).arg(cacheStat.evictions);
+        return info;
+    });
+}
+
+QFuture<QList<AnimeLite> > DanmuManager::localSearch(const QString &keyword)
+{
+    return GlobalObjects::dbExecutor->readAsync("DanmuManager::localSearch", [this,keyword](){
+        QList<AnimeLite> results;
+        loadAnimeIndex();
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.prepare("select EpType,EpIndex,EpName from pool where Anime=?");
+        for(const QString &animeTitle : animeIndex.search(keyword))
+        {
+            AnimeLite anime;
+            anime.name = animeTitle;
+            anime.epList.reset(new QList<EpInfo>());
+            query.bindValue(0,animeTitle);
+            query.exec();
+            while (query.next())
+            {
+                anime.epList->append(EpInfo(EpType(query.value(0).toInt()), query.value(1).toDouble(), query.value(2).toString()));
+            }
+            if(anime.epList->isEmpty()) continue;
+            std::sort(anime.epList->begin(), anime.epList->end());
+            results.append(anime);
+        }
+        return results;
+    });
+}
+
+void DanmuManager::loadAnimeIndex()
+{
+    QMutexLocker locker(&animeIndexLock);
+    if(animeIndexLoaded) return;
+    GlobalObjects::dbExecutor->read("DanmuManager::loadAnimeIndex", [this](){
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.exec("select distinct Anime from pool");
+        while (query.next())
+        {
+            QString animeTitle(query.value(0).toString());
+            animeIndex.add(animeTitle, animeTitle);
+        }
+        return 0;
+    });
+    animeIndexLoaded=true;
+}
+
+void DanmuManager::refreshAnimeIndex(const QString &animeTitle)
+{
+    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+    query.prepare("select 1 from pool where Anime=? limit 1");
+    query.bindValue(0,animeTitle);
+    query.exec();
+    if(query.first()) animeIndex.add(animeTitle, animeTitle);
+    else animeIndex.remove(animeTitle);
 }
 
 void DanmuManager::localMatch(const QString &path, MatchResult &result)
@@ -354,7 +687,7 @@ void DanmuManager::localMatch(const QString &path, MatchResult &result)
 QString DanmuManager::createPool(const QString &animeTitle, EpType epType, double epIndex, const QString &epName,  const QString &fileHash)
 {
     QString poolId(getPoolId(animeTitle, epType, epIndex));
-    Pool *pool = pools.value(poolId, nullptr);
+    Pool *pool = getPool(poolId, false);
     if(!pool)
     {
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
@@ -365,6 +698,14 @@ QString DanmuManager::createPool(const QString &animeTitle, EpType epType, doubl
         query.bindValue(3,epIndex);
         query.bindValue(4,epName);
         query.exec();
+        if(targetShard(poolId)!=DanmuPoolNode::idHash(poolId))
+        {
+            setPoolShard(query, poolId, targetShard(poolId));
+            cachePoolShard(poolId, targetShard(poolId));
+        }
+        //new pools are indexed by the write queue from the start
+        if(fullTextIndex) DanmuFts::setPoolIndexed(query, poolId);
+        animeIndex.add(animeTitle, animeTitle);
         QMutexLocker locker(&poolsLock);
         pools.insert(poolId,new Pool(poolId,animeTitle,epName,epType,epIndex));
     }
@@ -385,68 +726,110 @@ QString DanmuManager::createPool(const QString &animeTitle, EpType epType, doubl
     return poolId;
 }
 
-QString DanmuManager::createPool(const QString &path, const MatchResult &match)
+QStringList DanmuManager::createPools(const QList<MatchResult> &matches, const QStringList &fileHashes)
 {
-    return createPool(match.name, match.ep.type, match.ep.index, match.ep.name, getFileHash(path));
+    Q_ASSERT(fileHashes.size()==matches.size());
+    //pools and match records of a whole batch in one transaction
+    return GlobalObjects::dbExecutor->write("DanmuManager::createPools", [&](){
+        //existing pools are looked up before the transaction, the hashes come from the match pipeline
+        for(const MatchResult &match:matches)
+            findPool(getPoolId(match.name, match.ep.type, match.ep.index));
+        QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Comment_DB);
+        db.transaction();
+        QStringList pids;
+        for(int i=0; i<matches.size(); ++i)
+            pids<<createPool(matches[i].name, matches[i].ep.type, matches[i].ep.index, matches[i].ep.name, fileHashes[i]);
+        db.commit();
+        return pids;
+    }).toStringList();
 }
 
-QString DanmuManager::renamePool(const QString &pid, const QString &nAnimeTitle, EpType nType, double nIndex,  const QString &nEpTitle)
+QFuture<QString> DanmuManager::renamePool(const QString &pid, const QString &nAnimeTitle, EpType nType, double nIndex,  const QString &nEpTitle)
 {
     Pool *pool=getPool(pid,false);
-    if(!pool) return QString();
+    if(!pool) return Async::ready(QString());
     if(nAnimeTitle==pool->anime && nType==pool->epType && nIndex==pool->epIndex)
     {
         if(nEpTitle != pool->ep)
         {
-            QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-            query.prepare("update pool set EpName=? where PoolID=?");
-            query.bindValue(0,nEpTitle);
-            query.bindValue(1,pid);
-            query.exec();
+            GlobalObjects::dbExecutor->writeAsync("DanmuManager::renamePool", [pid,nEpTitle](){
+                QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+                query.prepare("update pool set EpName=? where PoolID=?");
+                query.bindValue(0,nEpTitle);
+                query.bindValue(1,pid);
+                return query.exec();
+            });
             pool->ep = nEpTitle;
         }
-        return pool->pid;
+        return Async::ready(pid);
     }
     QString npid(getPoolId(nAnimeTitle, nType, nIndex));
-    if(pools.contains(npid)) return QString();
-    PoolStateLock lock;
-    if(!lock.tryLock(pid)) return QString();
-    int oldId=DanmuPoolNode::idHash(pool->pid),newId=DanmuPoolNode::idHash(npid);
-    QSqlDatabase db(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-    db.transaction();
-
-    QSqlQuery query(db);
-    query.prepare("update pool set PoolID=?,Anime=?,EpType=?,EpIndex=?,EpName=? where PoolID=?");
-    query.bindValue(0,npid);
-    query.bindValue(1,nAnimeTitle);
-    query.bindValue(2,nType);
-    query.bindValue(3,nIndex);
-    query.bindValue(4,nEpTitle);
-    query.bindValue(5,pool->pid);
-    query.exec();
+    if(getPool(npid,false)) return Async::ready(QString());
+    const QString oAnimeTitle(pool->anime);
+    //tables are moved on workThread after the queued writes, the pool is renamed here once they are committed
+    QFuture<bool> moved=GlobalObjects::dbExecutor->writeAsync("DanmuManager::renamePool", [=](){
+        PoolStateLock lock;
+        if(!lock.tryLock(pid)) return false;
+        writeQueue->flush();
+        int oldId=tableOf(pid),newId=targetShard(npid);
+        QSqlDatabase db(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        db.transaction();
 
-    if(oldId!=newId)
-    {
-        query.prepare(QString("insert into danmu_%1 select * from danmu_%2 where PoolID=?").arg(newId).arg(oldId));
+        QSqlQuery query(db);
+        query.prepare("update pool set PoolID=?,Anime=?,EpType=?,EpIndex=?,EpName=? where PoolID=?");
         query.bindValue(0,npid);
+        query.bindValue(1,nAnimeTitle);
+        query.bindValue(2,nType);
+        query.bindValue(3,nIndex);
+        query.bindValue(4,nEpTitle);
+        query.bindValue(5,pid);
         query.exec();
-        query.exec(QString("delete from danmu_%1 where PoolID='%2'").arg(oldId).arg(npid));
-    }
-
-    if(!db.commit()) return QString();
 
-    QMutexLocker locker(&poolsLock);
-    poolCache->remove(pid, false);
-
-    pools.remove(pid);
-    pool->pid=npid;
-    pool->anime=nAnimeTitle;
-    pool->epType=nType;
-    pool->epIndex=nIndex;
-    pool->ep=nEpTitle;
-    pools.insert(npid,pool);
+        if(oldId!=newId)
+        {
+            query.prepare(QString("insert into danmu_%1 select * from danmu_%2 where PoolID=?").arg(newId).arg(oldId));
+            query.bindValue(0,npid);
+            query.exec();
+            query.exec(QString("delete from danmu_%1 where PoolID='%2'").arg(oldId).arg(npid));
+            //rowids change with the table, snapshots keeping them are outdated
+            DanmuWriteQueue::bumpPoolVersion(query, npid);
+        }
+        setPoolShard(query, npid, newId);
 
-    return npid;
+        if(!db.commit())
+        {
+            db.rollback();
+            return false;
+        }
+        cachePoolShard(npid, newId);
+        animeIndex.add(nAnimeTitle, nAnimeTitle);
+        if(oAnimeTitle!=nAnimeTitle) refreshAnimeIndex(oAnimeTitle);
+        PoolSnapshot::removeFiles(pid);
+        return true;
+    });
+    QFutureInterface<QString> futureInterface;
+    futureInterface.reportStarted();
+    Async::finally(moved, this, [=](const QFuture<bool> &future) mutable {
+        QString result;
+        QMutexLocker locker(&poolsLock);
+        Pool *renamed=pools.value(pid,nullptr);
+        if(renamed && future.resultCount()>0 && future.result())
+        {
+            poolCache->remove(pid);
+            pools.remove(pid);
+            renamed->pid=npid;
+            renamed->anime=nAnimeTitle;
+            renamed->epType=nType;
+            renamed->epIndex=nIndex;
+            renamed->ep=nEpTitle;
+            pools.insert(npid,renamed);
+            result=npid;
+        }
+        locker.unlock();
+        futureInterface.reportResult(result);
+        futureInterface.reportFinished();
+    });
+    return futureInterface.future();
 }
 
 QString DanmuManager::getPoolId(const QString &animeTitle, EpType epType, double epIndex)
@@ -469,141 +852,119 @@ void DanmuManager::setMatch(const QString &fileHash, const QString &poolId)
     query.exec();
 }
 
-void DanmuManager::deletePool(const QList<DanmuPoolNode *> &deleteList)
+QFuture<int> DanmuManager::deletePool(const QList<DanmuPoolNode *> &deleteList)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([&deleteList,this](){
+    const QList<CheckedPool> checked(checkedPools(deleteList));
+    return GlobalObjects::dbExecutor->writeAsync("DanmuManager::deletePool", [checked,this](){
+        writeQueue->flush();
         QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Comment_DB);
         QSqlQuery query(db);
+        QSet<QString> animeTitles;
+        int deleteCount=0;
         db.transaction();
-        for(const DanmuPoolNode *node:deleteList)
+        for(const CheckedPool &checkedPool:checked)
         {
-            if(node->type==DanmuPoolNode::AnimeNode && node->checkStatus!=Qt::Unchecked)
+            animeTitles.insert(checkedPool.anime);
+            if(checkedPool.whole)
+            {
+                emit workerStateMessage(tr("Deleting: %1 %2").arg(checkedPool.anime, checkedPool.ep));
+                PoolStateLock lock;
+                if(lock.tryLock(checkedPool.pid))
+                {
+                    deletePool(checkedPool.pid);
+                    if(fullTextIndex) DanmuFts::removePool(query, checkedPool.pid);
+                    query.prepare("delete from pool where PoolID=?");
+                    query.bindValue(0,checkedPool.pid);
+                    query.exec();
+                    ++deleteCount;
+                }
+                continue;
+            }
+            query.prepare("delete from source where PoolID=? and ID=?");
+            query.bindValue(0,checkedPool.pid);
+
+            QSqlQuery deleteDMQuery(db);
+            int tableId=tableOf(checkedPool.pid);
+            deleteDMQuery.prepare(QString("delete from danmu_%1 where PoolID=? and Source=?").arg(tableId));
+            deleteDMQuery.bindValue(0,checkedPool.pid);
+            QSqlQuery deletePackQuery(db);
+            deletePackQuery.prepare("delete from danmu_pack where PoolID=? and Source=?");
+            deletePackQuery.bindValue(0,checkedPool.pid);
+            QSqlQuery deleteCountQuery(db);
+            deleteCountQuery.prepare("delete from source_count where PoolID=? and Source=?");
+            deleteCountQuery.bindValue(0,checkedPool.pid);
+            QSqlQuery ftsQuery(db);
+            Pool *pool=getPool(checkedPool.pid,false);
+            if(!pool) continue;
+            for(const auto &src:checkedPool.sources)
             {
-                for(DanmuPoolNode *epNode:*node->children)
+                if(pool->deleteSource(src.first,false))
                 {
-                    switch (epNode->checkStatus)
-                    {
-                    case Qt::Checked:
-                    {
-                        emit workerStateMessage(tr("Deleting: %1 %2").arg(node->title, epNode->title));
-                        PoolStateLock lock;
-                        if(lock.tryLock(epNode->idInfo))
-                        {
-                            deletePool(epNode->idInfo);
-                            query.prepare("delete from pool where PoolID=?");
-                            query.bindValue(0,epNode->idInfo);
-                            query.exec();
-                        }
-                        break;
-                    }
-                    case Qt::PartiallyChecked:
-                    {
-                        query.prepare("delete from source where PoolID=? and ID=?");
-                        query.bindValue(0,epNode->idInfo);
-
-                        QSqlQuery deleteDMQuery(db);
-                        int tableId=DanmuPoolNode::idHash(epNode->idInfo);
-                        deleteDMQuery.prepare(QString("delete from danmu_%1 where PoolID=? and Source=?").arg(tableId));
-                        deleteDMQuery.bindValue(0,epNode->idInfo);
-                        Pool *pool=getPool(epNode->idInfo,false);
-                        for(DanmuPoolNode *srcNode:*epNode->children)
-                        {
-                            if(srcNode->checkStatus!=Qt::Checked)continue;
-                            if(pool->deleteSource(static_cast<DanmuPoolSourceNode *>(srcNode)->srcId,false))
-                            {
-                                emit workerStateMessage(tr("Deleting: %1 %2 %3").arg(node->title, epNode->title, srcNode->title));
-                                query.bindValue(1,static_cast<DanmuPoolSourceNode *>(srcNode)->srcId);
-                                query.exec();
-                                deleteDMQuery.bindValue(1,static_cast<DanmuPoolSourceNode *>(srcNode)->srcId);
-                                deleteDMQuery.exec();
-                            }
-                        }
-                        break;
-                    }
-                    default:
-                        break;
-                    }
+                    emit workerStateMessage(tr("Deleting: %1 %2 %3").arg(checkedPool.anime, checkedPool.ep, src.second));
+                    query.bindValue(1,src.first);
+                    query.exec();
+                    deleteDMQuery.bindValue(1,src.first);
+                    deleteDMQuery.exec();
+                    deletePackQuery.bindValue(1,src.first);
+                    deletePackQuery.exec();
+                    deleteCountQuery.bindValue(1,src.first);
+                    deleteCountQuery.exec();
+                    if(fullTextIndex) DanmuFts::removeSource(ftsQuery, checkedPool.pid, src.first);
+                    ++deleteCount;
                 }
             }
+            DanmuWriteQueue::bumpPoolVersion(query, checkedPool.pid);
         }
         db.commit();
+        for(const QString &animeTitle:animeTitles)
+            refreshAnimeIndex(animeTitle);
         emit workerStateMessage("Done");
-        return 0;
+        return deleteCount;
     });
 }
 
 void DanmuManager::deleteSource(const QString &pid, int srcId)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([pid,srcId](){
-        QSqlDatabase db = GlobalObjects::getDB(GlobalObjects::Comment_DB);
-        QSqlQuery query(db);
-        db.transaction();
-        query.exec(QString("delete from source where PoolID='%1' and ID=%2").arg(pid).arg(srcId));
-        int tableId=DanmuPoolNode::idHash(pid);
-        query.exec(QString("delete from danmu_%1 where PoolID='%2' and Source=%3").arg(tableId).arg(pid).arg(srcId));
-        db.commit();
-    });
+    writeQueue->deleteSource(pid, srcId);
 }
 
-void DanmuManager::deleteDanmu(const QString &pid, const QSharedPointer<DanmuComment> danmu)
+void DanmuManager::deleteDanmu(const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([pid,danmu](){
-        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-        int tableId=DanmuPoolNode::idHash(pid);
-        query.prepare(QString("delete from danmu_%1 where PoolID=? and Date=? and User=? and Text=? and Source=?").arg(tableId));
-        query.bindValue(0,pid);
-        query.bindValue(1,danmu->date);
-        query.bindValue(2,danmu->sender);
-        query.bindValue(3,danmu->text);
-        query.bindValue(4,danmu->source);
-        query.exec();
-    });
+    writeQueue->deleteDanmu(pid, danmuList);
+}
+
+void DanmuManager::repackSource(const QString &pid, int sourceId, const QList<QSharedPointer<DanmuComment> > &danmuList, bool contentChanged)
+{
+    writeQueue->repackSource(pid, sourceId, danmuList, contentChanged);
 }
 
-void DanmuManager::updatePool(QList<DanmuPoolNode *> &updateList)
+QFuture<DanmuManager::SourceCounts> DanmuManager::updatePool(const QList<DanmuPoolNode *> &updateList)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([this,&updateList](){
-        for(const DanmuPoolNode *animeNode:updateList)
+    const QList<CheckedPool> checked(checkedPools(updateList));
+    return GlobalObjects::dbExecutor->writeAsync("DanmuManager::updatePool", [this,checked](){
+        SourceCounts counts;
+        for(const CheckedPool &checkedPool:checked)
         {
-            if(animeNode->checkStatus==Qt::Unchecked)continue;
-            for(DanmuPoolNode *epNode:*animeNode->children)
+            Pool *pool=getPool(checkedPool.pid);
+            if(!pool) continue;
+            for(const auto &src:checkedPool.sources)
             {
-                if(epNode->checkStatus==Qt::Unchecked)continue;
-                Pool *pool=getPool(epNode->idInfo);
-                for(DanmuPoolNode *sourceNode:*epNode->children)
-                {
-                    if(sourceNode->checkStatus==Qt::Unchecked)continue;
-                    emit workerStateMessage(tr("Updating: %1 %2 %3").arg(animeNode->title, epNode->title, sourceNode->idInfo));
-                    DanmuPoolSourceNode *srcNode(static_cast<DanmuPoolSourceNode *>(sourceNode));
-                    pool->update(srcNode->srcId);
-                    srcNode->danmuCount=pool->sources()[srcNode->srcId].count;
-                }
+                emit workerStateMessage(tr("Updating: %1 %2 %3").arg(checkedPool.anime, checkedPool.ep, src.second));
+                pool->update(src.first);
+                counts.insert(qMakePair(checkedPool.pid, src.first), pool->sources().value(src.first).count);
             }
         }
         emit workerStateMessage("Done");
-        return 0;
+        return counts;
     });
 }
 
 void DanmuManager::updateSourceDelay(const QString &pid, const DanmuSource *sourceInfo)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    int delay=sourceInfo->delay,id=sourceInfo->id;
-    task.RunOnce([delay,id,pid](){
-        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-        query.prepare("update source set Delay= ? where PoolID=? and ID=?");
-        query.bindValue(0,delay);
-        query.bindValue(1,pid);
-        query.bindValue(2,id);
-        query.exec();
-    });
+    writeQueue->updateSourceDelay(pid, sourceInfo->id, sourceInfo->delay);
 }
 
-QList<DanmuComment *> DanmuManager::updateSource(const DanmuSource *sourceInfo, const QSet<QString> &danmuHashSet)
+QList<DanmuComment *> DanmuManager::updateSource(const DanmuSource *sourceInfo, QSet<quint64> &dedupSet)
 {
     QList<DanmuComment *> tmpList;
     auto ret = GlobalObjects::danmuProvider->downloadDanmu(sourceInfo, tmpList);
@@ -611,14 +972,15 @@ QList<DanmuComment *> DanmuManager::updateSource(const DanmuSource *sourceInfo,
     GlobalObjects::blocker->preFilter(tmpList);
     for(auto iter=tmpList.begin();iter!=tmpList.end();)
     {
-        QByteArray hashData(QString("%0%1%2%3").arg((*iter)->text, QString::number((*iter)->originTime), (*iter)->sender, QString::number((*iter)->color)).toUtf8());
-        if(danmuHashSet.contains(QCryptographicHash::hash(hashData,QCryptographicHash::Md5).toHex()) || (*iter)->text.isEmpty())
+        (*iter)->updateFingerprint();
+        if((*iter)->text.isEmpty() || dedupSet.contains((*iter)->getFingerprint()))
         {
             delete *iter;
             iter=tmpList.erase(iter);
         }
         else
         {
+            dedupSet.insert((*iter)->getFingerprint());
             (*iter)->source=sourceInfo->id;
             ++iter;
         }
@@ -626,28 +988,62 @@ QList<DanmuComment *> DanmuManager::updateSource(const DanmuSource *sourceInfo,
     return tmpList;
 }
 
-void DanmuManager::loadAllPool()
+void DanmuManager::loadFingerprints(const QString &pid, int sourceId, QSet<quint64> &dedupSet)
 {
-    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-    //get all danmu pools
-    query.exec("select * from pool");
-    int idNo = query.record().indexOf("PoolID"),
-        animeNo=query.record().indexOf("Anime"),
-        epTypeNo=query.record().indexOf("EpType"),
-        epIndexNo=query.record().indexOf("EpIndex"),
-        epNameNo=query.record().indexOf("EpName");
-    while (query.next())
+    //queued writes are overlaid instead of flushed, they are taken first so a flush in between is not missed
+    const DanmuWriteQueue::PendingFingerprints pending(writeQueue->pendingFingerprints(pid, sourceId));
+    if(pending.reset)
     {
-        QString poolId(query.value(idNo).toString());
-        pools.insert(poolId,  new Pool(poolId,query.value(animeNo).toString(),
-                              query.value(epNameNo).toString(),
-                              EpType(query.value(epTypeNo).toInt()),
-                              query.value(epIndexNo).toDouble()));
+        pending.applyTo(dedupSet);
+        return;
     }
+    GlobalObjects::dbExecutor->read("DanmuManager::loadFingerprints", [this,pid,sourceId,&dedupSet](){
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.setForwardOnly(true);
+        int tableId=tableOf(pid);
+        //every row has its Hash once migrateTables ran, it runs first on the writer lane where this is called from
+        query.prepare(QString("select Hash from danmu_%1 where PoolID=? and Source=?").arg(tableId));
+        query.bindValue(0,pid);
+        query.bindValue(1,sourceId);
+        query.exec();
+        while (query.next())
+            dedupSet.insert(quint64(query.value(0).toLongLong()));
+        query.prepare("select Data from danmu_pack where PoolID=? and Source=?");
+        query.bindValue(0,pid);
+        query.bindValue(1,sourceId);
+        query.exec();
+        while (query.next())
+        {
+            QList<DanmuComment *> danmuList;
+            DanmuPack::decode(query.value(0).toByteArray(), sourceId, danmuList);
+            for(DanmuComment *danmu:danmuList)
+                dedupSet.insert(danmu->getFingerprint());
+            qDeleteAll(danmuList);
+        }
+        return 0;
+    }, DBExecutor::Background);
+    pending.applyTo(dedupSet);
+}
+
+Pool *DanmuManager::findPool(const QString &pid)
+{
+    QMutexLocker locker(&poolsLock);
+    Pool *pool=pools.value(pid,nullptr);
+    if(pool || pid.isEmpty()) return pool;
+    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+    query.prepare("select Anime,EpType,EpIndex,EpName from pool where PoolID=?");
+    query.bindValue(0,pid);
+    query.exec();
+    if(!query.first()) return nullptr;
+    pool=new Pool(pid,query.value(0).toString(),query.value(3).toString(),
+                  EpType(query.value(1).toInt()),query.value(2).toDouble());
+    //pools may be found from worker threads, keep them in the manager thread like the others
+    if(pool->thread()!=thread()) pool->moveToThread(thread());
     //get source info
-    query.exec("select * from source");
-    int s_pidNo = query.record().indexOf("PoolID"),
-        s_idNo = query.record().indexOf("ID"),
+    query.prepare("select * from source where PoolID=?");
+    query.bindValue(0,pid);
+    query.exec();
+    int s_idNo = query.record().indexOf("ID"),
         s_titleNo = query.record().indexOf("Title"),
         s_descNo = query.record().indexOf("Desc"),
         s_scriptIdNo = query.record().indexOf("ScriptId"),
@@ -657,8 +1053,6 @@ void DanmuManager::loadAllPool()
         s_timelineNo=query.record().indexOf("TimeLine");
     while (query.next())
     {
-        Pool *pool = pools.value(query.value(s_pidNo).toString(),nullptr);
-        Q_ASSERT(pool);
         DanmuSource srcInfo;
         srcInfo.id=query.value(s_idNo).toInt();
         srcInfo.title = query.value(s_titleNo).toString();
@@ -672,6 +1066,363 @@ void DanmuManager::loadAllPool()
         srcInfo.setTimeline(query.value(s_timelineNo).toString());
         pool->sourcesTable.insert(srcInfo.id, srcInfo);
     }
+    query.prepare("select Source,Count from source_count where PoolID=?");
+    query.bindValue(0,pid);
+    query.exec();
+    while (query.next())
+    {
+        auto iter=pool->sourcesTable.find(query.value(0).toInt());
+        if(iter!=pool->sourcesTable.end()) iter->count=query.value(1).toInt();
+    }
+    pools.insert(pid, pool);
+    return pool;
+}
+
+void DanmuManager::createShardTables()
+{
+    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+    query.exec("select name from sqlite_master where type='table' and name like 'danmu_%'");
+    int existCount=0;
+    while (query.next())
+    {
+        bool ok;
+        int tableId=query.value(0).toString().mid(6).toInt(&ok);
+        if(ok) existCount=qMax(existCount, tableId+1);
+    }
+    const int shardCount=danmuShardCount.load();
+    for (int i = existCount; i < shardCount; ++i)
+    {
+        query.exec(QString("CREATE TABLE IF NOT EXISTS \"danmu_%1\" ("
+                           "\"PoolID\"  TEXT(32) NOT NULL,"
+                           "\"Time\"  INTEGER,"
+                           "\"Date\"  INTEGER,"
+                           "\"Color\"  INTEGER,"
+                           "\"Mode\"  INTEGER,"
+                           "\"Size\"  INTEGER,"
+                           "\"Source\"  INTEGER,"
+                           "\"User\"  TEXT,"
+                           "\"Text\"  TEXT,"
+                           "\"Hash\"  INTEGER,"
+                           "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE)").arg(i));
+        query.exec(QString("CREATE INDEX IF NOT EXISTS \"PoolID_%1\" ON \"danmu_%1\" (\"PoolID\" ASC, \"Source\" ASC)").arg(i));
+        query.exec(QString("CREATE INDEX IF NOT EXISTS \"Hash_%1\" ON \"danmu_%1\" (\"Hash\" ASC)").arg(i));
+    }
+    //tables beyond the shard count are kept, the pools in them are moved out by the balancer
+    tableCount=qMax(existCount, shardCount);
+}
+
+void DanmuManager::setPoolShard(QSqlQuery &query, const QString &pid, int shard)
+{
+    query.prepare("insert or replace into pool_shard(PoolID,Shard) values(?,?)");
+    query.bindValue(0,pid);
+    query.bindValue(1,shard);
+    query.exec();
+}
+
+void DanmuManager::cachePoolShard(const QString &pid, int shard)
+{
+    QMutexLocker locker(&shardLock);
+    poolShards.insert(pid, shard);
+}
+
+int DanmuManager::tableOf(const QString &pid)
+{
+    {
+        QMutexLocker locker(&shardLock);
+        auto iter=poolShards.constFind(pid);
+        if(iter!=poolShards.cend()) return iter.value();
+    }
+    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+    query.prepare("select Shard from pool_shard where PoolID=?");
+    query.bindValue(0,pid);
+    query.exec();
+    //pools without a record are still in their table of the original five-table layout
+    int shard=query.first()?query.value(0).toInt():DanmuPoolNode::idHash(pid);
+    cachePoolShard(pid, shard);
+    return shard;
+}
+
+void DanmuManager::setShardCount(int count)
+{
+    count=qBound(1,count,64);
+    if(count==danmuShardCount.load()) return;
+    GlobalObjects::appSetting->setValue("DanmuManager/ShardCount",count);
+    GlobalObjects::dbExecutor->writeOnce("DanmuManager::setShardCount", [this,count](){
+        //the balancer lives on workThread too, none of its steps runs while the tables change
+        shardBalancer->stop();
+        danmuShardCount=count;
+        createShardTables();
+        QMetaObject::invokeMethod(shardBalancer,"start",Qt::QueuedConnection);
+    });
+}
+
+QFuture<QString> DanmuManager::shardStats()
+{
+    return GlobalObjects::dbExecutor->readAsync("DanmuManager::shardStats", [this](){
+        QStringList tableInfo;
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        const int tables=tableCount.load();
+        for (int i = 0; i < tables; ++i)
+        {
+            query.exec(QString("select count(*),count(distinct PoolID) from danmu_%1").arg(i));
+            if(query.first())
+                tableInfo<<tr("danmu_%1: %2 rows, %3 pools").arg(i).arg(query.value(0).toLongLong()).arg(query.value(1).toInt());
+        }
+        query.exec("select count(*),ifnull(sum(Count),0),ifnull(sum(length(Data)),0) from danmu_pack");
+        if(query.first())
+            tableInfo<<tr("danmu_pack: %1 chunks, %2 comments, %3KB").arg(query.value(0).toLongLong())
+                       .arg(query.value(1).toLongLong()).arg(query.value(2).toLongLong()/1024);
+        const DanmuShardBalancer::Stat stat(shardBalancer->stat());
+        QString info(tr("Shard Count: %1, Tables: %2\n").arg(danmuShardCount.load()).arg(tables));
+        info+=tableInfo.join('\n');
+        info+=tr("\nRebalance: %1, moved %2 pools(%3 rows), pending %4, skipped %5")
+                .arg(stat.running?tr("running"):tr("idle")).arg(stat.movedPools).arg(stat.movedRows)
+                .arg(stat.pendingPools).arg(stat.skippedPools);
+        return info;
+    }, DBExecutor::Background);
+}
+
+QFuture<bool> DanmuManager::setFullTextIndex(bool on)
+{
+    if(on==fullTextIndex) return Async::ready(true);
+    auto future = GlobalObjects::dbExecutor->writeAsync("DanmuManager::setFullTextIndex", [this,on](){
+        writeQueue->flush();
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        if(on)
+        {
+            if(!DanmuFts::createTables(query)) return false;
+        }
+        else
+        {
+            DanmuFts::dropTables(query);
+        }
+        fullTextIndex=on;
+        return true;
+    });
+    Async::then(future, this, [this,on](bool ret){
+        if(!ret) return;
+        GlobalObjects::appSetting->setValue("DanmuManager/FullTextIndex",on);
+        if(on) buildFullTextIndex();
+    });
+    return future;
+}
+
+void DanmuManager::buildFullTextIndex()
+{
+    if(!fullTextIndex || ftsPendingPools.load()>0) return;
+    auto future = GlobalObjects::dbExecutor->readAsync("DanmuManager::listUnindexedPools", [](){
+        QStringList pidList;
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.exec("select PoolID from pool where PoolID not in (select PoolID from fts_pool)");
+        while (query.next())
+            pidList<<query.value(0).toString();
+        return pidList;
+    }, DBExecutor::Background);
+    Async::then(future, this, [this](const QStringList &pidList){
+        ftsPendingPools.store(pidList.size());
+        //one task per pool, other writes go in between
+        for(const QString &pid:pidList)
+        {
+            GlobalObjects::dbExecutor->writeOnce("DanmuManager::indexPoolText", [this,pid](){
+                indexPoolText(pid);
+                ftsPendingPools.deref();
+            });
+        }
+    });
+}
+
+void DanmuManager::indexPoolText(const QString &pid)
+{
+    if(!fullTextIndex) return;
+    PoolStateLock lock;
+    if(!lock.tryLock(pid)) return;
+    writeQueue->flush();
+    QElapsedTimer timer;
+    timer.start();
+    QList<DanmuComment *> danmuList;
+    QHash<int, int> chunkCount;
+    loadRowDanmu(pid, tableOf(pid), danmuList);
+    loadPackedDanmu(pid, danmuList, chunkCount);
+    QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Comment_DB);
+    QSqlQuery query(db);
+    db.transaction();
+    DanmuFts::removePool(query, pid);
+    DanmuFts::addDanmu(query, pid, danmuList);
+    DanmuFts::setPoolIndexed(query, pid);
+    if(db.commit())
+    {
+        ftsIndexedPools.ref();
+        ftsIndexedRows.fetchAndAddRelaxed(danmuList.size());
+        ftsIndexTime.fetchAndAddRelaxed(timer.elapsed());
+    }
+    qDeleteAll(danmuList);
+}
+
+QFuture<QList<DanmuFts::Hit> > DanmuManager::searchDanmu(const QString &keyword, int offset, int limit)
+{
+    return GlobalObjects::dbExecutor->readAsync("DanmuManager::searchDanmu", [this,keyword,offset,limit](){
+        if(!fullTextIndex) return QList<DanmuFts::Hit>();
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.setForwardOnly(true);
+        return DanmuFts::search(query, keyword, offset, limit);
+    });
+}
+
+QFuture<QString> DanmuManager::fullTextStats()
+{
+    return GlobalObjects::dbExecutor->readAsync("DanmuManager::fullTextStats", [this]() -> QString {
+        if(!fullTextIndex) return tr("Full-text index is off");
+        qint64 docCount=0, indexedPools=0, totalPools=0;
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.exec("select count(*) from danmu_fts_doc");
+        if(query.first()) docCount=query.value(0).toLongLong();
+        query.exec("select (select count(*) from fts_pool),(select count(*) from pool)");
+        if(query.first())
+        {
+            indexedPools=query.value(0).toLongLong();
+            totalPools=query.value(1).toLongLong();
+        }
+        const qint64 rows=ftsIndexedRows.load(), time=ftsIndexTime.load();
+        QString info(tr("Indexed Comments: %1, Pools: %2/%3").arg(docCount).arg(indexedPools).arg(totalPools));
+        info+=tr("\nBuild: %1 pools pending, %2 pools(%3 comments) in %4s, %5 comments/s")
+                .arg(ftsPendingPools.load()).arg(ftsIndexedPools.load()).arg(rows)
+                .arg(time/1000.0, 0, 'f', 1).arg(time>0?rows*1000/time:0);
+        return info;
+    }, DBExecutor::Background);
+}
+
+void DanmuManager::checkTables()
+{
+    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+    createShardTables();
+    query.exec("CREATE TABLE IF NOT EXISTS \"danmu_pack\" ("
+               "\"PoolID\"  TEXT(32) NOT NULL,"
+               "\"Source\"  INTEGER,"
+               "\"Chunk\"  INTEGER,"
+               "\"Count\"  INTEGER,"
+               "\"Data\"  BLOB,"
+               "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE)");
+    query.exec("CREATE INDEX IF NOT EXISTS \"PoolID_P\" ON \"danmu_pack\" (\"PoolID\" ASC, \"Source\" ASC, \"Chunk\" ASC)");
+    query.exec("CREATE TABLE IF NOT EXISTS \"pool_version\" ("
+               "\"PoolID\"  TEXT(32) NOT NULL,"
+               "\"Version\"  INTEGER,"
+               "PRIMARY KEY (\"PoolID\"),"
+               "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE)");
+    query.exec("CREATE INDEX IF NOT EXISTS \"Anime_P\" ON \"pool\" (\"Anime\" ASC)");
+    query.exec("CREATE TABLE IF NOT EXISTS \"pool_shard\" ("
+               "\"PoolID\"  TEXT(32) NOT NULL,"
+               "\"Shard\"  INTEGER,"
+               "PRIMARY KEY (\"PoolID\"),"
+               "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE)");
+    query.exec("CREATE TABLE IF NOT EXISTS \"file_hash\" ("
+               "\"Path\"  TEXT NOT NULL,"
+               "\"Size\"  INTEGER,"
+               "\"MTime\"  INTEGER,"
+               "\"Inode\"  INTEGER,"
+               "\"Hash\"  TEXT,"
+               "PRIMARY KEY (\"Path\"))");
+    if(fullTextIndex && !DanmuFts::createTables(query))
+    {
+        qWarning() << "FTS5 is not available, full-text danmu index disabled";
+        fullTextIndex=false;
+    }
+    query.exec("select 1 from sqlite_master where type='table' and name='source_count'");
+    bool hasCountTable=query.first();
+    query.exec("CREATE TABLE IF NOT EXISTS \"source_count\" ("
+               "\"PoolID\"  TEXT(32) NOT NULL,"
+               "\"Source\"  INTEGER NOT NULL,"
+               "\"Count\"  INTEGER,"
+               "PRIMARY KEY (\"PoolID\", \"Source\"),"
+               "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE)");
+    //columns, indexes and counts missing in an older library are added on the writer lane,
+    //reads through readAfterFlush wait for it like for queued writes
+    tablesMigrating=true;
+    GlobalObjects::dbExecutor->writeOnce("DanmuManager::migrateTables", [this,hasCountTable](){
+        migrateTables(!hasCountTable);
+        tablesMigrating=false;
+    });
+}
+
+void DanmuManager::migrateTables(bool countSources)
+{
+    QSqlDatabase db=GlobalObjects::getDB(GlobalObjects::Comment_DB);
+    QSqlQuery query(db);
+    const int tables=tableCount.load();
+    for (int i = 0; i < tables; ++i)
+    {
+        query.exec(QString("PRAGMA table_info(danmu_%1)").arg(i));
+        bool hasHash=false;
+        while (query.next())
+        {
+            if(query.value(1).toString()=="Hash")
+            {
+                hasHash=true;
+                break;
+            }
+        }
+        db.transaction();
+        if(!hasHash)
+        {
+            query.exec(QString("ALTER TABLE danmu_%1 ADD COLUMN \"Hash\" INTEGER").arg(i));
+            //fingerprints are filled once, readers then only need the Hash column
+            QList<QPair<qint64, quint64> > hashes;
+            query.setForwardOnly(true);
+            query.exec(QString("select rowid,Text,Time,User,Color from danmu_%1").arg(i));
+            while (query.next())
+            {
+                DanmuComment danmu;
+                danmu.text=query.value(1).toString();
+                danmu.originTime=query.value(2).toInt();
+                danmu.sender=query.value(3).toString();
+                danmu.color=query.value(4).toInt();
+                hashes.append(qMakePair(query.value(0).toLongLong(), danmu.computeFingerprint()));
+            }
+            query.setForwardOnly(false);
+            query.prepare(QString("update danmu_%1 set Hash=? where rowid=?").arg(i));
+            for(const auto &hash:hashes)
+            {
+                query.bindValue(0,qint64(hash.second));
+                query.bindValue(1,hash.first);
+                query.exec();
+            }
+        }
+        //comments without a usable rowid are deleted by (PoolID, Source, Hash)
+        query.exec(QString("CREATE INDEX IF NOT EXISTS \"Hash_%1\" ON \"danmu_%1\" (\"Hash\" ASC)").arg(i));
+        if(!db.commit())
+        {
+            db.rollback();
+            qWarning() << "Migrating danmu table failed:" << i;
+        }
+    }
+    if(countSources)
+    {
+        //one-time count of the existing danmu, the write queue keeps the table up to date afterwards
+        QStringList countQueries;
+        for (int i = 0; i < tables; ++i)
+            countQueries<<QString("select PoolID,Source,count(*) as DanmuCount from danmu_%1 group by PoolID,Source").arg(i);
+        countQueries<<"select PoolID,Source,sum(Count) as DanmuCount from danmu_pack group by PoolID,Source";
+        query.exec(QString("insert into source_count(PoolID,Source,Count) select PoolID,Source,sum(DanmuCount) from (%1) group by PoolID,Source")
+                   .arg(countQueries.join(" union all ")));
+    }
+}
+
+quint32 DanmuManager::getPoolVersion(const QString &pid)
+{
+    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+    query.prepare("select Version from pool_version where PoolID=?");
+    query.bindValue(0,pid);
+    query.exec();
+    return query.first()?query.value(0).toUInt():0;
+}
+
+QSharedPointer<PoolSnapshot> DanmuManager::openSnapshot(const QString &pid, quint32 version)
+{
+    QString fileName(PoolSnapshot::fileName(pid, version));
+    if(!QFile::exists(fileName)) return QSharedPointer<PoolSnapshot>();
+    //mapped only for this load, materialized comments own their strings
+    QSharedPointer<PoolSnapshot> snapshot(new PoolSnapshot(fileName));
+    if(!snapshot->isValid() || snapshot->poolVersion()!=version) return QSharedPointer<PoolSnapshot>();
+    return snapshot;
 }
 
 void DanmuManager::deletePool(const QString &pid)
@@ -683,129 +1434,179 @@ void DanmuManager::deletePool(const QString &pid)
         poolCache->remove(pid);
         pools.remove(pid);
         delete pool;
+        PoolSnapshot::removeFiles(pid);
     }
 
 }
 
 void DanmuManager::updateSourceTimeline(const QString &pid, const DanmuSource *sourceInfo)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    QString timeline(sourceInfo->timelineStr());
-    int id = sourceInfo->id;
-    task.RunOnce([=](){
+    writeQueue->updateSourceTimeline(pid, sourceInfo->id, sourceInfo->timelineStr());
+}
+
+void DanmuManager::loadPool(Pool *pool)
+{
+    //sync loads come from workThread and the lan server, the gui thread uses getPoolAsync
+    const QString pid(pool->id());
+    PoolData data;
+    if(QThread::currentThread()==writeQueue->thread())
+    {
+        writeQueue->flush();
+        GlobalObjects::dbExecutor->read("DanmuManager::loadPool", [this,pid,&data](){
+            data=readPool(pid);
+            return 0;
+        });
+    }
+    else
+    {
+        data=readPoolAsync(pid).result();
+    }
+    applyPool(pool, data);
+}
+
+DanmuManager::PoolData DanmuManager::readPool(const QString &pid)
+{
+    PoolData data;
+    data.version=getPoolVersion(pid);
+    QList<DanmuComment *> danmuList;
+    QSharedPointer<PoolSnapshot> snapshot;
+    if(useSnapshot) snapshot=openSnapshot(pid, data.version);
+    if(snapshot)
+    {
+        snapshot->materialize(danmuList);
         QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-        query.prepare("update source set TimeLine= ? where PoolID=? and ID=?");
-        query.bindValue(0,timeline);
-        query.bindValue(1,pid);
-        query.bindValue(2,id);
+        query.prepare("select distinct Source from danmu_pack where PoolID=?");
+        query.bindValue(0,pid);
         query.exec();
-    });
+        while(query.next())
+            data.packedSources.insert(query.value(0).toInt());
+        data.fromSnapshot=true;
+    }
+    else
+    {
+        loadPackedDanmu(pid, danmuList, data.chunkCount);
+        loadRowDanmu(pid, tableOf(pid), danmuList);
+        for(auto iter=data.chunkCount.cbegin();iter!=data.chunkCount.cend();++iter)
+            data.packedSources.insert(iter.key());
+    }
+    data.comments.reserve(danmuList.size());
+    for(DanmuComment *danmu:danmuList)
+        data.comments.append(QSharedPointer<DanmuComment>(danmu));
+    return data;
+}
 
+QFuture<DanmuManager::PoolData> DanmuManager::readPoolAsync(const QString &pid)
+{
+    return readAfterFlush("DanmuManager::loadPool", [this,pid](){
+        return readPool(pid);
+    });
 }
 
-void DanmuManager::loadPool(Pool *pool)
+void DanmuManager::applyPool(Pool *pool, const PoolData &data)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([pool](){
-        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-        auto &sources=pool->sourcesTable;
-        for(auto &src:sources)
-            src.count=0;
-        int tableId=DanmuPoolNode::idHash(pool->id());
-        query.exec(QString("select * from danmu_%1 where PoolID='%2'").arg(tableId).arg(pool->id()));
-        int timeNo = query.record().indexOf("Time"),
-            dateNo=query.record().indexOf("Date"),
-            colorNo=query.record().indexOf("Color"),
-            modeNo=query.record().indexOf("Mode"),
-            sizeNo=query.record().indexOf("Size"),
-            sourceNo=query.record().indexOf("Source"),
-            userNo=query.record().indexOf("User"),
-            textNo=query.record().indexOf("Text");
-        while (query.next())
+    auto &sources=pool->sourcesTable;
+    for(auto &src:sources)
+        src.count=0;
+    const QString pid(pool->id());
+    pool->packedSources=data.packedSources;
+    pool->commentList.reserve(pool->commentList.size()+data.comments.size());
+    for(const auto &danmu:data.comments)
+    {
+        Q_ASSERT(sources.contains(danmu->source));
+        pool->assignId(danmu.data());
+        pool->setDelay(danmu.data());
+        sources[danmu->source].count++;
+        pool->commentList.append(danmu);
+    }
+    for(auto iter=data.chunkCount.cbegin();iter!=data.chunkCount.cend();++iter)
+    {
+        if(iter.value()<MaxPackChunks) continue;
+        QList<QSharedPointer<DanmuComment> > srcList;
+        for(const auto &danmu:pool->commentList)
         {
-            QString text=query.value(textNo).toString();
-            if(text.isEmpty()) continue;
-            DanmuComment *danmu=new DanmuComment();
-            danmu->color=query.value(colorNo).toInt();
-            danmu->date=query.value(dateNo).toLongLong();
-            int fontSizeLevel(query.value(sizeNo).toInt());
-            danmu->fontSizeLevel=DanmuComment::FontSizeLevel(fontSizeLevel<3 && fontSizeLevel>=0?fontSizeLevel:0);
-            danmu->sender=query.value(userNo).toString();
-            int type(query.value(modeNo).toInt());
-            danmu->type=DanmuComment::DanmuType(type<3 && type>=0?type:0);
-            danmu->source=query.value(sourceNo).toInt();
-            danmu->text=text;
-            danmu->originTime=query.value(timeNo).toInt();
-
-            Q_ASSERT(sources.contains(danmu->source));
-            pool->setDelay(danmu);
-            sources[danmu->source].count++;
-            pool->commentList.append(QSharedPointer<DanmuComment>(danmu));
+            if(danmu->source==iter.key()) srcList.append(danmu);
         }
+        repackSource(pid, iter.key(), srcList, false);
+    }
+    if(useSnapshot && !data.fromSnapshot)
+    {
+        const quint32 version=data.version;
+        QList<QSharedPointer<DanmuComment> > snapshotList(pool->commentList);
+        GlobalObjects::dbExecutor->readAsync("DanmuManager::writeSnapshot", [this,pid,version,snapshotList](){
+            //pool changed after loading, the list is outdated
+            if(getPoolVersion(pid)!=version) return false;
+            QString fileName(PoolSnapshot::fileName(pid, version));
+            if(!PoolSnapshot::write(fileName, version, snapshotList)) return false;
+            PoolSnapshot::removeFiles(pid, fileName);
+            return true;
+        }, DBExecutor::Background);
+    }
+}
+
+void DanmuManager::updatePool(Pool *pool, QList<DanmuComment *> &outList, int sourceId)
+{
+    GlobalObjects::dbExecutor->write("DanmuManager::updatePool", [pool,&outList,sourceId,this](){
+        downloadPoolDanmu(pool, outList, sourceId);
         return 0;
     });
 }
 
-void DanmuManager::updatePool(Pool *pool, QList<DanmuComment *> &outList, int sourceId)
+QFuture<QList<DanmuComment *> > DanmuManager::updatePoolAsync(Pool *pool, int sourceId)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([pool,&outList,sourceId,this](){
-        const auto &danmuHashSet=pool->getDanmuHashSet(sourceId);
-        if(sourceId==-1)
-        {
-            const auto &sourceTable=pool->sources();
-            for(const auto &src:sourceTable)
-            {
-                outList.append(updateSource(&src,danmuHashSet));
-            }
-        }
-        else
+    return GlobalObjects::dbExecutor->writeAsync("DanmuManager::updatePool", [pool,sourceId,this](){
+        QList<DanmuComment *> outList;
+        downloadPoolDanmu(pool, outList, sourceId);
+        return outList;
+    });
+}
+
+void DanmuManager::downloadPoolDanmu(Pool *pool, QList<DanmuComment *> &outList, int sourceId)
+{
+    if(sourceId==-1)
+    {
+        const auto &sourceTable=pool->sources();
+        for(const auto &src:sourceTable)
         {
-            outList.append(updateSource(&pool->sourcesTable[sourceId],danmuHashSet));
+            outList.append(updateSource(&src,pool->getDedupSet(src.id)));
         }
-        return 0;
-    });
+    }
+    else
+    {
+        outList.append(updateSource(&pool->sourcesTable[sourceId],pool->getDedupSet(sourceId)));
+    }
 }
 
 void DanmuManager::saveSource(const QString &pid, const DanmuSource *source, const QList<QSharedPointer<DanmuComment> > &danmuList)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    DanmuSource src;
-    if(source!=nullptr) src=*source;
-    task.RunOnce([pid,src,source,danmuList](){
-        QSqlDatabase db = GlobalObjects::getDB(GlobalObjects::Comment_DB);
-        QSqlQuery query(db);
-        db.transaction();
-        if(source)
+    bool packed=packedStorage;
+    if(packed)
+    {
+        Pool *pool=pools.value(pid,nullptr);
+        if(pool)
         {
-            query.prepare("insert into source(PoolID,ID,Title,Desc,ScriptId,ScriptData,Delay,Duration,TimeLine) values(?,?,?,?,?,?,?,?,?)");
-            query.bindValue(0,pid);
-            query.bindValue(1,src.id);
-            query.bindValue(2,src.title);
-            query.bindValue(3,src.desc);
-            query.bindValue(4,src.scriptId);
-            query.bindValue(5,src.scriptData);
-            query.bindValue(6,src.delay);
-            query.bindValue(7,src.duration);
-            query.bindValue(8,src.timelineStr());
-            query.exec();
+            for(const auto &danmu: danmuList)
+                pool->packedSources.insert(danmu->source);
         }
-        int tableId=DanmuPoolNode::idHash(pid);
-        query.prepare(QString("insert into danmu_%1(PoolID,Time,Date,Color,Mode,Size,Source,User,Text) values(?,?,?,?,?,?,?,?,?)").arg(tableId));
-        for(const auto &danmu: danmuList)
+    }
+    writeQueue->saveSource(pid, source, danmuList, packed);
+}
+
+void DanmuManager::flushWrites(bool shutdown)
+{
+    if(shutdown)
+    {
+        //deferred repacks are queued before the queue shuts down
+        QMutexLocker locker(&poolsLock);
+        for(Pool *pool:pools)
         {
-            if(danmu->text.isEmpty()) continue;
-            query.bindValue(0,pid);
-            query.bindValue(1,danmu->originTime);
-            query.bindValue(2,danmu->date);
-            query.bindValue(3,danmu->color);
-            query.bindValue(4,(int)danmu->type);
-            query.bindValue(5,(int)danmu->fontSizeLevel);
-            query.bindValue(6,danmu->source);
-            query.bindValue(7,danmu->sender);
-            query.bindValue(8,danmu->text);
-            query.exec();
+            PoolStateLock stateLock;
+            if(stateLock.tryLock(pool->id())) pool->repackSources();
         }
-        db.commit();
+    }
+    //queued without waiting, on shutdown workThread runs it before it quits
+    if(!shutdown && !writeQueue->hasPending()) return;
+    GlobalObjects::dbExecutor->writeOnce("DanmuManager::flushWrites", [this,shutdown](){
+        if(shutdown) writeQueue->shutdown();
+        else writeQueue->flush();
     });
 }
@@ -2,37 +2,66 @@
 #define DANMUMANAGER_H
 
 #include <QAbstractItemModel>
+#include <QFuture>
+#include <atomic>
 #include "../common.h"
-#include "Common/lrucache.h"
+#include "Common/shardedcache.h"
+#include "Common/titleindex.h"
+#include "danmufts.h"
 #include "nodeinfo.h"
 #include "MediaLibrary/animeinfo.h"
 class Pool;
+class PoolSnapshot;
+class QSqlQuery;
+class DanmuWriteQueue;
+class DanmuShardBalancer;
+class FileHasher;
 class DanmuManager : public QObject
 {
     Q_OBJECT
     friend class Pool;
     friend class PoolStateLock;
+    friend class DanmuShardBalancer;
 public:
     explicit DanmuManager(QObject *parent = nullptr);
     virtual ~DanmuManager();
+    //danmu count of each updated (pool, source)
+    typedef QMap<QPair<QString, int>, int> SourceCounts;
 public:
     Pool *getPool(const QString &pid, bool loadDanmu=true);
     Pool *getPool(const QString &animeTitle, EpType epType, double epIndex, bool loadDanmu=true);
-    void loadPoolInfo(QList<DanmuPoolNode *> &poolNodeList);
-    void deletePool(const QList<DanmuPoolNode *> &deleteList);
-    void updatePool(QList<DanmuPoolNode *> &updateList);
-    void exportPool(const QList<DanmuPoolNode *> &exportList, const QString &dir, bool useTimeline=true, bool applyBlockRule=false);
-    void exportKdFile(const QList<DanmuPoolNode *> &exportList, const QString &dir, const QString &comment="");
-    int importKdFile(const QString &fileName, QWidget *parent);
+    QFuture<Pool *> getPoolAsync(const QString &pid);
+    QFuture<QList<DanmuPoolNode *> > loadPoolInfo();
+    QFuture<QList<DanmuPoolNode *> > loadAnimePools(const QString &animeTitle);
+    QFuture<int> deletePool(const QList<DanmuPoolNode *> &deleteList);
+    QFuture<SourceCounts> updatePool(const QList<DanmuPoolNode *> &updateList);
+    QFuture<int> exportPool(const QList<DanmuPoolNode *> &exportList, const QString &dir, bool useTimeline=true, bool applyBlockRule=false);
+    QFuture<int> exportKdFile(const QList<DanmuPoolNode *> &exportList, const QString &dir, const QString &comment="");
+    QFuture<int> importKdFile(const QString &fileName, QWidget *parent);
     QStringList getMatchedFile16Md5(const QString &pid);
     QString createPool(const QString &animeTitle, EpType epType, double epIndex, const QString &epName="", const QString &fileHash="");
-    QString createPool(const QString &path, const MatchResult &match);
-    QString renamePool(const QString &pid, const QString &nAnimeTitle, EpType nType, double nIndex, const QString &nEpTitle);
+    QStringList createPools(const QList<MatchResult> &matches, const QStringList &fileHashes);
+    QFuture<QString> renamePool(const QString &pid, const QString &nAnimeTitle, EpType nType, double nIndex, const QString &nEpTitle);
     QString getFileHash(const QString &fileName);
+    QFuture<QString> getFileHashAsync(const QString &fileName);
+    inline FileHasher *hasher() const {return fileHasher;}
+    inline bool usePackedStorage() const {return packedStorage;}
+    void setPackedStorage(bool on);
+    QFuture<int> packAllPools();
+    QFuture<QString> benchmarkLoad(const QString &pid);
+    void flushWrites(bool shutdown=false);
+    int tableOf(const QString &pid);
+    inline int shardCount() const {return danmuShardCount.load();}
+    void setShardCount(int count);
+    QFuture<QString> shardStats();
+    inline bool useFullTextIndex() const {return fullTextIndex.load();}
+    QFuture<bool> setFullTextIndex(bool on);
+    void buildFullTextIndex();
+    QFuture<QList<DanmuFts::Hit> > searchDanmu(const QString &keyword, int offset, int limit);
+    QFuture<QString> fullTextStats();
 public:
-    void localSearch(const QString &keyword,  QList<AnimeLite> &results);
+    QFuture<QList<AnimeLite> > localSearch(const QString &keyword);
     void localMatch(const QString &path, MatchResult &result);
-    QString updateMatch(const QString &fileName, const MatchResult &newMatchInfo);
     void removeMatch(const QString &fileName);
 private:
     void setMatch(const QString &fileHash, const QString &poolId);
@@ -40,30 +69,86 @@ private:
 signals:
     void workerStateMessage(const QString &msg);
 private:
+    //checked part of the pool manager tree, copied on the gui thread for tasks on the writer lane
+    struct CheckedPool
+    {
+        QString anime, ep, pid;
+        bool whole;
+        QList<QPair<int, QString> > sources;
+    };
+    static QList<CheckedPool> checkedPools(const QList<DanmuPoolNode *> &nodeList);
+    //comments of a pool read on a db reader thread, added to the pool by applyPool on its own thread
+    struct PoolData
+    {
+        QList<QSharedPointer<DanmuComment> > comments;
+        QSet<int> packedSources;
+        QHash<int, int> chunkCount;
+        quint32 version=0;
+        bool fromSnapshot=false;
+    };
     void loadPool(Pool *pool);
+    PoolData readPool(const QString &pid);
+    QFuture<PoolData> readPoolAsync(const QString &pid);
+    void applyPool(Pool *pool, const PoolData &data);
+    template<typename Func>
+    auto readAfterFlush(const QString &name, Func task) -> QFuture<decltype(task())>;
     void updatePool(Pool *pool, QList<DanmuComment *> &outList, int sourceId=-1);
+    QFuture<QList<DanmuComment *> > updatePoolAsync(Pool *pool, int sourceId=-1);
+    void downloadPoolDanmu(Pool *pool, QList<DanmuComment *> &outList, int sourceId);
     QString getPoolId(const QString &animeTitle, EpType epType, double epIndex);
     void saveSource(const QString &pid, const DanmuSource *source, const QList<QSharedPointer<DanmuComment> > &danmuList);
     void deleteSource(const QString &pid, int sourceId);
-    void deleteDanmu(const QString &pid, const QSharedPointer<DanmuComment> danmu);
+    void deleteDanmu(const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList);
+    void repackSource(const QString &pid, int sourceId, const QList<QSharedPointer<DanmuComment> > &danmuList, bool contentChanged=true);
     void updateSourceTimeline(const QString &pid, const DanmuSource *sourceInfo);
     void updateSourceDelay(const QString &pid, const DanmuSource *sourceInfo);
-    QList<DanmuComment *> updateSource(const DanmuSource *sourceInfo, const QSet<QString> &danmuHashSet);
+    QList<DanmuComment *> updateSource(const DanmuSource *sourceInfo, QSet<quint64> &dedupSet);
+    void loadFingerprints(const QString &pid, int sourceId, QSet<quint64> &dedupSet);
+    bool importKdPool(QDataStream &ds);
 
 private:
-    void loadAllPool();
-    void refreshCache(Pool *newPool=nullptr);
+    Pool *findPool(const QString &pid);
+    void checkTables();
+    void migrateTables(bool countSources);
+    void createShardTables();
+    inline int targetShard(const QString &pid) const {return DanmuPoolNode::idHash(pid, danmuShardCount.load());}
+    static void setPoolShard(QSqlQuery &query, const QString &pid, int shard);
+    void cachePoolShard(const QString &pid, int shard);
+    quint32 getPoolVersion(const QString &pid);
+    QSharedPointer<PoolSnapshot> openSnapshot(const QString &pid, quint32 version);
     void deletePool(const QString &pid);
+    void loadAnimeIndex();
+    void refreshAnimeIndex(const QString &animeTitle);
+    void indexPoolText(const QString &pid);
 
 private:
-    QMap<QString,int> poolDanmuCacheInfo;
-    QSharedPointer<LRUCache<QString, Pool *>> poolCache;
+    QSharedPointer<ShardedLRUCache<QString, Pool *>> poolCache;
+    //pools looked up so far, loaded on demand by findPool
     QMap<QString,Pool *> pools;
     QMutex poolsLock{QMutex::Recursive};
     QReadWriteLock poolStateLock;
     QSet<QString> busyPoolSet;
-    bool countInited;
-    const int DanmuTableCount=5;
+    bool packedStorage;
+    bool useSnapshot;
+    DanmuWriteQueue *writeQueue;
+    DanmuShardBalancer *shardBalancer;
+    FileHasher *fileHasher;
+    //danmu_0..danmu_{tableCount-1} exist, new pools go to the first danmuShardCount tables
+    //both are set on the writer lane and read from the gui and reader threads
+    std::atomic<int> danmuShardCount;
+    std::atomic<int> tableCount;
+    QHash<QString, int> poolShards;
+    QMutex shardLock;
+    //anime titles of all pools, loaded on first search
+    TitleIndex animeIndex;
+    bool animeIndexLoaded;
+    QMutex animeIndexLock;
+    //comment text index, see danmufts.h
+    std::atomic<bool> fullTextIndex;
+    std::atomic<bool> tablesMigrating;
+    QAtomicInt ftsIndexedPools, ftsPendingPools;
+    QAtomicInteger<qint64> ftsIndexedRows, ftsIndexTime;
+    const int MaxPackChunks=8;
 };
 class PoolStateLock
 {
@@ -0,0 +1,222 @@
+#include "danmupack.h"
+namespace
+{
+    const char packMagic[4] = {'K','D','P','K'};
+
+    inline void writeVarint(QByteArray &buf, quint64 val)
+    {
+        while(val >= 0x80)
+        {
+            buf.append(char((val & 0x7f) | 0x80));
+            val >>= 7;
+        }
+        buf.append(char(val));
+    }
+    inline quint64 zigzag(qint64 val)
+    {
+        return (quint64(val) << 1) ^ quint64(val >> 63);
+    }
+    inline qint64 unzigzag(quint64 val)
+    {
+        return qint64(val >> 1) ^ -qint64(val & 1);
+    }
+
+    struct Reader
+    {
+        const uchar *p, *end;
+        bool ok = true;
+        Reader(const QByteArray &data):p(reinterpret_cast<const uchar *>(data.constData())), end(p + data.size()){}
+        quint64 varint()
+        {
+            quint64 val = 0;
+            int shift = 0;
+            while(p < end && shift < 64)
+            {
+                uchar b = *p++;
+                val |= quint64(b & 0x7f) << shift;
+                if(!(b & 0x80)) return val;
+                shift += 7;
+            }
+            ok = false;
+            return 0;
+        }
+        const char *bytes(int len)
+        {
+            if(len < 0 || end - p < len)
+            {
+                ok = false;
+                return nullptr;
+            }
+            const char *s = reinterpret_cast<const char *>(p);
+            p += len;
+            return s;
+        }
+    };
+
+    template<typename T>
+    QByteArray encodeList(const QList<T> &danmuList)
+    {
+        QList<const DanmuComment *> sorted;
+        sorted.reserve(danmuList.size());
+        for(const auto &danmu : danmuList)
+        {
+            if(danmu->text.isEmpty()) continue;
+            sorted.append(&*danmu);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const DanmuComment *d1, const DanmuComment *d2){
+            return d1->originTime < d2->originTime;
+        });
+
+        QHash<quint64, int> styleIndex;
+        QList<quint64> styles;
+        QHash<QString, int> senderIndex;
+        QStringList senders;
+        QByteArray timeCol, dateCol, styleCol, senderCol, lenCol, fingerprintCol, textArena;
+        fingerprintCol.reserve(sorted.size() * sizeof(quint64));
+        qint64 lastTime = 0, lastDate = 0;
+        for(const DanmuComment *danmu : sorted)
+        {
+            quint64 style = (quint64(quint32(danmu->color)) << 16) | (quint64(danmu->type & 0xff) << 8) | quint64(danmu->fontSizeLevel & 0xff);
+            int sIndex = styleIndex.value(style, -1);
+            if(sIndex == -1)
+            {
+                sIndex = styles.size();
+                styles.append(style);
+                styleIndex.insert(style, sIndex);
+            }
+            int uIndex = senderIndex.value(danmu->sender, -1);
+            if(uIndex == -1)
+            {
+                uIndex = senders.size();
+                senders.append(danmu->sender);
+                senderIndex.insert(danmu->sender, uIndex);
+            }
+            QByteArray text(danmu->text.toUtf8());
+            writeVarint(timeCol, zigzag(danmu->originTime - lastTime));
+            writeVarint(dateCol, zigzag(danmu->date - lastDate));
+            writeVarint(styleCol, sIndex);
+            writeVarint(senderCol, uIndex);
+            writeVarint(lenCol, text.size());
+            const quint64 fingerprint = qToLittleEndian(danmu->getFingerprint());
+            fingerprintCol.append(reinterpret_cast<const char *>(&fingerprint), sizeof(quint64));
+            textArena.append(text);
+            lastTime = danmu->originTime;
+            lastDate = danmu->date;
+        }
+
+        QByteArray payload;
+        payload.reserve(timeCol.size() + dateCol.size() + styleCol.size() + senderCol.size() + lenCol.size() + fingerprintCol.size() + textArena.size() + 64);
+        writeVarint(payload, sorted.size());
+        writeVarint(payload, styles.size());
+        for(quint64 style : styles)
+        {
+            writeVarint(payload, style >> 16);
+            payload.append(char((style >> 8) & 0xff));
+            payload.append(char(style & 0xff));
+        }
+        writeVarint(payload, senders.size());
+        for(const QString &sender : senders)
+        {
+            QByteArray s(sender.toUtf8());
+            writeVarint(payload, s.size());
+            payload.append(s);
+        }
+        payload.append(timeCol).append(dateCol).append(styleCol).append(senderCol).append(lenCol).append(fingerprintCol).append(textArena);
+
+        QByteArray blob(packMagic, 4);
+        blob.append(char(DanmuPack::version));
+        blob.append(qCompress(payload));
+        return blob;
+    }
+}
+
+QByteArray DanmuPack::encode(const QList<QSharedPointer<DanmuComment> > &danmuList)
+{
+    return encodeList(danmuList);
+}
+
+QByteArray DanmuPack::encode(const QList<DanmuComment *> &danmuList)
+{
+    return encodeList(danmuList);
+}
+
+bool DanmuPack::decode(const QByteArray &blob, int source, QList<DanmuComment *> &danmuList)
+{
+    if(blob.size() < 5 || memcmp(blob.constData(), packMagic, 4) != 0) return false;
+    const quint8 blobVersion = quint8(blob.at(4));
+    if(blobVersion > version) return false;
+    QByteArray payload(qUncompress(reinterpret_cast<const uchar *>(blob.constData()) + 5, blob.size() - 5));
+    if(payload.isEmpty()) return false;
+
+    Reader r(payload);
+    const int count = r.varint();
+    const int styleCount = r.varint();
+    if(!r.ok || count < 0 || styleCount < 0 || count > payload.size()) return false;
+    QVector<int> colors(styleCount), types(styleCount), sizes(styleCount);
+    for(int i = 0; i < styleCount && r.ok; ++i)
+    {
+        colors[i] = int(quint32(r.varint()));
+        const char *ts = r.bytes(2);
+        if(!ts) return false;
+        types[i] = quint8(ts[0]) < 3 ? quint8(ts[0]) : 0;
+        sizes[i] = quint8(ts[1]) < 3 ? quint8(ts[1]) : 0;
+    }
+    const int senderCount = r.varint();
+    if(!r.ok || senderCount < 0) return false;
+    QVector<QString> senders(senderCount);
+    for(int i = 0; i < senderCount && r.ok; ++i)
+    {
+        int len = r.varint();
+        const char *s = r.bytes(len);
+        if(s) senders[i] = QString::fromUtf8(s, len);
+    }
+    if(!r.ok) return false;
+
+    QVector<qint64> times(count), dates(count);
+    QVector<int> styleIds(count), senderIds(count), lens(count);
+    qint64 lastTime = 0, lastDate = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        lastTime += unzigzag(r.varint());
+        times[i] = lastTime;
+    }
+    for(int i = 0; i < count; ++i)
+    {
+        lastDate += unzigzag(r.varint());
+        dates[i] = lastDate;
+    }
+    for(int i = 0; i < count; ++i) styleIds[i] = r.varint();
+    for(int i = 0; i < count; ++i) senderIds[i] = r.varint();
+    for(int i = 0; i < count; ++i) lens[i] = r.varint();
+    if(!r.ok) return false;
+    const char *fingerprints = blobVersion >= 2 ? r.bytes(count * sizeof(quint64)) : nullptr;
+    if(!r.ok) return false;
+
+    QList<DanmuComment *> decoded;
+    decoded.reserve(count);
+    for(int i = 0; i < count; ++i)
+    {
+        const char *text = r.bytes(lens[i]);
+        if(!text || styleIds[i] >= styleCount || senderIds[i] >= senderCount)
+        {
+            qDeleteAll(decoded);
+            return false;
+        }
+        DanmuComment *danmu = new DanmuComment;
+        danmu->text = QString::fromUtf8(text, lens[i]);
+        danmu->sender = senders[senderIds[i]];
+        danmu->color = colors[styleIds[i]];
+        danmu->type = DanmuComment::DanmuType(types[styleIds[i]]);
+        danmu->fontSizeLevel = DanmuComment::FontSizeLevel(sizes[styleIds[i]]);
+        danmu->date = dates[i];
+        danmu->originTime = times[i];
+        danmu->source = source;
+        if(fingerprints)
+            danmu->fingerprint = qFromLittleEndian<quint64>(reinterpret_cast<const uchar *>(fingerprints + i * sizeof(quint64)));
+        else
+            danmu->updateFingerprint();
+        decoded.append(danmu);
+    }
+    danmuList.append(decoded);
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef DANMUPACK_H
+#define DANMUPACK_H
+#include <QtCore>
+#include "../common.h"
+/*
+ * Packed storage for the comments of one (PoolID, Source) chunk.
+ * Blob layout: "KDPK" + version + qCompress(payload)
+ * payload:
+ *   count, style dict(color,type,size), sender dict,
+ *   time column(zigzag delta), date column(zigzag delta),
+ *   style index column, sender index column, text length column,
+ *   fingerprint column(8 bytes LE, since version 2), text arena(utf8)
+ * All integers are varint encoded.
+ */
+namespace DanmuPack
+{
+    const quint8 version = 2;
+    QByteArray encode(const QList<QSharedPointer<DanmuComment> > &danmuList);
+    QByteArray encode(const QList<DanmuComment *> &danmuList);
+    bool decode(const QByteArray &blob, int source, QList<DanmuComment *> &danmuList);
+}
+#endif // DANMUPACK_H
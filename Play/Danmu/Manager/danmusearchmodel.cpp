@@ -0,0 +1,86 @@
+#include "danmusearchmodel.h"
+#include "danmumanager.h"
+#include "globalobjects.h"
+#include "Common/asynctask.h"
+
+DanmuSearchModel::DanmuSearchModel(QObject *parent) : QAbstractTableModel(parent), currentOffset(0), searchId(0), hasMoreHits(false), isFetching(false)
+{
+
+}
+
+void DanmuSearchModel::search(const QString &keyword)
+{
+    beginResetModel();
+    hitList.clear();
+    this->keyword = keyword;
+    ++searchId;
+    currentOffset = 0;
+    hasMoreHits = !keyword.trimmed().isEmpty();
+    isFetching = false;
+    endResetModel();
+    if(hasMoreHits) fetchMore(QModelIndex());
+}
+
+const DanmuFts::Hit *DanmuSearchModel::getHit(int row) const
+{
+    if(row<0 || row>=hitList.count()) return nullptr;
+    return &hitList.at(row);
+}
+
+QVariant DanmuSearchModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) return QVariant();
+    const DanmuFts::Hit &hit = hitList.at(index.row());
+    Columns col=static_cast<Columns>(index.column());
+    if(role==Qt::DisplayRole || role==Qt::ToolTipRole)
+    {
+        switch (col)
+        {
+        case Columns::EPISODE:
+            return QString("%1 %2").arg(hit.anime, hit.ep.toString());
+        case Columns::TIME:
+        {
+            int sec = hit.time/1000;
+            return QString("%1:%2").arg(sec/60,2,10,QChar('0')).arg(sec%60,2,10,QChar('0'));
+        }
+        case Columns::TEXT:
+            return hit.text;
+        default:
+            break;
+        }
+    }
+    return QVariant();
+}
+
+QVariant DanmuSearchModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role == Qt::DisplayRole && orientation == Qt::Horizontal)
+    {
+        if(section<headers.size())return headers.at(section);
+    }
+    return QVariant();
+}
+
+void DanmuSearchModel::fetchMore(const QModelIndex &)
+{
+    if(isFetching || !hasMoreHits) return;
+    isFetching=true;
+    emit fetching(true);
+    const int id(searchId);
+    latency.start();
+    Async::then(GlobalObjects::danmuManager->searchDanmu(keyword,currentOffset,limitCount), this, [this, id](const QList<DanmuFts::Hit> &moreHits){
+        //searched again while fetching
+        if(id!=searchId) return;
+        isFetching=false;
+        emit fetching(false);
+        hasMoreHits=(moreHits.count()==limitCount);
+        if(moreHits.count()>0)
+        {
+            beginInsertRows(QModelIndex(),hitList.count(),hitList.count()+moreHits.count()-1);
+            hitList.append(moreHits);
+            endInsertRows();
+            currentOffset+=moreHits.count();
+        }
+        emit searchInfo(tr("%1%2 results, %3 ms").arg(hitList.count()).arg(hasMoreHits?"+":"").arg(latency.elapsed()));
+    });
+}
@@ -0,0 +1,44 @@
+#ifndef DANMUSEARCHMODEL_H
+#define DANMUSEARCHMODEL_H
+#include <QAbstractTableModel>
+#include <QElapsedTimer>
+#include "danmufts.h"
+class DanmuSearchModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    explicit DanmuSearchModel(QObject *parent = nullptr);
+    enum class Columns
+    {
+        EPISODE,
+        TIME,
+        TEXT,
+        NONE
+    };
+
+    void search(const QString &keyword);
+    const DanmuFts::Hit *getHit(int row) const;
+signals:
+    void fetching(bool);
+    void searchInfo(const QString &info);
+private:
+    QString keyword;
+    const int limitCount=100;
+    int currentOffset;
+    int searchId;
+    bool hasMoreHits;
+    bool isFetching;
+    QElapsedTimer latency;
+    QList<DanmuFts::Hit> hitList;
+    const QStringList headers={tr("Episode"),tr("Time"),tr("Danmu")};
+    // QAbstractItemModel interface
+public:
+    virtual int rowCount(const QModelIndex &parent) const override{return parent.isValid()?0:hitList.count();}
+    virtual int columnCount(const QModelIndex &parent) const override{return parent.isValid()?0:static_cast<int>(Columns::NONE);}
+    virtual QVariant data(const QModelIndex &index, int role) const override;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
+    virtual void fetchMore(const QModelIndex &) override;
+    virtual bool canFetchMore(const QModelIndex &) const override {return hasMoreHits && !isFetching;}
+};
+
+#endif // DANMUSEARCHMODEL_H
@@ -0,0 +1,133 @@
+#include "danmushardbalancer.h"
+#include <QSqlQuery>
+#include <QSqlDatabase>
+#include <QTimer>
+#include "danmumanager.h"
+#include "danmuwritequeue.h"
+#include "pool.h"
+#include "Common/dbexecutor.h"
+#include "globalobjects.h"
+
+DanmuShardBalancer::DanmuShardBalancer(DanmuManager *manager, QThread *thread) : QObject(nullptr),
+    manager(manager), scanTable(0), scanning(false), running(0), movedPools(0), pendingCount(0), skippedPools(0), movedRows(0)
+{
+    stepTimer = new QTimer(this);
+    stepTimer->setSingleShot(true);
+    QObject::connect(stepTimer, &QTimer::timeout, this, &DanmuShardBalancer::step);
+    moveToThread(thread);
+}
+
+DanmuShardBalancer::Stat DanmuShardBalancer::stat()
+{
+    Stat s;
+    s.running = running.load() != 0;
+    s.movedPools = movedPools.load();
+    s.movedRows = movedRows.load();
+    s.pendingPools = pendingCount.load();
+    s.skippedPools = skippedPools.load();
+    return s;
+}
+
+void DanmuShardBalancer::start()
+{
+    if(running.load()) return;
+    running.store(1);
+    scanTable = 0;
+    skippedPools.store(0);
+    pendingPools.clear();
+    qInfo() << "shard rebalance scheduled, shard count:" << manager->danmuShardCount.load();
+    stepTimer->start(startDelay);
+}
+
+void DanmuShardBalancer::stop()
+{
+    stepTimer->stop();
+    pendingPools.clear();
+    pendingCount.store(0);
+    running.store(0);
+}
+
+void DanmuShardBalancer::step()
+{
+    if(!running.load() || scanning) return;
+    if(pendingPools.isEmpty())
+    {
+        if(scanTable >= manager->tableCount) finish();
+        else scanNextTable();
+        return;
+    }
+    if(!migrate(pendingPools.takeFirst())) skippedPools.ref();
+    pendingCount.store(pendingPools.size());
+    stepTimer->start(stepInterval);
+}
+
+void DanmuShardBalancer::scanNextTable()
+{
+    const int table = scanTable++;
+    DanmuManager *manager = this->manager;
+    scanning = true;
+    auto future = GlobalObjects::dbExecutor->readAsync("DanmuShardBalancer::scan", [manager, table](){
+        QStringList misplaced;
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.exec(QString("select distinct PoolID from danmu_%1").arg(table));
+        while (query.next())
+        {
+            QString pid(query.value(0).toString());
+            if(manager->tableOf(pid) == table && manager->targetShard(pid) != table)
+                misplaced << pid;
+        }
+        return misplaced;
+    }, DBExecutor::Background);
+    Async::then(future, this, [this](const QStringList &misplaced){
+        scanning = false;
+        pendingPools = misplaced;
+        pendingCount.store(pendingPools.size());
+        if(running.load()) stepTimer->start(stepInterval);
+    });
+}
+
+bool DanmuShardBalancer::migrate(const QString &pid)
+{
+    const int fromTable = manager->tableOf(pid), toTable = manager->targetShard(pid);
+    if(fromTable == toTable) return true;
+    {
+        QMutexLocker locker(&manager->poolsLock);
+        Pool *pool = manager->pools.value(pid, nullptr);
+        if(pool && pool->isUsed()) return false;
+    }
+    PoolStateLock lock;
+    if(!lock.tryLock(pid)) return false;
+    //pending rows of the pool go to the old table first, then move with the rest
+    manager->writeQueue->flush();
+    QSqlDatabase db = GlobalObjects::getDB(GlobalObjects::Comment_DB);
+    QSqlQuery query(db);
+    db.transaction();
+    query.prepare(QString("insert into danmu_%1 select * from danmu_%2 where PoolID=?").arg(toTable).arg(fromTable));
+    query.bindValue(0,pid);
+    query.exec();
+    const int rows = query.numRowsAffected();
+    query.prepare(QString("delete from danmu_%1 where PoolID=?").arg(fromTable));
+    query.bindValue(0,pid);
+    query.exec();
+    //rowids change with the table, snapshots keeping them are outdated
+    DanmuWriteQueue::bumpPoolVersion(query, pid);
+    DanmuManager::setPoolShard(query, pid, toTable);
+    if(!db.commit())
+    {
+        db.rollback();
+        return false;
+    }
+    manager->cachePoolShard(pid, toTable);
+    movedPools.ref();
+    movedRows.fetchAndAddRelaxed(rows);
+    return true;
+}
+
+void DanmuShardBalancer::finish()
+{
+    running.store(0);
+    if(skippedPools.load() == 0)
+        GlobalObjects::appSetting->setValue("DanmuManager/BalancedShardCount", manager->danmuShardCount.load());
+    qInfo() << "shard rebalance finished, moved pools:" << movedPools.load() << "rows:" << movedRows.load()
+            << "skipped:" << skippedPools.load();
+}
@@ -0,0 +1,53 @@
+#ifndef DANMUSHARDBALANCER_H
+#define DANMUSHARDBALANCER_H
+#include <QObject>
+#include <QAtomicInt>
+#include <QStringList>
+class QTimer;
+class DanmuManager;
+/*
+ * Background rebalancer for the danmu_N tables.
+ * After the shard count changes, pools are moved to their target table one at a time,
+ * each pool in its own transaction on the queue thread (workThread), so writes are never held up for long.
+ * Tables are scanned on db reader threads, busy pools and pools in use are retried in the next pass.
+ */
+class DanmuShardBalancer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stat
+    {
+        bool running = false;
+        int movedPools = 0;
+        qint64 movedRows = 0;
+        int pendingPools = 0;
+        int skippedPools = 0;
+    };
+    explicit DanmuShardBalancer(DanmuManager *manager, QThread *thread);
+    Stat stat();
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void step();
+
+private:
+    DanmuManager *manager;
+    QTimer *stepTimer;
+    QStringList pendingPools;
+    int scanTable;
+    bool scanning;
+    QAtomicInt running, movedPools, pendingCount, skippedPools;
+    QAtomicInteger<qint64> movedRows;
+
+    const int startDelay = 30000;
+    const int stepInterval = 200;
+
+    void scanNextTable();
+    bool migrate(const QString &pid);
+    void finish();
+};
+
+#endif // DANMUSHARDBALANCER_H
@@ -0,0 +1,596 @@
+#include "danmuwritequeue.h"
+#include <QSqlQuery>
+#include <QSqlDatabase>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSqlError>
+#include <QDebug>
+#include "danmupack.h"
+#include "nodeinfo.h"
+#include "danmumanager.h"
+#include "globalobjects.h"
+
+DanmuWriteQueue::DanmuWriteQueue(QThread *thread) : QObject(nullptr),
+    pendingCommentCount(0), failedFlushes(0), flushScheduled(false), packChunkQuery(nullptr), packInsertQuery(nullptr)
+{
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(flushInterval);
+    QObject::connect(flushTimer, &QTimer::timeout, this, &DanmuWriteQueue::flush);
+    moveToThread(thread);
+}
+
+DanmuWriteQueue::~DanmuWriteQueue()
+{
+    releaseStatements();
+}
+
+void DanmuWriteQueue::saveSource(const QString &pid, const DanmuSource *source, const QList<QSharedPointer<DanmuComment> > &danmuList, bool packed)
+{
+    if(source)
+    {
+        Op op;
+        op.type = Op::InsertSource;
+        op.source = *source;
+        op.sourceId = source->id;
+        enqueue(pid, op);
+    }
+    if(danmuList.isEmpty()) return;
+    Op op;
+    op.type = Op::InsertDanmu;
+    op.danmuList = danmuList;
+    op.packed = packed;
+    enqueue(pid, op);
+}
+
+void DanmuWriteQueue::deleteSource(const QString &pid, int sourceId)
+{
+    Op op;
+    op.type = Op::DeleteSource;
+    op.sourceId = sourceId;
+    enqueue(pid, op);
+}
+
+void DanmuWriteQueue::deleteDanmu(const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList)
+{
+    if(danmuList.isEmpty()) return;
+    Op op;
+    op.type = Op::DeleteDanmu;
+    op.danmuList = danmuList;
+    enqueue(pid, op);
+}
+
+void DanmuWriteQueue::repackSource(const QString &pid, int sourceId, const QList<QSharedPointer<DanmuComment> > &danmuList, bool contentChanged)
+{
+    Op op;
+    op.type = Op::Repack;
+    op.sourceId = sourceId;
+    op.danmuList = danmuList;
+    op.contentChanged = contentChanged;
+    enqueue(pid, op);
+}
+
+void DanmuWriteQueue::updateSourceDelay(const QString &pid, int sourceId, int delay)
+{
+    Op op;
+    op.type = Op::UpdateDelay;
+    op.sourceId = sourceId;
+    op.delay = delay;
+    enqueue(pid, op);
+}
+
+void DanmuWriteQueue::updateSourceTimeline(const QString &pid, int sourceId, const QString &timeline)
+{
+    Op op;
+    op.type = Op::UpdateTimeline;
+    op.sourceId = sourceId;
+    op.timeline = timeline;
+    enqueue(pid, op);
+}
+
+DanmuWriteQueue::Metrics DanmuWriteQueue::metrics()
+{
+    QMutexLocker locker(&queueLock);
+    Metrics m(stat);
+    m.pendingPools = pendingOps.size();
+    m.pendingOps = 0;
+    for(const auto &ops : pendingOps) m.pendingOps += ops.size();
+    m.pendingComments = pendingCommentCount;
+    return m;
+}
+
+bool DanmuWriteQueue::hasPending()
+{
+    QMutexLocker locker(&queueLock);
+    return !pendingOps.isEmpty();
+}
+
+DanmuWriteQueue::PendingFingerprints DanmuWriteQueue::pendingFingerprints(const QString &pid, int sourceId)
+{
+    QList<Op> ops;
+    {
+        QMutexLocker locker(&queueLock);
+        ops = flushingOps.value(pid) + pendingOps.value(pid);
+    }
+    //the last op touching a fingerprint decides, so tables that already hold a part of the ops give the same set
+    PendingFingerprints pending;
+    for(const Op &op : ops)
+    {
+        if(op.sourceId != -1 && op.sourceId != sourceId) continue;
+        switch (op.type)
+        {
+        case Op::InsertDanmu:
+            for(const auto &danmu : op.danmuList)
+            {
+                if(danmu->source != sourceId) continue;
+                pending.added.insert(danmu->getFingerprint());
+                pending.removed.remove(danmu->getFingerprint());
+            }
+            break;
+        case Op::DeleteDanmu:
+            for(const auto &danmu : op.danmuList)
+            {
+                if(danmu->source != sourceId) continue;
+                pending.removed.insert(danmu->getFingerprint());
+                pending.added.remove(danmu->getFingerprint());
+            }
+            break;
+        case Op::DeleteSource:
+        case Op::Repack:
+            pending.reset = true;
+            pending.added.clear();
+            pending.removed.clear();
+            if(op.type == Op::Repack)
+            {
+                for(const auto &danmu : op.danmuList)
+                    pending.added.insert(danmu->getFingerprint());
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return pending;
+}
+
+void DanmuWriteQueue::PendingFingerprints::applyTo(QSet<quint64> &dedupSet) const
+{
+    if(reset) dedupSet.clear();
+    dedupSet.subtract(removed);
+    dedupSet.unite(added);
+}
+
+void DanmuWriteQueue::bumpPoolVersion(QSqlQuery &query, const QString &pid)
+{
+    query.prepare("update pool_version set Version=Version+1 where PoolID=?");
+    query.bindValue(0,pid);
+    query.exec();
+    if(query.numRowsAffected()>0) return;
+    query.prepare("insert into pool_version(PoolID,Version) values(?,1)");
+    query.bindValue(0,pid);
+    query.exec();
+}
+
+void DanmuWriteQueue::addSourceCount(QSqlQuery &query, const QString &pid, int sourceId, int delta)
+{
+    query.prepare("update source_count set Count=Count+? where PoolID=? and Source=?");
+    query.bindValue(0,delta);
+    query.bindValue(1,pid);
+    query.bindValue(2,sourceId);
+    query.exec();
+    if(query.numRowsAffected()>0) return;
+    query.prepare("insert into source_count(PoolID,Source,Count) values(?,?,?)");
+    query.bindValue(0,pid);
+    query.bindValue(1,sourceId);
+    query.bindValue(2,qMax(delta, 0));
+    query.exec();
+}
+
+void DanmuWriteQueue::flush()
+{
+    QHash<QString, QList<Op> > ops;
+    QStringList order;
+    {
+        QMutexLocker locker(&queueLock);
+        flushScheduled = false;
+        if(pendingOps.isEmpty()) return;
+        ops.swap(pendingOps);
+        order.swap(poolOrder);
+        pendingCommentCount = 0;
+        flushingOps = ops;
+    }
+    if(flushTimer->isActive()) flushTimer->stop();
+    QElapsedTimer timer;
+    timer.start();
+    QSqlDatabase db = GlobalObjects::getDB(GlobalObjects::Comment_DB);
+    QSqlQuery query(db);
+    qint64 commentCount = 0;
+    db.transaction();
+    for(const QString &pid : order)
+    {
+        bool contentChanged = false;
+        for(const Op &op : ops[pid])
+        {
+            execOp(query, pid, op);
+            if(op.type == Op::InsertDanmu) commentCount += op.danmuList.size();
+            if(op.type == Op::InsertDanmu || op.type == Op::DeleteSource || op.type == Op::DeleteDanmu ||
+               (op.type == Op::Repack && op.contentChanged))
+                contentChanged = true;
+        }
+        if(contentChanged) bumpPoolVersion(query, pid);
+    }
+    if(!db.commit())
+    {
+        db.rollback();
+        QMutexLocker locker(&queueLock);
+        flushingOps.clear();
+        if(++failedFlushes > maxRetries)
+        {
+            qWarning() << "DanmuWriteQueue: dropped writes of" << order.size() << "pools," << db.lastError().text();
+            failedFlushes = 0;
+            return;
+        }
+        qWarning() << "DanmuWriteQueue: flush failed, retrying," << db.lastError().text();
+        //ops queued in the meantime stay after the failed ones of the same pool
+        for(const QString &pid : order)
+        {
+            QList<Op> &pending = pendingOps[pid];
+            pending = ops[pid] + pending;
+            poolOrder.removeAll(pid);
+        }
+        poolOrder = order + poolOrder;
+        pendingCommentCount += int(commentCount);
+        locker.unlock();
+        scheduleFlush(false);
+        return;
+    }
+    qint64 elapsed = timer.elapsed();
+    {
+        QMutexLocker locker(&queueLock);
+        flushingOps.clear();
+        failedFlushes = 0;
+        ++stat.flushCount;
+        stat.flushedComments += commentCount;
+        stat.lastFlushTime = elapsed;
+        stat.maxFlushTime = qMax(stat.maxFlushTime, elapsed);
+    }
+}
+
+void DanmuWriteQueue::shutdown()
+{
+    flush();
+    releaseStatements();
+}
+
+void DanmuWriteQueue::enqueue(const QString &pid, DanmuWriteQueue::Op &op)
+{
+    bool immediately = false;
+    {
+        QMutexLocker locker(&queueLock);
+        auto iter = pendingOps.find(pid);
+        if(iter == pendingOps.end())
+        {
+            iter = pendingOps.insert(pid, QList<Op>());
+            poolOrder.append(pid);
+        }
+        QList<Op> &ops = iter.value();
+        bool merged = false;
+        switch (op.type)
+        {
+        case Op::InsertDanmu:
+            if(!ops.isEmpty() && ops.last().type == Op::InsertDanmu && ops.last().packed == op.packed)
+            {
+                ops.last().danmuList.append(op.danmuList);
+                merged = true;
+            }
+            pendingCommentCount += op.danmuList.size();
+            break;
+        case Op::UpdateDelay:
+        case Op::UpdateTimeline:
+            for(Op &pending : ops)
+            {
+                if(pending.type == op.type && pending.sourceId == op.sourceId)
+                {
+                    pending.delay = op.delay;
+                    pending.timeline = op.timeline;
+                    merged = true;
+                    break;
+                }
+            }
+            break;
+        case Op::Repack:
+            //a later repack rewrites the whole source
+            for(auto opIter = ops.begin(); opIter != ops.end();)
+            {
+                if(opIter->type == Op::Repack && opIter->sourceId == op.sourceId)
+                {
+                    op.contentChanged = op.contentChanged || opIter->contentChanged;
+                    opIter = ops.erase(opIter);
+                }
+                else
+                    ++opIter;
+            }
+            break;
+        default:
+            break;
+        }
+        if(!merged) ops.append(op);
+        immediately = pendingCommentCount > maxBacklog;
+    }
+    scheduleFlush(immediately);
+}
+
+void DanmuWriteQueue::scheduleFlush(bool immediately)
+{
+    {
+        QMutexLocker locker(&queueLock);
+        if(flushScheduled && !immediately) return;
+        flushScheduled = true;
+    }
+    QMetaObject::invokeMethod(this, [this, immediately](){
+        if(immediately) flush();
+        else if(!flushTimer->isActive()) flushTimer->start();
+    }, Qt::QueuedConnection);
+}
+
+QSqlQuery *DanmuWriteQueue::insertQuery(int tableId, int rows)
+{
+    QHash<int, QSqlQuery *> &queries = rows == 1 ? singleInsertQuery : batchInsertQuery;
+    QSqlQuery *query = queries.value(tableId, nullptr);
+    if(query) return query;
+    QStringList values;
+    for(int i = 0; i < rows; ++i) values << "(?,?,?,?,?,?,?,?,?,?)";
+    query = new QSqlQuery(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+    query->prepare(QString("insert into danmu_%1(PoolID,Time,Date,Color,Mode,Size,Source,User,Text,Hash) values %2").arg(tableId).arg(values.join(',')));
+    queries.insert(tableId, query);
+    return query;
+}
+
+QSqlQuery *DanmuWriteQueue::deleteQuery(int tableId, DeleteKey key)
+{
+    QHash<int, QSqlQuery *> &queries = deleteQueries[key];
+    QSqlQuery *query = queries.value(tableId, nullptr);
+    if(query) return query;
+    query = new QSqlQuery(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+    //every statement removes at most one row, identical copies are separate comments
+    switch (key)
+    {
+    case ByRowId:
+        query->prepare(QString("delete from danmu_%1 where rowid=? and PoolID=? and Source=? and Text=?").arg(tableId));
+        break;
+    case ByHash:
+        query->prepare(QString("delete from danmu_%1 where rowid=(select rowid from danmu_%1 where Hash=? and PoolID=? and Source=? limit 1)").arg(tableId));
+        break;
+    case ByContent:
+        query->prepare(QString("delete from danmu_%1 where rowid=(select rowid from danmu_%1 where PoolID=? and Source=? and Hash is null "
+                               "and Date=? and User=? and Text=? limit 1)").arg(tableId));
+        break;
+    }
+    queries.insert(tableId, query);
+    return query;
+}
+
+void DanmuWriteQueue::releaseStatements()
+{
+    qDeleteAll(batchInsertQuery);
+    batchInsertQuery.clear();
+    qDeleteAll(singleInsertQuery);
+    singleInsertQuery.clear();
+    for(auto &queries : deleteQueries)
+    {
+        qDeleteAll(queries);
+        queries.clear();
+    }
+    delete packChunkQuery;
+    packChunkQuery = nullptr;
+    delete packInsertQuery;
+    packInsertQuery = nullptr;
+}
+
+void DanmuWriteQueue::insertRows(const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList)
+{
+    QList<QSharedPointer<DanmuComment> > rows;
+    rows.reserve(danmuList.size());
+    for(const auto &danmu : danmuList)
+    {
+        if(!danmu->text.isEmpty()) rows.append(danmu);
+    }
+    const int tableId = GlobalObjects::danmuManager->tableOf(pid);
+    int pos = 0;
+    while(pos < rows.size())
+    {
+        const int n = rows.size() - pos >= rowsPerStatement ? rowsPerStatement : 1;
+        QSqlQuery *query = insertQuery(tableId, n);
+        for(int i = 0; i < n; ++i)
+        {
+            const auto &danmu = rows.at(pos + i);
+            const int base = i * 10;
+            query->bindValue(base + 0, pid);
+            query->bindValue(base + 1, danmu->originTime);
+            query->bindValue(base + 2, danmu->date);
+            query->bindValue(base + 3, danmu->color);
+            query->bindValue(base + 4, (int)danmu->type);
+            query->bindValue(base + 5, (int)danmu->fontSizeLevel);
+            query->bindValue(base + 6, danmu->source);
+            query->bindValue(base + 7, danmu->sender);
+            query->bindValue(base + 8, danmu->text);
+            query->bindValue(base + 9, qint64(danmu->getFingerprint()));
+        }
+        query->exec();
+        pos += n;
+    }
+}
+
+void DanmuWriteQueue::insertPacks(const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList)
+{
+    if(!packChunkQuery)
+    {
+        QSqlDatabase db = GlobalObjects::getDB(GlobalObjects::Comment_DB);
+        packChunkQuery = new QSqlQuery(db);
+        packChunkQuery->prepare("select max(Chunk) from danmu_pack where PoolID=? and Source=?");
+        packInsertQuery = new QSqlQuery(db);
+        packInsertQuery->prepare("insert into danmu_pack(PoolID,Source,Chunk,Count,Data) values(?,?,?,?,?)");
+    }
+    QHash<int, QList<QSharedPointer<DanmuComment> > > sourceDanmu;
+    for(const auto &danmu : danmuList)
+        sourceDanmu[danmu->source].append(danmu);
+    for(auto iter = sourceDanmu.cbegin(); iter != sourceDanmu.cend(); ++iter)
+    {
+        packChunkQuery->bindValue(0, pid);
+        packChunkQuery->bindValue(1, iter.key());
+        packChunkQuery->exec();
+        int chunk = (packChunkQuery->first() && !packChunkQuery->value(0).isNull()) ? packChunkQuery->value(0).toInt() + 1 : 0;
+        packChunkQuery->finish();
+        packInsertQuery->bindValue(0, pid);
+        packInsertQuery->bindValue(1, iter.key());
+        packInsertQuery->bindValue(2, chunk);
+        packInsertQuery->bindValue(3, iter.value().size());
+        packInsertQuery->bindValue(4, DanmuPack::encode(iter.value()));
+        packInsertQuery->exec();
+    }
+}
+
+void DanmuWriteQueue::execOp(QSqlQuery &query, const QString &pid, const DanmuWriteQueue::Op &op)
+{
+    const int tableId = GlobalObjects::danmuManager->tableOf(pid);
+    switch (op.type)
+    {
+    case Op::InsertSource:
+    {
+        const DanmuSource &src = op.source;
+        query.prepare("insert into source(PoolID,ID,Title,Desc,ScriptId,ScriptData,Delay,Duration,TimeLine) values(?,?,?,?,?,?,?,?,?)");
+        query.bindValue(0,pid);
+        query.bindValue(1,src.id);
+        query.bindValue(2,src.title);
+        query.bindValue(3,src.desc);
+        query.bindValue(4,src.scriptId);
+        query.bindValue(5,src.scriptData);
+        query.bindValue(6,src.delay);
+        query.bindValue(7,src.duration);
+        query.bindValue(8,src.timelineStr());
+        query.exec();
+        break;
+    }
+    case Op::InsertDanmu:
+    {
+        if(op.packed) insertPacks(pid, op.danmuList);
+        else insertRows(pid, op.danmuList);
+        QHash<int, int> sourceCount;
+        for(const auto &danmu : op.danmuList)
+            ++sourceCount[danmu->source];
+        for(auto iter = sourceCount.cbegin(); iter != sourceCount.cend(); ++iter)
+            addSourceCount(query, pid, iter.key(), iter.value());
+        if(GlobalObjects::danmuManager->useFullTextIndex())
+            DanmuFts::addDanmu(query, pid, op.danmuList);
+        break;
+    }
+    case Op::DeleteSource:
+        query.prepare("delete from source where PoolID=? and ID=?");
+        query.bindValue(0,pid);
+        query.bindValue(1,op.sourceId);
+        query.exec();
+        query.prepare(QString("delete from danmu_%1 where PoolID=? and Source=?").arg(tableId));
+        query.bindValue(0,pid);
+        query.bindValue(1,op.sourceId);
+        query.exec();
+        query.prepare("delete from danmu_pack where PoolID=? and Source=?");
+        query.bindValue(0,pid);
+        query.bindValue(1,op.sourceId);
+        query.exec();
+        query.prepare("delete from source_count where PoolID=? and Source=?");
+        query.bindValue(0,pid);
+        query.bindValue(1,op.sourceId);
+        query.exec();
+        if(GlobalObjects::danmuManager->useFullTextIndex())
+            DanmuFts::removeSource(query, pid, op.sourceId);
+        break;
+    case Op::DeleteDanmu:
+    {
+        QHash<int, int> sourceCount;
+        for(const auto &danmu : op.danmuList)
+        {
+            //comments loaded from rows carry their rowid, the text check skips rowids outdated by a shard move
+            int deleted = 0;
+            if(danmu->rowId > 0)
+            {
+                QSqlQuery *rowQuery = deleteQuery(tableId, ByRowId);
+                rowQuery->bindValue(0,danmu->rowId);
+                rowQuery->bindValue(1,pid);
+                rowQuery->bindValue(2,danmu->source);
+                rowQuery->bindValue(3,danmu->text);
+                rowQuery->exec();
+                deleted = rowQuery->numRowsAffected();
+            }
+            //newly added comments have no rowid yet, one row with the same Hash goes instead
+            if(deleted <= 0)
+            {
+                QSqlQuery *hashQuery = deleteQuery(tableId, ByHash);
+                hashQuery->bindValue(0,qint64(danmu->getFingerprint()));
+                hashQuery->bindValue(1,pid);
+                hashQuery->bindValue(2,danmu->source);
+                hashQuery->exec();
+                deleted = hashQuery->numRowsAffected();
+            }
+            //rows written before the Hash column are matched by content
+            if(deleted <= 0)
+            {
+                QSqlQuery *contentQuery = deleteQuery(tableId, ByContent);
+                contentQuery->bindValue(0,pid);
+                contentQuery->bindValue(1,danmu->source);
+                contentQuery->bindValue(2,danmu->date);
+                contentQuery->bindValue(3,danmu->sender);
+                contentQuery->bindValue(4,danmu->text);
+                contentQuery->exec();
+                deleted = contentQuery->numRowsAffected();
+            }
+            if(deleted > 0) sourceCount[danmu->source] += deleted;
+        }
+        if(GlobalObjects::danmuManager->useFullTextIndex())
+            DanmuFts::removeDanmu(query, pid, op.danmuList);
+        for(auto iter = sourceCount.cbegin(); iter != sourceCount.cend(); ++iter)
+            addSourceCount(query, pid, iter.key(), -iter.value());
+        break;
+    }
+    case Op::Repack:
+        query.prepare(QString("delete from danmu_%1 where PoolID=? and Source=?").arg(tableId));
+        query.bindValue(0,pid);
+        query.bindValue(1,op.sourceId);
+        query.exec();
+        query.prepare("delete from danmu_pack where PoolID=? and Source=?");
+        query.bindValue(0,pid);
+        query.bindValue(1,op.sourceId);
+        query.exec();
+        query.prepare("insert into danmu_pack(PoolID,Source,Chunk,Count,Data) values(?,?,?,?,?)");
+        query.bindValue(0,pid);
+        query.bindValue(1,op.sourceId);
+        query.bindValue(2,0);
+        query.bindValue(3,op.danmuList.size());
+        query.bindValue(4,DanmuPack::encode(op.danmuList));
+        query.exec();
+        query.prepare("insert or replace into source_count(PoolID,Source,Count) values(?,?,?)");
+        query.bindValue(0,pid);
+        query.bindValue(1,op.sourceId);
+        query.bindValue(2,op.danmuList.size());
+        query.exec();
+        if(op.contentChanged && GlobalObjects::danmuManager->useFullTextIndex())
+        {
+            DanmuFts::removeSource(query, pid, op.sourceId);
+            DanmuFts::addDanmu(query, pid, op.danmuList);
+        }
+        break;
+    case Op::UpdateDelay:
+        query.prepare("update source set Delay= ? where PoolID=? and ID=?");
+        query.bindValue(0,op.delay);
+        query.bindValue(1,pid);
+        query.bindValue(2,op.sourceId);
+        query.exec();
+        break;
+    case Op::UpdateTimeline:
+        query.prepare("update source set TimeLine= ? where PoolID=? and ID=?");
+        query.bindValue(0,op.timeline);
+        query.bindValue(1,pid);
+        query.bindValue(2,op.sourceId);
+        query.exec();
+        break;
+    }
+}
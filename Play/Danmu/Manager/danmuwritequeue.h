@@ -0,0 +1,113 @@
+#ifndef DANMUWRITEQUEUE_H
+#define DANMUWRITEQUEUE_H
+#include <QObject>
+#include <QMutex>
+#include <QSet>
+#include "../common.h"
+class QSqlQuery;
+class QTimer;
+/*
+ * Write-behind queue for danmu persistence.
+ * Producers only append to the in-memory queue, the writes of each pool are coalesced
+ * and flushed in one transaction on the queue thread (workThread).
+ * Readers on the queue thread call flush() before querying danmu tables.
+ */
+class DanmuWriteQueue : public QObject
+{
+    Q_OBJECT
+public:
+    struct Metrics
+    {
+        int pendingPools = 0;
+        int pendingOps = 0;
+        int pendingComments = 0;
+        int flushCount = 0;
+        qint64 flushedComments = 0;
+        qint64 lastFlushTime = 0;
+        qint64 maxFlushTime = 0;
+    };
+    explicit DanmuWriteQueue(QThread *thread);
+    virtual ~DanmuWriteQueue();
+
+    void saveSource(const QString &pid, const DanmuSource *source, const QList<QSharedPointer<DanmuComment> > &danmuList, bool packed);
+    void deleteSource(const QString &pid, int sourceId);
+    void deleteDanmu(const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList);
+    void repackSource(const QString &pid, int sourceId, const QList<QSharedPointer<DanmuComment> > &danmuList, bool contentChanged);
+    void updateSourceDelay(const QString &pid, int sourceId, int delay);
+    void updateSourceTimeline(const QString &pid, int sourceId, const QString &timeline);
+    Metrics metrics();
+    bool hasPending();
+    //fingerprint changes of a source not committed yet, taken before reading the tables
+    struct PendingFingerprints
+    {
+        bool reset = false;
+        QSet<quint64> added, removed;
+        void applyTo(QSet<quint64> &dedupSet) const;
+    };
+    PendingFingerprints pendingFingerprints(const QString &pid, int sourceId);
+
+    static void bumpPoolVersion(QSqlQuery &query, const QString &pid);
+    //per (pool, source) danmu count in source_count, read by the pool manager instead of counting rows
+    static void addSourceCount(QSqlQuery &query, const QString &pid, int sourceId, int delta);
+
+public slots:
+    //must be called in the queue thread
+    void flush();
+    void shutdown();
+
+private:
+    struct Op
+    {
+        enum Type
+        {
+            InsertSource,
+            InsertDanmu,
+            DeleteSource,
+            DeleteDanmu,
+            Repack,
+            UpdateDelay,
+            UpdateTimeline
+        };
+        Type type;
+        int sourceId = -1;
+        DanmuSource source;
+        QList<QSharedPointer<DanmuComment> > danmuList;
+        bool packed = false;
+        bool contentChanged = true;
+        int delay = 0;
+        QString timeline;
+    };
+    QMutex queueLock;
+    QHash<QString, QList<Op> > pendingOps, flushingOps;
+    QStringList poolOrder;
+    int pendingCommentCount;
+    int failedFlushes;
+    bool flushScheduled;
+    Metrics stat;
+    QTimer *flushTimer;
+
+    const int flushInterval = 500;
+    const int maxBacklog = 20000;
+    const int maxRetries = 3;
+    const int rowsPerStatement = 90;
+    QHash<int, QSqlQuery *> batchInsertQuery, singleInsertQuery;
+    enum DeleteKey
+    {
+        ByRowId,
+        ByHash,
+        ByContent
+    };
+    QHash<int, QSqlQuery *> deleteQueries[3];
+    QSqlQuery *packChunkQuery, *packInsertQuery;
+
+    void enqueue(const QString &pid, Op &op);
+    void scheduleFlush(bool immediately);
+    QSqlQuery *insertQuery(int tableId, int rows);
+    QSqlQuery *deleteQuery(int tableId, DeleteKey key);
+    void releaseStatements();
+    void insertRows(const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList);
+    void insertPacks(const QString &pid, const QList<QSharedPointer<DanmuComment> > &danmuList);
+    void execOp(QSqlQuery &query, const QString &pid, const Op &op);
+};
+
+#endif // DANMUWRITEQUEUE_H
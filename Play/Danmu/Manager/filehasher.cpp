@@ -0,0 +1,257 @@
+#include "filehasher.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThreadPool>
+#include <QStorageInfo>
+#include <QDir>
+#include <QCryptographicHash>
+#include <QSqlQuery>
+#include <QSqlDatabase>
+#include "Common/dbexecutor.h"
+#include "globalobjects.h"
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+const qint64 FileHasher::HashSize;
+
+FileHasher::FileHasher(int threadCount) : hashedFiles(0), hashedBytes(0), cacheHits(0)
+{
+    hashPool = new QThreadPool();
+    hashPool->setMaxThreadCount(qMax(1, threadCount));
+}
+
+FileHasher::~FileHasher()
+{
+    hashPool->waitForDone();
+    delete hashPool;
+}
+
+QString FileHasher::hash(const QString &fileName)
+{
+    FileKey key;
+    if(!fileKey(fileName, key)) return QString();
+    QString hashStr;
+    if(lookup(key, hashStr))
+    {
+        cacheHits.ref();
+        return hashStr;
+    }
+    qint64 bytes = 0;
+    hashStr = computeHash(key.path, bytes);
+    if(hashStr.isEmpty()) return hashStr;
+    hashedFiles.ref();
+    hashedBytes.fetchAndAddRelaxed(bytes);
+    store(key, hashStr);
+    return hashStr;
+}
+
+QFuture<QString> FileHasher::hashAsync(const QString &fileName, const CancelToken &token)
+{
+    return Async::runOn(hashPool, [this, fileName](){
+        return hash(fileName);
+    }, Async::Background, token);
+}
+
+QFuture<int> FileHasher::prune()
+{
+    return Async::runOn(hashPool, [this](){
+        return removeStale();
+    }, Async::Background);
+}
+
+FileHasher::Stat FileHasher::stat() const
+{
+    Stat s;
+    s.hashedFiles = hashedFiles.load();
+    s.hashedBytes = hashedBytes.load();
+    s.cacheHits = cacheHits.load();
+    return s;
+}
+
+bool FileHasher::fileKey(const QString &fileName, FileKey &key)
+{
+    QFileInfo info(fileName);
+    if(!info.exists() || !info.isFile()) return false;
+    key.path = info.canonicalFilePath();
+    key.size = info.size();
+    key.mtime = info.lastModified().toMSecsSinceEpoch();
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if(::stat(QFile::encodeName(key.path).constData(), &st) == 0)
+        key.inode = st.st_ino;
+#endif
+    return true;
+}
+
+QString FileHasher::computeHash(const QString &path, qint64 &bytes)
+{
+    QFile mediaFile(path);
+    if(!mediaFile.open(QIODevice::ReadOnly)) return QString();
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    const qint64 len = qMin(mediaFile.size(), HashSize);
+    uchar *data = len > 0 && canMap(path) ? mediaFile.map(0, len) : nullptr;
+    if(data)
+    {
+#ifdef Q_OS_UNIX
+        madvise(data, len, MADV_SEQUENTIAL);
+#endif
+        md5.addData(reinterpret_cast<const char *>(data), len);
+        mediaFile.unmap(data);
+        bytes = len;
+    }
+    else
+    {
+        const qint64 bufferSize = 1024*1024;
+        QByteArray buffer(bufferSize, Qt::Uninitialized);
+        bytes = 0;
+        while(bytes < HashSize)
+        {
+            const qint64 n = mediaFile.read(buffer.data(), qMin(bufferSize, HashSize - bytes));
+            if(n <= 0) break;
+            md5.addData(buffer.constData(), n);
+            bytes += n;
+        }
+    }
+    return md5.result().toHex();
+}
+
+bool FileHasher::canMap(const QString &path)
+{
+    QStorageInfo storage(path);
+    if(!storage.isValid() || !storage.isReady()) return false;
+#ifdef Q_OS_WIN
+    const QString root(QDir::toNativeSeparators(storage.rootPath()));
+    return GetDriveTypeW(reinterpret_cast<LPCWSTR>(root.utf16())) == DRIVE_FIXED;
+#else
+    static const QList<QByteArray> networkTypes{"nfs", "nfs4", "cifs", "smbfs", "smb3", "afs", "9p", "ceph", "glusterfs", "davfs", "webdav"};
+    const QByteArray fsType(storage.fileSystemType().toLower());
+    if(networkTypes.contains(fsType) || fsType.startsWith("fuse")) return false;
+    //usual mount points of removable media
+    const QString root(storage.rootPath());
+    for(const char *prefix : {"/media/", "/run/media/", "/Volumes/"})
+    {
+        if(root.startsWith(prefix)) return false;
+    }
+    return true;
+#endif
+}
+
+int FileHasher::removeStale()
+{
+    QList<FileKey> keys;
+    GlobalObjects::dbExecutor->read("FileHasher::listHashes", [&keys](){
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.exec("select Path,Size,MTime,Inode from file_hash");
+        while (query.next())
+        {
+            FileKey key;
+            key.path = query.value(0).toString();
+            key.size = query.value(1).toLongLong();
+            key.mtime = query.value(2).toLongLong();
+            key.inode = query.value(3).toULongLong();
+            keys.append(key);
+        }
+        return 0;
+    }, DBExecutor::Background);
+    QStringList stalePaths;
+    for(const FileKey &key : keys)
+    {
+        FileKey cur;
+        if(fileKey(key.path, cur))
+        {
+            if(!cur.sameFile(key)) stalePaths.append(key.path);
+        }
+        //the file is gone but its directory is there, so the volume is mounted
+        else if(QFileInfo(key.path).dir().exists())
+        {
+            stalePaths.append(key.path);
+        }
+    }
+    if(stalePaths.isEmpty()) return 0;
+    {
+        QMutexLocker locker(&cacheLock);
+        for(const QString &path : stalePaths)
+            hashCache.remove(path);
+    }
+    GlobalObjects::dbExecutor->writeOnce("FileHasher::prune", [stalePaths](){
+        QSqlDatabase db(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        QSqlQuery query(db);
+        db.transaction();
+        query.prepare("delete from file_hash where Path=?");
+        for(const QString &path : stalePaths)
+        {
+            query.bindValue(0, path);
+            query.exec();
+        }
+        db.commit();
+    });
+    return stalePaths.size();
+}
+
+bool FileHasher::lookup(const FileKey &key, QString &hash)
+{
+    {
+        QMutexLocker locker(&cacheLock);
+        auto iter = hashCache.constFind(key.path);
+        if(iter != hashCache.constEnd())
+        {
+            if(iter->key.sameFile(key))
+            {
+                hash = iter->hash;
+                return true;
+            }
+            //the file changed, the new hash replaces the entry in store
+            hashCache.remove(key.path);
+            return false;
+        }
+    }
+    QVariantList row = GlobalObjects::dbExecutor->read("FileHasher::lookup", [&key](){
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.prepare("select Size,MTime,Inode,Hash from file_hash where Path=?");
+        query.bindValue(0, key.path);
+        query.exec();
+        if(!query.first()) return QVariant();
+        return QVariant(QVariantList({query.value(0), query.value(1), query.value(2), query.value(3)}));
+    }, DBExecutor::Background).toList();
+    if(row.isEmpty()) return false;
+    Entry entry;
+    entry.key.path = key.path;
+    entry.key.size = row[0].toLongLong();
+    entry.key.mtime = row[1].toLongLong();
+    entry.key.inode = row[2].toULongLong();
+    entry.hash = row[3].toString();
+    if(!entry.key.sameFile(key)) return false;
+    {
+        QMutexLocker locker(&cacheLock);
+        hashCache.insert(key.path, entry);
+    }
+    hash = entry.hash;
+    return true;
+}
+
+void FileHasher::store(const FileKey &key, const QString &hash)
+{
+    Entry entry;
+    entry.key = key;
+    entry.hash = hash;
+    {
+        QMutexLocker locker(&cacheLock);
+        hashCache.insert(key.path, entry);
+    }
+    GlobalObjects::dbExecutor->writeOnce("FileHasher::store", [entry](){
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.prepare("insert or replace into file_hash(Path,Size,MTime,Inode,Hash) values(?,?,?,?,?)");
+        query.bindValue(0, entry.key.path);
+        query.bindValue(1, entry.key.size);
+        query.bindValue(2, entry.key.mtime);
+        query.bindValue(3, entry.key.inode);
+        query.bindValue(4, entry.hash);
+        query.exec();
+    });
+}
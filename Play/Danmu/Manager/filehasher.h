@@ -0,0 +1,65 @@
+#ifndef FILEHASHER_H
+#define FILEHASHER_H
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QFuture>
+#include "Common/asynctask.h"
+class QThreadPool;
+/*
+ * Match hash (md5 of the first 16MB) of media files.
+ * Hashes are cached in memory and in the file_hash table, keyed by canonical path and
+ * checked against size, mtime and inode, so unchanged files are never read again.
+ * Files on local fixed disks are mapped and read sequentially, files on network shares or removable
+ * media are read with buffered reads, a truncated or unmounted file must not fault a mapping.
+ * hashAsync runs on a small bounded pool, several files can be read and hashed at the same time during batch matching.
+ * hash reads the file and the file_hash table in place, it is for worker threads only, the gui thread uses hashAsync.
+ * prune drops cached hashes of files that are gone or changed, files on unmounted volumes are kept.
+ */
+class FileHasher
+{
+public:
+    struct Stat
+    {
+        qint64 hashedFiles = 0;
+        qint64 hashedBytes = 0;
+        qint64 cacheHits = 0;
+    };
+    explicit FileHasher(int threadCount);
+    ~FileHasher();
+
+    QString hash(const QString &fileName);
+    QFuture<QString> hashAsync(const QString &fileName, const CancelToken &token = CancelToken());
+    QFuture<int> prune();
+    Stat stat() const;
+
+    static const qint64 HashSize = 16*1024*1024;
+
+private:
+    struct FileKey
+    {
+        QString path;
+        qint64 size = -1;
+        qint64 mtime = 0;
+        quint64 inode = 0;
+        bool sameFile(const FileKey &o) const {return size==o.size && mtime==o.mtime && inode==o.inode;}
+    };
+    struct Entry
+    {
+        FileKey key;
+        QString hash;
+    };
+    QThreadPool *hashPool;
+    QHash<QString, Entry> hashCache;
+    QMutex cacheLock;
+    QAtomicInteger<qint64> hashedFiles, hashedBytes, cacheHits;
+
+    static bool fileKey(const QString &fileName, FileKey &key);
+    static QString computeHash(const QString &path, qint64 &bytes);
+    static bool canMap(const QString &path);
+    int removeStale();
+    bool lookup(const FileKey &key, QString &hash);
+    void store(const FileKey &key, const QString &hash);
+};
+
+#endif // FILEHASHER_H
@@ -0,0 +1,134 @@
+#include "kdfile.h"
+#include "Common/network.h"
+namespace
+{
+    const quint32 blockMagic = 0x4B44424B; //KDBK
+    const quint32 indexMagic = 0x4B444958; //KDIX
+    const qint64 trailerSize = sizeof(qint64) + sizeof(quint32);
+}
+
+KdFile::Writer::Writer(QIODevice *device, const QString &comment) :
+    device(device), stream(device), window(qMax(2, QThread::idealThreadCount()))
+{
+    stream<<QString("kd2")<<comment;
+}
+
+void KdFile::Writer::addBlock(const QByteArray &record, const QString &title)
+{
+    PendingBlock block;
+    block.info.size = record.size();
+    block.info.title = title;
+    block.compressed = Async::run([record](){
+        return qCompress(record);
+    });
+    pending.enqueue(block);
+    //blocks are written in order, at most window records are held in memory
+    while(pending.size() >= window) writeFront();
+}
+
+bool KdFile::Writer::finish()
+{
+    while(!pending.isEmpty()) writeFront();
+    const qint64 indexOffset = device->pos();
+    stream<<indexMagic<<qint32(index.size());
+    for(const BlockInfo &info : index)
+        stream<<info.offset<<info.size<<info.title;
+    stream<<indexOffset<<indexMagic;
+    return stream.status() == QDataStream::Ok;
+}
+
+void KdFile::Writer::writeFront()
+{
+    PendingBlock block(pending.dequeue());
+    block.info.offset = device->pos();
+    stream<<blockMagic<<block.compressed.result();
+    index.append(block.info);
+}
+
+KdFile::Reader::Reader(QIODevice *device) :
+    device(device), stream(device), window(qMax(2, QThread::idealThreadCount())),
+    legacy(false), atEnd(false), error(false)
+{
+}
+
+bool KdFile::Reader::readHeader(QString &comment)
+{
+    QString head;
+    stream>>head;
+    if(head == "kd") legacy = true;
+    else if(head != "kd2") return false;
+    stream>>comment;
+    if(!legacy) readIndex();
+    return stream.status() == QDataStream::Ok;
+}
+
+bool KdFile::Reader::next(QByteArray &records)
+{
+    if(atEnd && pending.isEmpty()) return false;
+    if(legacy)
+    {
+        QByteArray compressedContent;
+        stream>>compressedContent;
+        atEnd = true;
+        if(Network::gzipDecompress(compressedContent, records) != 0)
+        {
+            error = true;
+            return false;
+        }
+        return true;
+    }
+    fill();
+    if(pending.isEmpty()) return false;
+    records = pending.dequeue().result();
+    //keep the next blocks decompressing while this one is imported
+    fill();
+    if(records.isEmpty())
+    {
+        error = true;
+        return false;
+    }
+    return true;
+}
+
+void KdFile::Reader::readIndex()
+{
+    //the index is only used for progress, blocks are read in sequence
+    if(device->isSequential() || device->size() < trailerSize) return;
+    const qint64 pos = device->pos();
+    qint64 indexOffset = 0;
+    quint32 magic = 0;
+    device->seek(device->size() - trailerSize);
+    stream>>indexOffset>>magic;
+    if(magic == indexMagic && indexOffset >= pos && device->seek(indexOffset))
+    {
+        qint32 count = 0;
+        stream>>magic>>count;
+        for(int i = 0; magic == indexMagic && i < count && stream.status() == QDataStream::Ok; ++i)
+        {
+            BlockInfo info;
+            stream>>info.offset>>info.size>>info.title;
+            index.append(info);
+        }
+    }
+    stream.resetStatus();
+    device->seek(pos);
+}
+
+void KdFile::Reader::fill()
+{
+    while(!atEnd && pending.size() < window)
+    {
+        quint32 magic = 0;
+        stream>>magic;
+        if(magic != blockMagic || stream.status() != QDataStream::Ok)
+        {
+            atEnd = true;
+            break;
+        }
+        QByteArray compressed;
+        stream>>compressed;
+        pending.enqueue(Async::run([compressed](){
+            return qUncompress(compressed);
+        }));
+    }
+}
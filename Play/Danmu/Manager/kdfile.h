@@ -0,0 +1,64 @@
+#ifndef KDFILE_H
+#define KDFILE_H
+#include <QtCore>
+#include "Common/asynctask.h"
+/*
+ * KikoPlay danmu export file (.kd).
+ * v1: "kd", comment, gzip(pool records)
+ * v2: "kd2", comment, blocks..., index, trailer
+ *   block:   magic "KDBK", qCompress(pool record)
+ *   index:   magic "KDIX", block count, (offset, raw size, title) per block
+ *   trailer: index offset, magic "KDIX"
+ * A pool record is 0x23 followed by Pool::exportKdFile, v2 has one pool per block,
+ * so blocks are compressed and decompressed on worker threads independently.
+ */
+namespace KdFile
+{
+    struct BlockInfo
+    {
+        qint64 offset = 0;
+        qint32 size = 0;
+        QString title;
+    };
+
+    class Writer
+    {
+    public:
+        Writer(QIODevice *device, const QString &comment);
+        void addBlock(const QByteArray &record, const QString &title);
+        bool finish();
+    private:
+        struct PendingBlock
+        {
+            QFuture<QByteArray> compressed;
+            BlockInfo info;
+        };
+        QIODevice *device;
+        QDataStream stream;
+        QQueue<PendingBlock> pending;
+        QList<BlockInfo> index;
+        const int window;
+        void writeFront();
+    };
+
+    class Reader
+    {
+    public:
+        explicit Reader(QIODevice *device);
+        bool readHeader(QString &comment);
+        inline bool isLegacy() const {return legacy;}
+        inline bool hasError() const {return error;}
+        inline const QList<BlockInfo> &blocks() const {return index;}
+        bool next(QByteArray &records);
+    private:
+        QIODevice *device;
+        QDataStream stream;
+        QList<BlockInfo> index;
+        QQueue<QFuture<QByteArray>> pending;
+        const int window;
+        bool legacy, atEnd, error;
+        void readIndex();
+        void fill();
+    };
+}
+#endif // KDFILE_H
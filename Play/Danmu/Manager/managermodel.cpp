@@ -3,6 +3,7 @@
 #include "danmumanager.h"
 #include "../danmupool.h"
 #include "pool.h"
+#include "Common/asynctask.h"
 DanmuManagerModel::DanmuManagerModel(QObject *parent) : QAbstractItemModel(parent)
 {
 
@@ -15,24 +16,45 @@ DanmuManagerModel::~DanmuManagerModel()
 
 void DanmuManagerModel::refreshList()
 {
-    beginResetModel();
-    GlobalObjects::danmuManager->loadPoolInfo(animeNodeList);
-    endResetModel();
+    Async::then(GlobalObjects::danmuManager->loadPoolInfo(), this, [this](const QList<DanmuPoolNode *> &nodeList){
+        beginResetModel();
+        qDeleteAll(animeNodeList);
+        animeNodeList=nodeList;
+        endResetModel();
+        emit listRefreshed();
+    });
 }
 
-void DanmuManagerModel::exportPool(const QString &dir, bool useTimeline, bool applyBlockRule)
+void DanmuManagerModel::exportPool(const QString &dir, bool useTimeline, bool applyBlockRule, std::function<void()> callback)
 {
-    GlobalObjects::danmuManager->exportPool(animeNodeList,dir,useTimeline,applyBlockRule);
+    fetchCheckedNodes([this,dir,useTimeline,applyBlockRule,callback](){
+        Async::then(GlobalObjects::danmuManager->exportPool(animeNodeList,dir,useTimeline,applyBlockRule), this, [callback](int){
+            callback();
+        });
+    });
 }
 
-void DanmuManagerModel::exportKdFile(const QString &dir, const QString &comment)
+void DanmuManagerModel::exportKdFile(const QString &dir, const QString &comment, std::function<void()> callback)
 {
-    GlobalObjects::danmuManager->exportKdFile(animeNodeList,dir,comment);
+    fetchCheckedNodes([this,dir,comment,callback](){
+        Async::then(GlobalObjects::danmuManager->exportKdFile(animeNodeList,dir,comment), this, [callback](int){
+            callback();
+        });
+    });
 }
 
-void DanmuManagerModel::deletePool()
+void DanmuManagerModel::deletePool(std::function<void()> callback)
+{
+    fetchCheckedNodes([this,callback](){
+        Async::then(GlobalObjects::danmuManager->deletePool(animeNodeList), this, [this,callback](int){
+            removeCheckedNodes();
+            callback();
+        });
+    });
+}
+
+void DanmuManagerModel::removeCheckedNodes()
 {
-    GlobalObjects::danmuManager->deletePool(animeNodeList);
     QList<DanmuPoolNode *> nodes(animeNodeList);
     while(!nodes.empty())
     {
@@ -91,28 +113,34 @@ void DanmuManagerModel::deletePool()
     }
 }
 
-void DanmuManagerModel::updatePool()
+void DanmuManagerModel::updatePool(std::function<void()> callback)
 {
-    GlobalObjects::danmuManager->updatePool(animeNodeList);
-    for(DanmuPoolNode *animeNode:animeNodeList)
-    {
-        if(animeNode->checkStatus==Qt::Unchecked) continue;
-        animeNode->setCount();
-        QModelIndex aIndex=this->index(animeNodeList.indexOf(animeNode),3,QModelIndex());
-        emit dataChanged(aIndex,aIndex);
-        for(DanmuPoolNode *epNode:*animeNode->children)
-        {
-            if(epNode->checkStatus==Qt::Unchecked) continue;
-            QModelIndex eIndex=this->index(animeNode->children->indexOf(epNode),3,aIndex);
-            emit dataChanged(eIndex,eIndex);
-            for(DanmuPoolNode *sourceNode:*epNode->children)
+    fetchCheckedNodes([this,callback](){
+        Async::then(GlobalObjects::danmuManager->updatePool(animeNodeList), this, [this,callback](const DanmuManager::SourceCounts &counts){
+            for(DanmuPoolNode *animeNode:animeNodeList)
             {
-                if(sourceNode->checkStatus==Qt::Unchecked) continue;
-                QModelIndex sIndex=this->index(epNode->children->indexOf(sourceNode),3,eIndex);
-                emit dataChanged(sIndex,sIndex);
+                if(animeNode->checkStatus==Qt::Unchecked) continue;
+                QModelIndex aIndex=this->index(animeNodeList.indexOf(animeNode),3,QModelIndex());
+                for(DanmuPoolNode *epNode:*animeNode->children)
+                {
+                    if(epNode->checkStatus==Qt::Unchecked) continue;
+                    QModelIndex eIndex=this->index(animeNode->children->indexOf(epNode),3,aIndex);
+                    for(DanmuPoolNode *sourceNode:*epNode->children)
+                    {
+                        if(sourceNode->checkStatus==Qt::Unchecked) continue;
+                        auto iter=counts.constFind(qMakePair(epNode->idInfo, static_cast<DanmuPoolSourceNode *>(sourceNode)->srcId));
+                        if(iter!=counts.constEnd()) sourceNode->danmuCount=iter.value();
+                        QModelIndex sIndex=this->index(epNode->children->indexOf(sourceNode),3,eIndex);
+                        emit dataChanged(sIndex,sIndex);
+                    }
+                    emit dataChanged(eIndex,eIndex);
+                }
+                animeNode->setCount();
+                emit dataChanged(aIndex,aIndex);
             }
-        }
-    }
+            callback();
+        });
+    });
 }
 
 int DanmuManagerModel::totalDanmuCount()
@@ -130,7 +158,7 @@ int DanmuManagerModel::totalPoolCount()
     int sum=0;
     for(DanmuPoolNode *node:animeNodeList)
     {
-        sum+=node->children->count();
+        sum+=node->childrenLoaded?node->children->count():node->poolCount;
     }
     return sum;
 }
@@ -192,6 +220,12 @@ void DanmuManagerModel::addPoolNode(const QString &animeTitle, const EpInfo &ep,
     {
         if(node->title==animeTitle)
         {
+            if(!node->childrenLoaded)
+            {
+                //the new pool is read from db when the node is expanded
+                ++node->poolCount;
+                return;
+            }
             DanmuPoolEpNode *epNode=new DanmuPoolEpNode(ep, node);
             epNode->idInfo=pid;
             QModelIndex animeIndex(createIndex(i,0,node));
@@ -263,6 +297,14 @@ void DanmuManagerModel::renamePoolNode(DanmuPoolNode *epNode, const QString &ani
             animeNodeList.append(animeNode);
             endInsertRows();
         }
+        else if(!animeNode->childrenLoaded)
+        {
+            QModelIndex nAnimeIndex(createIndex(index,0,animeNode));
+            ++animeNode->poolCount;
+            animeNode->danmuCount+=epNode->danmuCount;
+            delete epNode;
+            emit dataChanged(nAnimeIndex.siblingAtColumn(3),nAnimeIndex.siblingAtColumn(3));
+        }
         else
         {
             QModelIndex nAnimeIndex(createIndex(index,0,animeNode));
@@ -277,6 +319,55 @@ void DanmuManagerModel::renamePoolNode(DanmuPoolNode *epNode, const QString &ani
     }
 }
 
+void DanmuManagerModel::fetchCheckedNodes(std::function<void()> callback)
+{
+    //checked anime nodes are loaded before their pools are collected, the callback runs once all are in
+    QSharedPointer<int> pending(new int(1));
+    auto done=[pending,callback](){
+        if(--*pending==0) callback();
+    };
+    for(DanmuPoolNode *animeNode:animeNodeList)
+    {
+        if(animeNode->childrenLoaded || animeNode->checkStatus==Qt::Unchecked) continue;
+        ++*pending;
+        fetchChildren(animeNode->title, done);
+    }
+    done();
+}
+
+void DanmuManagerModel::fetchChildren(const QString &animeTitle, std::function<void()> callback)
+{
+    Async::then(GlobalObjects::danmuManager->loadAnimePools(animeTitle), this, [this,animeTitle,callback](const QList<DanmuPoolNode *> &epNodes){
+        //the list may be refreshed or the node loaded by another fetch while the episodes are read
+        int row=0;
+        while(row<animeNodeList.size() && animeNodeList.at(row)->title!=animeTitle) ++row;
+        if(row==animeNodeList.size() || animeNodeList.at(row)->childrenLoaded)
+        {
+            qDeleteAll(epNodes);
+            if(callback) callback();
+            return;
+        }
+        DanmuPoolNode *animeNode=animeNodeList.at(row);
+        QModelIndex parent(createIndex(row,0,animeNode));
+        animeNode->childrenLoaded=true;
+        if(!epNodes.isEmpty())
+        {
+            beginInsertRows(parent,0,epNodes.count()-1);
+            for(DanmuPoolNode *epNode:epNodes)
+            {
+                epNode->parent=animeNode;
+                epNode->checkStatus=animeNode->checkStatus;
+                epNode->setChildrenCheckStatus();
+                animeNode->children->append(epNode);
+            }
+            endInsertRows();
+        }
+        animeNode->setCount();
+        emit dataChanged(parent.siblingAtColumn(3),parent.siblingAtColumn(3));
+        if(callback) callback();
+    });
+}
+
 void DanmuManagerModel::refreshChildrenCheckStatus(const QModelIndex &index)
 {
     QList<QModelIndex> pIndexes;
@@ -345,6 +436,24 @@ int DanmuManagerModel::rowCount(const QModelIndex &parent) const
     return parentItem->children?parentItem->children->size():0;
 }
 
+bool DanmuManagerModel::hasChildren(const QModelIndex &parent) const
+{
+    if(parent.isValid() && !static_cast<DanmuPoolNode *>(parent.internalPointer())->childrenLoaded) return true;
+    return QAbstractItemModel::hasChildren(parent);
+}
+
+bool DanmuManagerModel::canFetchMore(const QModelIndex &parent) const
+{
+    return parent.isValid() && !static_cast<DanmuPoolNode *>(parent.internalPointer())->childrenLoaded;
+}
+
+void DanmuManagerModel::fetchMore(const QModelIndex &parent)
+{
+    if(!canFetchMore(parent)) return;
+    DanmuPoolNode *animeNode = static_cast<DanmuPoolNode *>(parent.internalPointer());
+    fetchChildren(animeNode->title);
+}
+
 QVariant DanmuManagerModel::data(const QModelIndex &index, int role) const
 {
     if (!index.isValid()) return QVariant();
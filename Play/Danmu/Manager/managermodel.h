@@ -1,6 +1,7 @@
 #ifndef MANAGERVIEW_H
 #define MANAGERVIEW_H
 #include <QAbstractItemModel>
+#include <functional>
 #include "nodeinfo.h"
 class DanmuManagerModel : public QAbstractItemModel
 {
@@ -9,10 +10,11 @@ public:
     explicit DanmuManagerModel(QObject *parent = nullptr);
     virtual ~DanmuManagerModel();
     void refreshList();
-    void exportPool(const QString &dir, bool useTimeline=true, bool applyBlockRule=false);
-    void exportKdFile(const QString &dir, const QString &comment="");
-    void deletePool();
-    void updatePool();
+    //the callbacks run on the gui thread once the manager task is done
+    void exportPool(const QString &dir, bool useTimeline, bool applyBlockRule, std::function<void()> callback);
+    void exportKdFile(const QString &dir, const QString &comment, std::function<void()> callback);
+    void deletePool(std::function<void()> callback);
+    void updatePool(std::function<void()> callback);
     int totalDanmuCount();
     int totalPoolCount();
     bool hasSelected();
@@ -34,6 +36,11 @@ private:
 
     void refreshChildrenCheckStatus(const QModelIndex &index);
     void refreshParentCheckStatus(const QModelIndex &index);
+    void fetchCheckedNodes(std::function<void()> callback);
+    void fetchChildren(const QString &animeTitle, std::function<void()> callback=nullptr);
+    void removeCheckedNodes();
+signals:
+    void listRefreshed();
 
     // QAbstractItemModel interface
 public:
@@ -41,6 +48,9 @@ public:
     virtual QModelIndex parent(const QModelIndex &child) const;
     virtual int rowCount(const QModelIndex &parent) const;
     inline virtual int columnCount(const QModelIndex &) const {return headers.count();}
+    virtual bool hasChildren(const QModelIndex &parent) const;
+    virtual bool canFetchMore(const QModelIndex &parent) const;
+    virtual void fetchMore(const QModelIndex &parent);
     virtual QVariant data(const QModelIndex &index, int role) const;
     virtual QVariant headerData(int section, Qt::Orientation orientation, int role) const;
     virtual Qt::ItemFlags flags(const QModelIndex &index) const;
@@ -1,7 +1,7 @@
 #include "nodeinfo.h"
 
 DanmuPoolNode::DanmuPoolNode(DanmuPoolNode::NodeType nodeType,DanmuPoolNode *pNode):type(nodeType),danmuCount(0),
-    checkStatus(Qt::Unchecked),parent(pNode),children(nullptr)
+    checkStatus(Qt::Unchecked),childrenLoaded(true),poolCount(0),parent(pNode),children(nullptr)
 {
     if(type==NodeType::AnimeNode || type==NodeType::EpNode)
         children=new QList<DanmuPoolNode *>();
@@ -19,7 +19,7 @@ DanmuPoolNode::~DanmuPoolNode()
 
 int DanmuPoolNode::setCount()
 {
-    if(type==SourecNode)return danmuCount;
+    if(type==SourecNode || !childrenLoaded)return danmuCount;
     int sum=0;
     for(DanmuPoolNode *child:*children)
     {
@@ -62,14 +62,14 @@ void DanmuPoolNode::setParentCheckStatus()
     }
 }
 
-int DanmuPoolNode::idHash(const QString &str)
+int DanmuPoolNode::idHash(const QString &str, int tableCount)
 {
     size_t hash = 0;
     for(int i=0;i<str.length();++i)
     {
         hash=hash * 131 + str.at(i).unicode();
     }
-    return hash % 5;
+    return hash % tableCount;
 }
 /*
 DanmuSourceInfo DanmuPoolSourceNode::toSourceInfo()
@@ -16,6 +16,9 @@ struct DanmuPoolNode
     NodeType type;
     int danmuCount;
     int checkStatus;
+    //anime nodes from DanmuManager::loadPoolInfo load their episodes when expanded
+    bool childrenLoaded;
+    int poolCount;
 
     DanmuPoolNode *parent;
     QList<DanmuPoolNode *> *children;
@@ -25,7 +28,7 @@ struct DanmuPoolNode
     int setCount();
     void setChildrenCheckStatus();
     void setParentCheckStatus();
-    static int idHash(const QString &str);
+    static int idHash(const QString &str, int tableCount = 5);
 };
 struct DanmuPoolEpNode : public DanmuPoolNode
 {
@@ -1,8 +1,10 @@
 #include "pool.h"
+#include <QTimer>
 #include "danmumanager.h"
 #include "globalobjects.h"
 #include "../blocker.h"
 #include "Common/network.h"
+#include "Common/dbexecutor.h"
 namespace
 {
     struct
@@ -15,7 +17,7 @@ namespace
 }
 
 Pool::Pool(const QString &id, const QString &animeTitle, const QString &epTitle, EpType type, double index, QObject *parent):
-     QObject(parent),pid(id),anime(animeTitle),ep(epTitle),epType(type), epIndex(index), used(false),isLoaded(false)
+     QObject(parent),pid(id),anime(animeTitle),ep(epTitle),epType(type), epIndex(index), used(false),isLoaded(false),repackTimer(nullptr)
 {
 
 }
@@ -26,6 +28,8 @@ bool Pool::load()
     {
         PoolStateLock locker;
         if(!locker.tryLock(pid)) return false;
+        dedupSets.clear();
+        idCopies.clear();
         GlobalObjects::danmuManager->loadPool(this);
         GlobalObjects::blocker->checkDanmu(commentList);
         isLoaded=true;
@@ -39,8 +43,11 @@ bool Pool::clean()
 {
     PoolStateLock locker;
     if(!locker.tryLock(pid)) return false;
+    repackSources();
     QList<QSharedPointer<DanmuComment> > emptyList;
     commentList.swap(emptyList);
+    dedupSets.clear();
+    idCopies.clear();
     isLoaded=false;
     return true;
 }
@@ -53,12 +60,68 @@ int Pool::update(int sourceId, QList<QSharedPointer<DanmuComment> > *incList)
     if(!locker.tryLock(pid)) return 0;
     QList<DanmuComment *> tList;
     GlobalObjects::danmuManager->updatePool(this,tList,sourceId);
+    return addUpdatedDanmu(tList, sourceId, incList);
+}
+
+void Pool::updateAsync(int sourceId, QObject *context, std::function<void (int)> callback)
+{
+    QPointer<QObject> receiver(context);
+    if(sourcesTable.isEmpty() || (sourceId!=-1 && !sourcesTable.contains(sourceId)))
+    {
+        callback(0);
+        return;
+    }
+    QSharedPointer<PoolStateLock> locker(new PoolStateLock);
+    if(!locker->tryLock(pid))
+    {
+        callback(0);
+        return;
+    }
+    //the pool keeps the downloaded danmu even if the receiver is gone
+    Async::then(GlobalObjects::danmuManager->updatePoolAsync(this, sourceId), this, [this, sourceId, locker, receiver, callback](const QList<DanmuComment *> &danmuList){
+        QList<DanmuComment *> tList(danmuList);
+        int count = addUpdatedDanmu(tList, sourceId, nullptr);
+        if(receiver) callback(count);
+    });
+}
+
+QFuture<bool> Pool::loadAsync()
+{
+    QFutureInterface<bool> futureInterface;
+    futureInterface.reportStarted();
+    if(isLoaded || pid.isEmpty())
+    {
+        futureInterface.reportResult(false);
+        futureInterface.reportFinished();
+        return futureInterface.future();
+    }
+    //comments are read on a db reader thread, the pool itself is only changed here on its own thread
+    Async::finally(GlobalObjects::danmuManager->readPoolAsync(pid), this, [this, futureInterface](const QFuture<DanmuManager::PoolData> &future) mutable {
+        bool loaded=false;
+        PoolStateLock locker;
+        if(future.resultCount()>0 && !isLoaded && locker.tryLock(pid))
+        {
+            dedupSets.clear();
+            idCopies.clear();
+            GlobalObjects::danmuManager->applyPool(this, future.result());
+            isLoaded=true;
+            loaded=true;
+        }
+        futureInterface.reportResult(loaded);
+        futureInterface.reportFinished();
+    });
+    return futureInterface.future();
+}
+
+int Pool::addUpdatedDanmu(QList<DanmuComment *> &tList, int sourceId, QList<QSharedPointer<DanmuComment> > *incList)
+{
     QList<QSharedPointer<DanmuComment> > spList;
     if(sourceId!=-1)
     {
         sourcesTable[sourceId].count+=tList.count();
         for(auto comment:tList)
         {
+            assignId(comment);
             QSharedPointer<DanmuComment> sp(comment);
             commentList.append(sp);
             spList.append(sp);
@@ -70,6 +133,7 @@ int Pool::update(int sourceId, QList<QSharedPointer<DanmuComment> > *incList)
         for(auto &comment:tList)
         {
             sourcesTable[comment->source].count++;
+            assignId(comment);
             QSharedPointer<DanmuComment> sp(comment);
             commentList.append(sp);
             spList.append(sp);
@@ -91,6 +155,8 @@ int Pool::addSource(const DanmuSource &sourceInfo, QList<DanmuComment *> &danmuL
 {
     PoolStateLock locker;
     if(!locker.tryLock(pid)) return -1;
+    for(DanmuComment *danmu:danmuList)
+        danmu->updateFingerprint();
     DanmuSource *source(nullptr);
     bool containSource=false;
     for(auto iter=sourcesTable.begin();iter!=sourcesTable.end();++iter)
@@ -104,18 +170,18 @@ int Pool::addSource(const DanmuSource &sourceInfo, QList<DanmuComment *> &danmuL
     }
     if(source)
     {
-        QSet<QString> &&danmuHashSet=getDanmuHashSet(source->id);
+        QSet<quint64> &dedupSet=getDedupSet(source->id);
         for(auto iter=danmuList.begin();iter!=danmuList.end();)
         {
-            QByteArray hashData(QString("%0%1%2%3").arg((*iter)->text, QString::number((*iter)->originTime), (*iter)->sender, QString::number((*iter)->color)).toUtf8());
-            QString danmuHash(QString(QCryptographicHash::hash(hashData,QCryptographicHash::Md5).toHex()));
-            if(danmuHashSet.contains(danmuHash))
+            quint64 fingerprint=(*iter)->getFingerprint();
+            if(dedupSet.contains(fingerprint))
             {
                 delete *iter;
                 iter=danmuList.erase(iter);
             }
             else
             {
+                dedupSet.insert(fingerprint);
                 ++iter;
             }
         }
@@ -138,6 +204,7 @@ int Pool::addSource(const DanmuSource &sourceInfo, QList<DanmuComment *> &danmuL
     for(DanmuComment *danmu:danmuList)
     {
         danmu->source=source->id;
+        assignId(danmu);
 		setDelay(danmu);
         QSharedPointer<DanmuComment> sp(danmu);
         commentList.append(sp);
@@ -158,6 +225,9 @@ bool Pool::deleteSource(int sourceId, bool applyDB)
     PoolStateLock locker;
     if(!locker.tryLock(pid)) return false;
     sourcesTable.remove(sourceId);
+    packedSources.remove(sourceId);
+    repackPending.remove(sourceId);
+    dedupSets.remove(sourceId);
     for(auto iter=commentList.begin();iter!=commentList.end();)
     {
         if((*iter)->source==sourceId)
@@ -173,18 +243,99 @@ bool Pool::deleteSource(int sourceId, bool applyDB)
     return true;
 }
 
-bool Pool::deleteDanmu(int pos)
+int Pool::deleteDanmu(const QList<qint64> &ids, bool notify)
 {
-    if(pos>=0 && pos<commentList.size())
+    if(ids.isEmpty()) return 0;
+    PoolStateLock locker;
+    if(!locker.tryLock(pid)) return 0;
+    QSet<qint64> idSet;
+    for(qint64 id:ids) idSet.insert(id);
+    //one pass over the list
+    QList<QSharedPointer<DanmuComment> > remainList, deletedList;
+    remainList.reserve(commentList.size());
+    for(const auto &danmu:commentList)
     {
-        PoolStateLock locker;
-        if(!locker.tryLock(pid)) return false;
-        sourcesTable[commentList.at(pos)->source].count--;
-        if(!pid.isEmpty())GlobalObjects::danmuManager->deleteDanmu(pid, commentList.at(pos));
-        commentList.removeAt(pos);
-        return true;
+        if(idSet.contains(danmu->id())) deletedList.append(danmu);
+        else remainList.append(danmu);
     }
-    return false;
+    if(deletedList.isEmpty()) return 0;
+    commentList.swap(remainList);
+    QSet<int> repackSources;
+    QList<QSharedPointer<DanmuComment> > rowDeletedList;
+    for(const auto &danmu:deletedList)
+    {
+        auto srcIter=sourcesTable.find(danmu->source);
+        if(srcIter!=sourcesTable.end()) srcIter->count--;
+        if(dedupSets.contains(danmu->source))
+            dedupSets[danmu->source].remove(danmu->getFingerprint());
+        if(packedSources.contains(danmu->source)) repackSources.insert(danmu->source);
+        else rowDeletedList.append(danmu);
+    }
+    if(!pid.isEmpty())
+    {
+        for(int srcId:repackSources)
+            scheduleRepack(srcId);
+        if(!rowDeletedList.isEmpty())
+            GlobalObjects::danmuManager->deleteDanmu(pid, rowDeletedList);
+    }
+    if(used && notify)
+    {
+        emit poolChanged(true);
+    }
+    return deletedList.size();
+}
+
+qint64 Pool::editDanmu(qint64 id, const QString &text, int color)
+{
+    if(text.isEmpty()) return 0;
+    PoolStateLock locker;
+    if(!locker.tryLock(pid)) return 0;
+    auto iter=std::find_if(commentList.begin(), commentList.end(), [id](const QSharedPointer<DanmuComment> &danmu){
+        return danmu->id()==id;
+    });
+    if(iter==commentList.end()) return 0;
+    const QSharedPointer<DanmuComment> origin(*iter);
+    if(origin->text==text && origin->color==color) return id;
+    //a new comment instead of changing the old one, which draw lists and queued writes may still hold
+    DanmuComment *edited=new DanmuComment;
+    edited->text=text;
+    edited->color=color;
+    edited->sender=origin->sender;
+    edited->type=origin->type;
+    edited->fontSizeLevel=origin->fontSizeLevel;
+    edited->date=origin->date;
+    edited->originTime=origin->originTime;
+    edited->time=origin->time;
+    edited->source=origin->source;
+    edited->updateFingerprint();
+    assignId(edited);
+    QList<DanmuComment *> editedList({edited});
+    GlobalObjects::blocker->checkDanmu(editedList);
+    const QSharedPointer<DanmuComment> sp(edited);
+    *iter=sp;
+    if(dedupSets.contains(edited->source))
+    {
+        QSet<quint64> &dedupSet=dedupSets[edited->source];
+        dedupSet.remove(origin->getFingerprint());
+        dedupSet.insert(edited->getFingerprint());
+    }
+    if(!pid.isEmpty())
+    {
+        if(packedSources.contains(edited->source))
+        {
+            scheduleRepack(edited->source);
+        }
+        else
+        {
+            GlobalObjects::danmuManager->deleteDanmu(pid, {origin});
+            GlobalObjects::danmuManager->saveSource(pid, nullptr, {sp});
+        }
+    }
+    if(used)
+    {
+        emit poolChanged(true);
+    }
+    return edited->id();
 }
 
 bool Pool::setTimeline(int sourceId, const QList<QPair<int, int>> &timelineInfo)
@@ -232,6 +383,11 @@ bool Pool::setDelay(int sourceId, int delay)
 
 void Pool::setUsed(bool on)
 {
+    if(used!=on && !pid.isEmpty())
+    {
+        if(on) GlobalObjects::danmuManager->poolCache->pin(pid);
+        else GlobalObjects::danmuManager->poolCache->unpin(pid);
+    }
     used=on;
     if(used) std::sort(commentList.begin(),commentList.end(),DanmuSPCompare);
 }
@@ -372,11 +528,11 @@ QJsonArray Pool::exportJson(const QList<QSharedPointer<DanmuComment> > &danmuLis
         if(danmu->blockBy!=-1) continue;
         if(useOrigin)
         {
-            danmuArray.append(QJsonArray({danmu->originTime/1000.0,danmu->type,danmu->color,danmu->source,danmu->text}));
+            danmuArray.append(QJsonArray({danmu->originTime/1000.0,danmu->type,danmu->color,danmu->source,danmu->text,QString::number(danmu->id())}));
         }
         else
         {
-            danmuArray.append(QJsonArray({danmu->time/1000.0,danmu->type,danmu->color,danmu->sender,danmu->text}));
+            danmuArray.append(QJsonArray({danmu->time/1000.0,danmu->type,danmu->color,danmu->sender,danmu->text,QString::number(danmu->id())}));
         }
     }
     return danmuArray;
@@ -447,19 +603,24 @@ QJsonArray Pool::getPoolCodeInfo(const QString &code)
 }
 
 
-QSet<QString> Pool::getDanmuHashSet(int sourceId)
+QSet<quint64> &Pool::getDedupSet(int sourceId)
 {
-    if(sourceId != -1 && !sourcesTable.contains(sourceId)) return QSet<QString>();
-    QSet<QString> hashSet;
-    for(QSharedPointer<DanmuComment> &danmu:commentList)
+    auto iter=dedupSets.find(sourceId);
+    if(iter!=dedupSets.end()) return iter.value();
+    QSet<quint64> &dedupSet=dedupSets[sourceId];
+    if(isLoaded || pid.isEmpty())
     {
-        if(danmu->source==sourceId || sourceId==-1)
+        for(const auto &danmu:commentList)
         {
-            QByteArray hashData(QString("%0%1%2%3").arg(danmu->text).arg(danmu->originTime).arg(danmu->sender).arg(danmu->color).toUtf8());
-            hashSet.insert(QCryptographicHash::hash(hashData,QCryptographicHash::Md5).toHex());
+            if(danmu->source==sourceId)
+                dedupSet.insert(danmu->getFingerprint());
         }
     }
-    return hashSet;
+    else
+    {
+        GlobalObjects::danmuManager->loadFingerprints(pid,sourceId,dedupSet);
+    }
+    return dedupSet;
 }
 
 void Pool::addSourceJson(const QJsonArray &array)
@@ -488,3 +649,50 @@ void Pool::setDelay(DanmuComment *danmu)
     delay+=srcInfo->delay;
     danmu->time=danmu->originTime+delay<0?danmu->originTime:danmu->originTime+delay;
 }
+
+void Pool::scheduleRepack(int sourceId)
+{
+    repackPending.insert(sourceId);
+    if(!repackTimer)
+    {
+        repackTimer=new QTimer(this);
+        repackTimer->setSingleShot(true);
+        repackTimer->setInterval(repackDelay);
+        QObject::connect(repackTimer, &QTimer::timeout, this, [this](){
+            PoolStateLock locker;
+            //the pool is being changed elsewhere, try again later
+            if(!locker.tryLock(pid)) repackTimer->start();
+            else repackSources();
+        });
+    }
+    //restarted by every edit, a run of deletes is encoded once
+    repackTimer->start();
+}
+
+void Pool::repackSources()
+{
+    //called with the pool state lock held
+    if(repackTimer) repackTimer->stop();
+    if(repackPending.isEmpty() || pid.isEmpty()) return;
+    QHash<int, QList<QSharedPointer<DanmuComment> > > srcLists;
+    for(int srcId:repackPending)
+        srcLists.insert(srcId, QList<QSharedPointer<DanmuComment> >());
+    repackPending.clear();
+    //one pass over the pool for all pending sources
+    for(const auto &comment:commentList)
+    {
+        auto iter=srcLists.find(comment->source);
+        if(iter!=srcLists.end()) iter->append(comment);
+    }
+    for(auto iter=srcLists.cbegin();iter!=srcLists.cend();++iter)
+        GlobalObjects::danmuManager->repackSource(pid, iter.key(), iter.value());
+}
+
+void Pool::assignId(DanmuComment *danmu)
+{
+    //identical copies are told apart by their number, which copy gets which number does not matter
+    const qint64 firstId=DanmuComment::stableId(danmu->getFingerprint(), danmu->source, 0);
+    int &copies=idCopies[firstId];
+    danmu->commentId=copies==0?firstId:DanmuComment::stableId(danmu->getFingerprint(), danmu->source, copies);
+    ++copies;
+}
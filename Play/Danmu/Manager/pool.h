@@ -2,8 +2,11 @@
 #define POOL_H
 
 #include <QObject>
+#include <QFuture>
+#include <functional>
 #include "../common.h"
 #include "MediaLibrary/animeinfo.h"
+class QTimer;
 
 class Pool : public QObject
 {
@@ -19,9 +22,13 @@ public:
     EpInfo toEp() const { EpInfo ep; ep.name = this->ep; ep.type = epType; ep.index = epIndex; return ep; }
 public:
     int update(int sourceId=-1, QList<QSharedPointer<DanmuComment> > *incList=nullptr);
+    void updateAsync(int sourceId, QObject *context, std::function<void(int)> callback);
+    QFuture<bool> loadAsync();
     int addSource(const DanmuSource &sourceInfo, QList<DanmuComment *> &danmuList, bool reset=false);
     bool deleteSource(int sourceId, bool applyDB=true);
-    bool deleteDanmu(int pos);
+    int deleteDanmu(const QList<qint64> &ids, bool notify=true);
+    //the edited comment replaces the old one, its id follows the new content, 0 on failure
+    qint64 editDanmu(qint64 id, const QString &text, int color);
     bool setTimeline(int sourceId, const QList<QPair<int, int>> &timelineInfo);
     bool setDelay(int sourceId, int delay);
     void setUsed(bool on);
@@ -46,11 +53,22 @@ private:
     bool isLoaded;
     QList<QSharedPointer<DanmuComment> > commentList;
     QMap<int,DanmuSource> sourcesTable;
+    QSet<int> packedSources;
+    //packed sources with deleted or edited comments, repacked together once the edits settle
+    QSet<int> repackPending;
+    QTimer *repackTimer;
+    const int repackDelay=2000;
+    QHash<int, QSet<quint64> > dedupSets;
+    QHash<qint64, int> idCopies;
 
     bool load();
+    int addUpdatedDanmu(QList<DanmuComment *> &tList, int sourceId, QList<QSharedPointer<DanmuComment> > *incList);
     bool clean();
     void setDelay(DanmuComment *danmu);
-    QSet<QString> getDanmuHashSet(int sourceId=-1);
+    void assignId(DanmuComment *danmu);
+    void scheduleRepack(int sourceId);
+    void repackSources();
+    QSet<quint64> &getDedupSet(int sourceId);
     void addSourceJson(const QJsonArray &array);
 
     friend class DanmuManager;
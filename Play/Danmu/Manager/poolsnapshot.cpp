@@ -0,0 +1,134 @@
+#include "poolsnapshot.h"
+#include "globalobjects.h"
+namespace
+{
+    const char snapshotMagic[4] = {'K','D','S','S'};
+}
+
+PoolSnapshot::PoolSnapshot(const QString &fileName) : file(fileName), header(nullptr), records(nullptr), arena(nullptr)
+{
+    if(!file.open(QIODevice::ReadOnly)) return;
+    const qint64 size = file.size();
+    if(size < qint64(sizeof(Header))) return;
+    const uchar *data = file.map(0, size);
+    if(!data) return;
+    const Header *h = reinterpret_cast<const Header *>(data);
+    if(memcmp(h->magic, snapshotMagic, 4) != 0 || h->formatVersion != formatVersion) return;
+    const qint64 expectSize = qint64(sizeof(Header)) + qint64(h->count) * qint64(sizeof(Record)) + qint64(h->arenaLength) * qint64(sizeof(QChar));
+    if(expectSize != size) return;
+    records = reinterpret_cast<const Record *>(data + sizeof(Header));
+    arena = reinterpret_cast<const QChar *>(data + sizeof(Header) + h->count * sizeof(Record));
+    header = h;
+}
+
+PoolSnapshot::~PoolSnapshot()
+{
+    file.close();
+}
+
+void PoolSnapshot::materialize(QList<DanmuComment *> &danmuList) const
+{
+    if(!header) return;
+    danmuList.reserve(danmuList.size() + header->count);
+    //senders are stored once in the arena, comments of the same sender share one string
+    QHash<quint32, QString> senders;
+    for(quint32 i = 0; i < header->count; ++i)
+    {
+        const Record &r = records[i];
+        if(quint64(r.textOffset) + r.textLength > header->arenaLength ||
+           quint64(r.senderOffset) + r.senderLength > header->arenaLength) continue;
+        DanmuComment *danmu = new DanmuComment;
+        danmu->text = QString(arena + r.textOffset, r.textLength);
+        auto senderIter = senders.find(r.senderOffset);
+        if(senderIter == senders.end())
+            senderIter = senders.insert(r.senderOffset, QString(arena + r.senderOffset, r.senderLength));
+        danmu->sender = senderIter.value();
+        danmu->color = r.color;
+        danmu->type = DanmuComment::DanmuType(r.type < 3 ? r.type : 0);
+        danmu->fontSizeLevel = DanmuComment::FontSizeLevel(r.fontSizeLevel < 3 ? r.fontSizeLevel : 0);
+        danmu->date = r.date;
+        danmu->fingerprint = r.fingerprint;
+        if(r.rowId > 0) danmu->rowId = r.rowId;
+        danmu->originTime = r.originTime;
+        danmu->source = r.source;
+        danmuList.append(danmu);
+    }
+}
+
+bool PoolSnapshot::write(const QString &fileName, quint32 poolVersion, const QList<QSharedPointer<DanmuComment> > &danmuList)
+{
+    QList<const DanmuComment *> sorted;
+    sorted.reserve(danmuList.size());
+    for(const auto &danmu : danmuList)
+        sorted.append(danmu.data());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const DanmuComment *d1, const DanmuComment *d2){
+        return d1->originTime < d2->originTime;
+    });
+
+    QVector<Record> recordList(sorted.size());
+    QVector<QChar> arenaData;
+    QHash<QString, quint32> senderOffset;
+    auto appendString = [&arenaData](const QString &str){
+        const int pos = arenaData.size();
+        arenaData.resize(pos + str.size());
+        memcpy(arenaData.data() + pos, str.constData(), str.size() * sizeof(QChar));
+    };
+    for(int i = 0; i < sorted.size(); ++i)
+    {
+        const DanmuComment *danmu = sorted[i];
+        Record &r = recordList[i];
+        memset(&r, 0, sizeof(Record));
+        r.originTime = danmu->originTime;
+        r.source = danmu->source;
+        r.date = danmu->date;
+        r.fingerprint = danmu->getFingerprint();
+        r.rowId = danmu->rowId;
+        r.color = danmu->color;
+        r.type = danmu->type;
+        r.fontSizeLevel = danmu->fontSizeLevel;
+        r.textOffset = arenaData.size();
+        r.textLength = danmu->text.size();
+        appendString(danmu->text);
+        auto iter = senderOffset.find(danmu->sender);
+        if(iter == senderOffset.end())
+        {
+            iter = senderOffset.insert(danmu->sender, arenaData.size());
+            appendString(danmu->sender);
+        }
+        r.senderOffset = iter.value();
+        r.senderLength = danmu->sender.size();
+    }
+
+    Header h;
+    memset(&h, 0, sizeof(Header));
+    memcpy(h.magic, snapshotMagic, 4);
+    h.formatVersion = formatVersion;
+    h.poolVersion = poolVersion;
+    h.count = recordList.size();
+    h.arenaLength = arenaData.size();
+
+    QDir dir(QFileInfo(fileName).absolutePath());
+    if(!dir.exists()) dir.mkpath(".");
+    QSaveFile snapshotFile(fileName);
+    if(!snapshotFile.open(QIODevice::WriteOnly)) return false;
+    snapshotFile.write(reinterpret_cast<const char *>(&h), sizeof(Header));
+    snapshotFile.write(reinterpret_cast<const char *>(recordList.constData()), recordList.size() * sizeof(Record));
+    snapshotFile.write(reinterpret_cast<const char *>(arenaData.constData()), arenaData.size() * sizeof(QChar));
+    return snapshotFile.commit();
+}
+
+QString PoolSnapshot::fileName(const QString &pid, quint32 poolVersion)
+{
+    return QString("%1snapshot/%2_%3.kds").arg(GlobalObjects::dataPath, pid).arg(poolVersion);
+}
+
+void PoolSnapshot::removeFiles(const QString &pid, const QString &keepFile)
+{
+    QDir dir(GlobalObjects::dataPath + "snapshot");
+    const QString keepName(QFileInfo(keepFile).fileName());
+    for(const QString &name : dir.entryList({pid + "_*.kds"}, QDir::Files))
+    {
+        //fails while another load still maps the file on Windows, it will be removed next time
+        if(name != keepName) dir.remove(name);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef POOLSNAPSHOT_H
+#define POOLSNAPSHOT_H
+#include <QtCore>
+#include "../common.h"
+/*
+ * On-disk, memory-mappable copy of a loaded pool:
+ *   Header | Record[count] (sorted by originTime) | UTF-16 string arena
+ * Text and sender are copied out of the mapping when the comments are materialized,
+ * so the file is only mapped while a pool is being loaded. Comments outlive their pool
+ * in draw lists, the write queue and exports, strings pointing into a mapping owned by
+ * the pool would dangle; a load saves the queries, the blob decoding and the sort instead.
+ * Off by default, enabled by DanmuManager/PoolSnapshot.
+ */
+class PoolSnapshot
+{
+public:
+    explicit PoolSnapshot(const QString &fileName);
+    ~PoolSnapshot();
+
+    inline bool isValid() const {return header!=nullptr;}
+    inline int count() const {return header?header->count:0;}
+    inline quint32 poolVersion() const {return header?header->poolVersion:0;}
+    void materialize(QList<DanmuComment *> &danmuList) const;
+
+    static bool write(const QString &fileName, quint32 poolVersion, const QList<QSharedPointer<DanmuComment> > &danmuList);
+    static QString fileName(const QString &pid, quint32 poolVersion);
+    static void removeFiles(const QString &pid, const QString &keepFile=QString());
+
+private:
+    struct Header
+    {
+        char magic[4];
+        quint32 formatVersion;
+        quint32 poolVersion;
+        quint32 count;
+        quint32 arenaLength;
+        quint32 reserved[3];
+    };
+    struct Record
+    {
+        qint32 originTime;
+        qint32 source;
+        qint64 date;
+        quint64 fingerprint;
+        qint64 rowId;
+        qint32 color;
+        quint8 type;
+        quint8 fontSizeLevel;
+        quint16 reserved;
+        quint32 textOffset;
+        quint32 textLength;
+        quint32 senderOffset;
+        quint32 senderLength;
+    };
+    static const quint32 formatVersion = 1;
+
+    QFile file;
+    const Header *header;
+    const Record *records;
+    const QChar *arena;
+};
+
+#endif // POOLSNAPSHOT_H
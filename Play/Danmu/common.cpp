@@ -117,6 +117,50 @@ void DanmuObject::DeleteObjPool()
     poolCount=0;
 }
 
+quint64 DanmuComment::computeFingerprint() const
+{
+    //FNV-1a
+    quint64 hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void *data, int len){
+        const uchar *p = static_cast<const uchar *>(data);
+        for(int i = 0; i < len; ++i)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    auto mixInt = [&mix](qint64 val){
+        qint64 le = qToLittleEndian(val);
+        mix(&le, sizeof(le));
+    };
+    auto mixStr = [&mix, &mixInt](const QString &str){
+        mixInt(str.size());
+        for(const QChar &ch : str)
+        {
+            quint16 le = qToLittleEndian(ch.unicode());
+            mix(&le, sizeof(le));
+        }
+    };
+    mixStr(text);
+    mixInt(originTime);
+    mixStr(sender);
+    mixInt(color);
+    return hash ? hash : 1;
+}
+
+qint64 DanmuComment::stableId(quint64 fingerprint, int source, int copy)
+{
+    //splitmix64 finalizer over the three parts, kept positive for scripts and the lan json
+    quint64 x = fingerprint ^ (quint64(quint32(source)) << 32 | quint32(copy));
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    x &= 0x7fffffffffffffffULL;
+    return x ? qint64(x) : 1;
+}
+
 QDataStream &operator<<(QDataStream &stream, const DanmuComment &danmu)
 {
     static int type[3]={1,5,4};
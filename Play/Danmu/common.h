@@ -4,7 +4,7 @@
 #include <QtGui>
 struct DanmuComment
 {
-    DanmuComment():time(0),originTime(0),blockBy(-1),mergedList(nullptr),m_parent(nullptr){}
+    DanmuComment():time(0),originTime(0),blockBy(-1),source(0),fingerprint(0),rowId(0),commentId(0),mergedList(nullptr),m_parent(nullptr){}
     ~DanmuComment(){if(mergedList)delete mergedList;}
 
     enum DanmuType
@@ -50,10 +50,23 @@ struct DanmuComment
     int originTime;
     int blockBy;
     int source;
+    //stable 64-bit hash of text, originTime, sender and color, used for dedup
+    //set once when a comment is decoded or enters a pool, before it is shared between threads
+    quint64 fingerprint;
+    inline quint64 getFingerprint() const {return fingerprint?fingerprint:computeFingerprint();}
+    inline void updateFingerprint() {fingerprint=computeFingerprint();}
+    quint64 computeFingerprint() const;
+    //rowid in the pool's danmu table for comments loaded from rows, 0 for packed and new comments
+    qint64 rowId;
+    //id of the comment in its pool, given by Pool from the fingerprint, the source and the number
+    //of identical copies before it, so it stays the same when the pool is loaded again
+    qint64 commentId;
+    inline qint64 id() const {return commentId;}
+    static qint64 stableId(quint64 fingerprint, int source, int copy);
 
     QList<QSharedPointer<DanmuComment> > *mergedList;
     DanmuComment *m_parent;
-    QVariantMap toMap() const {return {{"text", text}, {"time", originTime}, {"color", color}, {"fontsize", fontSizeLevel}, {"date", QString::number(date)}, {"type", type}};}
+    QVariantMap toMap() const {return {{"text", text}, {"time", originTime}, {"color", color}, {"fontsize", fontSizeLevel}, {"date", QString::number(date)}, {"type", type}, {"id", QString::number(id())}};}
 };
 QDataStream &operator<<(QDataStream &stream, const DanmuComment &danmu);
 QDataStream &operator>>(QDataStream &stream, DanmuComment &danmu);
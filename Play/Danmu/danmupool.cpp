@@ -10,6 +10,7 @@
 #include "blocker.h"
 #include "Manager/danmumanager.h"
 #include "Manager/pool.h"
+#include "Common/asynctask.h"
 #include "Play/Playlist/playlist.h"
 namespace
 {
@@ -86,13 +87,37 @@ void DanmuPool::testBlockRule(BlockRule *rule)
 }
 
 void DanmuPool::deleteDanmu(QSharedPointer<DanmuComment> danmu)
+{
+    //ids are unique, identical copies of the comment stay
+    if(curPool->deleteDanmu({danmu->id()}, false)==0) return;
+    removeDanmu(danmu);
+    setStatisInfo();
+}
+
+int DanmuPool::findDanmu(const QList<QSharedPointer<DanmuComment> > &list, int time, const DanmuComment *danmu)
+{
+    //lists are sorted by time, only comments at the same time are compared
+    int pos = std::lower_bound(list.begin(), list.end(), time, DanmuComparer) - list.begin();
+    if(!danmu) return pos;
+    for(; pos < list.size() && list.at(pos)->time == time; ++pos)
+    {
+        if(list.at(pos).data() == danmu) return pos;
+    }
+    return -1;
+}
+
+void DanmuPool::removeDanmu(const QSharedPointer<DanmuComment> &danmu)
 {
     if(!danmu->m_parent)
     {
-        int row = finalPool.indexOf(danmu);
-        beginRemoveRows(QModelIndex(), row, row);
-        finalPool.removeAt(row);
-        endRemoveRows();
+        int row = findDanmu(finalPool, danmu->time, danmu.data());
+        if(row != -1)
+        {
+            beginRemoveRows(QModelIndex(), row, row);
+            finalPool.removeAt(row);
+            endRemoveRows();
+            if(row < currentPosition) --currentPosition;
+        }
         if(danmu->mergedList)
         {
            for(auto &c:*danmu->mergedList)
@@ -103,21 +128,17 @@ void DanmuPool::deleteDanmu(QSharedPointer<DanmuComment> danmu)
     }
     else
     {
-        int f_pos = std::lower_bound(finalPool.begin(), finalPool.end(), danmu->m_parent->time, DanmuComparer) - finalPool.begin();
-        while(finalPool.at(f_pos)!=danmu->m_parent) f_pos++;
-        Q_ASSERT(f_pos<finalPool.length());
+        int f_pos = findDanmu(finalPool, danmu->m_parent->time, danmu->m_parent);
+        Q_ASSERT(f_pos != -1);
         int c_pos=danmu->m_parent->mergedList->indexOf(danmu);
         beginRemoveRows(createIndex(f_pos,0,danmu->m_parent), c_pos, c_pos);
         danmu->m_parent->mergedList->removeAt(c_pos);
         endRemoveRows();
     }
-	int row = danmuPool.indexOf(danmu);
-    curPool->deleteDanmu(row);
-	beginRemoveRows(QModelIndex(), row, row);
-    danmuPool.removeAt(row);
-    endRemoveRows();
-    setStatisInfo();
+    int row = findDanmu(danmuPool, danmu->time, danmu.data());
+    if(row != -1) danmuPool.removeAt(row);
 }
+
 void DanmuPool::setMerged()
 {
 #ifdef QT_DEBUG
@@ -125,7 +146,16 @@ void DanmuPool::setMerged()
     QElapsedTimer timer;
     timer.start();
 #endif
-    for(auto iter=danmuPool.cbegin();iter!=danmuPool.cend();++iter)
+    statisInfo.mergeCount=mergeDanmu(danmuPool, finalPool);
+    currentPosition = std::lower_bound(finalPool.begin(), finalPool.end(), currentTime, DanmuComparer) - finalPool.begin();
+#ifdef QT_DEBUG
+    qDebug()<<"merge done:"<<timer.elapsed()<<"ms";
+#endif
+}
+
+int DanmuPool::mergeDanmu(const QList<QSharedPointer<DanmuComment> > &comments, QList<QSharedPointer<DanmuComment> > &merged)
+{
+    for(auto iter=comments.cbegin();iter!=comments.cend();++iter)
     {
         if((*iter)->mergedList)
         {
@@ -134,12 +164,12 @@ void DanmuPool::setMerged()
         }
         if((*iter)->m_parent) (*iter)->m_parent=nullptr;
     }
-    statisInfo.mergeCount=0;
+    int mergeCount=0;
+    merged.clear();
     if(enableMerged)
     {
-        finalPool.clear();
         QList<QSharedPointer<DanmuComment> > slideWindow;
-        for(auto iter=danmuPool.cbegin();iter!=danmuPool.cend();++iter)
+        for(auto iter=comments.cbegin();iter!=comments.cend();++iter)
         {
             DanmuComment *cc((*iter).data());
             while(!slideWindow.isEmpty() && cc->time-slideWindow.first()->time>mergeInterval)
@@ -149,7 +179,7 @@ void DanmuPool::setMerged()
                 {
                     if(c->mergedList->count()<minMergeCount)
                     {
-                        finalPool.append(*c->mergedList);
+                        merged.append(*c->mergedList);
                         for(auto &cc:*c->mergedList)
                             cc->m_parent=nullptr;
                         delete c->mergedList;
@@ -157,12 +187,12 @@ void DanmuPool::setMerged()
                     }
                     else
                     {
-                        statisInfo.mergeCount+=c->mergedList->count();
+                        mergeCount+=c->mergedList->count();
                     }
                 }
-                finalPool.append(c);
+                merged.append(c);
             }
-            bool merged=false;
+            bool isMerged=false;
             for(int i=0;i<slideWindow.length();++i)
             {
                 DanmuComment *sw(slideWindow.at(i).data());
@@ -173,26 +203,23 @@ void DanmuPool::setMerged()
                     cc->m_parent=sw;
                     if(!sw->mergedList) sw->mergedList=new QList<QSharedPointer<DanmuComment> >();
                     sw->mergedList->append((*iter));
-                    merged=true;
+                    isMerged=true;
                     break;
                 }
             }
-            if(!merged)
+            if(!isMerged)
             {
                 slideWindow.append((*iter));
             }
         }
-        finalPool.append(slideWindow);
-        std::sort(finalPool.begin(),finalPool.end(),DanmuSPCompare);
+        merged.append(slideWindow);
+        std::sort(merged.begin(),merged.end(),DanmuSPCompare);
     }
     else
     {
-        finalPool=danmuPool;
+        merged=comments;
     }
-    currentPosition = std::lower_bound(finalPool.begin(), finalPool.end(), currentTime, DanmuComparer) - finalPool.begin();
-#ifdef QT_DEBUG
-    qDebug()<<"merge done:"<<timer.elapsed()<<"ms";
-#endif
+    return mergeCount;
 }
 
 bool DanmuPool::contentSimilar(const DanmuComment *dm1, const DanmuComment *dm2)
@@ -232,7 +259,7 @@ void DanmuPool::setConnect(Pool *pool)
 {
 	if (curPool)
 	{
-		disconnect(curPool);
+		QObject::disconnect(curPool, &Pool::poolChanged, this, nullptr);
 		curPool->setUsed(false);
 	}
     curPool=pool;
@@ -241,9 +268,22 @@ void DanmuPool::setConnect(Pool *pool)
     curPool->setUsed(true);
     beginResetModel();
     danmuPool=curPool->comments();
-    setMerged();
-    setStatisInfo();
-    setAnalyzation();
+    if(standby.ready && standby.pool==pool)
+    {
+        //merged and analyzed while the previous item was playing
+        QObject::disconnect(pool, &Pool::poolChanged, this, &DanmuPool::dropStandby);
+        finalPool.swap(standby.finalPool);
+        statisInfo.mergeCount=standby.mergeCount;
+        setStatisInfo();
+        emit eventAnalyzeFinished(standby.events);
+        standby=Standby();
+    }
+    else
+    {
+        setMerged();
+        setStatisInfo();
+        setAnalyzation();
+    }
     endResetModel();
     QObject::connect(curPool,&Pool::poolChanged,this,[this](bool ){
         beginResetModel();
@@ -256,6 +296,17 @@ void DanmuPool::setConnect(Pool *pool)
     });
 }
 
+void DanmuPool::dropStandby()
+{
+    if(!standby.pool) return;
+    if(standby.pool!=curPool)
+    {
+        QObject::disconnect(standby.pool, &Pool::poolChanged, this, &DanmuPool::dropStandby);
+        if(standby.ready) standby.pool->setUsed(false);
+    }
+    standby=Standby();
+}
+
 void DanmuPool::setStatisInfo()
 {
     statisInfo.countOfSecond.clear();
@@ -296,6 +347,7 @@ void DanmuPool::setStatisInfo()
 void DanmuPool::setAnalyzeEnable(bool enable)
 {
     enableAnalyze = enable;
+    dropStandby();
     setAnalyzation();
 }
 
@@ -304,6 +356,7 @@ void DanmuPool::setMergeEnable(bool enable)
     if(enable!=enableMerged)
     {
         enableMerged=enable;
+        dropStandby();
         beginResetModel();
         setMerged();
         endResetModel();
@@ -315,6 +368,7 @@ void DanmuPool::setMergeInterval(int val)
     if(val!=mergeInterval)
     {
         mergeInterval=val;
+        dropStandby();
         beginResetModel();
         setMerged();
         endResetModel();
@@ -326,6 +380,7 @@ void DanmuPool::setMaxUnSimCount(int val)
     if(val!=maxContentUnsimCount)
     {
         maxContentUnsimCount=val;
+        dropStandby();
         beginResetModel();
         setMerged();
         endResetModel();
@@ -337,6 +392,7 @@ void DanmuPool::setMinMergeCount(int val)
     if(val!=minMergeCount)
     {
         minMergeCount=val;
+        dropStandby();
         beginResetModel();
         setMerged();
         endResetModel();
@@ -345,11 +401,45 @@ void DanmuPool::setMinMergeCount(int val)
 
 void DanmuPool::setPoolID(const QString &pid)
 {
-    if(pid==curPool->id()) return;
+    if(pid==curPool->id() || (!pid.isEmpty() && pid==loadingPoolId)) return;
     GlobalObjects::blocker->resetBlockCount();
-    Pool *pool = GlobalObjects::danmuManager->getPool(pid);
-    if(pool) setConnect(pool);
-    else if(curPool!=emptyPool) setConnect(emptyPool);
+    loadingPoolId.clear();
+    if(standby.ready && standby.pool->id()==pid)
+    {
+        setConnect(standby.pool);
+        return;
+    }
+    dropStandby();
+    Pool *pool = GlobalObjects::danmuManager->getPool(pid, false);
+    if(curPool!=emptyPool) setConnect(emptyPool);
+    if(!pool) return;
+    loadingPoolId = pid;
+    Async::then(GlobalObjects::danmuManager->getPoolAsync(pid), this, [this, pid](Pool *pool){
+        //another pool is requested while loading
+        if(pid!=loadingPoolId) return;
+        loadingPoolId.clear();
+        if(pool) setConnect(pool);
+    });
+}
+
+void DanmuPool::prefetch(const QString &pid)
+{
+    if(pid.isEmpty() || pid==curPool->id() || pid==loadingPoolId || (standby.pool && standby.pool->id()==pid)) return;
+    dropStandby();
+    Pool *pool = GlobalObjects::danmuManager->getPool(pid, false);
+    if(!pool) return;
+    standby.pool = pool;
+    //danmu added or removed in the meantime invalidates the merge
+    QObject::connect(pool, &Pool::poolChanged, this, &DanmuPool::dropStandby);
+    //block rules and the pool cache are applied by getPoolAsync, as in setPoolID
+    Async::then(GlobalObjects::danmuManager->getPoolAsync(pid), this, [this](Pool *pool){
+        if(!pool || standby.pool!=pool || pool==curPool) return;
+        //pinned in the pool cache and sorted, as the current pool
+        pool->setUsed(true);
+        standby.mergeCount = mergeDanmu(pool->comments(), standby.finalPool);
+        if(enableAnalyze) standby.events = analyzer->analyze(pool);
+        standby.ready = true;
+    });
 }
 
 void DanmuPool::mediaTimeElapsed(int newTime)
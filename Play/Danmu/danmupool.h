@@ -35,6 +35,17 @@ public:
 
 private:
     Pool *curPool,*emptyPool;
+    QString loadingPoolId;
+    //pool of the next item, loaded and merged before the switch by prefetch()
+    struct Standby
+    {
+        Pool *pool = nullptr;
+        bool ready = false;
+        QList<QSharedPointer<DanmuComment> > finalPool;
+        int mergeCount = 0;
+        QList<DanmuEvent> events;
+    };
+    Standby standby;
     QList<QSharedPointer<DanmuComment> > danmuPool;
     QList<QSharedPointer<DanmuComment> > finalPool;
     QList<QList<DrawTask> *> prepareListPool;
@@ -50,9 +61,13 @@ private:
     int maxContentUnsimCount;
     int minMergeCount;
     void setMerged();
+    int mergeDanmu(const QList<QSharedPointer<DanmuComment> > &comments, QList<QSharedPointer<DanmuComment> > &merged);
+    void removeDanmu(const QSharedPointer<DanmuComment> &danmu);
+    static int findDanmu(const QList<QSharedPointer<DanmuComment> > &list, int time, const DanmuComment *danmu);
     bool contentSimilar(const DanmuComment *dm1, const DanmuComment *dm2);
     void setAnalyzation();
     void setConnect(Pool *pool);
+    void dropStandby();
 
     void setStatisInfo();
 public:
@@ -62,6 +77,7 @@ public:
     void setMaxUnSimCount(int val);
     void setMinMergeCount(int val);
     void setPoolID(const QString &pid);
+    void prefetch(const QString &pid);
     void testBlockRule(BlockRule *rule);
     void cleanUp();
 
@@ -4,6 +4,7 @@
 #include <QAbstractItemModel>
 #include "common.h"
 static const int SourceRole = Qt::UserRole+1;
+static const int IdRole = Qt::UserRole+2;
 template<typename T>
 class DanmuViewModel : public QAbstractItemModel
 {
@@ -12,6 +13,11 @@ public:
     {
         this->danmuList=danmuList;
     }
+    void refresh()
+    {
+        beginResetModel();
+        endResetModel();
+    }
 private:
     const QList<T> *danmuList;
 public:
@@ -77,6 +83,8 @@ public:
         }
         case SourceRole:
             return comment->source;
+        case IdRole:
+            return comment->id();
         default:
             return QVariant();
         }
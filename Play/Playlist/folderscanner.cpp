@@ -0,0 +1,202 @@
+#include "folderscanner.h"
+#include "globalobjects.h"
+#include "Play/Video/mpvplayer.h"
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+FolderScanner::FolderScanner(int threadCount)
+{
+    scanPool = new QThreadPool();
+    scanPool->setMaxThreadCount(qMax(1, threadCount));
+}
+
+FolderScanner::~FolderScanner()
+{
+    {
+        QMutexLocker locker(&scansLock);
+        for(const auto &weakScan : activeScans)
+        {
+            QSharedPointer<Scan> scan(weakScan.toStrongRef());
+            if(scan) scan->token.cancel();
+        }
+    }
+    scanPool->waitForDone();
+    delete scanPool;
+}
+
+QFuture<int> FolderScanner::scan(const QStringList &roots, QObject *context, BatchCallback callback, const CancelToken &token,
+                                 const QSet<QString> &skipDirs)
+{
+    QSharedPointer<Scan> scan(new Scan);
+    scan->token = token;
+    scan->context = context;
+    scan->callback = callback;
+    scan->skipDirs = skipDirs;
+    for(const QString &format : GlobalObjects::mpvplayer->videoFileFormats)
+        scan->suffixes << format.mid(format.lastIndexOf('.') + 1).toLower();
+    scan->futureInterface.reportStarted();
+    QFuture<int> future(scan->futureInterface.future());
+    {
+        QMutexLocker locker(&scansLock);
+        activeScans << scan.toWeakRef();
+    }
+    if(roots.isEmpty())
+    {
+        finish(scan);
+        return future;
+    }
+    scan->pending.store(roots.size());
+    for(const QString &root : roots)
+    {
+        Dir dir;
+        dir.path = root;
+        scanPool->start(new Async::FunctionRunnable([this, scan, dir](){
+            listDir(scan, dir, 0);
+        }));
+    }
+    return future;
+}
+
+void FolderScanner::listDir(const QSharedPointer<Scan> &scan, Dir dir, int depth)
+{
+    if(!scan->token.isCancelled())
+    {
+        QVector<Entry> entries;
+        dir.listed = readDir(dir.path, entries);
+        //same order as QDir::entryInfoList
+        std::sort(entries.begin(), entries.end(), [](const Entry &e1, const Entry &e2){
+            return e1.name.compare(e2.name, Qt::CaseInsensitive) < 0;
+        });
+        const QString prefix(dir.path.endsWith('/') ? dir.path : dir.path + '/');
+        QList<Dir> subDirs;
+        for(int i = 0; i < entries.size(); ++i)
+        {
+            const Entry &entry = entries[i];
+            if(entry.isDir)
+            {
+                Dir subDir;
+                subDir.path = prefix + entry.name;
+                subDir.parentPath = dir.path;
+                subDir.order = i;
+                dir.dirs << subDir.path;
+                if(depth >= maxDepth || scan->skipDirs.contains(subDir.path)) continue;
+                if(entry.isLink)
+                {
+                    //symlinked directories may point back to an ancestor
+                    QString target(QFileInfo(subDir.path).canonicalFilePath());
+                    QMutexLocker locker(&scan->lock);
+                    if(target.isEmpty() || scan->linkTargets.contains(target)) continue;
+                    scan->linkTargets << target;
+                }
+                subDirs << subDir;
+            }
+            else
+            {
+                const int suffixPos = entry.name.lastIndexOf('.');
+                if(suffixPos < 0 || !scan->suffixes.contains(entry.name.mid(suffixPos + 1).toLower())) continue;
+                dir.files << prefix + entry.name;
+                dir.fileOrder << i;
+            }
+        }
+        scan->dirCount.ref();
+        post(scan, dir);
+        scan->pending.fetchAndAddOrdered(subDirs.size());
+        for(const Dir &subDir : subDirs)
+        {
+            scanPool->start(new Async::FunctionRunnable([this, scan, subDir, depth](){
+                listDir(scan, subDir, depth + 1);
+            }));
+        }
+    }
+    if(!scan->pending.deref()) finish(scan);
+}
+
+void FolderScanner::post(const QSharedPointer<Scan> &scan, const Dir &dir)
+{
+    QMutexLocker locker(&scan->lock);
+    scan->batch.append(dir);
+    if(scan->flushPosted) return;
+    scan->flushPosted = true;
+    //the posted flush takes everything listed until it runs
+    QSharedPointer<Scan> s(scan);
+    QMetaObject::invokeMethod(scan->context, [s](){
+        QList<Dir> batch;
+        {
+            QMutexLocker locker(&s->lock);
+            batch.swap(s->batch);
+            s->flushPosted = false;
+        }
+        if(!batch.isEmpty()) s->callback(batch);
+    }, Qt::QueuedConnection);
+}
+
+void FolderScanner::finish(const QSharedPointer<Scan> &scan)
+{
+    {
+        QMutexLocker locker(&scansLock);
+        for(auto iter = activeScans.begin(); iter != activeScans.end();)
+        {
+            QSharedPointer<Scan> s(iter->toStrongRef());
+            if(!s || s == scan) iter = activeScans.erase(iter);
+            else ++iter;
+        }
+    }
+    //queued after the last flush, so the callback has seen every directory when the future finishes
+    scan->futureInterface.reportResult(scan->dirCount.load());
+    scan->futureInterface.reportFinished();
+}
+
+bool FolderScanner::readDir(const QString &path, QVector<Entry> &entries)
+{
+#ifdef Q_OS_UNIX
+    DIR *dir = opendir(QFile::encodeName(path).constData());
+    if(!dir) return false;
+    while(dirent *e = readdir(dir))
+    {
+        //hidden entries, "." and "..", as QDir skips them by default
+        if(e->d_name[0] == '.') continue;
+        Entry entry;
+        entry.isLink = false;
+        if(e->d_type == DT_DIR)
+        {
+            entry.isDir = true;
+        }
+        else if(e->d_type == DT_REG)
+        {
+            entry.isDir = false;
+        }
+        else if(e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+        {
+            struct stat st;
+            if(fstatat(dirfd(dir), e->d_name, &st, 0) != 0) continue;
+            if(!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) continue;
+            entry.isDir = S_ISDIR(st.st_mode);
+            entry.isLink = e->d_type == DT_LNK;
+        }
+        else
+        {
+            continue;
+        }
+        entry.name = QFile::decodeName(e->d_name);
+        entries.append(entry);
+    }
+    closedir(dir);
+    return true;
+#else
+    if(!QFileInfo(path).isDir()) return false;
+    QDirIterator iter(path, QDir::AllEntries | QDir::NoDotAndDotDot);
+    while(iter.hasNext())
+    {
+        iter.next();
+        const QFileInfo info(iter.fileInfo());
+        Entry entry;
+        entry.name = info.fileName();
+        entry.isDir = info.isDir();
+        entry.isLink = info.isSymLink();
+        entries.append(entry);
+    }
+    return true;
+#endif
+}
@@ -0,0 +1,66 @@
+#ifndef FOLDERSCANNER_H
+#define FOLDERSCANNER_H
+#include <QtCore>
+#include <functional>
+#include "Common/asynctask.h"
+/*
+ * Background folder walker for folder collections.
+ * Every directory is listed by its own task on a small bounded pool, so sibling directories
+ * (slow on network shares) are read in parallel. On unix the entry type comes from readdir,
+ * only symlinks and unknown types are stat'ed.
+ * Listed directories (parents always before children) are handed to the callback in batches
+ * on the thread of the context object, the future gives the number of directories when the walk is over.
+ * Directories in skipDirs are not entered unless they are roots, for rescanning only the changed part of a tree.
+ */
+class FolderScanner
+{
+public:
+    struct Dir
+    {
+        QString path, parentPath;
+        int order = 0;  //position among the entries of the parent directory
+        bool listed = false;
+        QStringList files, dirs;
+        QVector<int> fileOrder;
+    };
+    typedef std::function<void(const QList<Dir> &)> BatchCallback;
+
+    explicit FolderScanner(int threadCount);
+    ~FolderScanner();
+
+    QFuture<int> scan(const QStringList &roots, QObject *context, BatchCallback callback, const CancelToken &token,
+                      const QSet<QString> &skipDirs = QSet<QString>());
+
+private:
+    struct Entry
+    {
+        QString name;
+        bool isDir;
+        bool isLink;
+    };
+    struct Scan
+    {
+        CancelToken token;
+        QObject *context;
+        BatchCallback callback;
+        QSet<QString> suffixes;
+        QSet<QString> skipDirs;
+        QFutureInterface<int> futureInterface;
+        QAtomicInt pending, dirCount;
+        QMutex lock;
+        QList<Dir> batch;
+        bool flushPosted = false;
+        QSet<QString> linkTargets;
+    };
+    QThreadPool *scanPool;
+    QMutex scansLock;
+    QList<QWeakPointer<Scan>> activeScans;
+    const int maxDepth = 32;
+
+    void listDir(const QSharedPointer<Scan> &scan, Dir dir, int depth);
+    void post(const QSharedPointer<Scan> &scan, const Dir &dir);
+    void finish(const QSharedPointer<Scan> &scan);
+    static bool readDir(const QString &path, QVector<Entry> &entries);
+};
+
+#endif // FOLDERSCANNER_H
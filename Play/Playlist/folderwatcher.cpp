@@ -0,0 +1,165 @@
+#include "folderwatcher.h"
+#include <QFileSystemWatcher>
+#include <QFileInfo>
+#include <QTimer>
+#include "globalobjects.h"
+#include "Common/asynctask.h"
+
+FolderWatcher::FolderWatcher(QObject *parent) : QObject(parent), pollPos(0), enabled(false), polling(false)
+{
+#ifdef Q_OS_LINUX
+    //every directory costs an inotify watch, the per-user limit is shared with other programs
+    const int defaultBudget = 2048;
+#else
+    const int defaultBudget = 256;
+#endif
+    watchBudget = qMax(0, GlobalObjects::appSetting->value("List/MaxFolderWatches", defaultBudget).toInt());
+    watcher = new QFileSystemWatcher(this);
+    QObject::connect(watcher, &QFileSystemWatcher::directoryChanged, this, &FolderWatcher::folderChanged);
+    debounceTimer = new QTimer(this);
+    debounceTimer->setSingleShot(true);
+    QObject::connect(debounceTimer, &QTimer::timeout, this, &FolderWatcher::flush);
+    pollTimer = new QTimer(this);
+    QObject::connect(pollTimer, &QTimer::timeout, this, &FolderWatcher::poll);
+}
+
+void FolderWatcher::setFolders(const QStringList &folders)
+{
+    this->folders = folders;
+    if(enabled) updateWatches();
+}
+
+void FolderWatcher::setEnable(bool on)
+{
+    if(enabled == on) return;
+    enabled = on;
+    if(enabled)
+    {
+        updateWatches();
+    }
+    else
+    {
+        if(!watcher->directories().isEmpty()) watcher->removePaths(watcher->directories());
+        watchedFolders.clear();
+        polledFolders.clear();
+        pollMTime.clear();
+        changedFolders.clear();
+        debounceTimer->stop();
+        pollTimer->stop();
+    }
+}
+
+void FolderWatcher::updateWatches()
+{
+    QSet<QString> folderSet;
+    for(const QString &folder : folders) folderSet << folder;
+    QStringList unwatched;
+    for(const QString &folder : watchedFolders)
+    {
+        if(!folderSet.contains(folder)) unwatched << folder;
+    }
+    if(!unwatched.isEmpty())
+    {
+        watcher->removePaths(unwatched);
+        for(const QString &folder : unwatched) watchedFolders.remove(folder);
+    }
+    //folders come in tree order, so the budget goes to the upper levels first
+    QStringList toWatch, toPoll;
+    int watchCount = watchedFolders.size();
+    for(const QString &folder : folders)
+    {
+        if(watchedFolders.contains(folder)) continue;
+        if(watchCount < watchBudget)
+        {
+            toWatch << folder;
+            ++watchCount;
+        }
+        else
+        {
+            toPoll << folder;
+        }
+    }
+    if(!toWatch.isEmpty())
+    {
+        //out of watch descriptors or missing, poll them instead
+        const QStringList failed(watcher->addPaths(toWatch));
+        for(const QString &folder : toWatch) watchedFolders << folder;
+        for(const QString &folder : failed)
+        {
+            watchedFolders.remove(folder);
+            toPoll << folder;
+        }
+    }
+    polledFolders = toPoll;
+    QSet<QString> polledSet;
+    for(const QString &folder : polledFolders) polledSet << folder;
+    for(auto iter = pollMTime.begin(); iter != pollMTime.end();)
+    {
+        if(!polledSet.contains(iter.key())) iter = pollMTime.erase(iter);
+        else ++iter;
+    }
+    if(pollPos >= polledFolders.size()) pollPos = 0;
+    if(polledFolders.isEmpty()) pollTimer->stop();
+    else if(!pollTimer->isActive()) pollTimer->start(pollInterval);
+}
+
+void FolderWatcher::folderChanged(const QString &path)
+{
+    if(changedFolders.isEmpty()) changeTimer.start();
+    changedFolders << path;
+    //copying a season in fires a change per file, wait until it calms down, but not forever
+    const int remain = maxDebounceDelay - int(changeTimer.elapsed());
+    debounceTimer->start(qBound(0, remain, debounceInterval));
+    //a removed directory drops its watch, it may come back later
+    if(watchedFolders.contains(path) && !QFileInfo(path).isDir())
+    {
+        watcher->removePath(path);
+        watchedFolders.remove(path);
+        if(!polledFolders.contains(path)) polledFolders << path;
+        if(!pollTimer->isActive()) pollTimer->start(pollInterval);
+    }
+}
+
+void FolderWatcher::flush()
+{
+    if(changedFolders.isEmpty()) return;
+    QStringList changed(changedFolders.toList());
+    changedFolders.clear();
+    emit foldersChanged(changed);
+}
+
+void FolderWatcher::poll()
+{
+    if(polling || polledFolders.isEmpty()) return;
+    const int end = qMin(pollPos + pollBatchSize, polledFolders.size());
+    const QStringList batch(polledFolders.mid(pollPos, end - pollPos));
+    pollPos = end < polledFolders.size() ? end : 0;
+    polling = true;
+    auto future = Async::run([batch](){
+        QVector<qint64> mtimes;
+        mtimes.reserve(batch.size());
+        for(const QString &path : batch)
+        {
+            QFileInfo info(path);
+            mtimes << (info.isDir() ? info.lastModified().toMSecsSinceEpoch() : -1);
+        }
+        return mtimes;
+    });
+    Async::then(future, this, [this, batch](const QVector<qint64> &mtimes){
+        polling = false;
+        if(!enabled) return;
+        for(int i = 0; i < batch.size(); ++i)
+        {
+            auto iter = pollMTime.find(batch[i]);
+            if(iter == pollMTime.end())
+            {
+                //the first check only takes the baseline
+                pollMTime.insert(batch[i], mtimes[i]);
+                continue;
+            }
+            if(iter.value() == mtimes[i]) continue;
+            iter.value() = mtimes[i];
+            folderChanged(batch[i]);
+        }
+    });
+}
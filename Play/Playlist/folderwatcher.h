@@ -0,0 +1,52 @@
+#ifndef FOLDERWATCHER_H
+#define FOLDERWATCHER_H
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QElapsedTimer>
+class QFileSystemWatcher;
+class QTimer;
+/*
+ * Change monitor for the directories of folder collections.
+ * Directories are watched by QFileSystemWatcher (inotify on Linux) up to a watch budget,
+ * the rest (and those the system refuses to watch) are polled: a slice of them is checked
+ * for an mtime change on every tick, on a task pool thread.
+ * Changes are debounced, foldersChanged gives the directories whose entries changed.
+ */
+class FolderWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FolderWatcher(QObject *parent = nullptr);
+
+    void setFolders(const QStringList &folders);
+    void setEnable(bool on);
+    inline bool isEnabled() const {return enabled;}
+
+signals:
+    void foldersChanged(const QStringList &folders);
+
+private:
+    QFileSystemWatcher *watcher;
+    QTimer *debounceTimer, *pollTimer;
+    QStringList folders, polledFolders;
+    QSet<QString> watchedFolders;
+    QHash<QString, qint64> pollMTime;
+    QSet<QString> changedFolders;
+    QElapsedTimer changeTimer;
+    int watchBudget, pollPos;
+    bool enabled, polling;
+
+    const int debounceInterval = 2000;
+    const int maxDebounceDelay = 30000;
+    const int pollInterval = 30000;
+    const int pollBatchSize = 200;
+
+    void updateWatches();
+    void folderChanged(const QString &path);
+    void flush();
+    void poll();
+};
+
+#endif // FOLDERWATCHER_H
@@ -0,0 +1,74 @@
+#include "nextitemprefetcher.h"
+#include <QFile>
+#include "playlist.h"
+#include "globalobjects.h"
+#include "Play/Video/mpvplayer.h"
+#include "Play/Danmu/danmupool.h"
+
+NextItemPrefetcher::NextItemPrefetcher(PlayList *playlist) : QObject(playlist), playlist(playlist), prefetched(false),
+    edChapter("^(ed|ending)\\b", QRegularExpression::CaseInsensitiveOption)
+{
+    enabled = GlobalObjects::appSetting->value("Play/Prefetch", true).toBool();
+    prefetchPosition = qBound(50, GlobalObjects::appSetting->value("Play/PrefetchPosition", 90).toInt(), 99);
+    QObject::connect(GlobalObjects::mpvplayer, &MPVPlayer::fileChanged, this, [this](){
+        warmToken.cancel();
+        prefetched = false;
+    });
+    QObject::connect(GlobalObjects::mpvplayer, &MPVPlayer::positionChanged, this, &NextItemPrefetcher::positionChanged);
+}
+
+void NextItemPrefetcher::positionChanged(int pos)
+{
+    if(!enabled || prefetched) return;
+    const qint64 duration = GlobalObjects::mpvplayer->getDuration()*1000ll;
+    if(duration <= 0) return;
+    bool reached = pos >= duration*prefetchPosition/100;
+    if(!reached)
+    {
+        for(const MPVPlayer::ChapterInfo &chapter : GlobalObjects::mpvplayer->getChapters())
+        {
+            if(pos >= chapter.position && chapter.title.contains(edChapter))
+            {
+                reached = true;
+                break;
+            }
+        }
+    }
+    if(reached) prefetch();
+}
+
+void NextItemPrefetcher::prefetch()
+{
+    prefetched = true;
+    //the player stops or replays the current item at the end in these modes
+    const PlayList::LoopMode loopMode = playlist->getLoopMode();
+    if(loopMode == PlayList::NO_Loop_One || loopMode == PlayList::Loop_One) return;
+    const PlayListItem *cur = playlist->getCurrentItem();
+    const PlayListItem *next = playlist->peekNextItem();
+    if(!cur || !next || next == cur) return;
+    if(next->hasPool() && next->poolID != cur->poolID)
+        GlobalObjects::danmuPool->prefetch(next->poolID);
+    warmToken = CancelToken();
+    const QString path(next->path);
+    const CancelToken token(warmToken);
+    const qint64 size = warmSize;
+    Async::run([path, size, token](){
+        warmFile(path, size, token);
+        return true;
+    }, Async::Background, token);
+}
+
+void NextItemPrefetcher::warmFile(const QString &path, qint64 size, const CancelToken &token)
+{
+    //container headers and the first seconds, mpv opens the file from the page cache after the switch
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) return;
+    const qint64 chunkSize = 1024*1024;
+    QByteArray buffer(chunkSize, Qt::Uninitialized);
+    for(qint64 read = 0; read < size && !token.isCancelled();)
+    {
+        const qint64 len = file.read(buffer.data(), chunkSize);
+        if(len <= 0) break;
+        read += len;
+    }
+}
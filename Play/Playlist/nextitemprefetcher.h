@@ -0,0 +1,32 @@
+#ifndef NEXTITEMPREFETCHER_H
+#define NEXTITEMPREFETCHER_H
+#include <QObject>
+#include <QRegularExpression>
+#include "Common/asynctask.h"
+class PlayList;
+/*
+ * Prepares the item playPrevOrNext(false) will go to while the current one is near its end:
+ * once playback passes Play/PrefetchPosition (percent of the duration) or enters an ED chapter,
+ * the danmu pool of the next item is loaded and merged into the standby state of DanmuPool,
+ * and the head of its file is read into the page cache on a task pool thread.
+ */
+class NextItemPrefetcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit NextItemPrefetcher(PlayList *playlist);
+
+private:
+    PlayList *playlist;
+    CancelToken warmToken;
+    bool enabled, prefetched;
+    int prefetchPosition;
+    const QRegularExpression edChapter;
+    const qint64 warmSize = 32*1024*1024;
+
+    void positionChanged(int pos);
+    void prefetch();
+    static void warmFile(const QString &path, qint64 size, const CancelToken &token);
+};
+
+#endif // NEXTITEMPREFETCHER_H
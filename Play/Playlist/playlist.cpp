@@ -6,57 +6,121 @@
 #include <QFile>
 #include <QCoreApplication>
 #include <QDir>
-#include <QCollator>
+#include <QtConcurrent>
+#include <QElapsedTimer>
+#include <QTimer>
 
 #include "playlistprivate.h"
+#include "folderwatcher.h"
+#include "playprogress.h"
+#include "nextitemprefetcher.h"
 #include "globalobjects.h"
 #include "Play/Video/mpvplayer.h"
 #include "Play/Danmu/Manager/danmumanager.h"
 #include "Play/Danmu/Manager/pool.h"
+#include "Play/Danmu/Manager/filehasher.h"
 #include "MediaLibrary/animeworker.h"
 #include "MediaLibrary/animeprovider.h"
 #include "Common/notifier.h"
+#include "Common/asynctask.h"
+#include "Common/dbexecutor.h"
 
 #define BgmCollectionRole Qt::UserRole+1
 #define FolderCollectionRole Qt::UserRole+2
 
 namespace
 {
-    static QCollator comparer;
-    struct
+    //items may be removed while their pools load, only what the task needs is copied
+    struct PoolItem
     {
-        inline bool operator()(const PlayListItem *item1,const PlayListItem *item2) const
+        QString pid, title, path;
+    };
+    typedef std::function<void(Pool *, const PoolItem &, std::function<void()>)> PoolTask;
+
+    //loads the pools one after another and runs the task on each, a cancel stops before the next pool
+    void forEachPool(const QSharedPointer<QList<PoolItem> > &items, const CancelToken &token, QObject *context,
+                     const PoolTask &task, const std::function<void()> &done)
+    {
+        if(items->isEmpty() || token.isCancelled())
         {
-            return comparer.compare(item1->title,item2->title)>=0?false:true;
+            done();
+            return;
         }
-    } titleCompareAscending;
-    struct
+        const PoolItem item(items->takeFirst());
+        Async::then(GlobalObjects::danmuManager->getPoolAsync(item.pid), context, [=](Pool *pool){
+            auto next = [=](){ forEachPool(items, token, context, task, done); };
+            if(pool) task(pool, item, next);
+            else next();
+        });
+    }
+
+    QSharedPointer<QList<PoolItem> > poolItems(const QModelIndexList &indexes)
     {
-        inline bool operator()(const PlayListItem *item1,const PlayListItem *item2) const
+        QSharedPointer<QList<PoolItem> > poolList(new QList<PoolItem>);
+        QList<PlayListItem *> items;
+        for(const QModelIndex &index : indexes)
         {
-            return comparer.compare(item2->title,item1->title)>=0?false:true;
+            if (index.isValid()) items.append(static_cast<PlayListItem*>(index.internalPointer()));
+        }
+        while(!items.empty())
+        {
+            PlayListItem *currentItem=items.takeFirst();
+            if(currentItem->children)
+            {
+                for(PlayListItem *child:*currentItem->children)
+                {
+                    items.push_back(child);
+                }
+            }
+            else if(!currentItem->poolID.isEmpty())
+            {
+                poolList->append({currentItem->poolID, currentItem->title, currentItem->path});
+            }
         }
-    } titleCompareDescending;
+        return poolList;
+    }
 }
 
 PlayList::PlayList(QObject *parent) : QAbstractItemModel(parent), d_ptr(new PlayListPrivate(this))
 {
     Q_D(PlayList);
-    comparer.setNumericMode(true);
     d->loadRecentlist();
     d->loadPlaylist();
     qRegisterMetaType<QList<PlayListItem *> >("QList<PlayListItem *>");
+    qRegisterMetaType<QList<MatchResult> >("QList<MatchResult>");
     matchWorker=new MatchWorker();
     matchWorker->moveToThread(GlobalObjects::workThread);
+    folderScanner=new FolderScanner(GlobalObjects::appSetting->value("List/ScanThreads",4).toInt());
+    folderWatcher=new FolderWatcher(this);
+    QObject::connect(folderWatcher, &FolderWatcher::foldersChanged, this, &PlayList::syncFolders);
+    folderWatcher->setEnable(GlobalObjects::appSetting->value("List/FolderSync", true).toBool());
+    d->scheduleWatchUpdate();
+    playProgress=new PlayProgress(this);
+    QObject::connect(playProgress, &PlayProgress::flushing, this, [this](const QHash<QString, PlayProgress::Entry> &entries){
+        Q_D(PlayList);
+        for(auto iter = entries.cbegin(); iter != entries.cend(); ++iter)
+        {
+            PlayListItem *item = d->fileItems.value(iter.key(), nullptr);
+            if(item && iter->positionChanged) d->itemChanged(item, PlayListJournal::PlayTimeChanged);
+        }
+        d->savePlaylist();
+    });
+    prefetcher=new NextItemPrefetcher(this);
     QObject::connect(GlobalObjects::workThread, &QThread::finished, matchWorker, &QObject::deleteLater);
     //QObject::connect(matchWorker,&MatchWorker::message, this, &PlayList::message);
-    QObject::connect(matchWorker, &MatchWorker::matchDown, this, [this](const QList<PlayListItem *> &matchedItems){
+    QObject::connect(matchWorker, &MatchWorker::matchDown, this, [this](const QStringList &paths, const QList<MatchResult> &matches, const QStringList &pids){
         Q_D(PlayList);
-        d->playListChanged = true;
         d->needRefresh = true;
-        for(auto currentItem : matchedItems)
+        for(int i = 0; i < paths.size(); ++i)
         {
-            QModelIndex nIndex = createIndex(currentItem->parent->children->indexOf(currentItem), 0, currentItem);
+            //items removed while matching are skipped
+            PlayListItem *currentItem = d->fileItems.value(paths[i], nullptr);
+            if(!currentItem || pids.value(i).isEmpty()) continue;
+            currentItem->animeTitle = matches[i].name;
+            currentItem->title = matches[i].ep.toString();
+            currentItem->poolID = pids[i];
+            d->itemChanged(currentItem);
+            QModelIndex nIndex = createIndex(currentItem->row(), 0, currentItem);
             emit dataChanged(nIndex, nIndex);
             if (currentItem == d->currentItem) emit currentMatchChanged(currentItem->poolID);
             autoMoveToBgmCollection(nIndex);
@@ -69,6 +133,7 @@ PlayList::PlayList(QObject *parent) : QAbstractItemModel(parent), d_ptr(new Play
 PlayList::~PlayList()
 {
     Q_D(PlayList);
+    delete folderScanner;
     d->savePlaylist();
     d->saveRecentlist();
     delete d;
@@ -80,11 +145,22 @@ const PlayListItem *PlayList::getCurrentItem() const
     return d->currentItem;
 }
 
+const PlayListItem *PlayList::getPoolItem(const QString &pid) const
+{
+    Q_D(const PlayList);
+    if(pid.isEmpty()) return nullptr;
+    for(PlayListItem *item : d->fileItems)
+    {
+        if(item->poolID == pid && QFile::exists(item->path)) return item;
+    }
+    return nullptr;
+}
+
 QModelIndex PlayList::getCurrentIndex() const
 {
     Q_D(const PlayList);
     PlayListItem *currentItem = d->currentItem;
-    return currentItem?createIndex(currentItem->parent->children->indexOf(currentItem),0,currentItem):QModelIndex();
+    return currentItem?createIndex(currentItem->row(),0,currentItem):QModelIndex();
 }
 
 QList<const PlayListItem *> PlayList::getSiblings(const PlayListItem *item, bool sameAnime)
@@ -106,6 +182,18 @@ PlayList::LoopMode PlayList::getLoopMode() const
     return d->loopMode;
 }
 
+const PlayListItem *PlayList::peekNextItem()
+{
+    Q_D(PlayList);
+    if(d->loopMode==Random)
+    {
+        //keep the choice, playPrevOrNext goes to the item prepared for
+        if(!d->randomNext) d->randomNext=d->getPrevOrNextItem(false);
+        return d->randomNext;
+    }
+    return d->getPrevOrNextItem(false);
+}
+
 bool PlayList::canPaste() const
 {
     Q_D(const PlayList);
@@ -164,7 +252,7 @@ int PlayList::addItems(QStringList &items, QModelIndex parent)
         insertPosition = parentItem->children->size();
     else
     {
-        insertPosition = parentItem->parent->children->indexOf(parentItem) + 1;
+        insertPosition = parentItem->row() + 1;
         parentItem = parentItem->parent;
         parent = this->parent(parent);
     }
@@ -181,21 +269,24 @@ int PlayList::addItems(QStringList &items, QModelIndex parent)
         if(d->autoMatch) matchItems<<newItem;
 	}
 	endInsertRows();
-    d->playListChanged=true;
+    d->childrenChanged(parentItem);
     d->needRefresh = true;
     d->incModifyCounter();
     notifier->showMessage(Notifier::LIST_NOTIFY, tr("Add %1 item(s)").arg(tmpItems.size()),NM_HIDE);
     if(d->autoMatch && matchItems.count()>0)
     {
         emit matchStatusChanged(true);
-        QMetaObject::invokeMethod(matchWorker, [this, matchItems](){
-            matchWorker->match(matchItems);
+        QStringList matchPaths;
+        for(PlayListItem *item : matchItems)
+            matchPaths << item->path;
+        QMetaObject::invokeMethod(matchWorker, [this, matchPaths](){
+            matchWorker->match(matchPaths);
         },Qt::QueuedConnection);
     }
     return tmpItems.size();
 }
 
-int PlayList::addFolder(QString folderStr, QModelIndex parent)
+void PlayList::addFolder(QString folderStr, QModelIndex parent)
 {
     Q_D(PlayList);
     int insertPosition(0);
@@ -206,58 +297,19 @@ int PlayList::addFolder(QString folderStr, QModelIndex parent)
     }
 	else
 	{
-        insertPosition = parentItem->parent->children->indexOf(parentItem) + 1;
+        insertPosition = parentItem->row() + 1;
 		parentItem = parentItem->parent;
-		parent = this->parent(parent);
 	}
-	
-    PlayListItem folderRootCollection;
-    int itemCount=0;
-    d->addSubFolder(folderStr, &folderRootCollection,itemCount);
-    QList<PlayListItem *> matchItems;
-    if (folderRootCollection.children->count())
-	{
-        PlayListItem *folderRoot(folderRootCollection.children->first());
-        beginInsertRows(parent, insertPosition, insertPosition);
-        folderRoot->moveTo(parentItem, insertPosition);
-		endInsertRows();
-        d->playListChanged=true;
-        d->needRefresh = true;
-        d->incModifyCounter();
-        if(d->autoMatch)
-        {
-            QList<PlayListItem *> items({folderRoot});
-            while(!items.empty())
-            {
-                PlayListItem *currentItem=items.takeFirst();
-                if(currentItem->children)
-                {
-                    for(PlayListItem *child:*currentItem->children)
-                    {
-                        items.push_back(child);
-                    }
-                }
-                else if(currentItem->poolID.isEmpty())
-                {
-                    matchItems<<currentItem;
-                }
-            }
-        }
-	}
-    Notifier *notifier = Notifier::getNotifier();
-    notifier->showMessage(Notifier::LIST_NOTIFY, tr("Add %1 item(s)").arg(itemCount),NotifyMessageFlag::NM_HIDE);
-    if(d->autoMatch && matchItems.count()>0)
-    {
-        emit matchStatusChanged(true);
-        QMetaObject::invokeMethod(matchWorker, [this, matchItems](){
-            matchWorker->match(matchItems);
-        },Qt::QueuedConnection);
-    }
-    return itemCount;
+    QSharedPointer<FolderScan> scan(new FolderScan);
+    scan->rootPath = QDir::cleanPath(folderStr);
+    scan->target = parentItem;
+    scan->targetPosition = insertPosition;
+    startFolderScan(QStringList(scan->rootPath), scan);
 }
 
 void PlayList::deleteItems(const QModelIndexList &deleteIndexes)
 {
+    Q_D(PlayList);
     QList<PlayListItem *> items;
     for(const QModelIndex &index : deleteIndexes)
     {
@@ -267,25 +319,15 @@ void PlayList::deleteItems(const QModelIndexList &deleteIndexes)
             items.append(item);
         }
     }
-    std::sort(items.begin(),items.end(),[](const PlayListItem *item1,const PlayListItem *item2){return item1->level>item2->level;});
-    for(PlayListItem *curItem:items)
-    {
-        int cr_row = curItem->parent->children->indexOf(curItem);
-        const QModelIndex &itemIndex = createIndex(cr_row, 0, curItem);
-        beginRemoveRows(itemIndex.parent(), cr_row, cr_row);
-        curItem->parent->children->removeAt(cr_row);
-        endRemoveRows();
-        delete curItem;
-    }
-    Q_D(PlayList);
-    d->playListChanged=true;
-    d->needRefresh = true;
+    d->removeItems(items);
     d->incModifyCounter();
 }
 
-int PlayList::deleteInvalidItems(const QModelIndexList &indexes)
+void PlayList::deleteInvalidItems(const QModelIndexList &indexes)
 {
-    QList<PlayListItem *> items, invalidItems;
+    Q_D(PlayList);
+    QList<PlayListItem *> items, checkItems;
+    QStringList checkPaths;
     for(const QModelIndex &index : indexes)
     {
         if (index.isValid())
@@ -305,30 +347,54 @@ int PlayList::deleteInvalidItems(const QModelIndexList &indexes)
             }
             if(!currentItem->folderPath.isEmpty())
             {
-                if(!QFileInfo::exists(currentItem->folderPath)) invalidItems.append(currentItem);
+                checkItems.append(currentItem);
+                checkPaths.append(currentItem->folderPath);
             }
         }
         else if(!currentItem->path.isEmpty())
         {
-            if(!QFileInfo::exists(currentItem->path)) invalidItems.append(currentItem);
+            checkItems.append(currentItem);
+            checkPaths.append(currentItem->path);
         }
     }
-    if(invalidItems.size() == 0) return 0;
-    std::sort(invalidItems.begin(),invalidItems.end(),[](const PlayListItem *item1,const PlayListItem *item2){return item1->level>item2->level;});
-    for(PlayListItem *curItem:invalidItems)
+    Notifier *notifier = Notifier::getNotifier();
+    if(checkItems.isEmpty())
     {
-        int cr_row = curItem->parent->children->indexOf(curItem);
-        const QModelIndex &itemIndex = createIndex(cr_row, 0, curItem);
-        beginRemoveRows(itemIndex.parent(), cr_row, cr_row);
-        curItem->parent->children->removeAt(cr_row);
-        endRemoveRows();
-        delete curItem;
+        notifier->showMessage(Notifier::LIST_NOTIFY, tr("Remove %1 Invalid Item(s)").arg(0), NotifyMessageFlag::NM_HIDE);
+        return;
+    }
+    //files on slow or unmounted drives can take seconds to stat, check them off the GUI thread in chunks
+    QSharedPointer<ItemCheck> check(new ItemCheck);
+    check->liveItems = checkItems.toSet();
+    const int chunkSize = 256;
+    check->pending = (checkItems.size() + chunkSize - 1) / chunkSize;
+    d->itemChecks << check;
+    notifier->showMessage(Notifier::LIST_NOTIFY, tr("Checking Items..."), NotifyMessageFlag::NM_PROCESS);
+    for(int pos = 0; pos < checkItems.size(); pos += chunkSize)
+    {
+        const QList<PlayListItem *> chunkItems(checkItems.mid(pos, chunkSize));
+        const QStringList chunkPaths(checkPaths.mid(pos, chunkSize));
+        auto future = Async::run([chunkPaths](){
+            QVector<bool> exists;
+            exists.reserve(chunkPaths.size());
+            for(const QString &path : chunkPaths)
+                exists.append(QFileInfo::exists(path));
+            return exists;
+        });
+        Async::then(future, this, [this, check, chunkItems](const QVector<bool> &exists){
+            Q_D(PlayList);
+            QList<PlayListItem *> invalidItems;
+            for(int i = 0; i < chunkItems.size(); ++i)
+            {
+                if(!exists[i] && check->liveItems.contains(chunkItems[i])) invalidItems.append(chunkItems[i]);
+            }
+            check->removedCount += d->removeItems(invalidItems);
+            if(--check->pending > 0) return;
+            d->itemChecks.removeOne(check);
+            if(check->removedCount > 0) d->incModifyCounter();
+            Notifier::getNotifier()->showMessage(Notifier::LIST_NOTIFY, tr("Remove %1 Invalid Item(s)").arg(check->removedCount), NotifyMessageFlag::NM_HIDE);
+        });
     }
-    Q_D(PlayList);
-    d->playListChanged=true;
-    d->needRefresh = true;
-    d->incModifyCounter();
-    return invalidItems.size();
 }
 
 void PlayList::clear()
@@ -342,7 +408,6 @@ void PlayList::clear()
     root->children->clear();
     endRemoveRows();
     d->fileItems.clear();
-    d->playListChanged=true;
     d->needRefresh = true;
 }
 
@@ -355,13 +420,10 @@ void PlayList::sortItems(const QModelIndex &parent, bool ascendingOrder)
         QList<QPersistentModelIndex> persistentIndexList;
         persistentIndexList.append(QPersistentModelIndex(parent));
         emit layoutAboutToBeChanged(persistentIndexList);
-        if(ascendingOrder)
-            std::sort(parentItem->children->begin(),parentItem->children->end(),titleCompareAscending);
-        else
-            std::sort(parentItem->children->begin(),parentItem->children->end(),titleCompareDescending);
+        parentItem->sortChildren(ascendingOrder);
         emit layoutChanged(persistentIndexList);
+        d->childrenChanged(parentItem);
     }
-    d->playListChanged=true;
     d->needRefresh = true;
     d->incModifyCounter();
 }
@@ -369,22 +431,20 @@ void PlayList::sortItems(const QModelIndex &parent, bool ascendingOrder)
 void PlayList::sortAllItems(bool ascendingOrder)
 {
     Q_D(PlayList);
-    QList<PlayListItem *> items;
-    items.push_back(d->root);
-    emit layoutAboutToBeChanged();
-    while(!items.empty())
+    QList<PlayListItem *> collections({d->root});
+    for(int i = 0; i < collections.size(); ++i)
     {
-        PlayListItem *currentItem=items.front();
-        items.pop_front();
-        if(ascendingOrder)
-            std::sort(currentItem->children->begin(),currentItem->children->end(),titleCompareAscending);
-        else
-            std::sort(currentItem->children->begin(),currentItem->children->end(),titleCompareDescending);
-        for(PlayListItem *child:*currentItem->children)
+        for(PlayListItem *child:*collections[i]->children)
             if(child->children)
-                items.push_back(child);
+                collections.push_back(child);
     }
-    d->playListChanged=true;
+    emit layoutAboutToBeChanged();
+    //collections share no items, each one is sorted on its own
+    QtConcurrent::blockingMap(collections, [ascendingOrder](PlayListItem *collection){
+        collection->sortChildren(ascendingOrder);
+    });
+    for(PlayListItem *collection : collections)
+        d->childrenChanged(collection);
     d->needRefresh = true;
     emit layoutChanged();
 }
@@ -401,7 +461,7 @@ QModelIndex PlayList::addCollection(QModelIndex parent, QString title)
 	}
 	else
 	{
-        insertPosition = parentItem->parent->children->indexOf(parentItem) + 1;
+        insertPosition = parentItem->row() + 1;
 		parentItem = parentItem->parent;
 		parent = this->parent(parent);
 	}
@@ -409,37 +469,152 @@ QModelIndex PlayList::addCollection(QModelIndex parent, QString title)
     newCollection = new PlayListItem(parentItem,false,insertPosition);
 	newCollection->title = title;
 	endInsertRows();
-    d->playListChanged=true;
+    d->childrenChanged(parentItem);
     d->needRefresh = true;
     d->incModifyCounter();
     return this->index(insertPosition,0,parent);
 }
 
-int PlayList::refreshFolder(const QModelIndex &index)
+void PlayList::refreshFolder(const QModelIndex &index)
 {
-    Q_D(PlayList);
-    if(!index.isValid())return 0;
+    if(!index.isValid())return;
     PlayListItem *item= static_cast<PlayListItem*>(index.internalPointer());
-    if(!item->children) return 0;
-    QList<PlayListItem *> nItems;
-    int c = d->refreshFolder(item, nItems);
+    if(!item->children) return;
+    QSharedPointer<FolderScan> scan(new FolderScan);
+    QList<PlayListItem *> items({item});
+    while(!items.empty())
+    {
+        PlayListItem *currentItem=items.takeFirst();
+        if(!currentItem->children) continue;
+        if(!currentItem->folderPath.isEmpty() && !scan->collections.contains(currentItem->folderPath))
+        {
+            scan->collections.insert(currentItem->folderPath, currentItem);
+            scan->collectionDirs.insert(currentItem, currentItem->folderPath);
+        }
+        items.append(*currentItem->children);
+    }
+    //folders inside another folder collection are reached by its walk
+    QStringList folders;
+    for(const QString &path : scan->collections.keys())
+        folders << (path.endsWith('/') ? path : path + '/');
+    std::sort(folders.begin(), folders.end());
+    QStringList roots;
+    for(const QString &folder : folders)
+    {
+        if(!roots.isEmpty() && folder.startsWith(roots.last())) continue;
+        roots << folder;
+    }
+    for(QString &root : roots)
+    {
+        if(!scan->collections.contains(root)) root.chop(1);
+    }
+    startFolderScan(roots, scan);
+}
+
+void PlayList::setFolderSync(bool on)
+{
+    folderWatcher->setEnable(on);
+}
+
+void PlayList::syncFolders(const QStringList &folders)
+{
+    Q_D(PlayList);
+    //one sync at a time, changes coming in meanwhile are picked up by the next one
+    for(const auto &scan : d->folderScans)
+    {
+        if(scan->sync)
+        {
+            for(const QString &folder : folders) d->pendingSyncFolders << folder;
+            return;
+        }
+    }
+    QSharedPointer<FolderScan> scan(new FolderScan);
+    scan->sync = true;
+    QList<PlayListItem *> items({d->root});
+    while(!items.empty())
+    {
+        PlayListItem *currentItem=items.takeFirst();
+        if(!currentItem->children) continue;
+        if(!currentItem->folderPath.isEmpty() && !scan->collections.contains(currentItem->folderPath))
+        {
+            scan->collections.insert(currentItem->folderPath, currentItem);
+            scan->collectionDirs.insert(currentItem, currentItem->folderPath);
+        }
+        items.append(*currentItem->children);
+    }
+    //only changed folders are listed again, new subfolders are walked, known ones are left to their own changes
+    QStringList roots;
+    for(const QString &folder : folders)
+    {
+        if(scan->collections.contains(folder)) roots << folder;
+    }
+    if(roots.isEmpty()) return;
+    QSet<QString> skipDirs;
+    for(auto iter = scan->collections.cbegin(); iter != scan->collections.cend(); ++iter)
+        skipDirs << iter.key();
+    startFolderScan(roots, scan, skipDirs);
+}
+
+void PlayList::startFolderScan(const QStringList &roots, const QSharedPointer<FolderScan> &scan, const QSet<QString> &skipDirs)
+{
+    Q_D(PlayList);
+    d->folderScans << scan;
     Notifier *notifier = Notifier::getNotifier();
-    notifier->showMessage(Notifier::LIST_NOTIFY, tr("Add %1 item(s)").arg(c),NotifyMessageFlag::NM_HIDE);
-    if(c>0)
+    QSharedPointer<QMetaObject::Connection> conn(new QMetaObject::Connection);
+    if(!scan->sync)
     {
-        d->playListChanged=true;
-        d->needRefresh = true;
-        d->incModifyCounter();
-        if(d->autoMatch)
+        notifier->showMessage(Notifier::LIST_NOTIFY, tr("Scanning Folder..."), NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
+        CancelToken token(scan->token);
+        *conn = QObject::connect(notifier, &Notifier::cancelTrigger, [token](int nType) mutable { if(nType & Notifier::LIST_NOTIFY) token.cancel();});
+    }
+    auto future = folderScanner->scan(roots, this, [this, scan](const QList<FolderScanner::Dir> &dirs){
+        Q_D(PlayList);
+        if(scan->sync)
+        {
+            d->removeVanishedItems(scan.data(), dirs);
+            d->addScannedDirs(scan.data(), dirs);
+            return;
+        }
+        d->addScannedDirs(scan.data(), dirs);
+        Notifier::getNotifier()->showMessage(Notifier::LIST_NOTIFY, tr("Scanning: %1 folder(s), %2 new item(s)").arg(scan->dirInfo.size()).arg(scan->itemCount),
+                                             NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
+    }, scan->token, skipDirs);
+    Async::then(future, this, [this, scan, conn](int){
+        Q_D(PlayList);
+        QObject::disconnect(*conn);
+        d->folderScans.removeOne(scan);
+        if(scan->sync)
+        {
+            if(!d->pendingSyncFolders.isEmpty())
+            {
+                const QStringList folders(d->pendingSyncFolders.toList());
+                d->pendingSyncFolders.clear();
+                QTimer::singleShot(0, this, [this, folders](){ syncFolders(folders); });
+            }
+            if(scan->itemCount > 0 || scan->removedCount > 0)
+                Notifier::getNotifier()->showMessage(Notifier::LIST_NOTIFY, tr("Folder Sync: %1 new item(s), %2 removed").arg(scan->itemCount).arg(scan->removedCount),
+                                                     NotifyMessageFlag::NM_HIDE);
+        }
+        else
+        {
+            Notifier::getNotifier()->showMessage(Notifier::LIST_NOTIFY, tr("Add %1 item(s)").arg(scan->itemCount),NotifyMessageFlag::NM_HIDE);
+        }
+        if(scan->itemCount == 0 && scan->removedCount == 0) return;
+        d->savePlaylist();
+        d->scheduleWatchUpdate();
+        QStringList matchPaths;
+        for(PlayListItem *item : scan->newItems)
+        {
+            if(scan->liveItems.contains(item) && !item->hasPool()) matchPaths << item->path;
+        }
+        if(d->autoMatch && matchPaths.count()>0)
         {
             emit matchStatusChanged(true);
-            QMetaObject::invokeMethod(matchWorker, [this, nItems](){
-                matchWorker->match(nItems);
+            QMetaObject::invokeMethod(matchWorker, [this, matchPaths](){
+                matchWorker->match(matchPaths);
             },Qt::QueuedConnection);
         }
-        d->savePlaylist();
-    }
-    return c;
+    });
 }
 
 void PlayList::cutItems(const QModelIndexList &cutIndexes)
@@ -461,13 +636,13 @@ void PlayList::cutItems(const QModelIndexList &cutIndexes)
     std::sort(d->itemsClipboard.begin(),d->itemsClipboard.end(),[](const PlayListItem *item1,const PlayListItem *item2){return item1->level>item2->level;});
     for(PlayListItem *curItem:d->itemsClipboard)
     {
-        int cr_row = curItem->parent->children->indexOf(curItem);
+        int cr_row = curItem->row();
         const QModelIndex &itemIndex = createIndex(cr_row, 0, curItem);
         beginRemoveRows(itemIndex.parent(), cr_row, cr_row);
         curItem->parent->children->removeAt(cr_row);
         endRemoveRows();
+        d->childrenChanged(curItem->parent);
     }
-    d->playListChanged=true;
 }
 
 void PlayList::pasteItems(QModelIndex parent)
@@ -480,7 +655,7 @@ void PlayList::pasteItems(QModelIndex parent)
         insertPosition = parentItem->children->size();
     else
     {
-        insertPosition = parentItem->parent->children->indexOf(parentItem) + 1;
+        insertPosition = parentItem->row() + 1;
         parentItem = parentItem->parent;
         parent = this->parent(parent);
     }
@@ -491,7 +666,7 @@ void PlayList::pasteItems(QModelIndex parent)
         item->moveTo(parentItem,insertPosition++);
     }
     endInsertRows();
-    d->playListChanged=true;
+    d->childrenChanged(parentItem);
     d->needRefresh = true;
     d->itemsClipboard.clear();
 }
@@ -501,7 +676,7 @@ void PlayList::moveUpDown(QModelIndex index, bool up)
     if(!index.isValid())return;
     PlayListItem *item= static_cast<PlayListItem*>(index.internalPointer());
     PlayListItem *parent=item->parent;
-    int row=parent->children->indexOf(item);
+    int row=item->row();
     int endPos=up?0:parent->children->count()-1;
     if(row==endPos)return;
     QModelIndex parentIndex=this->parent(index);
@@ -509,7 +684,7 @@ void PlayList::moveUpDown(QModelIndex index, bool up)
     parent->children->move(row,up?row-1:row+1);
     endMoveRows();
     Q_D(PlayList);
-    d->playListChanged=true;
+    d->childrenChanged(parent);
     d->needRefresh = true;
     d->incModifyCounter();
 }
@@ -529,7 +704,7 @@ void PlayList::switchBgmCollection(const QModelIndex &index)
     {
         d->bgmCollectionItems.remove(item->title);
     }
-    d->playListChanged=true;
+    d->itemChanged(item);
     emit dataChanged(index, index);
 }
 
@@ -542,9 +717,9 @@ void PlayList::autoMoveToBgmCollection(const QModelIndex &index)
     if(!bgmCollectionItem)
     {
         PlayListItem *parentItem= currentItem->parent;
-        int insertPosition = parentItem->children->indexOf(currentItem) + 1;
+        int insertPosition = currentItem->row() + 1;
         QModelIndex pIndex = parentItem==d->root?QModelIndex():
-                                                 createIndex(parentItem->parent->children->indexOf(parentItem), 0, parentItem);
+                                                 createIndex(parentItem->row(), 0, parentItem);
 
         beginInsertRows(pIndex, insertPosition, insertPosition);
         bgmCollectionItem=new PlayListItem(parentItem,false,insertPosition);
@@ -555,13 +730,14 @@ void PlayList::autoMoveToBgmCollection(const QModelIndex &index)
     }
     beginRemoveRows(index.parent(), index.row(), index.row());
     currentItem->parent->children->removeAt(index.row());
+    d->childrenChanged(currentItem->parent);
     endRemoveRows();
-    QModelIndex bgmCollectionIndex=createIndex(bgmCollectionItem->parent->children->indexOf(bgmCollectionItem),0,bgmCollectionItem);
+    QModelIndex bgmCollectionIndex=createIndex(bgmCollectionItem->row(),0,bgmCollectionItem);
     int insertPosition = bgmCollectionItem->children->count();
     beginInsertRows(bgmCollectionIndex, insertPosition, insertPosition);
     currentItem->moveTo(bgmCollectionItem);
     endInsertRows();
-    d->playListChanged = true;
+    d->childrenChanged(bgmCollectionItem);
     d->needRefresh = true;
 }
 
@@ -571,7 +747,9 @@ QModelIndex PlayList::index(int row, int column, const QModelIndex &parent) cons
     if (!hasIndex(row, column, parent)) return QModelIndex();
     const PlayListItem *parentItem = parent.isValid() ? static_cast<PlayListItem*>(parent.internalPointer()) : d->root;
 	PlayListItem *childItem = parentItem->children->value(row);
-    return childItem?createIndex(row, column, childItem):QModelIndex();
+    if(!childItem) return QModelIndex();
+    childItem->rowHint = row;
+    return createIndex(row, column, childItem);
 }
 
 QModelIndex PlayList::parent(const QModelIndex &child) const
@@ -583,7 +761,7 @@ QModelIndex PlayList::parent(const QModelIndex &child) const
     PlayListItem *parentItem = childItem->parent;
 
     if (parentItem == d->root) return QModelIndex();
-    int row=parentItem->parent->children->indexOf(parentItem);
+    int row=parentItem->row();
     return createIndex(row, 0, parentItem);
 }
 
@@ -701,7 +879,7 @@ bool PlayList::dropMimeData(const QMimeData *data, Qt::DropAction action, int ro
     QModelIndex pParentIndex=parent;
     if (!parentItem->children)
     {
-        beginRow=parentItem->parent->children->indexOf(parentItem);
+        beginRow=parentItem->row();
         parentItem=parentItem->parent;
         pParentIndex=this->parent(parent);
     }
@@ -709,10 +887,11 @@ bool PlayList::dropMimeData(const QMimeData *data, Qt::DropAction action, int ro
 	{
 		PlayListItem *curItem = newItems[cr];
         PlayListItem *curParent=curItem->parent;
-        int cr_row = curParent->children->indexOf(curItem);
+        int cr_row = curItem->row();
         QModelIndex itemIndex = createIndex(cr_row, 0, curItem);
 		beginRemoveRows(itemIndex.parent(), cr_row, cr_row);
         curParent->children->removeAt(cr_row);
+        d->childrenChanged(curParent);
 		endRemoveRows();
         if (cr_row < beginRow && curParent==parentItem)
 		{
@@ -721,7 +900,7 @@ bool PlayList::dropMimeData(const QMimeData *data, Qt::DropAction action, int ro
         //Moving within the same node, the pParentIndex may change when curItem is removed
         if (parentItem->parent == curParent)
 		{
-			int parentRow = curParent->children->indexOf(parentItem);
+			int parentRow = parentItem->row();
             pParentIndex = createIndex(parentRow, 0, parentItem);
 		}
         beginInsertRows(pParentIndex, beginRow, beginRow);
@@ -730,7 +909,7 @@ bool PlayList::dropMimeData(const QMimeData *data, Qt::DropAction action, int ro
 		parentItem->children->insert(beginRow++, curItem);
 		endInsertRows();
 	}
-    d->playListChanged=true;
+    d->childrenChanged(parentItem);
     d->needRefresh = true;
     return true;
 }
@@ -748,7 +927,7 @@ bool PlayList::setData(const QModelIndex &index, const QVariant &value, int)
             d->bgmCollectionItems.insert(val, item);
         }
         item->title=val;
-        d->playListChanged=true;
+        d->itemChanged(item);
         d->needRefresh = true;
         return true;
     }
@@ -768,7 +947,7 @@ const PlayListItem *PlayList::setCurrentItem(const QModelIndex &index,bool playC
         while (cur!=current)
         {
             if(!cur->children)break;
-            int row=cur->parent->children->indexOf(cur);
+            int row=cur->row();
             if(row==cur->parent->children->count()-1)
                 cur=cur->parent;
             else
@@ -793,12 +972,12 @@ const PlayListItem *PlayList::setCurrentItem(const QModelIndex &index,bool playC
     d->currentItem = cur;
 	if (tmp)
 	{
-		QModelIndex nIndex = createIndex(tmp->parent->children->indexOf(tmp), 0, tmp);
+		QModelIndex nIndex = createIndex(tmp->row(), 0, tmp);
 		emit dataChanged(nIndex, nIndex);
 	}
     d->updateRecentlist(cur);
     if(!cur->animeTitle.isEmpty())
-        AnimeWorker::instance()->updateEpTime(cur->animeTitle, cur->path);
+        playProgress->setPlayed(cur->path, cur->animeTitle);
     return cur;
 }
 
@@ -812,13 +991,13 @@ const PlayListItem *PlayList::setCurrentItem(const QString &path)
         d->currentItem = curItem;
         if (tmp)
         {
-            QModelIndex nIndex = createIndex(tmp->parent->children->indexOf(tmp), 0, tmp);
+            QModelIndex nIndex = createIndex(tmp->row(), 0, tmp);
             emit dataChanged(nIndex, nIndex);
         }
-        QModelIndex cIndex = createIndex(curItem->parent->children->indexOf(curItem), 0, curItem);
+        QModelIndex cIndex = createIndex(curItem->row(), 0, curItem);
         emit dataChanged(cIndex, cIndex);
         if(!curItem->animeTitle.isEmpty())
-            AnimeWorker::instance()->updateEpTime(curItem->animeTitle, curItem->path);
+            playProgress->setPlayed(curItem->path, curItem->animeTitle);
         d->updateRecentlist(curItem);
     }
     return curItem;
@@ -829,7 +1008,7 @@ void PlayList::cleanCurrentItem()
     Q_D(PlayList);
     if (d->currentItem)
 	{
-        QModelIndex cIndex = createIndex(d->currentItem->parent->children->indexOf(d->currentItem), 0, d->currentItem);
+        QModelIndex cIndex = createIndex(d->currentItem->row(), 0, d->currentItem);
         d->currentItem = nullptr;
 		emit dataChanged(cIndex, cIndex);
 	}
@@ -846,14 +1025,14 @@ const PlayListItem *PlayList::playPrevOrNext(bool prev)
         d->currentItem = item;
         if (tmp)
         {
-            QModelIndex nIndex(createIndex(tmp->parent->children->indexOf(tmp), 0, tmp));
+            QModelIndex nIndex(createIndex(tmp->row(), 0, tmp));
             emit dataChanged(nIndex, nIndex);
         }
-        QModelIndex nIndex(createIndex(item->parent->children->indexOf(item),0,item));
+        QModelIndex nIndex(createIndex(item->row(),0,item));
         emit dataChanged(nIndex,nIndex);
         d->updateRecentlist(item);
         if(!item->animeTitle.isEmpty())
-            AnimeWorker::instance()->updateEpTime(item->animeTitle, item->path);
+            playProgress->setPlayed(item->path, item->animeTitle);
         return item;
     }
     return nullptr;
@@ -863,11 +1042,13 @@ void PlayList::setLoopMode(PlayList::LoopMode newMode)
 {
     Q_D(PlayList);
     d->loopMode=newMode;
+    d->randomNext=nullptr;
 }
 
 void PlayList::checkCurrentItem(PlayListItem *itemDeleted)
 {
     Q_D(PlayList);
+    d->itemRemoved(itemDeleted);
     if(!itemDeleted->path.isEmpty())d->fileItems.remove(itemDeleted->path);
     if(itemDeleted->isBgmCollection) d->bgmCollectionItems.remove(itemDeleted->title);
     if(itemDeleted==d->currentItem)
@@ -911,44 +1092,54 @@ void PlayList::matchItems(const QModelIndexList &matchIndexes)
     }
     if(selectedItems.count()==0) return;
     emit matchStatusChanged(true);
-    QMetaObject::invokeMethod(matchWorker, [this, selectedItems](){
-        matchWorker->match(selectedItems);
+    QStringList matchPaths;
+    for(PlayListItem *item : selectedItems)
+        matchPaths << item->path;
+    QMetaObject::invokeMethod(matchWorker, [this, matchPaths](){
+        matchWorker->match(matchPaths);
     },Qt::QueuedConnection);
 }
 
 void PlayList::matchIndex(QModelIndex &index, const MatchResult &match)
 {
-    Q_D(PlayList);
     if(!index.isValid())return;
     PlayListItem *item=static_cast<PlayListItem *>(index.internalPointer());
-    item->animeTitle=match.name;
-    item->title=match.ep.toString();
-    item->poolID=GlobalObjects::danmuManager->updateMatch(item->path,match);
-    d->playListChanged = true;
-    d->needRefresh = true;
-    Notifier *notifier = Notifier::getNotifier();
-    notifier->showMessage(Notifier::LIST_NOTIFY, tr("Success: %1").arg(item->title),NotifyMessageFlag::NM_HIDE);
-    emit dataChanged(index, index);
-    if (item == d->currentItem)
-    {
-        emit currentMatchChanged(item->poolID);
-    }
-    autoMoveToBgmCollection(index);
-    AnimeWorker::instance()->addAnime(match);
-    //GlobalObjects::library->addToLibrary(item->animeTitle,item->title,item->path);
-    d->savePlaylist();
+    const QString path(item->path);
+    //the file is hashed on the hasher pool, the item is looked up again as it may be gone by then
+    Async::then(GlobalObjects::danmuManager->getFileHashAsync(path), this, [this, path, match](const QString &fileHash){
+        Q_D(PlayList);
+        PlayListItem *item=d->fileItems.value(path, nullptr);
+        if(!item) return;
+        item->animeTitle=match.name;
+        item->title=match.ep.toString();
+        item->poolID=GlobalObjects::danmuManager->createPool(match.name, match.ep.type, match.ep.index, match.ep.name, fileHash);
+        d->itemChanged(item);
+        d->needRefresh = true;
+        Notifier *notifier = Notifier::getNotifier();
+        notifier->showMessage(Notifier::LIST_NOTIFY, tr("Success: %1").arg(item->title),NotifyMessageFlag::NM_HIDE);
+        QModelIndex nIndex = createIndex(item->row(), 0, item);
+        emit dataChanged(nIndex, nIndex);
+        if (item == d->currentItem)
+        {
+            emit currentMatchChanged(item->poolID);
+        }
+        autoMoveToBgmCollection(nIndex);
+        AnimeWorker::instance()->addAnime(match);
+        //GlobalObjects::library->addToLibrary(item->animeTitle,item->title,item->path);
+        d->savePlaylist();
+    });
 }
 
 void PlayList::matchItems(const QList<const PlayListItem *> &items, const QString &title,  const QList<EpInfo> &eps)
 {
-    QList<PlayListItem *> ncItems;
+    QStringList paths;
     for(auto i : items)
     {
-        ncItems.append(const_cast<PlayListItem *>(i));
+        paths.append(i->path);
     }
     emit matchStatusChanged(true);
     QMetaObject::invokeMethod(matchWorker, [=](){
-        matchWorker->match(ncItems, title, eps);
+        matchWorker->match(paths, title, eps);
     },Qt::QueuedConnection);
 }
 
@@ -982,50 +1173,29 @@ void PlayList::removeMatch(const QModelIndexList &matchIndexes)
             int suffixPos = currentItem->path.lastIndexOf('.'), pathPos = currentItem->path.lastIndexOf('/') + 1;
             currentItem->title = currentItem->path.mid(pathPos, suffixPos - pathPos);
             if (currentItem == d->currentItem) emit currentMatchChanged(currentItem->poolID);
-            d->playListChanged = true;
+            d->itemChanged(currentItem);
             d->needRefresh = true;
-            QModelIndex nIndex = createIndex(currentItem->parent->children->indexOf(currentItem), 0, currentItem);
+            QModelIndex nIndex = createIndex(currentItem->row(), 0, currentItem);
             emit dataChanged(nIndex, nIndex);
         }
     }
 }
 
-void PlayList::updateItemsDanmu(const QModelIndexList &itemIndexes)
+void PlayList::updateItemsDanmu(const QModelIndexList &itemIndexes, std::function<void()> callback)
 {
-    QList<PlayListItem *> items;
-    for(const QModelIndex &index : itemIndexes)
-    {
-        if (index.isValid())
-        {
-            PlayListItem *item = static_cast<PlayListItem*>(index.internalPointer());
-            items.append(item);
-        }
-    }
-    bool cancel = false;
+    CancelToken token;
     auto notifier = Notifier::getNotifier();
-    auto conn = QObject::connect(notifier, &Notifier::cancelTrigger, [&](int nType){ if(nType&Notifier::LIST_NOTIFY) cancel=true;});
+    QSharedPointer<QMetaObject::Connection> conn(new QMetaObject::Connection);
+    *conn = QObject::connect(notifier, &Notifier::cancelTrigger, [token](int nType) mutable { if(nType&Notifier::LIST_NOTIFY) token.cancel();});
     notifier->showMessage(Notifier::LIST_NOTIFY, tr("Update Start"),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
-    while(!items.empty())
-    {
-        if(cancel) break;
-        PlayListItem *currentItem=items.takeFirst();
-        if(currentItem->children)
-        {
-            for(PlayListItem *child:*currentItem->children)
-            {
-                items.push_back(child);
-            }
-        }
-        else if(!currentItem->poolID.isEmpty())
-        {
-            Pool *pool=GlobalObjects::danmuManager->getPool(currentItem->poolID);
-            if(!pool) continue;
-            notifier->showMessage(Notifier::LIST_NOTIFY, tr("Updating: %1").arg(currentItem->title),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
-            pool->update();
-        }
-    }
-    QObject::disconnect(conn);
-    notifier->showMessage(Notifier::LIST_NOTIFY, tr("Update Done"),NotifyMessageFlag::NM_HIDE);
+    forEachPool(poolItems(itemIndexes), token, this, [notifier](Pool *pool, const PoolItem &item, std::function<void()> next){
+        notifier->showMessage(Notifier::LIST_NOTIFY, tr("Updating: %1").arg(item.title),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
+        pool->updateAsync(-1, pool, [next](int){ next(); });
+    }, [notifier, conn, callback](){
+        QObject::disconnect(*conn);
+        notifier->showMessage(Notifier::LIST_NOTIFY, tr("Update Done"),NotifyMessageFlag::NM_HIDE);
+        if(callback) callback();
+    });
 }
 
 void PlayList::setCurrentPlayTime(int playTime)
@@ -1050,14 +1220,20 @@ void PlayList::setCurrentPlayTime(int playTime)
     {
         currentItem->playTimeState=PlayListItem::UNFINISH;//playing
     }
+    playProgress->setPosition(currentItem->path, currentItem->animeTitle);
     if(!currentItem->animeTitle.isEmpty() && currentItem->playTimeState==PlayListItem::FINISH)
     {
         if((d->saveFinishTimeOnce && lastState!=PlayListItem::FINISH) || !d->saveFinishTimeOnce)
-            AnimeWorker::instance()->updateEpTime(currentItem->animeTitle, currentItem->path, true);
+            playProgress->setFinished(currentItem->path, currentItem->animeTitle);
     }
-    d->playListChanged=true;
     d->needRefresh=true;
-    d->incModifyCounter();
+    //called when playback stops or switches to another item
+    playProgress->flush();
+}
+
+void PlayList::flushPlayProgress()
+{
+    playProgress->flush();
 }
 
 QModelIndex PlayList::mergeItems(const QModelIndexList &mergeIndexes)
@@ -1076,13 +1252,13 @@ QModelIndex PlayList::mergeItems(const QModelIndexList &mergeIndexes)
         {
             minLevel=item->level;
             mergeParent=item->parent;
-            insertPosition=mergeParent->children->indexOf(item);
+            insertPosition=item->row();
         }
     }
     QModelIndex parentIndex;
     if (mergeParent != d->root)
     {
-        int row=mergeParent->parent->children->indexOf(mergeParent);
+        int row=mergeParent->row();
         parentIndex= createIndex(row, 0, mergeParent);
     }
     beginInsertRows(parentIndex, insertPosition, insertPosition);
@@ -1092,76 +1268,54 @@ QModelIndex PlayList::mergeItems(const QModelIndexList &mergeIndexes)
 
     for(PlayListItem *curItem:items)
     {
-        int cr_row = curItem->parent->children->indexOf(curItem);
+        int cr_row = curItem->row();
         const QModelIndex &itemIndex = createIndex(cr_row, 0, curItem);
         beginRemoveRows(itemIndex.parent(), cr_row, cr_row);
         curItem->parent->children->removeAt(cr_row);
+        d->childrenChanged(curItem->parent);
         curItem->parent=nullptr;
         endRemoveRows();
     }
-	QModelIndex collectionIndex= createIndex(newParent->parent->children->indexOf(newParent), 0, newParent);
+	QModelIndex collectionIndex= createIndex(newParent->row(), 0, newParent);
 	beginInsertRows(collectionIndex, 0, items.count()-1);
     for(PlayListItem *curItem:items)
     {
         curItem->moveTo(newParent);
     }
 	endInsertRows();
-    d->playListChanged=true;
+    d->childrenChanged(mergeParent);
     return collectionIndex;
 }
 
-void PlayList::exportDanmuItems(const QModelIndexList &exportIndexes)
+void PlayList::exportDanmuItems(const QModelIndexList &exportIndexes, std::function<void()> callback)
 {
-    QList<PlayListItem *> items;
-    for(const QModelIndex &index : exportIndexes)
-    {
-        if (index.isValid())
-        {
-            PlayListItem *item = static_cast<PlayListItem*>(index.internalPointer());
-            items.append(item);
-        }
-    }
     Notifier *notifier = Notifier::getNotifier();
-    while(!items.empty())
-    {
-        PlayListItem *currentItem=items.takeFirst();
-        if(currentItem->children)
+    forEachPool(poolItems(exportIndexes), CancelToken(), this, [notifier](Pool *pool, const PoolItem &item, std::function<void()> next){
+        if(!item.path.isEmpty())
         {
-            for(PlayListItem *child:*currentItem->children)
-            {
-                if(child->children || !child->poolID.isEmpty())
-                {
-                    items.push_back(child);
-                }
-            }
+            notifier->showMessage(Notifier::LIST_NOTIFY, tr("Exporting: %1").arg(item.title),NotifyMessageFlag::NM_PROCESS);
+            QFileInfo fi(item.path);
+            QFileInfo dfi(fi.absolutePath(),fi.baseName()+".xml");
+            pool->exportPool(dfi.absoluteFilePath());
         }
-        else if(!currentItem->poolID.isEmpty())
-        {
-            if(!currentItem->path.isEmpty())
-            {
-                notifier->showMessage(Notifier::LIST_NOTIFY, tr("Exporting: %1").arg(currentItem->title),NotifyMessageFlag::NM_PROCESS);
-                QFileInfo fi(currentItem->path);
-                QFileInfo dfi(fi.absolutePath(),fi.baseName()+".xml");
-                Pool *pool=GlobalObjects::danmuManager->getPool(currentItem->poolID);
-                if(pool) pool->exportPool(dfi.absoluteFilePath());
-            }
-        }
-    }
-    notifier->showMessage(Notifier::LIST_NOTIFY, tr("Export Down"),NotifyMessageFlag::NM_HIDE);
+        next();
+    }, [notifier, callback](){
+        notifier->showMessage(Notifier::LIST_NOTIFY, tr("Export Down"),NotifyMessageFlag::NM_HIDE);
+        if(callback) callback();
+    });
 }
 
-void PlayList::dumpJsonPlaylist(QJsonDocument &jsonDoc, QHash<QString, QString> &mediaHash)
+QSharedPointer<const PlayListSnapshot> PlayList::snapshot()
 {
     Q_D(PlayList);
-    if(!d->needRefresh) return;
-    QJsonDocument newDoc;
-    QJsonArray rootArray;
-    QHash<QString, QString> newHash;
-    d->dumpItem(rootArray,d->root,newHash);
-    newDoc.setArray(rootArray);
-    jsonDoc.swap(newDoc);
-    mediaHash.swap(newHash);
-    d->needRefresh=false;
+    if(d->lastSnapshot && !d->needRefresh) return d->lastSnapshot;
+    QSharedPointer<PlayListSnapshot> snapshot(new PlayListSnapshot);
+    snapshot->version = d->lastSnapshot ? d->lastSnapshot->version + 1 : 1;
+    snapshot->nodes.reserve(d->fileItems.size() + d->bgmCollectionItems.size());
+    d->snapshotItems(snapshot->nodes, d->root, -1);
+    d->lastSnapshot = snapshot;
+    d->needRefresh = false;
+    return d->lastSnapshot;
 }
 
 void PlayList::updatePlayTime(const QString &path, int time, PlayListItem::PlayState state)
@@ -1173,24 +1327,24 @@ void PlayList::updatePlayTime(const QString &path, int time, PlayListItem::PlayS
         PlayListItem::PlayState lastState = item->playTimeState;
         item->playTime=time;
         item->playTimeState=state;
-        QModelIndex cIndex = createIndex(item->parent->children->indexOf(item), 0, item);
+        QModelIndex cIndex = createIndex(item->row(), 0, item);
         emit dataChanged(cIndex, cIndex);
-        d->playListChanged=true;
         d->needRefresh=true;
+        //LAN clients report every few seconds, the writes are coalesced by playProgress
+        playProgress->setPosition(item->path, item->animeTitle);
         if(!item->animeTitle.isEmpty())
         {
             if(state==PlayListItem::PlayState::FINISH)
             {
                 if((d->saveFinishTimeOnce && lastState!=PlayListItem::FINISH) || !d->saveFinishTimeOnce)
-                    AnimeWorker::instance()->updateEpTime(item->animeTitle, item->path, true);
+                    playProgress->setFinished(item->path, item->animeTitle);
             }
             else
             {
-                AnimeWorker::instance()->updateEpTime(item->animeTitle, item->path);
+                playProgress->setPlayed(item->path, item->animeTitle);
             }
         }
         d->updateRecentlist(item);
-        d->incModifyCounter();
     }
 }
 
@@ -1214,7 +1368,7 @@ void PlayList::renameItemPoolId(const QString &opid, const QString &npid)
             {
                 emit currentMatchChanged(item->poolID);
             }
-            d->playListChanged=true;
+            d->itemChanged(item);
             d->needRefresh=true;
             d->incModifyCounter();
             match.ep.localFile = item->path;
@@ -1224,65 +1378,256 @@ void PlayList::renameItemPoolId(const QString &opid, const QString &npid)
 }
 
 
-void MatchWorker::match(const QList<PlayListItem *> &items)
+struct MatchWorker::MatchJob
+{
+    CancelToken token;
+    QMetaObject::Connection cancelConn;
+    QString scriptId;
+    QStringList paths;  //files of the same folder are next to each other
+    QHash<QString, int> pathOrder;
+    QMap<int, QString> scriptQueue;  //by path order
+    QHash<QString, MatchResult> results;
+    QHash<QString, QString> fileHashes;
+    int hashedCount = 0, doneCount = 0;
+    bool scriptScheduled = false, finished = false;
+    qint64 startBytes = 0;
+    QElapsedTimer hashTimer, progressTimer;
+};
+
+MatchWorker::MatchWorker(QObject *parent) : QObject(parent)
+{
+    scriptInterval = qMax(0, GlobalObjects::appSetting->value("List/MatchScriptInterval", 200).toInt());
+    clock.start();
+}
+
+QSharedPointer<MatchWorker::MatchJob> MatchWorker::createJob(const QStringList &paths, bool existingOnly)
 {
-    QList<PlayListItem *> matchedItems;
+    QSharedPointer<MatchJob> job(new MatchJob);
     auto notifier = Notifier::getNotifier();
     notifier->showMessage(Notifier::LIST_NOTIFY, tr("Match Start"),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
-    bool cancel = false;
-    auto conn = QObject::connect(notifier, &Notifier::cancelTrigger, [&](int nType){ if(nType & Notifier::LIST_NOTIFY) cancel=true;});
-    for(auto currentItem: items)
+    CancelToken token(job->token);
+    job->cancelConn = QObject::connect(notifier, &Notifier::cancelTrigger, [token](int nType) mutable { if(nType & Notifier::LIST_NOTIFY) token.cancel();});
+    //group by folder, keep the order the folders first appear in
+    QHash<QString, int> folderRank;
+    QSet<QString> added;
+    QList<QPair<int, QString> > rankedPaths;
+    for(const QString &path : paths)
+    {
+        if(added.contains(path) || (existingOnly && !QFile::exists(path))) continue;
+        added.insert(path);
+        const QString folder(path.left(path.lastIndexOf('/')));
+        auto iter = folderRank.find(folder);
+        if(iter == folderRank.end()) iter = folderRank.insert(folder, folderRank.size());
+        rankedPaths.append(qMakePair(iter.value(), path));
+    }
+    std::stable_sort(rankedPaths.begin(), rankedPaths.end(), [](const QPair<int, QString> &p1, const QPair<int, QString> &p2){
+        return p1.first < p2.first;
+    });
+    for(const auto &p : rankedPaths)
+    {
+        job->pathOrder.insert(p.second, job->paths.size());
+        job->paths << p.second;
+    }
+    return job;
+}
+
+void MatchWorker::match(const QStringList &paths)
+{
+    QSharedPointer<MatchJob> job(createJob(paths, true));
+    job->scriptId = GlobalObjects::animeProvider->defaultMatchScript();
+    hashFiles(job, [this, job](const QString &path, const QString &fileHash){
+        //unreadable files can still be matched by name
+        if(fileHash.isEmpty())
+        {
+            job->scriptQueue.insert(job->pathOrder.value(path), path);
+            scheduleScriptMatch(job);
+            return;
+        }
+        localMatch(job, path);
+    });
+}
+
+void MatchWorker::hashFiles(const QSharedPointer<MatchJob> &job, std::function<void (const QString &, const QString &)> hashed)
+{
+    if(job->paths.isEmpty())
     {
-        if(cancel) break;
-        if(currentItem->hasPool()) continue;
-        if (!QFile::exists(currentItem->path))continue;
+        finish(job);
+        return;
+    }
+    //the whole batch is hashed on the hasher pool, each file goes on once its hash is ready
+    FileHasher *hasher = GlobalObjects::danmuManager->hasher();
+    job->startBytes = hasher->stat().hashedBytes;
+    job->hashTimer.start();
+    job->progressTimer.start();
+    for(const QString &path : job->paths)
+    {
+        Async::finally(hasher->hashAsync(path, job->token), this, [this, job, path, hashed](const QFuture<QString> &future){
+            if(job->token.isCancelled() || future.resultCount() == 0)
+            {
+                itemDone(job);
+                return;
+            }
+            ++job->hashedCount;
+            job->fileHashes.insert(path, future.result());
+            if(job->hashedCount < job->paths.size() && job->progressTimer.elapsed() > 200)
+            {
+                const qint64 hashedBytes = GlobalObjects::danmuManager->hasher()->stat().hashedBytes - job->startBytes;
+                const double mbps = hashedBytes / 1048576.0 / qMax<qint64>(1, job->hashTimer.elapsed()) * 1000;
+                Notifier::getNotifier()->showMessage(Notifier::LIST_NOTIFY, tr("Hashing(%1/%2): %3 MB/s").arg(job->hashedCount).arg(job->paths.size()).arg(mbps, 0, 'f', 1),
+                                                     NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
+                job->progressTimer.restart();
+            }
+            hashed(path, future.result());
+        });
+    }
+}
+
+void MatchWorker::localMatch(const QSharedPointer<MatchJob> &job, const QString &path)
+{
+    auto future = GlobalObjects::dbExecutor->readAsync("MatchWorker::localMatch", [path](){
         MatchResult match;
-        GlobalObjects::danmuManager->localMatch(currentItem->path, match);
-        if(!match.success) GlobalObjects::animeProvider->match(GlobalObjects::animeProvider->defaultMatchScript(), currentItem->path, match);
-        if(!match.success)
+        GlobalObjects::danmuManager->localMatch(path, match);
+        return match;
+    }, DBExecutor::Background, job->token);
+    Async::finally(future, this, [this, job, path](const QFuture<MatchResult> &future){
+        if(job->token.isCancelled() || future.resultCount() == 0)
         {
-            notifier->showMessage(Notifier::LIST_NOTIFY, tr("Failed: %1").arg(currentItem->title),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
-            continue;
+            itemDone(job);
+            return;
         }
-        currentItem->animeTitle=match.name;
-        currentItem->title=match.ep.toString();
-        currentItem->poolID=GlobalObjects::danmuManager->createPool(currentItem->path, match);
-        matchedItems<<currentItem;
-        notifier->showMessage(Notifier::LIST_NOTIFY, tr("Success: %1").arg(currentItem->title),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
-        AnimeWorker::instance()->addAnime(match);
-        //GlobalObjects::library->addToLibrary(currentItem->animeTitle,currentItem->title,currentItem->path);
+        const MatchResult match(future.result());
+        if(match.success)
+        {
+            job->results.insert(path, match);
+            itemDone(job);
+            return;
+        }
+        job->scriptQueue.insert(job->pathOrder.value(path), path);
+        scheduleScriptMatch(job);
+    });
+}
+
+void MatchWorker::scheduleScriptMatch(const QSharedPointer<MatchJob> &job, int delay)
+{
+    //one script call of a job at a time, the flag is cleared when the call returns
+    if(job->scriptScheduled || job->scriptQueue.isEmpty()) return;
+    job->scriptScheduled = true;
+    //scripts mostly query web services, keep a minimum interval between two calls of the same script
+    auto iter = scriptCallTime.constFind(job->scriptId);
+    if(iter != scriptCallTime.constEnd()) delay = int(qMax<qint64>(delay, iter.value() + scriptInterval - clock.elapsed()));
+    QTimer::singleShot(qMax(0, delay), this, [this, job](){
+        scriptMatch(job);
+    });
+}
+
+void MatchWorker::scriptMatch(const QSharedPointer<MatchJob> &job)
+{
+    if(job->scriptQueue.isEmpty())
+    {
+        job->scriptScheduled = false;
+        return;
     }
-    QObject::disconnect(conn);
-    emit matchDown(matchedItems);
-    notifier->showMessage(Notifier::LIST_NOTIFY, tr("Match Done"),NotifyMessageFlag::NM_HIDE);
+    if(job->token.isCancelled() || job->scriptId.isEmpty())
+    {
+        job->scriptScheduled = false;
+        const int count = job->scriptQueue.size();
+        job->scriptQueue.clear();
+        itemDone(job, count);
+        return;
+    }
+    const int order = job->scriptQueue.firstKey();
+    const QString path(job->scriptQueue.take(order));
+    const QString scriptId(job->scriptId);
+    scriptCallTime.insert(scriptId, clock.elapsed());
+    //the script waits for its web requests on the task pool, workThread keeps serving the db writes
+    auto future = Async::run([scriptId, path](){
+        MatchResult match;
+        match.success = false;
+        ScriptState state = GlobalObjects::animeProvider->match(scriptId, path, match);
+        return qMakePair(state.state == ScriptState::S_BUSY, match);
+    });
+    Async::finally(future, this, [this, job, order, path](const QFuture<QPair<bool, MatchResult> > &future){
+        job->scriptScheduled = false;
+        if(future.resultCount() == 0)
+        {
+            itemDone(job);
+            scheduleScriptMatch(job);
+            return;
+        }
+        const QPair<bool, MatchResult> result(future.result());
+        if(result.first)
+        {
+            //the script is in use elsewhere, try again later
+            job->scriptQueue.insert(order, path);
+            scheduleScriptMatch(job, scriptBusyRetry);
+            return;
+        }
+        auto notifier = Notifier::getNotifier();
+        if(result.second.success)
+        {
+            job->results.insert(path, result.second);
+            notifier->showMessage(Notifier::LIST_NOTIFY, tr("Success: %1").arg(result.second.ep.toString()),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
+        }
+        else
+        {
+            notifier->showMessage(Notifier::LIST_NOTIFY, tr("Failed: %1").arg(QFileInfo(path).fileName()),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
+        }
+        itemDone(job);
+        scheduleScriptMatch(job);
+    });
 }
 
-void MatchWorker::match(const QList<PlayListItem *> &items, const QString &animeTitle, const QList<EpInfo> &eps)
+void MatchWorker::itemDone(const QSharedPointer<MatchJob> &job, int count)
 {
-    Q_ASSERT(items.size()==eps.size());
-    QList<PlayListItem *> matchedItems;
-    auto notifier = Notifier::getNotifier();
-    notifier->showMessage(Notifier::LIST_NOTIFY, tr("Match Start"),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
-    bool cancel = false;
-    auto conn = QObject::connect(notifier, &Notifier::cancelTrigger, [&](int nType){ if(nType & Notifier::LIST_NOTIFY) cancel=true;});
-    for(int i=0; i<items.size(); ++i)
+    job->doneCount += count;
+    if(job->doneCount >= job->paths.size()) finish(job);
+}
+
+void MatchWorker::finish(const QSharedPointer<MatchJob> &job)
+{
+    if(job->finished) return;
+    job->finished = true;
+    QObject::disconnect(job->cancelConn);
+    //matches found before a cancel are kept, as the items were matched one by one before
+    QStringList matchedPaths;
+    QStringList fileHashes;
+    QList<MatchResult> matches;
+    for(const QString &path : job->paths)
+    {
+        auto iter = job->results.constFind(path);
+        if(iter == job->results.constEnd()) continue;
+        matchedPaths << path;
+        fileHashes << job->fileHashes.value(path);
+        matches << iter.value();
+    }
+    QStringList pids;
+    if(!matchedPaths.isEmpty())
     {
-        if(cancel) break;
-        notifier->showMessage(Notifier::LIST_NOTIFY, tr("Success: %1").arg(eps[i].toString()),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
+        //pools and match records are written here on workThread, the items are changed on the gui thread
+        pids = GlobalObjects::danmuManager->createPools(matches, fileHashes);
+        AnimeWorker::instance()->addAnime(matches);
+    }
+    emit matchDown(matchedPaths, matches, pids);
+    Notifier::getNotifier()->showMessage(Notifier::LIST_NOTIFY, tr("Match Done"),NotifyMessageFlag::NM_HIDE);
+}
 
+void MatchWorker::match(const QStringList &paths, const QString &animeTitle, const QList<EpInfo> &eps)
+{
+    Q_ASSERT(paths.size()==eps.size());
+    QHash<QString, MatchResult> matches;
+    for(int i=0; i<paths.size(); ++i)
+    {
         MatchResult match;
         match.success = true;
         match.name = animeTitle;
         match.ep = eps[i];
-
-        items[i]->animeTitle=animeTitle;
-        items[i]->title=eps[i].toString();
-        items[i]->poolID=GlobalObjects::danmuManager->updateMatch(items[i]->path, match);
-
-        matchedItems<<items[i];
-        AnimeWorker::instance()->addAnime(match);
+        matches.insert(paths[i], match);
     }
-    QObject::disconnect(conn);
-    emit matchDown(matchedItems);
-    notifier->showMessage(Notifier::LIST_NOTIFY, tr("Match Done"),NotifyMessageFlag::NM_HIDE);
+    //the episodes are given, only the hashes are needed before the pools are created in finish
+    QSharedPointer<MatchJob> job(createJob(paths, false));
+    hashFiles(job, [this, job, matches](const QString &path, const QString &){
+        job->results.insert(path, matches.value(path));
+        Notifier::getNotifier()->showMessage(Notifier::LIST_NOTIFY, tr("Success: %1").arg(matches.value(path).ep.toString()),NotifyMessageFlag::NM_PROCESS|NotifyMessageFlag::NM_SHOWCANCEL);
+        itemDone(job);
+    });
 }
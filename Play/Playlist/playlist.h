@@ -3,18 +3,65 @@
 
 #include <QAbstractItemModel>
 #include <QSortFilterProxyModel>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+#include <functional>
 #include "playlistitem.h"
 #include "MediaLibrary/animeinfo.h"
 class PlayListPrivate;
+class FolderScanner;
+class FolderWatcher;
+class PlayProgress;
+class NextItemPrefetcher;
+struct FolderScan;
+/*
+ * Auto match runs as a pipeline on workThread: files are hashed on the hasher pool,
+ * looked up in the match table on db reader threads, and the rest go to the match script,
+ * one call at a time with a minimum interval per script, files of the same folder in a row.
+ * Pools and library episodes of the whole batch are written at the end.
+ */
 class MatchWorker : public QObject
 {
     Q_OBJECT
 public:
-    explicit MatchWorker(QObject *parent = nullptr):QObject(parent){}
-    void match(const QList<PlayListItem *> &items);
-    void match(const QList<PlayListItem *> &items, const QString &animeTitle, const QList<EpInfo> &eps);
+    explicit MatchWorker(QObject *parent = nullptr);
+    //jobs are keyed by path, items are only touched on the gui thread when matchDown arrives
+    void match(const QStringList &paths);
+    void match(const QStringList &paths, const QString &animeTitle, const QList<EpInfo> &eps);
 signals:
-    void matchDown(const QList<PlayListItem *> &matchedItems);
+    void matchDown(const QStringList &paths, const QList<MatchResult> &matches, const QStringList &pids);
+private:
+    struct MatchJob;
+    QHash<QString, qint64> scriptCallTime;
+    QElapsedTimer clock;
+    int scriptInterval;
+    const int scriptBusyRetry = 1000;
+
+    QSharedPointer<MatchJob> createJob(const QStringList &paths, bool existingOnly);
+    void hashFiles(const QSharedPointer<MatchJob> &job, std::function<void(const QString &, const QString &)> hashed);
+    void localMatch(const QSharedPointer<MatchJob> &job, const QString &path);
+    void scheduleScriptMatch(const QSharedPointer<MatchJob> &job, int delay = 0);
+    void scriptMatch(const QSharedPointer<MatchJob> &job);
+    void itemDone(const QSharedPointer<MatchJob> &job, int count = 1);
+    void finish(const QSharedPointer<MatchJob> &job);
+};
+
+/*
+ * Flat pre-order copy of the tree for readers on other threads (LAN server).
+ * Strings are shared with the items, the version grows by one whenever the tree or any item changed.
+ */
+struct PlayListSnapshot
+{
+    struct Node
+    {
+        int parent;  //index in nodes, -1 for top-level items
+        bool isCollection;
+        QString title, path, poolID;
+        int playTime;
+        PlayListItem::PlayState playTimeState;
+    };
+    quint64 version = 0;
+    QVector<Node> nodes;
 };
 
 class PlayList : public QAbstractItemModel
@@ -37,7 +84,9 @@ public:
     QModelIndex getCurrentIndex() const;
     inline const PlayListItem *getItem(const QModelIndex &index){return index.isValid()?static_cast<PlayListItem*>(index.internalPointer()):nullptr; }
     QList<const PlayListItem *> getSiblings(const PlayListItem *item, bool sameAnime=true);
+    const PlayListItem *getPoolItem(const QString &pid) const;
     LoopMode getLoopMode() const;
+    const PlayListItem *peekNextItem();
     bool canPaste() const;
     const QList<QPair<QString,QString> > &recent();
     void removeRecentItem(const QString &path);
@@ -50,12 +99,13 @@ signals:
     void matchStatusChanged(bool on);
 public slots :
     int addItems(QStringList &items, QModelIndex parent);
-    int addFolder(QString folderStr, QModelIndex parent);
+    void addFolder(QString folderStr, QModelIndex parent);
     QModelIndex addCollection(QModelIndex parent,QString title);
-    int refreshFolder(const QModelIndex &index);
+    void refreshFolder(const QModelIndex &index);
+    void setFolderSync(bool on);
 
     void deleteItems(const QModelIndexList &deleteIndexes);
-    int deleteInvalidItems(const QModelIndexList &indexes);
+    void deleteInvalidItems(const QModelIndexList &indexes);
     void clear();
 
     void sortItems(const QModelIndex &parent,bool ascendingOrder);
@@ -78,13 +128,14 @@ public slots :
     void matchIndex(QModelIndex &index, const MatchResult &match);
     void matchItems(const QList<const PlayListItem *> &items, const QString &title, const QList<EpInfo> &eps);
     void removeMatch(const QModelIndexList &matchIndexes);
-    void updateItemsDanmu(const QModelIndexList &itemIndexes);
+    void updateItemsDanmu(const QModelIndexList &itemIndexes, std::function<void()> callback=nullptr);
     void setCurrentPlayTime(int playTime);
+    void flushPlayProgress();
     QModelIndex mergeItems(const QModelIndexList &mergeIndexes);
-    void exportDanmuItems(const QModelIndexList &exportIndexes);
+    void exportDanmuItems(const QModelIndexList &exportIndexes, std::function<void()> callback=nullptr);
 
     
-    void dumpJsonPlaylist(QJsonDocument &jsonDoc,QHash<QString,QString> &mediaHash);
+    QSharedPointer<const PlayListSnapshot> snapshot();
     void updatePlayTime(const QString &path, int time, PlayListItem::PlayState state);
     void renameItemPoolId(const QString &opid, const QString &npid);
 
@@ -104,6 +155,13 @@ public:
 private:
     PlayListPrivate * const d_ptr;
     MatchWorker *matchWorker;
+    FolderScanner *folderScanner;
+    FolderWatcher *folderWatcher;
+    PlayProgress *playProgress;
+    NextItemPrefetcher *prefetcher;
+    void startFolderScan(const QStringList &roots, const QSharedPointer<FolderScan> &scan,
+                         const QSet<QString> &skipDirs = QSet<QString>());
+    void syncFolders(const QStringList &folders);
     Q_DECLARE_PRIVATE(PlayList)
     Q_DISABLE_COPY(PlayList)
 
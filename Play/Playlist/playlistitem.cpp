@@ -2,11 +2,49 @@
 #include "playlist.h"
 #include "Play/Danmu/Manager/danmumanager.h"
 #include "globalobjects.h"
+#include <QThreadStorage>
+
+namespace
+{
+    //width of the digit count written before each number
+    const int lengthWidth = 3;
+
+    //QCollator is not thread safe, sorting runs on several threads
+    const QCollator &keyCollator()
+    {
+        static QThreadStorage<QCollator *> collators;
+        if(!collators.hasLocalData()) collators.setLocalData(new QCollator);
+        return *collators.localData();
+    }
+
+    //digit runs without leading zeros, prefixed with their length, compare by value at any length;
+    //the numeric mode of QCollator is not supported by sort keys everywhere
+    QString naturalSortText(const QString &title)
+    {
+        QString text;
+        text.reserve(title.size() + lengthWidth * 4);
+        for(int i = 0; i < title.size();)
+        {
+            if(!title[i].isDigit())
+            {
+                text.append(title[i++]);
+                continue;
+            }
+            int end = i;
+            while(end < title.size() && title[end].isDigit()) ++end;
+            while(i < end - 1 && title[i] == '0') ++i;
+            text.append(QString::number(end - i).rightJustified(lengthWidth, '0'));
+            text.append(title.midRef(i, end - i));
+            i = end;
+        }
+        return text;
+    }
+}
 
 PlayList* PlayListItem::playlist=nullptr;
 
 PlayListItem::PlayListItem(PlayListItem *p, bool leaf, int insertPosition):
-    parent(p),children(nullptr),playTime(0),playTimeState(UNPLAY),level(0),isBgmCollection(false)
+    parent(p),children(nullptr),rowHint(0),id(0),playTime(0),playTimeState(UNPLAY),level(0),isBgmCollection(false)
 {
     if(!leaf)
     {
@@ -18,6 +56,7 @@ PlayListItem::PlayListItem(PlayListItem *p, bool leaf, int insertPosition):
             parent->children->append(this);
         else
             parent->children->insert(insertPosition, this);
+        rowHint=insertPosition == -1?parent->children->size()-1:insertPosition;
         level=parent->level+1;
     }
 }
@@ -59,3 +98,40 @@ void PlayListItem::moveTo(PlayListItem *newParent, int insertPosition)
     }
     parent = newParent;
 }
+
+int PlayListItem::row() const
+{
+    if(!parent) return 0;
+    const QList<PlayListItem *> &siblings = *parent->children;
+    if(rowHint >= 0 && rowHint < siblings.size() && siblings.at(rowHint) == this) return rowHint;
+    //siblings were inserted, removed or moved since, number all of them again
+    for(int i = 0; i < siblings.size(); ++i)
+        siblings.at(i)->rowHint = i;
+    return rowHint < siblings.size() && siblings.at(rowHint) == this ? rowHint : -1;
+}
+
+const QCollatorSortKey &PlayListItem::titleSortKey() const
+{
+    if(!titleKey || titleKeySource != title)
+    {
+        titleKey.reset(new QCollatorSortKey(keyCollator().sortKey(naturalSortText(title))));
+        titleKeySource = title;
+    }
+    return *titleKey;
+}
+
+void PlayListItem::sortChildren(bool ascendingOrder)
+{
+    if(!children) return;
+    //keys are built once per item, comparisons only compare keys
+    for(const PlayListItem *child : qAsConst(*children))
+        child->titleSortKey();
+    if(ascendingOrder)
+        std::stable_sort(children->begin(), children->end(), [](const PlayListItem *item1, const PlayListItem *item2){
+            return item1->titleKey->compare(*item2->titleKey) < 0;
+        });
+    else
+        std::stable_sort(children->begin(), children->end(), [](const PlayListItem *item1, const PlayListItem *item2){
+            return item2->titleKey->compare(*item1->titleKey) < 0;
+        });
+}
@@ -1,6 +1,8 @@
 #ifndef PLAYLISTITEM_H
 #define PLAYLISTITEM_H
 #include <QObject>
+#include <QCollator>
+#include <QScopedPointer>
 
 class PlayList;
 class PlayListItem
@@ -12,17 +14,22 @@ public:
     bool hasPool() const;
     void setLevel(int newLevel);
     void moveTo(PlayListItem *newParent, int insertPosition = -1);
+    int row() const;
+    const QCollatorSortKey &titleSortKey() const;
+    void sortChildren(bool ascendingOrder);
 
     static PlayList *playlist;
 
     PlayListItem *parent;
     QList<PlayListItem *> *children;
+    mutable int rowHint;  //last known position in parent->children, checked by row()
 
     enum PlayState
     {
         UNPLAY, UNFINISH, FINISH
     };
 
+    quint32 id;
     int playTime;
     PlayState playTimeState;
     int level;
@@ -32,6 +39,11 @@ public:
     QString animeTitle;
     QString path, folderPath;
     QString poolID;
+
+private:
+    //natural order key of title, rebuilt when the title changes
+    mutable QScopedPointer<QCollatorSortKey> titleKey;
+    mutable QString titleKeySource;
 };
 
 #endif // PLAYLISTITEM_H
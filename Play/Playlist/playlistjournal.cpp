@@ -0,0 +1,314 @@
+#include "playlistjournal.h"
+#include "playlistitem.h"
+namespace
+{
+    const char snapshotMagic[4] = {'K','P','L','S'};
+    const char journalMagic[4] = {'K','P','L','J'};
+    const quint8 ItemLeaf = 0x1;
+    const quint8 ItemBgmCollection = 0x2;
+    const quint32 noParent = 0xffffffff;
+}
+
+PlayListJournal::PlayListJournal(const QString &snapshotPath, const QString &journalPath) :
+    snapshotPath(snapshotPath), journalPath(journalPath), nextId(1), snapshotSize(0), compactPending(false)
+{
+    journalFile.setFileName(journalPath);
+}
+
+bool PlayListJournal::load(PlayListItem *root)
+{
+    QHash<quint32, PlayListItem *> items;
+    items.insert(0, root);
+    {
+        QFile snapshotFile(snapshotPath);
+        if(!snapshotFile.open(QIODevice::ReadOnly)) return false;
+        const qint64 size = snapshotFile.size();
+        if(size < qint64(sizeof(SnapshotHeader))) return false;
+        const uchar *data = snapshotFile.map(0, size);
+        if(!data) return false;
+        const SnapshotHeader *h = reinterpret_cast<const SnapshotHeader *>(data);
+        if(memcmp(h->magic, snapshotMagic, 4) != 0 || h->formatVersion != formatVersion) return false;
+        nextId = qMax<quint32>(1, h->nextId);
+        items.reserve(h->count + 1);
+        const qint64 bodySize = size - sizeof(SnapshotHeader);
+        if(replay(data + sizeof(SnapshotHeader), bodySize, items) != bodySize)
+        {
+            qInfo() << "playlist snapshot is damaged, keep the readable part";
+            compactPending = true;
+        }
+        snapshotSize = size;
+    }
+    qint64 validLength = 0;
+    {
+        QFile file(journalPath);
+        const qint64 size = file.size();
+        if(size >= qint64(sizeof(JournalHeader)) && file.open(QIODevice::ReadOnly))
+        {
+            const uchar *data = file.map(0, size);
+            const JournalHeader *h = reinterpret_cast<const JournalHeader *>(data);
+            if(data && memcmp(h->magic, journalMagic, 4) == 0 && h->formatVersion == formatVersion)
+            {
+                validLength = sizeof(JournalHeader) + replay(data + sizeof(JournalHeader), size - sizeof(JournalHeader), items);
+                if(validLength < size) qInfo() << "playlist journal: drop torn tail," << size - validLength << "bytes";
+            }
+        }
+    }
+    //items cut but never pasted, or whose parent is gone
+    QList<PlayListItem *> orphans;
+    for(PlayListItem *item : items)
+    {
+        if(item != root && !item->parent) orphans << item;
+    }
+    if(!orphans.isEmpty())
+    {
+        qDeleteAll(orphans);
+        compactPending = true;
+    }
+    root->setLevel(0);
+    openJournal(validLength);
+    return true;
+}
+
+void PlayListJournal::appendItem(const PlayListItem *item, int changes)
+{
+    if(changes == PlayTimeChanged)
+    {
+        QByteArray payload;
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_6);
+        stream << item->id << qint32(item->playTime) << quint8(item->playTimeState);
+        appendRecord(pending, Op_PlayTime, payload);
+        return;
+    }
+    appendRecord(pending, Op_Item, itemPayload(item, item->parent ? item->parent->id : noParent));
+}
+
+void PlayListJournal::appendOrder(const PlayListItem *collection)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << collection->id << quint32(collection->children->size());
+    for(const PlayListItem *child : *collection->children)
+        stream << child->id;
+    appendRecord(pending, Op_Order, payload);
+}
+
+void PlayListJournal::appendRemove(quint32 id)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << id;
+    appendRecord(pending, Op_Remove, payload);
+}
+
+bool PlayListJournal::commit()
+{
+    if(pending.isEmpty()) return true;
+    if(!journalFile.isOpen() || journalFile.write(pending) != pending.size() || !journalFile.flush())
+    {
+        //the tail may be torn now, records after it would be dropped on load
+        compactPending = true;
+        return false;
+    }
+    pending.clear();
+    return true;
+}
+
+bool PlayListJournal::compact(PlayListItem *root, const QList<PlayListItem *> &detachedItems)
+{
+    QByteArray buffer;
+    quint32 count = 0;
+    writeItems(buffer, root, count);
+    //cut items may be pasted later in this session, keep them detached, they are dropped on the next load
+    for(PlayListItem *item : detachedItems)
+    {
+        if(!item->id) item->id = newId();
+        appendRecord(buffer, Op_Item, itemPayload(item, noParent));
+        ++count;
+        writeItems(buffer, item, count);
+    }
+
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(SnapshotHeader));
+    memcpy(h.magic, snapshotMagic, 4);
+    h.formatVersion = formatVersion;
+    h.nextId = nextId;
+    h.count = count;
+
+    QSaveFile snapshotFile(snapshotPath);
+    if(!snapshotFile.open(QIODevice::WriteOnly)) return false;
+    snapshotFile.write(reinterpret_cast<const char *>(&h), sizeof(SnapshotHeader));
+    snapshotFile.write(buffer);
+    if(!snapshotFile.commit()) return false;
+    //a crash before the journal is cleared only replays records already in the snapshot
+    snapshotSize = sizeof(SnapshotHeader) + buffer.size();
+    pending.clear();
+    compactPending = false;
+    return openJournal(0);
+}
+
+void PlayListJournal::appendRecord(QByteArray &buffer, Op op, const QByteArray &payload)
+{
+    RecordHeader h;
+    h.length = payload.size();
+    h.checksum = qChecksum(payload.constData(), payload.size());
+    h.op = op;
+    h.reserved = 0;
+    buffer.append(reinterpret_cast<const char *>(&h), sizeof(RecordHeader));
+    buffer.append(payload);
+}
+
+QByteArray PlayListJournal::itemPayload(const PlayListItem *item, quint32 parentId)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    const quint8 flags = (item->children ? 0 : ItemLeaf) | (item->isBgmCollection ? ItemBgmCollection : 0);
+    stream << item->id << parentId << flags << qint32(item->playTime) << quint8(item->playTimeState)
+           << item->title << item->animeTitle << item->path << item->folderPath << item->poolID;
+    return payload;
+}
+
+void PlayListJournal::writeItems(QByteArray &buffer, PlayListItem *item, quint32 &count)
+{
+    if(!item->children) return;
+    for(PlayListItem *child : *item->children)
+    {
+        if(!child->id) child->id = newId();
+        appendRecord(buffer, Op_Item, itemPayload(child, item->id));
+        ++count;
+        writeItems(buffer, child, count);
+    }
+}
+
+qint64 PlayListJournal::replay(const uchar *data, qint64 size, QHash<quint32, PlayListItem *> &items)
+{
+    qint64 pos = 0;
+    while(pos + qint64(sizeof(RecordHeader)) <= size)
+    {
+        RecordHeader h;
+        memcpy(&h, data + pos, sizeof(RecordHeader));
+        const qint64 recordSize = sizeof(RecordHeader) + qint64(h.length);
+        if(pos + recordSize > size) break;
+        const char *payload = reinterpret_cast<const char *>(data + pos + sizeof(RecordHeader));
+        if(qChecksum(payload, h.length) != h.checksum) break;
+        QByteArray bytes(QByteArray::fromRawData(payload, h.length));
+        QDataStream stream(bytes);
+        stream.setVersion(QDataStream::Qt_5_6);
+        apply(Op(h.op), stream, items);
+        pos += recordSize;
+    }
+    return pos;
+}
+
+void PlayListJournal::apply(Op op, QDataStream &stream, QHash<quint32, PlayListItem *> &items)
+{
+    switch (op)
+    {
+    case Op_Item:
+    {
+        quint32 id, parentId;
+        quint8 flags, state;
+        qint32 playTime;
+        QString title, animeTitle, path, folderPath, poolID;
+        stream >> id >> parentId >> flags >> playTime >> state >> title >> animeTitle >> path >> folderPath >> poolID;
+        if(stream.status() != QDataStream::Ok || id == 0) return;
+        PlayListItem *item = items.value(id, nullptr);
+        if(!item)
+        {
+            //appended to the parent, the order of its children follows in an Op_Order record
+            item = new PlayListItem(items.value(parentId, nullptr), flags & ItemLeaf);
+            item->id = id;
+            items.insert(id, item);
+            nextId = qMax(nextId, id + 1);
+        }
+        item->isBgmCollection = flags & ItemBgmCollection;
+        item->playTime = playTime;
+        item->playTimeState = PlayListItem::PlayState(state <= PlayListItem::FINISH ? state : PlayListItem::UNPLAY);
+        item->title = title;
+        item->animeTitle = animeTitle;
+        item->path = path;
+        item->folderPath = folderPath;
+        item->poolID = poolID;
+        break;
+    }
+    case Op_PlayTime:
+    {
+        quint32 id;
+        qint32 playTime;
+        quint8 state;
+        stream >> id >> playTime >> state;
+        PlayListItem *item = items.value(id, nullptr);
+        if(stream.status() != QDataStream::Ok || !item) return;
+        item->playTime = playTime;
+        item->playTimeState = PlayListItem::PlayState(state <= PlayListItem::FINISH ? state : PlayListItem::UNPLAY);
+        break;
+    }
+    case Op_Order:
+    {
+        quint32 id, count;
+        stream >> id >> count;
+        PlayListItem *collection = items.value(id, nullptr);
+        if(stream.status() != QDataStream::Ok || !collection || !collection->children) return;
+        //children left out of the new order stay detached until another collection takes them
+        for(PlayListItem *child : *collection->children)
+        {
+            if(child->parent == collection) child->parent = nullptr;
+        }
+        QList<PlayListItem *> children;
+        for(quint32 i = 0; i < count; ++i)
+        {
+            quint32 childId;
+            stream >> childId;
+            if(stream.status() != QDataStream::Ok) break;
+            PlayListItem *child = items.value(childId, nullptr);
+            if(!child || child == collection || child->parent == collection) continue;
+            if(child->parent) child->parent->children->removeOne(child);
+            child->parent = collection;
+            children << child;
+        }
+        collection->children->swap(children);
+        break;
+    }
+    case Op_Remove:
+    {
+        quint32 id;
+        stream >> id;
+        PlayListItem *item = items.value(id, nullptr);
+        if(stream.status() != QDataStream::Ok || !item || id == 0) return;
+        if(item->parent) item->parent->children->removeOne(item);
+        QList<PlayListItem *> subItems({item});
+        while(!subItems.isEmpty())
+        {
+            PlayListItem *cur = subItems.takeLast();
+            items.remove(cur->id);
+            if(cur->children) subItems.append(*cur->children);
+        }
+        delete item;
+        break;
+    }
+    }
+}
+
+bool PlayListJournal::openJournal(qint64 validLength)
+{
+    journalFile.close();
+    if(!journalFile.open(QIODevice::ReadWrite)) return false;
+    if(validLength < qint64(sizeof(JournalHeader)))
+    {
+        JournalHeader h;
+        memset(&h, 0, sizeof(JournalHeader));
+        memcpy(h.magic, journalMagic, 4);
+        h.formatVersion = formatVersion;
+        journalFile.resize(0);
+        journalFile.write(reinterpret_cast<const char *>(&h), sizeof(JournalHeader));
+    }
+    else if(journalFile.size() > validLength)
+    {
+        journalFile.resize(validLength);
+    }
+    journalFile.seek(journalFile.size());
+    return journalFile.flush();
+}
@@ -0,0 +1,82 @@
+#ifndef PLAYLISTJOURNAL_H
+#define PLAYLISTJOURNAL_H
+#include <QtCore>
+class PlayListItem;
+/*
+ * Binary playlist storage: a snapshot of the whole tree plus an append-only journal of the changes since.
+ *   Snapshot: Header | Item record[count] (pre-order, so parents come first and children keep their order)
+ *   Journal:  Header | Record...
+ * Every record carries absolute state (item fields, the full child order of a collection, a removal),
+ * so replaying a record twice gives the same tree and a torn record at the tail is simply dropped.
+ * Items are keyed by a stable id, the root is id 0. The snapshot is rewritten once the journal outgrows it.
+ */
+class PlayListJournal
+{
+public:
+    enum ItemChange
+    {
+        PlayTimeChanged = 0x1,
+        InfoChanged = 0x2,
+        AllChanged = PlayTimeChanged | InfoChanged
+    };
+    PlayListJournal(const QString &snapshotPath, const QString &journalPath);
+
+    bool load(PlayListItem *root);
+    inline quint32 newId() {return nextId++;}
+
+    void appendItem(const PlayListItem *item, int changes = AllChanged);
+    void appendOrder(const PlayListItem *collection);
+    void appendRemove(quint32 id);
+    bool commit();
+
+    inline bool needCompact() const {return compactPending || journalFile.size() > qMax(minCompactSize, snapshotSize);}
+    bool compact(PlayListItem *root, const QList<PlayListItem *> &detachedItems = QList<PlayListItem *>());
+
+private:
+    enum Op : quint8
+    {
+        Op_Item = 1,
+        Op_PlayTime,
+        Op_Order,
+        Op_Remove
+    };
+    struct SnapshotHeader
+    {
+        char magic[4];
+        quint32 formatVersion;
+        quint32 nextId;
+        quint32 count;
+        quint32 reserved[4];
+    };
+    struct JournalHeader
+    {
+        char magic[4];
+        quint32 formatVersion;
+        quint32 reserved[2];
+    };
+    struct RecordHeader
+    {
+        quint32 length;
+        quint16 checksum;
+        quint8 op;
+        quint8 reserved;
+    };
+    static const quint32 formatVersion = 1;
+    const qint64 minCompactSize = 256*1024;
+
+    QString snapshotPath, journalPath;
+    QFile journalFile;
+    QByteArray pending;
+    quint32 nextId;
+    qint64 snapshotSize;
+    bool compactPending;
+
+    static void appendRecord(QByteArray &buffer, Op op, const QByteArray &payload);
+    static QByteArray itemPayload(const PlayListItem *item, quint32 parentId);
+    void writeItems(QByteArray &buffer, PlayListItem *item, quint32 &count);
+    qint64 replay(const uchar *data, qint64 size, QHash<quint32, PlayListItem *> &items);
+    void apply(Op op, QDataStream &stream, QHash<quint32, PlayListItem *> &items);
+    bool openJournal(qint64 validLength);
+};
+
+#endif // PLAYLISTJOURNAL_H
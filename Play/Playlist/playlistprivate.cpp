@@ -2,27 +2,70 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 #include <QCoreApplication>
 #include <QRandomGenerator>
+#include <QTimer>
 
 #include "globalobjects.h"
-#include "Play/Video/mpvplayer.h"
 #include "Play/Danmu/Manager/danmumanager.h"
+#include "folderwatcher.h"
 
-PlayListPrivate::PlayListPrivate(PlayList *pl) : root(new PlayListItem), currentItem(nullptr), playListChanged(false),
-    needRefresh(true), loopMode(PlayList::NO_Loop_All), autoMatch(true), modifyCounter(0), saveFinishTimeOnce(true), q_ptr(pl)
+void FolderScan::forget(PlayListItem *item)
+{
+    if(item == target) target = nullptr;
+    auto iter = collectionDirs.find(item);
+    if(iter != collectionDirs.end())
+    {
+        collections.remove(iter.value());
+        collectionDirs.erase(iter);
+    }
+    entryOrder.remove(item);
+    liveItems.remove(item);
+}
+
+PlayListPrivate::PlayListPrivate(PlayList *pl) : root(new PlayListItem), currentItem(nullptr), randomNext(nullptr), playListChanged(false),
+    needRefresh(true), loopMode(PlayList::NO_Loop_All), autoMatch(true), modifyCounter(0), saveFinishTimeOnce(true), q_ptr(pl),
+    trackChanges(true), watchUpdatePending(false)
 {
     PlayListItem::playlist = pl;
     plPath = GlobalObjects::dataPath + "playlist.xml";
     rectPath = GlobalObjects::dataPath + "recent.xml";
+    journal = new PlayListJournal(GlobalObjects::dataPath + "playlist.kpl", GlobalObjects::dataPath + "playlist.kpj");
 }
 
 PlayListPrivate::~PlayListPrivate()
 {
+    trackChanges = false;
     delete root;
+    delete journal;
 }
 
 void PlayListPrivate::loadPlaylist()
+{
+    trackChanges = false;
+    if(!journal->load(root))
+    {
+        //no binary playlist yet, import playlist.xml once
+        loadXmlPlaylist();
+        journal->compact(root);
+    }
+    else if(journal->needCompact())
+    {
+        journal->compact(root);
+    }
+    trackChanges = true;
+    indexItems(root);
+    for(auto iter= recentList.begin();iter!=recentList.end();)
+    {
+        if((*iter).second.isEmpty()) //not included in playlist
+            iter=recentList.erase(iter);
+        else
+            iter++;
+    }
+}
+
+void PlayListPrivate::loadXmlPlaylist()
 {
     QFile playlistFile(plPath);
     bool ret=playlistFile.open(QIODevice::ReadOnly|QIODevice::Text);
@@ -50,7 +93,6 @@ void PlayListPrivate::loadPlaylist()
                 PlayListItem *collection=new PlayListItem(parents.last(),false);
                 collection->title=reader.attributes().value("title").toString();
                 collection->isBgmCollection=(reader.attributes().value("bgmCollection")=="true");
-                if(collection->isBgmCollection) bgmCollectionItems.insert(collection->title, collection);
                 collection->folderPath=reader.attributes().value("folderPath").toString();
                 parents.push_back(collection);
                 break;
@@ -63,12 +105,6 @@ void PlayListPrivate::loadPlaylist()
                 int playTime=reader.attributes().value("playTime").toInt();
                 int playTimeState=reader.attributes().value("playTimeState").toInt();
                 QString path = reader.readElementText().trimmed();
-                /*QFileInfo fileInfo(path);
-                if(!fileInfo.exists())
-                {
-                    playListChanged=true;
-                    break;
-                }*/
 
                 PlayListItem *item=new PlayListItem(parents.last(),true);
                 item->title=title;
@@ -76,16 +112,7 @@ void PlayListPrivate::loadPlaylist()
                 item->playTime=playTime;
                 item->poolID = poolID;
                 item->playTimeState=PlayListItem::PlayState(playTimeState);
-                fileItems.insert(item->path,item);
                 if(!animeTitle.isEmpty())item->animeTitle=animeTitle;
-                for(auto &pair :recentList)
-                {
-                    if(pair.first==item->path)
-                    {
-                        pair.second=item->animeTitle.isEmpty()?item->title:QString("%1 %2").arg(item->animeTitle, item->title);
-                        break;
-                    }
-                }
                 break;
             }
             }
@@ -101,27 +128,51 @@ void PlayListPrivate::loadPlaylist()
         }
         reader.readNext();
     }
-    for(auto iter= recentList.begin();iter!=recentList.end();)
+}
+
+void PlayListPrivate::indexItems(PlayListItem *collection)
+{
+    for(PlayListItem *item : *collection->children)
     {
-        if((*iter).second.isEmpty()) //not included in playlist
-            iter=recentList.erase(iter);
-        else
-            iter++;
+        if(item->children)
+        {
+            if(item->isBgmCollection) bgmCollectionItems.insert(item->title, item);
+            indexItems(item);
+            continue;
+        }
+        fileItems.insert(item->path,item);
+        for(auto &pair :recentList)
+        {
+            if(pair.first==item->path)
+            {
+                pair.second=item->animeTitle.isEmpty()?item->title:QString("%1 %2").arg(item->animeTitle, item->title);
+                break;
+            }
+        }
     }
 }
 
 void PlayListPrivate::savePlaylist()
 {
     if(!playListChanged)return;
-    QFile playlistFile(plPath);
-    bool ret=playlistFile.open(QIODevice::WriteOnly|QIODevice::Text);
-    if(!ret) return;
-    QXmlStreamWriter writer(&playlistFile);
-    writer.setAutoFormatting(true);
-    writer.writeStartDocument();
-    saveItem(writer, root);
-    writer.writeEndDocument();
-    playListChanged=false;
+    for(quint32 id : removedItems)
+        journal->appendRemove(id);
+    for(PlayListItem *collection : changedCollections)
+    {
+        //new collections are written along with their parent
+        if(collection==root || collection->id) saveChildren(collection);
+    }
+    for(auto iter = changedItems.cbegin(); iter != changedItems.cend(); ++iter)
+    {
+        if(iter.key()->id) journal->appendItem(iter.key(), iter.value());
+    }
+    removedItems.clear();
+    changedCollections.clear();
+    changedItems.clear();
+    bool ret = journal->commit();
+    if(!ret || journal->needCompact())
+        ret = journal->compact(root, itemsClipboard);
+    playListChanged=!ret;
 }
 
 void PlayListPrivate::incModifyCounter()
@@ -134,42 +185,46 @@ void PlayListPrivate::incModifyCounter()
     }
 }
 
-void PlayListPrivate::saveItem(QXmlStreamWriter &writer, PlayListItem *item)
+void PlayListPrivate::itemChanged(PlayListItem *item, int changes)
 {
-    if(item==root)
-    {
-        writer.writeStartElement("playlist");
+    changedItems[item] |= changes;
+    playListChanged = true;
+}
 
-    }
-    else
+void PlayListPrivate::childrenChanged(PlayListItem *collection)
+{
+    changedCollections.insert(collection);
+    playListChanged = true;
+}
+
+void PlayListPrivate::itemRemoved(PlayListItem *item)
+{
+    for(const auto &scan : folderScans)
+        scan->forget(item);
+    for(const auto &check : itemChecks)
+        check->liveItems.remove(item);
+    if(item==randomNext) randomNext=nullptr;
+    if(!trackChanges) return;
+    if(!item->folderPath.isEmpty()) scheduleWatchUpdate();
+    changedItems.remove(item);
+    changedCollections.remove(item);
+    if(item->id)
     {
-        writer.writeStartElement("collection");
-        writer.writeAttribute("title",item->title);
-        writer.writeAttribute("bgmCollection",item->isBgmCollection?"true":"false");
-        if(!item->folderPath.isEmpty())
-            writer.writeAttribute("folderPath",item->folderPath);
+        removedItems.append(item->id);
+        playListChanged = true;
     }
-    for(PlayListItem *child : *item->children)
+}
+
+void PlayListPrivate::saveChildren(PlayListItem *collection)
+{
+    for(PlayListItem *child : *collection->children)
     {
-        if(child->children)
-        {
-            saveItem(writer,child);
-        }
-        else
-        {
-            writer.writeStartElement("item");
-            writer.writeAttribute("title", child->title);
-            if(!child->animeTitle.isEmpty())
-                writer.writeAttribute("animeTitle",child->animeTitle);
-            if(!child->poolID.isEmpty())
-                writer.writeAttribute("poolID",child->poolID);
-            writer.writeAttribute("playTime",QString::number(child->playTime));
-            writer.writeAttribute("playTimeState",QString::number((int)child->playTimeState));
-            writer.writeCharacters(child->path);
-            writer.writeEndElement();
-        }
+        if(child->id) continue;
+        child->id = journal->newId();
+        journal->appendItem(child);
+        if(child->children) saveChildren(child);
     }
-    writer.writeEndElement();
+    journal->appendOrder(collection);
 }
 
 void PlayListPrivate::loadRecentlist()
@@ -244,7 +299,7 @@ PlayListItem *PlayListPrivate::getPrevOrNextItem(bool prev)
         {
             while (cur != root)
             {
-                int row=cur->parent->children->indexOf(cur);
+                int row=cur->row();
                 int pos=prev?0:cur->parent->children->count()-1;
                 if(row==pos)
                     cur=cur->parent;
@@ -273,6 +328,12 @@ PlayListItem *PlayListPrivate::getPrevOrNextItem(bool prev)
     }
     case PlayList::Random:
     {
+        if(!prev && randomNext)
+        {
+            PlayListItem *item=randomNext;
+            randomNext=nullptr;
+            return item;
+        }
         QList<PlayListItem *> collectionItems,mediaItems;
         collectionItems.push_back(root);
         while(!collectionItems.empty())
@@ -298,105 +359,206 @@ PlayListItem *PlayListPrivate::getPrevOrNextItem(bool prev)
     return nullptr;
 }
 
-bool PlayListPrivate::addSubFolder(QString folderStr, PlayListItem *parent, int &itemCount)
+void PlayListPrivate::addScannedDirs(FolderScan *scan, const QList<FolderScanner::Dir> &dirs)
 {
-    QDir folder(folderStr);
-    bool containsVideoFile = false;
-    PlayListItem *folderCollection = new PlayListItem();
-    folderCollection->title = folder.dirName();
-    folderCollection->folderPath = folderStr;
-    for (QFileInfo fileInfo : folder.entryInfoList())
+    Q_Q(PlayList);
+    for(const FolderScanner::Dir &dir : dirs)
     {
-        QString fileName = fileInfo.fileName();
-        if (fileInfo.isFile())
+        scan->dirInfo.insert(dir.path, qMakePair(dir.parentPath, dir.order));
+        QList<int> newFiles;
+        for(int i = 0; i < dir.files.size(); ++i)
         {
-            if (GlobalObjects::mpvplayer->videoFileFormats.contains("*."+fileInfo.suffix().toLower()))
-            {
-                if(!fileItems.contains(fileInfo.filePath()))
-                {
-                    PlayListItem *newItem = new PlayListItem(folderCollection, true);
-                    int suffixPos = fileName.lastIndexOf('.'), pathPos = fileName.lastIndexOf('/') + 1;
-                    newItem->title = fileName.mid(pathPos, suffixPos - pathPos);
-                    newItem->path = fileInfo.filePath();
-                    containsVideoFile = true;
-                    itemCount++;
-                    fileItems.insert(newItem->path,newItem);
-                }
-            }
+            if(!fileItems.contains(dir.files[i])) newFiles << i;
         }
-        else
+        if(newFiles.isEmpty()) continue;
+        //parents are listed before their children, a new collection is still empty here
+        PlayListItem *collection = folderCollection(scan, dir.path);
+        QModelIndex collectionIndex;
+        if(!collection || !itemIndex(collection, collectionIndex)) continue;
+        const int insertPosition = collection->children->size();
+        q->beginInsertRows(collectionIndex, insertPosition, insertPosition + newFiles.size() - 1);
+        for(int i : newFiles)
         {
-            if (fileName == "." || fileName == "..")continue;
-            bool ret = addSubFolder(fileInfo.absoluteFilePath(), folderCollection,itemCount);
-            if (ret) containsVideoFile = true;
+            const QString &filePath = dir.files[i];
+            PlayListItem *newItem = new PlayListItem(collection, true);
+            int suffixPos = filePath.lastIndexOf('.'), pathPos = filePath.lastIndexOf('/') + 1;
+            newItem->title = filePath.mid(pathPos, suffixPos - pathPos);
+            newItem->path = filePath;
+            fileItems.insert(newItem->path,newItem);
+            scan->entryOrder.insert(newItem, dir.fileOrder[i]);
+            scan->newItems << newItem;
+            scan->liveItems << newItem;
         }
+        q->endInsertRows();
+        childrenChanged(collection);
+        scan->itemCount += newFiles.size();
+        needRefresh = true;
     }
-    if (containsVideoFile)
-        folderCollection->moveTo(parent);
-    else
-        delete folderCollection;
-    return containsVideoFile;
 }
 
-int PlayListPrivate::refreshFolder(PlayListItem *folderItem, QList<PlayListItem *> &nItems)
+PlayListItem *PlayListPrivate::folderCollection(FolderScan *scan, const QString &path)
 {
-    int nCount = 0;
-    QSet<QString> currentPaths;
-    for(PlayListItem *item : *folderItem->children)
+    Q_Q(PlayList);
+    PlayListItem *collection = scan->collections.value(path, nullptr);
+    if(collection) return collection;
+    PlayListItem *parent = nullptr;
+    int insertPosition = 0, order = 0;
+    if(path == scan->rootPath)
     {
-        if(item->children)
-        {
-            if(!item->folderPath.isEmpty()) currentPaths<<item->folderPath;
-            nCount += refreshFolder(item, nItems);
-        }
+        //only for addFolder, collections being refreshed are registered before the scan
+        parent = scan->target;
+        if(!parent) return nullptr;
+        insertPosition = qMin(scan->targetPosition, parent->children->size());
     }
-    if(folderItem->folderPath.isEmpty()) return nCount;
-
-    QDir folder(folderItem->folderPath);
-    bool oFolder(folderItem->parent);
-    QModelIndex fIndex;
-    if(oFolder) fIndex = q_ptr->createIndex(folderItem->parent->children->indexOf(folderItem),0,folderItem);
-    for (QFileInfo fileInfo : folder.entryInfoList())
+    else
     {
-        QString fileName(fileInfo.fileName()), filePath(fileInfo.filePath());
-        if (fileInfo.isFile())
+        auto iter = scan->dirInfo.constFind(path);
+        if(iter == scan->dirInfo.constEnd()) return nullptr;
+        parent = folderCollection(scan, iter->first);
+        if(!parent) return nullptr;
+        order = iter->second;
+        if(scan->entryOrder.contains(parent))
         {
-            if(GlobalObjects::mpvplayer->videoFileFormats.contains("*."+fileInfo.suffix().toLower())
-                    && !fileItems.contains(filePath))
+            //keep the directory order in collections created by the scan
+            for(PlayListItem *child : *parent->children)
             {
-                if(oFolder) q_ptr->beginInsertRows(fIndex, folderItem->children->size(), folderItem->children->size());
-                PlayListItem *newItem = new PlayListItem(folderItem, true);
-                int suffixPos = fileName.lastIndexOf('.'), pathPos = fileName.lastIndexOf('/') + 1;
-                newItem->title = fileName.mid(pathPos, suffixPos - pathPos);
-                newItem->path = filePath;
-                fileItems.insert(newItem->path,newItem);
-                nItems<<newItem;
-                ++nCount;
-                if(oFolder) q_ptr->endInsertRows();
-
+                if(scan->entryOrder.value(child, -1) < order) ++insertPosition;
             }
         }
         else
         {
-            if (fileName == "." || fileName == "..")continue;
-            if(!currentPaths.contains(filePath))
+            insertPosition = parent->children->size();
+        }
+    }
+    QModelIndex parentIndex;
+    if(!itemIndex(parent, parentIndex)) return nullptr;
+    q->beginInsertRows(parentIndex, insertPosition, insertPosition);
+    collection = new PlayListItem(parent, false, insertPosition);
+    collection->title = QDir(path).dirName();
+    collection->folderPath = path;
+    q->endInsertRows();
+    childrenChanged(parent);
+    scan->collections.insert(path, collection);
+    scan->collectionDirs.insert(collection, path);
+    scan->entryOrder.insert(collection, order);
+    return collection;
+}
+
+void PlayListPrivate::removeVanishedItems(FolderScan *scan, const QList<FolderScanner::Dir> &dirs)
+{
+    for(const FolderScanner::Dir &dir : dirs)
+    {
+        //an unmounted share lists as an empty directory, keep its items
+        if(!dir.listed || (dir.files.isEmpty() && dir.dirs.isEmpty())) continue;
+        PlayListItem *collection = scan->collections.value(dir.path, nullptr);
+        if(!collection) continue;
+        const QSet<QString> files(dir.files.toSet()), subDirs(dir.dirs.toSet());
+        const QString prefix(dir.path.endsWith('/') ? dir.path : dir.path + '/');
+        QList<PlayListItem *> vanishedItems;
+        for(PlayListItem *child : *collection->children)
+        {
+            if(child->children)
             {
-                PlayListItem *folderCollection = new PlayListItem();
-                folderCollection->title = fileName;
-                folderCollection->folderPath = filePath;
-                int c = refreshFolder(folderCollection, nItems);
-                if(c>0)
+                //a vanished subfolder, unless items from elsewhere were put into it
+                if(child->folderPath.isEmpty() || subDirs.contains(child->folderPath)) continue;
+                const int pos = child->folderPath.lastIndexOf('/');
+                if(pos < 0 || child->folderPath.left(pos + 1) != prefix) continue;
+                const QString childPrefix(child->folderPath + '/');
+                bool onlyFolderItems = true;
+                QList<PlayListItem *> items(*child->children);
+                while(!items.isEmpty() && onlyFolderItems)
                 {
-                    if(oFolder) q_ptr->beginInsertRows(fIndex, folderItem->children->size(), folderItem->children->size());
-                    folderCollection->moveTo(folderItem);
-                    if(oFolder) q_ptr->endInsertRows();
+                    PlayListItem *item = items.takeLast();
+                    if(item->children) items.append(*item->children);
+                    else onlyFolderItems = item != currentItem && item->path.startsWith(childPrefix);
                 }
-                else delete folderCollection;
-                nCount += c;
+                if(onlyFolderItems) vanishedItems << child;
+            }
+            else if(child != currentItem && child->path.startsWith(prefix) && child->path.indexOf('/', prefix.length()) < 0
+                    && !files.contains(child->path))
+            {
+                vanishedItems << child;
             }
         }
+        scan->removedCount += removeItems(vanishedItems);
     }
-    return nCount;
+}
+
+void PlayListPrivate::scheduleWatchUpdate()
+{
+    if(watchUpdatePending) return;
+    watchUpdatePending = true;
+    QTimer::singleShot(0, q_ptr, [this](){
+        watchUpdatePending = false;
+        //breadth first, upper levels get the watches first
+        QStringList folders;
+        QSet<QString> folderSet;
+        QList<PlayListItem *> items({root});
+        while(!items.isEmpty())
+        {
+            PlayListItem *item = items.takeFirst();
+            if(!item->children) continue;
+            if(!item->folderPath.isEmpty() && !folderSet.contains(item->folderPath))
+            {
+                folderSet << item->folderPath;
+                folders << item->folderPath;
+            }
+            items.append(*item->children);
+        }
+        q_ptr->folderWatcher->setFolders(folders);
+    });
+}
+
+bool PlayListPrivate::itemIndex(PlayListItem *item, QModelIndex &index)
+{
+    //cut items keep their parent pointer but are no longer in the tree
+    for(PlayListItem *cur = item; cur != root; cur = cur->parent)
+    {
+        if(!cur->parent || cur->row() < 0) return false;
+    }
+    index = item == root ? QModelIndex() : q_ptr->createIndex(item->row(), 0, item);
+    return true;
+}
+
+int PlayListPrivate::removeItems(const QList<PlayListItem *> &items)
+{
+    Q_Q(PlayList);
+    //items under another removed item go with it
+    const QSet<PlayListItem *> itemSet(items.toSet());
+    QHash<PlayListItem *, QVector<int> > parentRows;
+    for(PlayListItem *item : itemSet)
+    {
+        bool covered = false;
+        for(PlayListItem *p = item->parent; p && !covered; p = p->parent)
+            covered = itemSet.contains(p);
+        if(covered || !item->parent) continue;
+        const int row = item->row();
+        if(row >= 0) parentRows[item->parent].append(row);
+    }
+    int count = 0;
+    for(auto iter = parentRows.begin(); iter != parentRows.end(); ++iter)
+    {
+        PlayListItem *parent = iter.key();
+        QModelIndex parentIndex;
+        if(!itemIndex(parent, parentIndex)) continue;
+        QVector<int> &rows = iter.value();
+        std::sort(rows.begin(), rows.end(), std::greater<int>());
+        //one signal for each run of adjacent rows, bottom up so the rows above stay valid
+        for(int i = 0; i < rows.size();)
+        {
+            const int last = rows[i];
+            int first = last;
+            for(++i; i < rows.size() && rows[i] == first - 1; ++i) first = rows[i];
+            q->beginRemoveRows(parentIndex, first, last);
+            const QList<PlayListItem *> removedItems(parent->children->mid(first, last - first + 1));
+            parent->children->erase(parent->children->begin() + first, parent->children->begin() + last + 1);
+            q->endRemoveRows();
+            qDeleteAll(removedItems);
+            count += removedItems.size();
+        }
+    }
+    if(count > 0) needRefresh = true;
+    return count;
 }
 
 QString PlayListPrivate::setCollectionTitle(QList<PlayListItem *> &list)
@@ -468,29 +630,19 @@ QString PlayListPrivate::setCollectionTitle(QList<PlayListItem *> &list)
     return matchStr.length() < minLength? defaultTitle : matchStr;
 }
 
-void PlayListPrivate::dumpItem(QJsonArray &array, PlayListItem *item, QHash<QString, QString> &mediaHash)
+void PlayListPrivate::snapshotItems(QVector<PlayListSnapshot::Node> &nodes, PlayListItem *collection, int parentIndex)
 {
-    for(PlayListItem *child:*item->children)
+    for(PlayListItem *child:*collection->children)
     {
-        QJsonObject itemObj;
-        itemObj.insert("text",child->title);
-        if(child->children)
-        {
-            QJsonArray childArray;
-            dumpItem(childArray,child,mediaHash);
-            itemObj.insert("nodes",childArray);
-        }
-        else
-        {
-            QString pathHash(QCryptographicHash::hash(child->path.toUtf8(),QCryptographicHash::Md5).toHex());
-            itemObj.insert("mediaId",pathHash);
-            itemObj.insert("danmuPool",child->poolID);
-            itemObj.insert("playTime",child->playTime);
-            itemObj.insert("playTimeState",child->playTimeState);
-            static QString nodeColors[3]={"#333","#428bca","#a4a2a2"};
-            itemObj.insert("color",nodeColors[child->playTimeState]);
-            mediaHash.insert(pathHash,child->path);
-        }
-        array.append(itemObj);
+        PlayListSnapshot::Node node;
+        node.parent = parentIndex;
+        node.isCollection = child->children != nullptr;
+        node.title = child->title;
+        node.path = child->path;
+        node.poolID = child->poolID;
+        node.playTime = child->playTime;
+        node.playTimeState = child->playTimeState;
+        nodes.append(node);
+        if(child->children) snapshotItems(nodes, child, nodes.size() - 1);
     }
 }
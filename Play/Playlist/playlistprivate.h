@@ -1,7 +1,32 @@
 #ifndef PLAYLISTPRIVATE_H
 #define PLAYLISTPRIVATE_H
 #include "playlist.h"
-#include <QXmlStreamWriter>
+#include "playlistjournal.h"
+#include "folderscanner.h"
+struct FolderScan
+{
+    CancelToken token;
+    QString rootPath;
+    PlayListItem *target = nullptr;  //addFolder: the collection the new folder goes into
+    int targetPosition = 0;
+    QHash<QString, QPair<QString, int> > dirInfo;  //dir -> parent dir, entry order
+    QHash<QString, PlayListItem *> collections;
+    QHash<PlayListItem *, QString> collectionDirs;
+    QHash<PlayListItem *, int> entryOrder;  //items created by the scan
+    QList<PlayListItem *> newItems;
+    QSet<PlayListItem *> liveItems;
+    int itemCount = 0;
+    bool sync = false;  //folder sync: silent, also removes items whose files are gone
+    int removedCount = 0;
+
+    void forget(PlayListItem *item);
+};
+struct ItemCheck
+{
+    QSet<PlayListItem *> liveItems;
+    int pending = 0;
+    int removedCount = 0;
+};
 class PlayListPrivate
 {
 public:
@@ -10,6 +35,7 @@ public:
 
     PlayListItem *root;
     PlayListItem *currentItem;
+    PlayListItem *randomNext;  //next item in Random mode, chosen ahead by peekNextItem
     bool playListChanged, needRefresh;
     PlayList::LoopMode loopMode;
     bool autoMatch;
@@ -19,29 +45,49 @@ public:
     QList<PlayListItem *> itemsClipboard;
     QList<QPair<QString,QString> > recentList;
     QHash<QString,PlayListItem *> fileItems, bgmCollectionItems;
+    QList<QSharedPointer<FolderScan> > folderScans;
+    QSet<QString> pendingSyncFolders;
+    QList<QSharedPointer<ItemCheck> > itemChecks;
+    QSharedPointer<const PlayListSnapshot> lastSnapshot;
 
 public:
     void loadPlaylist();
     void savePlaylist();
     void incModifyCounter();
 
+    void itemChanged(PlayListItem *item, int changes = PlayListJournal::InfoChanged);
+    void childrenChanged(PlayListItem *collection);
+    void itemRemoved(PlayListItem *item);
+
     void loadRecentlist();
     void saveRecentlist();
     void updateRecentlist(PlayListItem *item);
 
     PlayListItem *getPrevOrNextItem(bool prev);
-    bool addSubFolder(QString folderStr, PlayListItem *parent, int &itemCount);
-    int refreshFolder(PlayListItem *folderItem, QList<PlayListItem *> &nItems);
+    void addScannedDirs(FolderScan *scan, const QList<FolderScanner::Dir> &dirs);
+    PlayListItem *folderCollection(FolderScan *scan, const QString &path);
+    void removeVanishedItems(FolderScan *scan, const QList<FolderScanner::Dir> &dirs);
+    void scheduleWatchUpdate();
+    bool itemIndex(PlayListItem *item, QModelIndex &index);
+    int removeItems(const QList<PlayListItem *> &items);
 
     QString setCollectionTitle(QList<PlayListItem *> &list);
-    void dumpItem(QJsonArray &array,PlayListItem *item, QHash<QString, QString> &mediaHash);
+    void snapshotItems(QVector<PlayListSnapshot::Node> &nodes, PlayListItem *collection, int parentIndex);
 private:
-    void saveItem(QXmlStreamWriter &writer,PlayListItem *item);
+    void loadXmlPlaylist();
+    void indexItems(PlayListItem *collection);
+    void saveChildren(PlayListItem *collection);
 private:
     PlayList *const q_ptr;
     Q_DECLARE_PUBLIC(PlayList)
     QString plPath;
     QString rectPath;
+    PlayListJournal *journal;
+    bool trackChanges;
+    bool watchUpdatePending;
+    QHash<PlayListItem *, int> changedItems;
+    QSet<PlayListItem *> changedCollections;
+    QVector<quint32> removedItems;
 };
 
 #endif // PLAYLISTPRIVATE_H
@@ -0,0 +1,61 @@
+#include "playprogress.h"
+#include <QTimer>
+#include <QDateTime>
+#include "globalobjects.h"
+#include "Play/Video/mpvplayer.h"
+#include "MediaLibrary/animeworker.h"
+
+PlayProgress::PlayProgress(QObject *parent) : QObject(parent)
+{
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(qMax(1, GlobalObjects::appSetting->value("Play/ProgressFlushInterval", 10).toInt()) * 1000);
+    QObject::connect(flushTimer, &QTimer::timeout, this, &PlayProgress::flush);
+    QObject::connect(GlobalObjects::mpvplayer, &MPVPlayer::stateChanged, this, [this](MPVPlayer::PlayState state){
+        if(state != MPVPlayer::Play) flush();
+    });
+}
+
+void PlayProgress::setPosition(const QString &path, const QString &animeTitle)
+{
+    entry(path, animeTitle).positionChanged = true;
+}
+
+void PlayProgress::setPlayed(const QString &path, const QString &animeTitle)
+{
+    entry(path, animeTitle).lastPlayTime = QDateTime::currentDateTime().toSecsSinceEpoch();
+}
+
+void PlayProgress::setFinished(const QString &path, const QString &animeTitle)
+{
+    entry(path, animeTitle).finishTime = QDateTime::currentDateTime().toSecsSinceEpoch();
+}
+
+void PlayProgress::flush()
+{
+    flushTimer->stop();
+    if(pending.isEmpty()) return;
+    QHash<QString, Entry> entries;
+    entries.swap(pending);
+    emit flushing(entries);
+    QList<AnimeWorker::EpTime> epTimes;
+    for(auto iter = entries.cbegin(); iter != entries.cend(); ++iter)
+    {
+        if(iter->animeTitle.isEmpty() || (!iter->lastPlayTime && !iter->finishTime)) continue;
+        AnimeWorker::EpTime epTime;
+        epTime.animeName = iter->animeTitle;
+        epTime.path = iter.key();
+        epTime.lastPlayTime = iter->lastPlayTime;
+        epTime.finishTime = iter->finishTime;
+        epTimes.append(epTime);
+    }
+    if(!epTimes.isEmpty()) AnimeWorker::instance()->updateEpTimes(epTimes);
+}
+
+PlayProgress::Entry &PlayProgress::entry(const QString &path, const QString &animeTitle)
+{
+    if(!flushTimer->isActive()) flushTimer->start();
+    Entry &e = pending[path];
+    e.animeTitle = animeTitle;
+    return e;
+}
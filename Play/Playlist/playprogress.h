@@ -0,0 +1,43 @@
+#ifndef PLAYPROGRESS_H
+#define PLAYPROGRESS_H
+#include <QObject>
+#include <QHash>
+class QTimer;
+/*
+ * Write-behind store for play progress, used on the gui thread.
+ * Positions reported by the player and LAN clients are only kept in memory, per media,
+ * and written out together: the playlist journal and the episode table (in one transaction)
+ * every flushInterval, and right away when playback is paused or stopped and on exit.
+ */
+class PlayProgress : public QObject
+{
+    Q_OBJECT
+public:
+    struct Entry
+    {
+        QString animeTitle;
+        bool positionChanged = false;
+        qint64 lastPlayTime = 0, finishTime = 0;  //0: unchanged
+    };
+    explicit PlayProgress(QObject *parent = nullptr);
+
+    void setPosition(const QString &path, const QString &animeTitle);
+    void setPlayed(const QString &path, const QString &animeTitle);
+    void setFinished(const QString &path, const QString &animeTitle);
+    inline bool hasPending() const {return !pending.isEmpty();}
+
+signals:
+    //emitted first in flush, the playlist writes the items with positionChanged
+    void flushing(const QHash<QString, PlayProgress::Entry> &entries);
+
+public slots:
+    void flush();
+
+private:
+    QHash<QString, Entry> pending;
+    QTimer *flushTimer;
+
+    Entry &entry(const QString &path, const QString &animeTitle);
+};
+
+#endif // PLAYPROGRESS_H
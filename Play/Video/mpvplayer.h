@@ -53,7 +53,7 @@ public:
     inline int getDuration() const{return currentDuration;}
     inline QString getMediaTitle() const {return mpv::qt::get_property(mpv,"media-title").toString();}
     inline const QList<ChapterInfo> &getChapters() const {return chapters;}
-    inline QPixmap *getPreview(int timePos, bool refresh=true) { if(!mpvPreview) return nullptr; return mpvPreview->getPreview(timePos, refresh);}
+    inline QPixmap getPreview(int timePos, bool refresh=true) { if(!mpvPreview) return QPixmap(); return mpvPreview->getPreview(timePos, refresh);}
     inline const QString &getCurrentFile() const {return currentFile;}
     inline int getVolume() const {return volume;}
     QString getMPVProperty(const QString &property, bool &hasError);
@@ -72,7 +72,7 @@ signals:
     void chapterChanged();
     void initContext();
     void showLog(const QString &log);
-    void refreshPreview(int time, QPixmap *pixmap);
+    void refreshPreview(int time, const QPixmap &pixmap);
 public slots:   
     void setMedia(const QString &file);
     void setState(PlayState newState);
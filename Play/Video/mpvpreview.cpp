@@ -18,7 +18,8 @@ static void *get_proc_address(void *ctx, const char *name) {
 }
 }
 
-MPVPreview::MPVPreview(const QSize &previewSize, int pInterval, QObject *parent):QObject (parent),previewInterval(pInterval)
+MPVPreview::MPVPreview(const QSize &previewSize, int pInterval, QObject *parent):QObject (parent),previewInterval(pInterval),
+    previewCache(64*1024*1024, 4, [](const QPixmap &pixmap){return qint64(pixmap.width())*pixmap.height()*pixmap.depth()/8;})
 {
     mpv = mpv_create();
     if (!mpv)
@@ -71,18 +72,13 @@ MPVPreview::~MPVPreview()
     ctx = nullptr;
 }
 
-QPixmap *MPVPreview::getPreview(int timePos, bool refresh)
+QPixmap MPVPreview::getPreview(int timePos, bool refresh)
 {
-    if(curFilename.isEmpty()) return nullptr;
+    if(curFilename.isEmpty()) return QPixmap();
     int pos = timePos / previewInterval;
-    QPixmap *pixmap = nullptr;
-    locker.lockForRead();
-    if(previewCache.contains(pos))
-    {
-        pixmap = &previewCache[pos];
-    }
-    locker.unlock();
-    if(!pixmap && refresh)
+    QPixmap pixmap;
+    previewCache.get(pos, pixmap);
+    if(pixmap.isNull() && refresh)
     {
         mpv::qt::command_variant(mpv, QVariantList() << "seek" << timePos << "absolute");
     }
@@ -100,9 +96,7 @@ void MPVPreview::reset(const QString &filename)
         curFilename = filename;
         mpv::qt::command_variant(mpv, QStringList() << "loadfile" << curFilename);
         mpv::qt::set_property(mpv,"pause",true);
-        locker.lockForWrite();
         previewCache.clear();
-        locker.unlock();
         posSet.clear();
     }
 }
@@ -134,10 +128,9 @@ void MPVPreview::update()
         ctx->doneCurrent();
         return;
     }
-    locker.lockForWrite();
-    previewCache[pos] = QPixmap::fromImage(pFbo->toImage().scaled(previewSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
-    locker.unlock();
-    emit previewDown(ptime, &previewCache[pos]);
+    QPixmap pixmap(QPixmap::fromImage(pFbo->toImage().scaled(previewSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)));
+    previewCache.put(pos, pixmap);
+    emit previewDown(ptime, pixmap);
 
     ctx->doneCurrent();
 }
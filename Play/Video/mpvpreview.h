@@ -1,14 +1,14 @@
 #ifndef MPVPREVIEW_H
 #define MPVPREVIEW_H
 
-#include <QHash>
 #include <QObject>
-#include <QReadWriteLock>
+#include <QPixmap>
 #include <QSet>
 #include <QSize>
 #include <mpv/client.h>
 #include <mpv/render_gl.h>
 #include <mpv/qthelper.hpp>
+#include "Common/shardedcache.h"
 
 class QOpenGLFramebufferObject;
 class QOffscreenSurface;
@@ -19,10 +19,10 @@ class MPVPreview : public QObject
 public:
     MPVPreview(const QSize &previewSize, int pInterval=3, QObject *parent = nullptr);
     ~MPVPreview();
-    QPixmap *getPreview(int timePos, bool refresh=true);
+    QPixmap getPreview(int timePos, bool refresh=true);
     void reset(const QString &filename="");
 signals:
-    void previewDown(int time, QPixmap *pixmap);
+    void previewDown(int time, const QPixmap &pixmap);
 private slots:
     void update();
 private:
@@ -39,8 +39,7 @@ private:
 
     QString curFilename;
     int previewInterval;
-    QReadWriteLock locker;
-    QHash<int, QPixmap> previewCache;
+    ShardedLRUCache<int, QPixmap> previewCache;
 
 };
 
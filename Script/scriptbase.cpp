@@ -4,10 +4,8 @@
 #include "Common/network.h"
 #include "Common/htmlparsersax.h"
 #include "Common/notifier.h"
+#include "Common/titleindex.h"
 #include "scriptlogger.h"
-#ifdef Q_OS_WIN
-#include <windows.h>
-#endif
 namespace
 {
 static int httpGet(lua_State *L)
@@ -479,16 +477,6 @@ static int dialog(lua_State *L)
     }
     return 0;
 }
-#ifdef Q_OS_WIN
-const QString stTrans(const QString &str, bool toSimplified)
-{
-    WORD wLanguageID = MAKELANGID(LANG_CHINESE, SUBLANG_CHINESE_SIMPLIFIED);
-    LCID Locale = MAKELCID(wLanguageID, SORT_CHINESE_PRCP);
-    QScopedPointer<QChar> buf(new QChar[str.length()]);
-    LCMapString(Locale,toSimplified?LCMAP_SIMPLIFIED_CHINESE:LCMAP_TRADITIONAL_CHINESE,reinterpret_cast<LPCWSTR>(str.constData()),str.length(),reinterpret_cast<LPWSTR>(buf.data()),str.length());
-    return QString(buf.data(), str.length());
-}
-#endif
 static int simplifiedTraditionalTrans(lua_State *L)
 {
 #ifdef Q_OS_WIN
@@ -500,13 +488,13 @@ static int simplifiedTraditionalTrans(lua_State *L)
         return 2;
     }
     QString input(lua_tostring(L, 1));
-    QString trans(stTrans(input, lua_toboolean(L, 2)));
+    QString trans(TitleIndex::stTrans(input, lua_toboolean(L, 2)));
     lua_pushnil(L);
     lua_pushstring(L, trans.toStdString().c_str());
     return 2;
 #else
     lua_pushnil(L);
-    lua_pushvalue(L, 1)
+    lua_pushvalue(L, 1);
     return 2;
 #endif
 }
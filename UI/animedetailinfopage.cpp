@@ -69,6 +69,12 @@ AnimeDetailInfoPage::AnimeDetailInfoPage(QWidget *parent) : QWidget(parent), cur
     coverLabel->addAction(actCopyCover);
     coverLabel->addAction(actDownloadCover);
     coverLabel->setContextMenuPolicy(Qt::ActionsContextMenu);
+    QObject::connect(AnimeWorker::instance(), &AnimeWorker::coverLoaded, this, [=](Anime *anime){
+        if(anime==currentAnime) coverLabel->setPixmap(anime->cover());
+    });
+    QObject::connect(AnimeWorker::instance(), &AnimeWorker::charactersLoaded, this, [=](const QList<Anime *> &animes){
+        if(animes.contains(currentAnime)) refreshCharacters();
+    });
 
     titleLabel=new QLabel(this);
     titleLabel->setObjectName(QStringLiteral("AnimeDetailTitle"));
@@ -208,6 +214,23 @@ void AnimeDetailInfoPage::setAnime(Anime *anime)
     descInfo->setText(currentAnime->description());
     epModel->setAnime(currentAnime);
     epDelegate->setAnime(currentAnime);
+    refreshCharacters();
+    auto &tagMap=GlobalObjects::animeLabelModel->customTags();
+    QStringList tags;
+    for(auto iter=tagMap.begin();iter!=tagMap.end();++iter)
+    {
+        if(iter.value().contains(currentAnime->name()))
+            tags<<iter.key();
+    }
+    tagPanel->addTag(tags);
+    tagContainerSLayout->setCurrentIndex(0);
+    captureModel->setAnimeName(currentAnime->name());
+}
+
+void AnimeDetailInfoPage::refreshCharacters()
+{
+    characterList->clear();
+    if(!currentAnime) return;
     for(auto &character: currentAnime->crList(true))
     {
         CharacterWidget *crtItem=new CharacterWidget(&character);
@@ -232,16 +255,6 @@ void AnimeDetailInfoPage::setAnime(Anime *anime)
         characterList->setItemWidget(listItem, crtItem);
         listItem->setSizeHint(crtItem->sizeHint());
     }
-    auto &tagMap=GlobalObjects::animeLabelModel->customTags();
-    QStringList tags;
-    for(auto iter=tagMap.begin();iter!=tagMap.end();++iter)
-    {
-        if(iter.value().contains(currentAnime->name()))
-            tags<<iter.key();
-    }
-    tagPanel->addTag(tags);
-    tagContainerSLayout->setCurrentIndex(0);
-    captureModel->setAnimeName(currentAnime->name());
 }
 
 
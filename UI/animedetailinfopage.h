@@ -57,6 +57,7 @@ class AnimeDetailInfoPage : public QWidget
 public:
     AnimeDetailInfoPage(QWidget *parent = nullptr);
     void setAnime(Anime *anime);
+    inline Anime *anime() const {return currentAnime;}
 signals:
     void playFile(const QString &file);
 private:
@@ -71,6 +72,7 @@ private:
     QStackedLayout *tagContainerSLayout;
     CaptureListModel *captureModel;
 
+    void refreshCharacters();
     QWidget *setupDescriptionPage();
     QWidget *setupEpisodesPage();
     QWidget *setupCharacterPage();
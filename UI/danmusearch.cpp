@@ -0,0 +1,67 @@
+#include "danmusearch.h"
+#include <QTreeView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QGridLayout>
+#include <QHeaderView>
+#include "globalobjects.h"
+#include "Common/notifier.h"
+#include "Play/Danmu/Manager/danmusearchmodel.h"
+#include "Play/Playlist/playlist.h"
+#include "Play/Playlist/playlistitem.h"
+
+DanmuSearch::DanmuSearch(QWidget *parent) : CFramelessDialog(tr("Search Danmu"), parent), playTime(-1)
+{
+    searchModel = new DanmuSearchModel(this);
+
+    searchEdit = new QLineEdit(this);
+    searchEdit->setClearButtonEnabled(true);
+    searchEdit->setPlaceholderText(tr("Keyword, press Enter to search"));
+    tipLabel = new QLabel(this);
+
+    hitView = new QTreeView(this);
+    hitView->setRootIsDecorated(false);
+    hitView->setAlternatingRowColors(true);
+    hitView->setSelectionMode(QAbstractItemView::SingleSelection);
+    hitView->setModel(searchModel);
+    hitView->header()->resizeSection(static_cast<int>(DanmuSearchModel::Columns::EPISODE), 200*logicalDpiX()/96);
+    hitView->header()->resizeSection(static_cast<int>(DanmuSearchModel::Columns::TIME), 60*logicalDpiX()/96);
+
+    QObject::connect(searchEdit, &QLineEdit::returnPressed, this, [this](){
+        tipLabel->clear();
+        searchModel->search(searchEdit->text());
+    });
+    QObject::connect(searchModel, &DanmuSearchModel::fetching, this, [this](bool on){
+        showBusyState(on);
+        searchEdit->setEnabled(!on);
+    });
+    QObject::connect(searchModel, &DanmuSearchModel::searchInfo, tipLabel, &QLabel::setText);
+    QObject::connect(hitView, &QTreeView::doubleClicked, this, [this](const QModelIndex &index){
+        const DanmuFts::Hit *hit = searchModel->getHit(index.row());
+        if(!hit) return;
+        const PlayListItem *item = GlobalObjects::playlist->getPoolItem(hit->pid);
+        if(!item)
+        {
+            showMessage(tr("No File in Playlist for %1 %2").arg(hit->anime, hit->ep.toString()), NM_ERROR | NM_HIDE);
+            return;
+        }
+        playPath = item->path;
+        playTime = hit->time;
+        CFramelessDialog::onAccept();
+    });
+
+    QGridLayout *searchGLayout = new QGridLayout(this);
+    searchGLayout->addWidget(searchEdit, 0, 0);
+    searchGLayout->addWidget(tipLabel, 0, 1);
+    searchGLayout->addWidget(hitView, 1, 0, 1, 2);
+    searchGLayout->setRowStretch(1, 1);
+    searchGLayout->setColumnStretch(0, 1);
+    searchGLayout->setContentsMargins(0, 0, 0, 0);
+    resize(GlobalObjects::appSetting->value("DialogSize/DanmuSearch", QSize(600*logicalDpiX()/96, 400*logicalDpiY()/96)).toSize());
+}
+
+void DanmuSearch::onClose()
+{
+    GlobalObjects::appSetting->setValue("DialogSize/DanmuSearch", size());
+    CFramelessDialog::onClose();
+}
@@ -0,0 +1,27 @@
+#ifndef DANMUSEARCH_H
+#define DANMUSEARCH_H
+#include "framelessdialog.h"
+class QTreeView;
+class QLineEdit;
+class QLabel;
+class DanmuSearchModel;
+class DanmuSearch : public CFramelessDialog
+{
+    Q_OBJECT
+public:
+    explicit DanmuSearch(QWidget *parent = nullptr);
+    QString playPath;
+    int playTime;
+
+private:
+    QLineEdit *searchEdit;
+    QTreeView *hitView;
+    QLabel *tipLabel;
+    DanmuSearchModel *searchModel;
+
+    // CFramelessDialog interface
+protected:
+    virtual void onClose();
+};
+
+#endif // DANMUSEARCH_H
@@ -8,8 +8,11 @@
 #include <QMenu>
 #include <QHeaderView>
 #include <QWidgetAction>
+#include <QInputDialog>
 #include "globalobjects.h"
+#include "Common/notifier.h"
 #include "Play/Danmu/danmuviewmodel.h"
+#include "Play/Danmu/Manager/pool.h"
 DanmuView::DanmuView(const QList<DanmuComment *> *danmuList, QWidget *parent, int sourceId):CFramelessDialog (tr("View Danmu"),parent)
 {
     initView();
@@ -45,6 +48,61 @@ DanmuView::DanmuView(const QList<QSharedPointer<DanmuComment> > *danmuList, QWid
     });
 }
 
+DanmuView::DanmuView(Pool *pool, QWidget *parent, int sourceId):CFramelessDialog (tr("View Danmu"),parent)
+{
+    initView();
+    DanmuViewModel<QSharedPointer<DanmuComment> > *model=new DanmuViewModel<QSharedPointer<DanmuComment> >(&pool->comments(),this);
+    DanmuViewProxyModel *proxyModel = new DanmuViewProxyModel(this);
+    proxyModel->setSourceId(sourceId);
+    proxyModel->setFilterCaseSensitivity(Qt::CaseInsensitive);
+    proxyModel->setFilterKeyColumn(4);
+    proxyModel->setSourceModel(model);
+    danmuView->setModel(proxyModel);
+    tipLabel->setText(tr("Danmu Count: %1").arg(proxyModel->rowCount()));
+    QObject::connect(filterEdit,&DanmuFilterBox::filterChanged,[proxyModel,this](int type, const QString &keyword){
+        proxyModel->setFilterKeyColumn(type);
+        proxyModel->setFilterRegExp(keyword);
+        tipLabel->setText(tr("Danmu Count: %1").arg(proxyModel->rowCount()));
+    });
+
+    QAction *act_delete=new QAction(tr("Delete"),this);
+    QObject::connect(act_delete,&QAction::triggered,this,[this,pool,model,proxyModel](){
+        QModelIndexList indexList = danmuView->selectionModel()->selectedRows();
+        if(indexList.isEmpty()) return;
+        QList<qint64> ids;
+        for(const QModelIndex &index:indexList)
+            ids.append(proxyModel->mapToSource(index).data(IdRole).toLongLong());
+        int deleted=pool->deleteDanmu(ids);
+        if(deleted==0)
+        {
+            showMessage(tr("Pool is Busy, Try Again Later"), NM_ERROR | NM_HIDE);
+            return;
+        }
+        model->refresh();
+        tipLabel->setText(tr("Danmu Count: %1").arg(proxyModel->rowCount()));
+    });
+    QAction *act_edit=new QAction(tr("Edit"),this);
+    QObject::connect(act_edit,&QAction::triggered,this,[this,pool,model,proxyModel](){
+        QModelIndexList indexList = danmuView->selectionModel()->selectedRows();
+        if(indexList.size()!=1) return;
+        QModelIndex index(proxyModel->mapToSource(indexList.first()));
+        //the dialog runs an event loop, the comment is held until it returns
+        const QSharedPointer<DanmuComment> danmu(pool->comments().at(index.row()));
+        bool ok=false;
+        QString text=QInputDialog::getText(this,tr("Edit"),tr("Content"),QLineEdit::Normal,danmu->text,&ok).trimmed();
+        if(!ok || text.isEmpty()) return;
+        if(pool->editDanmu(danmu->id(),text,danmu->color)==0)
+        {
+            showMessage(tr("Pool is Busy, Try Again Later"), NM_ERROR | NM_HIDE);
+            return;
+        }
+        model->refresh();
+    });
+    danmuView->setContextMenuPolicy(Qt::ActionsContextMenu);
+    danmuView->addAction(act_edit);
+    danmuView->addAction(act_delete);
+}
+
 void DanmuView::initView()
 {
     danmuView=new QTreeView(this);
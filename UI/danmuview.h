@@ -6,6 +6,7 @@
 class QTreeView;
 class QActionGroup;
 class QLabel;
+class Pool;
 class DanmuFilterBox : public QLineEdit
 {
     Q_OBJECT
@@ -33,6 +34,8 @@ public:
                        int sourceId=-1);
     explicit DanmuView(const QList<QSharedPointer<DanmuComment> > *danmuList, QWidget *parent = nullptr,
                        int sourceId=-1);
+    //comments of the pool can be deleted, several at once
+    explicit DanmuView(Pool *pool, QWidget *parent = nullptr, int sourceId=-1);
 
 private:
     QTreeView *danmuView;
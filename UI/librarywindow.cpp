@@ -35,6 +35,7 @@
 #include "MediaLibrary/labelmodel.h"
 #include "MediaLibrary/labelitemdelegate.h"
 #include "MediaLibrary/animefilterproxymodel.h"
+#include "Common/asynctask.h"
 
 namespace
 {
@@ -92,6 +93,9 @@ LibraryWindow::LibraryWindow(QWidget *parent) : QWidget(parent)
     animeListView->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
     animeListView->setSelectionMode(QAbstractItemView::SingleSelection);
     animeListView->setItemDelegate(itemDelegate);
+    QObject::connect(itemDelegate, &AnimeItemDelegate::coverLoaded, animeListView, [=](){
+        animeListView->viewport()->update();
+    });
     animeListView->setMouseTracking(true);
     animeListView->setContextMenuPolicy(Qt::CustomContextMenu);
     animeModel = new AnimeModel(this);
@@ -141,32 +145,21 @@ LibraryWindow::LibraryWindow(QWidget *parent) : QWidget(parent)
         }
         else
         {
-            QString animeName(AnimeWorker::instance()->addAnime(currentAnime, nAnime));
-            auto &tagAnimes = GlobalObjects::animeLabelModel->customTags();
-            bool hasTag = false;
-            for(const auto &animes : tagAnimes)
-            {
-                if(animes.contains(animeName))
-                {
-                    hasTag = true;
-                    break;
-                }
-            }
-            if(!hasTag)
-            {
-                QStringList tags;
-                Anime *tAnime = AnimeWorker::instance()->getAnime(animeName);
-                if(tAnime)
+            Async::then(AnimeWorker::instance()->addAnime(currentAnime, nAnime), this, [this, scriptName](const QString &animeName){
+                auto &tagAnimes = GlobalObjects::animeLabelModel->customTags();
+                bool hasTag = false;
+                for(const auto &animes : tagAnimes)
                 {
-                    showMessage(tr("Fetching Tags from %1").arg(scriptName), NM_PROCESS | NM_DARKNESS_BACK);
-                    GlobalObjects::animeProvider->getTags(tAnime, tags);
-                    if(tags.size()>0)
+                    if(animes.contains(animeName))
                     {
-                        GlobalObjects::animeLabelModel->addCustomTags(tAnime->name(), tags);
+                        hasTag = true;
+                        break;
                     }
                 }
-            }
-            showMessage(tr("Fetch Down"), NotifyMessageFlag::NM_HIDE);
+                Anime *tAnime = AnimeWorker::instance()->getAnime(animeName);
+                if(!hasTag && tAnime) fetchTags(tAnime, scriptName);
+                showMessage(tr("Fetch Down"), NotifyMessageFlag::NM_HIDE);
+            });
         }
     });
     act_updateDetailInfo->setEnabled(false);
@@ -344,6 +337,10 @@ LibraryWindow::LibraryWindow(QWidget *parent) : QWidget(parent)
     QObject::connect(labelView->selectionModel(), &QItemSelectionModel::selectionChanged, refreshLabelFilter);
 
     QObject::connect(detailPage,&AnimeDetailInfoPage::playFile,this,&LibraryWindow::playFile);
+    QObject::connect(AnimeWorker::instance(),&AnimeWorker::coverLoaded,this,[=](Anime *anime){
+        if(viewSLayout->currentIndex()==1 && detailPage->anime()==anime)
+            emit switchBackground(anime->cover(), true);
+    });
     QObject::connect(itemDelegate,&AnimeItemDelegate::ItemClicked,[=](const QModelIndex &index){
         Anime * anime = animeModel->getAnime(static_cast<AnimeFilterProxyModel *>(animeListView->model())->mapToSource(index));
         emit switchBackground(anime->cover(), true);
@@ -405,34 +402,23 @@ void LibraryWindow::searchAddAnime(Anime *srcAnime)
         ScriptState state = GlobalObjects::animeProvider->getDetail(animeSearch.curSelectedAnime, nAnime);
         if(state)
         {
-            QStringList tags;
             if(srcAnime)
             {
-                QString animeName(AnimeWorker::instance()->addAnime(srcAnime, nAnime));
-                Anime *tAnime = AnimeWorker::instance()->getAnime(animeName);
-                if(tAnime)
-                {
-                    showMessage(tr("Fetching Tags from %1").arg(scriptName), NM_PROCESS | NM_DARKNESS_BACK);
-                    GlobalObjects::animeProvider->getTags(tAnime, tags);
-                    if(tags.size()>0)
-                    {
-                        GlobalObjects::animeLabelModel->addCustomTags(tAnime->name(), tags);
-                    }
-                }
+                Async::then(AnimeWorker::instance()->addAnime(srcAnime, nAnime), this, [this, scriptName](const QString &animeName){
+                    Anime *tAnime = AnimeWorker::instance()->getAnime(animeName);
+                    if(tAnime) fetchTags(tAnime, scriptName);
+                    showMessage(tr("Fetch Down"), NotifyMessageFlag::NM_HIDE);
+                });
             }
             else
             {
-                if(AnimeWorker::instance()->addAnime(nAnime))
-                {
-                    showMessage(tr("Fetching Tags from %1").arg(scriptName), NM_PROCESS | NM_DARKNESS_BACK);
-                    GlobalObjects::animeProvider->getTags(nAnime, tags);
-                    if(tags.size()>0)
-                    {
-                        GlobalObjects::animeLabelModel->addCustomTags(nAnime->name(), tags);
-                    }
-                }
+                const QString animeName(nAnime->name());
+                Async::then(AnimeWorker::instance()->addAnime(nAnime), this, [this, animeName, scriptName](bool added){
+                    Anime *tAnime = AnimeWorker::instance()->getAnime(animeName);
+                    if(added && tAnime) fetchTags(tAnime, scriptName);
+                    showMessage(tr("Fetch Down"), NotifyMessageFlag::NM_HIDE);
+                });
             }
-            showMessage(tr("Fetch Down"), NotifyMessageFlag::NM_HIDE);
             break;
         }
         else
@@ -445,19 +431,30 @@ void LibraryWindow::searchAddAnime(Anime *srcAnime)
 
 }
 
+void LibraryWindow::fetchTags(Anime *anime, const QString &scriptName)
+{
+    QStringList tags;
+    showMessage(tr("Fetching Tags from %1").arg(scriptName), NM_PROCESS | NM_DARKNESS_BACK);
+    GlobalObjects::animeProvider->getTags(anime, tags);
+    if(tags.size()>0)
+    {
+        GlobalObjects::animeLabelModel->addCustomTags(anime->name(), tags);
+    }
+}
+
 void LibraryWindow::showEvent(QShowEvent *)
 {
     static bool labelInited = false;
     if(!labelInited)
     {
         labelInited = true;
-        QTimer::singleShot(0, [=](){
-            GlobalObjects::animeLabelModel->loadLabels();
+        QObject::connect(GlobalObjects::animeLabelModel, &LabelModel::labelsLoaded, this, [=](){
             labelView->expand(labelProxyModel->index(0,0,QModelIndex()));
             labelView->expand(labelProxyModel->index(1,0,QModelIndex()));
             labelView->expand(labelProxyModel->index(2,0,QModelIndex()));
             labelView->expand(labelProxyModel->index(3,0,QModelIndex()));
         });
+        GlobalObjects::animeLabelModel->loadLabels();
     }
     animeModel->setActive(true);
 }
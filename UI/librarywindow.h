@@ -87,6 +87,7 @@ private:
     DialogTip *dialogTip;
     AnimeDetailInfoPage *detailPage;
     void searchAddAnime(Anime *srcAnime = nullptr);
+    void fetchTags(Anime *anime, const QString &scriptName);
 signals:
     void playFile(const QString &file);
     void switchBackground(const QPixmap &pixmap, bool setPixmap);
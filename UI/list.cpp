@@ -24,6 +24,8 @@
 #include "Play/Danmu/Manager/danmumanager.h"
 #include "Play/Danmu/Manager/pool.h"
 #include "Download/downloadmodel.h"
+#include "Common/asynctask.h"
+#include "Common/dbexecutor.h"
 #define BgmCollectionRole Qt::UserRole+1
 #define FolderCollectionRole Qt::UserRole+2
 namespace
@@ -265,6 +267,13 @@ void ListWindow::initActions()
         QModelIndex selIndex(selection.indexes().first());
         GlobalObjects::playlist->refreshFolder(selIndex);
     });
+    act_folderSync=new QAction(tr("Auto Sync Folders"),this);
+    act_folderSync->setCheckable(true);
+    act_folderSync->setChecked(GlobalObjects::appSetting->value("List/FolderSync", true).toBool());
+    QObject::connect(act_folderSync,&QAction::toggled, this, [](bool checked){
+        GlobalObjects::playlist->setFolderSync(checked);
+        GlobalObjects::appSetting->setValue("List/FolderSync",checked);
+    });
 
     act_addWebDanmuSource=new QAction(tr("Add Web Danmu Source"),this);
     QObject::connect(act_addWebDanmuSource,&QAction::triggered,[this](){
@@ -297,26 +306,31 @@ void ListWindow::initActions()
         AddDanmu addDanmuDialog(item, this,true,poolTitles);
         if(QDialog::Accepted==addDanmuDialog.exec())
         {
+            if(addDanmuDialog.selectedDanmuList.isEmpty()) return;
+            QSharedPointer<int> pending(new int(addDanmuDialog.selectedDanmuList.size()));
             int i = 0;
             for(auto iter=addDanmuDialog.selectedDanmuList.begin();iter!=addDanmuDialog.selectedDanmuList.end();++iter)
             {
-                Pool *pool=GlobalObjects::danmuManager->getPool(poolIdMap.value(addDanmuDialog.danmuToPoolList.at(i++)));
-                DanmuSource &sourceInfo=(*iter).first;
-                QList<DanmuComment *> &danmuList=(*iter).second;
-                if(pool)
-                {
-                    showMessage(tr("Adding: %1").arg(pool->epTitle()),NotifyMessageFlag::NM_PROCESS);
-                    if(pool->addSource(sourceInfo,danmuList,true)==-1)
+                const DanmuSource source((*iter).first);
+                const QList<DanmuComment *> danmu((*iter).second);
+                Async::then(GlobalObjects::danmuManager->getPoolAsync(poolIdMap.value(addDanmuDialog.danmuToPoolList.at(i++))), this, [this,source,danmu,pending](Pool *pool){
+                    DanmuSource sourceInfo(source);
+                    QList<DanmuComment *> danmuList(danmu);
+                    if(pool)
+                    {
+                        showMessage(tr("Adding: %1").arg(pool->epTitle()),NotifyMessageFlag::NM_PROCESS);
+                        if(pool->addSource(sourceInfo,danmuList,true)==-1)
+                        {
+                            qDeleteAll(danmuList);
+                        }
+                    }
+                    else
                     {
                         qDeleteAll(danmuList);
                     }
-                }
-                else
-                {
-                    qDeleteAll(danmuList);
-                }
+                    if(--*pending==0) showMessage(tr("Done adding"), NotifyMessageFlag::NM_HIDE);
+                });
             }
-            showMessage(tr("Done adding"), NotifyMessageFlag::NM_HIDE);
         }
 
     });
@@ -339,25 +353,30 @@ void ListWindow::initActions()
             GlobalObjects::mpvplayer->setState(MPVPlayer::Pause);
         }
         QStringList files = QFileDialog::getOpenFileNames(this,tr("Select Xml File"),"","Xml File(*.xml) ");
-        if(!files.isEmpty())
+        if(files.isEmpty())
         {
+            if(restorePlayState)GlobalObjects::mpvplayer->setState(MPVPlayer::Play);
+            return;
+        }
+        Async::then(GlobalObjects::danmuManager->getPoolAsync(item->poolID), this, [this,files,restorePlayState](Pool *pool){
             for(auto &file: files)
             {
+                if(!pool) break;
                 QList<DanmuComment *> tmplist;
                 LocalProvider::LoadXmlDanmuFile(file,tmplist);
                 DanmuSource sourceInfo;
                 sourceInfo.scriptData = file;
                 sourceInfo.title=file.mid(file.lastIndexOf('/')+1);
                 sourceInfo.count=tmplist.count();
-                if(GlobalObjects::danmuManager->getPool(item->poolID)->addSource(sourceInfo,tmplist,true)==-1)
+                if(pool->addSource(sourceInfo,tmplist,true)==-1)
                 {
                     qDeleteAll(tmplist);
                     showMessage(tr("Add Failed: Pool is busy"), NotifyMessageFlag::NM_HIDE);
                 }
             }
-        }
-        if(restorePlayState)GlobalObjects::mpvplayer->setState(MPVPlayer::Play);
-        showMessage(tr("Done adding"), NotifyMessageFlag::NM_HIDE);
+            if(restorePlayState)GlobalObjects::mpvplayer->setState(MPVPlayer::Play);
+            showMessage(tr("Done adding"), NotifyMessageFlag::NM_HIDE);
+        });
     });
     act_updateDanmu=new QAction(tr("Update Danmu"),this);
     QObject::connect(act_updateDanmu,&QAction::triggered,[this](){
@@ -371,13 +390,14 @@ void ListWindow::initActions()
         act_addFolder->setEnabled(false);
         act_addItem->setEnabled(false);
         playlistView->setDragEnabled(false);
-        GlobalObjects::playlist->updateItemsDanmu(indexes);
-        actionDisable=false;
-        updatePlaylistActions();
-        playlistView->setDragEnabled(true);
-        act_addCollection->setEnabled(true);
-        act_addFolder->setEnabled(true);
-        act_addItem->setEnabled(true);
+        GlobalObjects::playlist->updateItemsDanmu(indexes, [this](){
+            actionDisable=false;
+            updatePlaylistActions();
+            playlistView->setDragEnabled(true);
+            act_addCollection->setEnabled(true);
+            act_addFolder->setEnabled(true);
+            act_addItem->setEnabled(true);
+        });
     });
     act_exportDanmu=new QAction(tr("Export Danmu"),this);
     QObject::connect(act_exportDanmu,&QAction::triggered,[this](){
@@ -391,13 +411,14 @@ void ListWindow::initActions()
         act_addFolder->setEnabled(false);
         act_addItem->setEnabled(false);
         playlistView->setDragEnabled(false);
-        GlobalObjects::playlist->exportDanmuItems(indexes);
-        actionDisable=false;
-        updatePlaylistActions();
-        playlistView->setDragEnabled(true);
-        act_addCollection->setEnabled(true);
-        act_addFolder->setEnabled(true);
-        act_addItem->setEnabled(true);
+        GlobalObjects::playlist->exportDanmuItems(indexes, [this](){
+            actionDisable=false;
+            updatePlaylistActions();
+            playlistView->setDragEnabled(true);
+            act_addCollection->setEnabled(true);
+            act_addFolder->setEnabled(true);
+            act_addItem->setEnabled(true);
+        });
     });
 
     act_shareResourceCode=new QAction(tr("Resource Code"),this);
@@ -407,7 +428,6 @@ void ListWindow::initActions()
         if (selection.size() == 0)return;
         QModelIndex selIndex(selection.indexes().first());
         const PlayListItem *item=GlobalObjects::playlist->getItem(selIndex);
-        Pool *pool = nullptr;
         if(!item->hasPool())
         {
             showMessage(tr("No pool associated"), NotifyMessageFlag::NM_HIDE);
@@ -418,19 +438,23 @@ void ListWindow::initActions()
                                 GlobalObjects::downloadModel->findFileUri(item->path),false,this);
         if(QDialog::Accepted!=inputDialog.exec()) return;
         QString uri = inputDialog.text;
-        QString file16MD5(GlobalObjects::danmuManager->getFileHash(item->path));
-        EpInfo ep(pool->toEp());
-        QString code(pool->getPoolCode(QStringList({uri,pool->animeTitle(),ep.name,QString::number(ep.type),QString::number(ep.index),file16MD5})));
-        if(code.isEmpty())
-        {
-            showMessage(tr("No Danmu Source to Share"), NotifyMessageFlag::NM_HIDE);
-        }
-        else
-        {
-            QClipboard *cb = QApplication::clipboard();
-            cb->setText("kikoplay:anime="+code);
-            showMessage(tr("Resource Code has been Copied to Clipboard"), NotifyMessageFlag::NM_HIDE);
-        }
+        const QString poolId(item->poolID);
+        Async::then(GlobalObjects::danmuManager->getFileHashAsync(item->path), this, [this,uri,poolId](const QString &file16MD5){
+            Pool *pool = GlobalObjects::danmuManager->getPool(poolId,false);
+            if(!pool) return;
+            EpInfo ep(pool->toEp());
+            QString code(pool->getPoolCode(QStringList({uri,pool->animeTitle(),ep.name,QString::number(ep.type),QString::number(ep.index),file16MD5})));
+            if(code.isEmpty())
+            {
+                showMessage(tr("No Danmu Source to Share"), NotifyMessageFlag::NM_HIDE);
+            }
+            else
+            {
+                QClipboard *cb = QApplication::clipboard();
+                cb->setText("kikoplay:anime="+code);
+                showMessage(tr("Resource Code has been Copied to Clipboard"), NotifyMessageFlag::NM_HIDE);
+            }
+        });
     });
     act_sharePoolCode=new QAction(tr("Danmu Pool Code"),this);
     QObject::connect(act_sharePoolCode,&QAction::triggered,[this](){
@@ -552,7 +576,7 @@ void ListWindow::initActions()
         QSortFilterProxyModel *model = static_cast<QSortFilterProxyModel *>(playlistView->model());
         QItemSelection selection = model->mapSelectionToSource(playlistView->selectionModel()->selection());
         if (selection.size() == 0)return;
-        showMessage(tr("Remove %1 Invalid Item(s)").arg(GlobalObjects::playlist->deleteInvalidItems(selection.indexes())), NM_HIDE);
+        GlobalObjects::playlist->deleteInvalidItems(selection.indexes());
     });
 
     act_clear=new QAction(tr("Clear"),this);
@@ -774,59 +798,80 @@ void ListWindow::matchPool(const QString &scriptId)
     const PlayListItem *item=GlobalObjects::playlist->getItem(indexes.first());
     if(indexes.size()==1 && !item->children)
     {
-
-        if(!item->children)
+        //the item may be moved or removed while the match runs
+        QPersistentModelIndex matchIndex(indexes.first());
+        if(item->hasPool())
         {
-            bool matchSuccess = false;
-            if(!item->hasPool())
-            {
-                showMessage(tr("Match Start"),NotifyMessageFlag::NM_PROCESS);
+            showMatchEditor(matchIndex);
+            return;
+        }
+        showMessage(tr("Match Start"),NotifyMessageFlag::NM_PROCESS);
+        const QString path(item->path);
+        const QString script(scriptId.isEmpty()?GlobalObjects::animeProvider->defaultMatchScript():scriptId);
+        //the file is hashed on the hasher pool first, the lookup on a db reader then finds the hash cached
+        Async::then(GlobalObjects::danmuManager->getFileHashAsync(path), this, [this,path,script,matchIndex](const QString &){
+            auto future = GlobalObjects::dbExecutor->readAsync("ListWindow::matchPool", [path](){
                 MatchResult match;
-                GlobalObjects::danmuManager->localMatch(item->path, match);
-                if(!match.success) GlobalObjects::animeProvider->match(scriptId.isEmpty()?GlobalObjects::animeProvider->defaultMatchScript():scriptId, item->path, match);
-                if(match.success)
+                GlobalObjects::danmuManager->localMatch(path, match);
+                return match;
+            });
+            Async::then(future, this, [this,path,script,matchIndex](MatchResult match){
+                if(!matchIndex.isValid())
                 {
-                    GlobalObjects::playlist->matchIndex(indexes.first(), match);
-                    matchSuccess = true;
+                    showMessage(tr("Match Done"), NotifyMessageFlag::NM_HIDE);
+                    return;
                 }
-                showMessage(tr("Match Done"), NotifyMessageFlag::NM_HIDE);
-            }
-            if(!matchSuccess)
-            {
-                QList<const PlayListItem *> &&siblings=GlobalObjects::playlist->getSiblings(item, false);
-                MatchEditor matchEditor(GlobalObjects::playlist->getItem(indexes.first()),&siblings,this);
-                if(QDialog::Accepted==matchEditor.exec())
+                if(!match.success) GlobalObjects::animeProvider->match(script, path, match);
+                if(match.success)
                 {
-                    if(matchEditor.singleEp.type!=EpType::UNKNOWN)
-                    {
-                        MatchResult match;
-                        match.success = true;
-                        match.name = matchEditor.anime;
-                        match.ep = matchEditor.singleEp;
-                        GlobalObjects::playlist->matchIndex(indexes.first(), match);
-                    }
-                    else
-                    {
-                         QList<const PlayListItem *> items;
-                         QList<EpInfo> eps;
-                         for(int i=0;i<siblings.size();++i)
-                         {
-                             if(matchEditor.epCheckedList[i])
-                             {
-                                 items.append(siblings[i]);
-                                 eps.append(matchEditor.epList[i]);
-                             }
-                         }
-                         GlobalObjects::playlist->matchItems(items, matchEditor.anime, eps);
-                    }
+                    QModelIndex index(matchIndex);
+                    GlobalObjects::playlist->matchIndex(index, match);
                 }
-            }
-        }
+                showMessage(tr("Match Done"), NotifyMessageFlag::NM_HIDE);
+                if(!match.success) showMatchEditor(matchIndex);
+            });
+        });
     } else {
         GlobalObjects::playlist->matchItems(indexes);
     }
 }
 
+void ListWindow::showMatchEditor(const QPersistentModelIndex &matchIndex)
+{
+    if(!matchIndex.isValid()) return;
+    QModelIndex index(matchIndex);
+    const PlayListItem *item=GlobalObjects::playlist->getItem(index);
+    QList<const PlayListItem *> &&siblings=GlobalObjects::playlist->getSiblings(item, false);
+    MatchEditor matchEditor(item,&siblings,this);
+    if(QDialog::Accepted!=matchEditor.exec()) return;
+    if(matchEditor.singleEp.type!=EpType::UNKNOWN)
+    {
+        MatchResult match;
+        match.success = true;
+        match.name = matchEditor.anime;
+        match.ep = matchEditor.singleEp;
+        if(matchIndex.isValid())
+        {
+            index = matchIndex;
+            GlobalObjects::playlist->matchIndex(index, match);
+        }
+    }
+    else
+    {
+         QList<const PlayListItem *> items;
+         QList<EpInfo> eps;
+         for(int i=0;i<siblings.size();++i)
+         {
+             if(matchEditor.epCheckedList[i])
+             {
+                 items.append(siblings[i]);
+                 eps.append(matchEditor.epList[i]);
+             }
+         }
+         GlobalObjects::playlist->matchItems(items, matchEditor.anime, eps);
+    }
+}
+
 void ListWindow::updatePlaylistActions()
 {
     if(actionDisable)
@@ -1041,6 +1086,7 @@ QWidget *ListWindow::setupPlaylistPage()
     playlistContextMenu->addMenu(shareSubMenu);
     playlistContextMenu->addSeparator();
     playlistContextMenu->addAction(act_updateFolder);
+    playlistContextMenu->addAction(act_folderSync);
     playlistContextMenu->addAction(act_removeInvalid);
     playlistContextMenu->addAction(act_browseFile);
 
@@ -1165,7 +1211,7 @@ QWidget *ListWindow::setupDanmulistPage()
     updatePool->setObjectName(QStringLiteral("ListEditButton"));
     updatePool->setToolButtonStyle(Qt::ToolButtonTextOnly);
     updatePool->setToolTip(tr("Update Danmu Pool"));
-    QObject::connect(updatePool,&QToolButton::clicked, this, &ListWindow::updateCurrentPool);
+    QObject::connect(updatePool,&QToolButton::clicked, this, [this](){ updateCurrentPool(); });
 
     QToolButton *addDanmu=new QToolButton(danmulistPage);
     addDanmu->setFont(GlobalObjects::iconfont);
@@ -1211,24 +1257,22 @@ QWidget *ListWindow::setupDanmulistPage()
     return danmulistPage;
 }
 
-int ListWindow::updateCurrentPool()
+void ListWindow::updateCurrentPool(std::function<void(int)> callback)
 {
+    Pool *pool=GlobalObjects::danmuPool->getPool();
+    if(!pool) return;
     act_autoMatch->setEnabled(false);
     act_addOnlineDanmu->setEnabled(false);
     act_addLocalDanmu->setEnabled(false);
-    const auto &sources =  GlobalObjects::danmuPool->getPool()->sources();
-    int count=0;
-    for(auto iter=sources.cbegin();iter!=sources.cend();++iter)
-    {
-        QList<DanmuComment *> tmpList;
-        showMessage(tr("Updating: %1").arg(iter.value().title),NotifyMessageFlag::NM_PROCESS);
-        count+=GlobalObjects::danmuPool->getPool()->update(iter.key());
-    }
-    showMessage(tr("Add %1 Danmu").arg(count), NotifyMessageFlag::NM_HIDE);
-    act_autoMatch->setEnabled(true);
-    act_addOnlineDanmu->setEnabled(true);
-    act_addLocalDanmu->setEnabled(true);
-    return count;
+    showMessage(tr("Updating..."),NotifyMessageFlag::NM_PROCESS);
+    //all sources are downloaded on the writer lane, the new danmu are added back on the gui thread
+    pool->updateAsync(-1, this, [this,callback](int count){
+        showMessage(tr("Add %1 Danmu").arg(count), NotifyMessageFlag::NM_HIDE);
+        act_autoMatch->setEnabled(true);
+        act_addOnlineDanmu->setEnabled(true);
+        act_addLocalDanmu->setEnabled(true);
+        if(callback) callback(count);
+    });
 }
 
 void ListWindow::infoCancelClicked()
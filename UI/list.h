@@ -11,6 +11,7 @@
 #include <QLineEdit>
 #include <QRegExp>
 #include <QStyledItemDelegate>
+#include <functional>
 #include "Common/notifier.h"
 struct DanmuComment;
 class FilterBox : public QLineEdit
@@ -43,6 +44,7 @@ private:
     inline QModelIndex getPSParentIndex();
     inline QSharedPointer<DanmuComment> getSelectedDanmu();
     void matchPool(const QString &scriptId = "");
+    void showMatchEditor(const QPersistentModelIndex &matchIndex);
 
     QWidget *infoTip;
 
@@ -55,7 +57,8 @@ private:
             *act_sortSelectionAscending,*act_sortSelectionDescending,*act_sortAllAscending,*act_sortAllDescending,
             *act_noLoopOne,*act_noLoopAll,*act_loopOne,*act_loopAll,*act_random,
             *act_browseFile,*act_autoMatch,*act_exportDanmu,*act_addWebDanmuSource, *act_addLocalDanmuSource, *act_updateDanmu,
-            *act_sharePoolCode, *act_shareResourceCode, *act_autoMatchMode, *act_markBgmCollection, *act_updateFolder;
+            *act_sharePoolCode, *act_shareResourceCode, *act_autoMatchMode, *act_markBgmCollection, *act_updateFolder,
+            *act_folderSync;
     QMenu *matchSubMenu;
     bool actionDisable;
     QActionGroup *loopModeGroup;
@@ -83,7 +86,7 @@ public slots:
     virtual void showMessage(const QString &msg, int flag);
     void updatePlaylistActions();
     void updateDanmuActions();
-    int updateCurrentPool();
+    void updateCurrentPool(std::function<void(int)> callback=nullptr);
     void infoCancelClicked();
 };
 
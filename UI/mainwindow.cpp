@@ -186,7 +186,15 @@ void MainWindow::setupUI()
     QObject::connect(act_poolManager,&QAction::triggered,[this](){
         PoolManager poolManage(buttonIcon);
         poolManage.exec();
-
+        if(poolManage.playPath.isEmpty()) return;
+        const int playTime=poolManage.playTime;
+        //seek to the searched comment once the file is loaded
+        QSharedPointer<QMetaObject::Connection> conn(new QMetaObject::Connection);
+        *conn=QObject::connect(GlobalObjects::mpvplayer,&MPVPlayer::durationChanged,this,[conn,playTime](){
+            QObject::disconnect(*conn);
+            GlobalObjects::mpvplayer->seek(playTime);
+        });
+        switchToPlay(poolManage.playPath);
     });
     buttonIcon->addAction(act_poolManager);
 
@@ -621,11 +629,12 @@ QWidget *MainWindow::setupPlayPage()
         {
             notifier->showMessage(Notifier::PLAYER_NOTIFY, tr("Updating..."));
         }
-        int c = listWindow->updateCurrentPool();
-        if(listWindow->isHidden())
-        {
-            notifier->showMessage(Notifier::PLAYER_NOTIFY, tr("Add %1 Danmu").arg(c));
-        }
+        listWindow->updateCurrentPool([this, notifier](int c){
+            if(listWindow->isHidden())
+            {
+                notifier->showMessage(Notifier::PLAYER_NOTIFY, tr("Add %1 Danmu").arg(c));
+            }
+        });
     });
     QObject::connect(playerWindow, &PlayerWindow::showMPVLog, this, [this](){
         logWindow->show(LogWindow::LogType::MPV);
@@ -774,11 +783,12 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
 
                 notifier->showMessage(Notifier::PLAYER_NOTIFY, tr("Updating..."));
             }
-            int c = listWindow->updateCurrentPool();
-            if(listWindow->isHidden())
-            {
-                notifier->showMessage(Notifier::PLAYER_NOTIFY, tr("Add %1 Danmu").arg(c));
-            }
+            listWindow->updateCurrentPool([this, notifier](int c){
+                if(listWindow->isHidden())
+                {
+                    notifier->showMessage(Notifier::PLAYER_NOTIFY, tr("Add %1 Danmu").arg(c));
+                }
+            });
         }
         break;
     default:
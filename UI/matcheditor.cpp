@@ -21,6 +21,7 @@
 #include <QHeaderView>
 #include "Common/lrucache.h"
 #include "Common/notifier.h"
+#include "Common/asynctask.h"
 #include "globalobjects.h"
 #define AnimeRole Qt::UserRole+1
 #define EpRole Qt::UserRole+2
@@ -531,21 +532,26 @@ QWidget *MatchEditor::setupSearchPage(const QString &srcAnime)
         }
         searchSubPage->setEnabled(false);
         showBusyState(true);
-        QList<AnimeLite> results;
-        ScriptState state;
-        if(scriptCombo->currentIndex()==scriptCombo->count()-1)
-            GlobalObjects::danmuManager->localSearch(keyword, results);
-        else
-            state = GlobalObjects::animeProvider->animeSearch(scriptCombo->currentData().toString(), keyword, results);
-        if(state)
-        {
+        auto showResults = [=](const QList<AnimeLite> &results){
             if(!lastSearchCacheId.isEmpty())
                 animeCache.put(lastSearchCacheId,  static_cast<AnimeModel *>(animeModel)->animeBases());
             lastSearchCacheId = cacheId;
             hitWords.remove(keyword);
             static_cast<AnimeModel *>(animeModel)->reset(results);
             animeCache.put(cacheId, results);
+        };
+        if(scriptCombo->currentIndex()==scriptCombo->count()-1)
+        {
+            Async::then(GlobalObjects::danmuManager->localSearch(keyword), this, [=](const QList<AnimeLite> &results){
+                showResults(results);
+                showBusyState(false);
+                searchSubPage->setEnabled(true);
+            });
+            return;
         }
+        QList<AnimeLite> results;
+        ScriptState state = GlobalObjects::animeProvider->animeSearch(scriptCombo->currentData().toString(), keyword, results);
+        if(state) showResults(results);
         showBusyState(false);
         searchSubPage->setEnabled(true);
     });
@@ -245,12 +245,12 @@ PlayerWindow::PlayerWindow(QWidget *parent) : QWidget(parent),autoHideControlPan
     QObject::connect(&previewTimer,&QTimer::timeout,[this](){
         if(isShowPreview && !progressInfo->isHidden() && previewLabel->isHidden())
         {
-            QPixmap *pixmap = GlobalObjects::mpvplayer->getPreview(progress->curMousePos()/1000);
-            if(pixmap)
+            QPixmap pixmap(GlobalObjects::mpvplayer->getPreview(progress->curMousePos()/1000));
+            if(!pixmap.isNull())
             {
-                previewLabel->resize(pixmap->width(), pixmap->height());
-                previewLabel->setPixmap(*pixmap);
-                timeInfoTip->setMaximumWidth(pixmap->width());
+                previewLabel->resize(pixmap.width(), pixmap.height());
+                previewLabel->setPixmap(pixmap);
+                timeInfoTip->setMaximumWidth(pixmap.width());
                 adjustProgressInfoPos();
                 previewLabel->show();
             }
@@ -1464,14 +1464,14 @@ void PlayerWindow::setupSignals()
         if(miniModeOn) miniProgress->setValue(newtime);
         timeLabel->setText(QString("%1:%2%3").arg(cmin,2,10,QChar('0')).arg(cls,2,10,QChar('0')).arg(this->totalTimeStr));
     });
-    QObject::connect(GlobalObjects::mpvplayer,&MPVPlayer::refreshPreview,[this](int timePos, QPixmap *pixmap){
+    QObject::connect(GlobalObjects::mpvplayer,&MPVPlayer::refreshPreview,[this](int timePos, const QPixmap &pixmap){
         int cp = progress->curMousePos() / 1000;
         if(!progressInfo->isHidden() && qAbs(timePos-cp)<3)
         {
-            previewLabel->resize(pixmap->width(), pixmap->height());
-            previewLabel->setPixmap(*pixmap);
+            previewLabel->resize(pixmap.width(), pixmap.height());
+            previewLabel->setPixmap(pixmap);
             progressInfo->adjustSize();
-            timeInfoTip->setMaximumWidth(pixmap->width());
+            timeInfoTip->setMaximumWidth(pixmap.width());
             adjustProgressInfoPos();
             previewLabel->show();
             //previewLabel->adjustSize();
@@ -1605,13 +1605,13 @@ void PlayerWindow::setupSignals()
         if(isShowPreview && GlobalObjects::playlist->getCurrentItem() != nullptr)
         {
             previewLabel->clear();
-            QPixmap *pixmap = GlobalObjects::mpvplayer->getPreview(cs, false);
-            if(pixmap)
+            QPixmap pixmap(GlobalObjects::mpvplayer->getPreview(cs, false));
+            if(!pixmap.isNull())
             {
-                previewLabel->resize(pixmap->width(), pixmap->height());
-                previewLabel->setPixmap(*pixmap);
+                previewLabel->resize(pixmap.width(), pixmap.height());
+                previewLabel->setPixmap(pixmap);
                 previewLabel->show();
-                timeInfoTip->setMaximumWidth(pixmap->width());
+                timeInfoTip->setMaximumWidth(pixmap.width());
             }
             else
             {
@@ -201,24 +201,24 @@ PoolItem::PoolItem(const DanmuSource *sourceInfo, QWidget *parent):QFrame(parent
     //	updateButton->setEnabled(false);
     QObject::connect(updateButton,&QPushButton::clicked,[this,sourceInfo,updateButton,deleteButton,
                      editTimeline,delaySpinBox,name](){
-        QList<DanmuComment *> tmpList;
         updateButton->setEnabled(false);
         deleteButton->setEnabled(false);
         editTimeline->setEnabled(false);
         delaySpinBox->setEnabled(false);
-        int addCount = GlobalObjects::danmuPool->getPool()->update(sourceInfo->id);
-        if(addCount>0)
-        {
-            editor->showMessage(tr("Add %1 New Danmu").arg(addCount));
-            QString sourceName = QString("%1(%2)").arg(sourceInfo->title).arg(sourceInfo->count);
-            QString elidedName = name->fontMetrics().elidedText(sourceName, Qt::ElideMiddle, 600*logicalDpiX()/96);
-            name->setText(sourceName);
-            name->setToolTip(elidedName);
-        }
-        updateButton->setEnabled(true);
-        deleteButton->setEnabled(true);
-        editTimeline->setEnabled(true);
-        delaySpinBox->setEnabled(true);
+        GlobalObjects::danmuPool->getPool()->updateAsync(sourceInfo->id, this, [=](int addCount){
+            if(addCount>0)
+            {
+                editor->showMessage(tr("Add %1 New Danmu").arg(addCount));
+                QString sourceName = QString("%1(%2)").arg(sourceInfo->title).arg(sourceInfo->count);
+                QString elidedName = name->fontMetrics().elidedText(sourceName, Qt::ElideMiddle, 600*logicalDpiX()/96);
+                name->setText(sourceName);
+                name->setToolTip(elidedName);
+            }
+            updateButton->setEnabled(true);
+            deleteButton->setEnabled(true);
+            editTimeline->setEnabled(true);
+            delaySpinBox->setEnabled(true);
+        });
     });
 
     QPushButton *exportButton=new QPushButton(tr("Export"),this);
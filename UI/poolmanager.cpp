@@ -19,17 +19,20 @@
 #include "Play/Playlist/playlistitem.h"
 #include "Play/Playlist/playlist.h"
 #include "Common/notifier.h"
+#include "Common/dbmaintenance.h"
+#include "Common/asynctask.h"
 #include "timelineedit.h"
 #include "adddanmu.h"
 #include "addpool.h"
 #include "danmuview.h"
+#include "danmusearch.h"
 #include "inputdialog.h"
 #include "globalobjects.h"
 namespace
 {
     static QCollator comparer;
 }
-PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Manager"),parent)
+PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Manager"),parent), playTime(-1)
 {
     comparer.setNumericMode(true);
     setFont(QFont(GlobalObjects::normalFont,10));
@@ -56,6 +59,9 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
        else
            stateLabel->setText(msg);
     });
+    QObject::connect(managerModel,&DanmuManagerModel::listRefreshed,stateLabel,[stateLabel,managerModel](){
+        stateLabel->setText(tr("Pool: %1 Danmu: %2").arg(managerModel->totalPoolCount()).arg(managerModel->totalDanmuCount()));
+    });
 
     QAction *act_editTimeLine=new QAction(tr("Edit TimeLine"),this);
     QObject::connect(act_editTimeLine,&QAction::triggered,this,[this,managerModel,poolView,proxyModel](){
@@ -63,19 +69,20 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         if(indexList.size()==0)return;
         DanmuPoolSourceNode *srcNode=managerModel->getSourceNode(proxyModel->mapToSource(indexList.first()));
         if(!srcNode)return;
-        QList<SimpleDanmuInfo> simpleDanmuList;
-        Pool *pool=GlobalObjects::danmuManager->getPool(srcNode->parent->idInfo);
-        if(pool)
-        {
-            pool->exportSimpleInfo(srcNode->srcId,simpleDanmuList);
-            DanmuSource srcInfo(pool->sources()[srcNode->srcId]);
+        const int srcId=srcNode->srcId;
+        this->showBusyState(true);
+        Async::then(GlobalObjects::danmuManager->getPoolAsync(srcNode->parent->idInfo), this, [this,srcId](Pool *pool){
+            this->showBusyState(false);
+            if(!pool || !pool->sources().contains(srcId)) return;
+            QList<SimpleDanmuInfo> simpleDanmuList;
+            pool->exportSimpleInfo(srcId,simpleDanmuList);
+            DanmuSource srcInfo(pool->sources()[srcId]);
             TimelineEdit timeLineEdit(&srcInfo,simpleDanmuList,this);
             if(QDialog::Accepted==timeLineEdit.exec())
             {
-                pool->setTimeline(srcNode->srcId,srcInfo.timelineInfo);
+                pool->setTimeline(srcId,srcInfo.timelineInfo);
             }
-        }
-
+        });
     });
     QAction *act_addWebSource=new QAction(tr("Add Web Source"),this);
     QObject::connect(act_addWebSource,&QAction::triggered,this,[this,stateLabel,managerModel,poolView,proxyModel](){
@@ -99,40 +106,48 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         AddDanmu addDanmuDialog(&item, this,false,poolTitles);
         if(QDialog::Accepted==addDanmuDialog.exec())
         {
+            if(addDanmuDialog.selectedDanmuList.isEmpty()) return;
             poolView->setEnabled(false);
             this->showBusyState(true);
+            //each source is added once its pool is loaded, the view stays disabled until the last one
+            QSharedPointer<int> pending(new int(addDanmuDialog.selectedDanmuList.size()));
             int i = 0;
             for(auto iter=addDanmuDialog.selectedDanmuList.begin();iter!=addDanmuDialog.selectedDanmuList.end();++iter)
             {
                 DanmuPoolNode *curNode=poolNodeMap.value(addDanmuDialog.danmuToPoolList.at(i++));
                 Q_ASSERT(curNode);
-                Pool *pool=GlobalObjects::danmuManager->getPool(curNode->idInfo);
-                Q_ASSERT(pool);
-                DanmuSource &sourceInfo=(*iter).first;
-                QList<DanmuComment *> &danmuList=(*iter).second;
-                int srcId=pool->addSource(sourceInfo,danmuList,true);
-				sourceInfo.id = srcId;
-                if(srcId<0)
-                {
-                    showMessage(tr("Add %1 Failed").arg(sourceInfo.title), NM_ERROR | NM_HIDE);
-                    qDeleteAll(danmuList);
-                    continue;
-                }
-                DanmuPoolSourceNode *sourceNode(nullptr);
-                for(auto n:*curNode->children)
-                {
-                    DanmuPoolSourceNode *srcNode=static_cast<DanmuPoolSourceNode *>(n);
-                    if(srcNode->idInfo==sourceInfo.scriptId && srcNode->scriptData==sourceInfo.scriptData)
+                const DanmuSource source((*iter).first);
+                const QList<DanmuComment *> danmu((*iter).second);
+                Async::then(GlobalObjects::danmuManager->getPoolAsync(curNode->idInfo), this, [=](Pool *pool){
+                    DanmuSource sourceInfo(source);
+                    QList<DanmuComment *> danmuList(danmu);
+                    int srcId=pool?pool->addSource(sourceInfo,danmuList,true):-1;
+                    sourceInfo.id = srcId;
+                    if(srcId<0)
                     {
-                        sourceNode=srcNode;
-                        break;
+                        showMessage(tr("Add %1 Failed").arg(sourceInfo.title), NM_ERROR | NM_HIDE);
+                        qDeleteAll(danmuList);
                     }
-                }
-                managerModel->addSrcNode(curNode,sourceNode?nullptr:new DanmuPoolSourceNode(sourceInfo));
+                    else
+                    {
+                        DanmuPoolSourceNode *sourceNode(nullptr);
+                        for(auto n:*curNode->children)
+                        {
+                            DanmuPoolSourceNode *srcNode=static_cast<DanmuPoolSourceNode *>(n);
+                            if(srcNode->idInfo==sourceInfo.scriptId && srcNode->scriptData==sourceInfo.scriptData)
+                            {
+                                sourceNode=srcNode;
+                                break;
+                            }
+                        }
+                        managerModel->addSrcNode(curNode,sourceNode?nullptr:new DanmuPoolSourceNode(sourceInfo));
+                    }
+                    if(--*pending>0) return;
+                    stateLabel->setText(tr("Pool: %1 Danmu: %2").arg(managerModel->totalPoolCount()).arg(managerModel->totalDanmuCount()));
+                    poolView->setEnabled(true);
+                    this->showBusyState(false);
+                });
             }
-            stateLabel->setText(tr("Pool: %1 Danmu: %2").arg(managerModel->totalPoolCount()).arg(managerModel->totalDanmuCount()));
-            poolView->setEnabled(true);
-            this->showBusyState(false);
         }
     });
 
@@ -149,34 +164,36 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
                 !code.startsWith("kikoplay:anime="))) return;
         poolView->setEnabled(false);
         this->showBusyState(true);
-        Pool *pool = GlobalObjects::danmuManager->getPool(poolNode->idInfo,false);
-        bool ret = pool->addPoolCode(
-                    code.mid(code.startsWith("kikoplay:pool=")?14:15),
-                    code.startsWith("kikoplay:anime="));
-        if(ret)
-        {
-            for(const DanmuSource &sourceInfo:pool->sources())
+        //loaded first, fingerprints of existing sources then come from the pool
+        Async::then(GlobalObjects::danmuManager->getPoolAsync(poolNode->idInfo), this, [=](Pool *pool){
+            bool ret = pool && pool->addPoolCode(
+                        code.mid(code.startsWith("kikoplay:pool=")?14:15),
+                        code.startsWith("kikoplay:anime="));
+            if(ret)
             {
-                bool isNewSource=true;
-                for(auto n:*poolNode->children)
+                for(const DanmuSource &sourceInfo:pool->sources())
                 {
-                    DanmuPoolSourceNode *srcNode=static_cast<DanmuPoolSourceNode *>(n);
-                    if(srcNode->isSameSource(sourceInfo))
+                    bool isNewSource=true;
+                    for(auto n:*poolNode->children)
                     {
-                        isNewSource=false;
-                        break;
+                        DanmuPoolSourceNode *srcNode=static_cast<DanmuPoolSourceNode *>(n);
+                        if(srcNode->isSameSource(sourceInfo))
+                        {
+                            isNewSource=false;
+                            break;
+                        }
+                    }
+                    if(isNewSource)
+                    {
+                        DanmuPoolSourceNode *sourceNode=new DanmuPoolSourceNode(sourceInfo);
+                        managerModel->addSrcNode(poolNode,sourceNode);
                     }
-                }
-                if(isNewSource)
-                {
-                    DanmuPoolSourceNode *sourceNode=new DanmuPoolSourceNode(sourceInfo);
-                    managerModel->addSrcNode(poolNode,sourceNode);
                 }
             }
-        }
-        poolView->setEnabled(true);
-        this->showBusyState(false);
-        this->showMessage(ret?tr("Code Added"):tr("Code Error"),ret?NM_HIDE:NM_ERROR | NM_HIDE);
+            poolView->setEnabled(true);
+            this->showBusyState(false);
+            this->showMessage(ret?tr("Code Added"):tr("Code Error"),ret?NM_HIDE:NM_ERROR | NM_HIDE);
+        });
     });
     QAction *act_copyPoolCode=new QAction(tr("Copy Danmu Pool Code"),this);
     QObject::connect(act_copyPoolCode,&QAction::triggered,this,[this,managerModel,poolView,proxyModel](){
@@ -226,15 +243,23 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         {
             QString opid(poolNode->idInfo);
             EpInfo nEp(addPool.epType, addPool.epIndex, addPool.ep);
-            QString npid = GlobalObjects::danmuManager->renamePool(opid,addPool.anime,nEp.type,nEp.index,nEp.name);
-            if(npid.isEmpty())
-            {
-                showMessage(tr("Rename Failed, Try Again?"), NM_ERROR | NM_HIDE);
-                return;
-            }
-            if(opid==npid && epNode->epName==nEp.name) return;
-            managerModel->renamePoolNode(poolNode,addPool.anime,nEp.toString(),npid);
-            GlobalObjects::playlist->renameItemPoolId(opid,npid);
+            QString animeTitle(addPool.anime);
+            //the tree stays untouched while the tables are moved
+            poolView->setEnabled(false);
+            this->showBusyState(true);
+            Async::then(GlobalObjects::danmuManager->renamePool(opid,animeTitle,nEp.type,nEp.index,nEp.name), this,
+                        [=](const QString &npid){
+                poolView->setEnabled(true);
+                this->showBusyState(false);
+                if(npid.isEmpty())
+                {
+                    showMessage(tr("Rename Failed, Try Again?"), NM_ERROR | NM_HIDE);
+                    return;
+                }
+                if(opid==npid && epNode->epName==nEp.name) return;
+                managerModel->renamePoolNode(poolNode,animeTitle,nEp.toString(),npid);
+                GlobalObjects::playlist->renameItemPoolId(opid,npid);
+            });
         }
 
     });
@@ -244,10 +269,110 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         if(indexList.size()==0)return;
         DanmuPoolNode *poolNode=managerModel->getPoolNode(proxyModel->mapToSource(indexList.first()));
         if(!poolNode)return;
-        Pool *pool=GlobalObjects::danmuManager->getPool(poolNode->idInfo);
         DanmuPoolSourceNode *sourceNode=managerModel->getSourceNode(proxyModel->mapToSource(indexList.first()));
-        DanmuView view(&pool->comments(),this,  sourceNode?sourceNode->srcId:-1);
-        view.exec();
+        const int srcId=sourceNode?sourceNode->srcId:-1;
+        this->showBusyState(true);
+        Async::then(GlobalObjects::danmuManager->getPoolAsync(poolNode->idInfo), this, [this,srcId](Pool *pool){
+            this->showBusyState(false);
+            if(!pool) return;
+            DanmuView view(pool,this,srcId);
+            view.exec();
+        });
+    });
+
+    QAction *act_loadBenchmark=new QAction(tr("Load Benchmark"),this);
+    QObject::connect(act_loadBenchmark,&QAction::triggered,this,[this,managerModel,poolView,proxyModel](){
+        QModelIndexList indexList = poolView->selectionModel()->selectedRows();
+        if(indexList.size()==0)return;
+        DanmuPoolNode *poolNode=managerModel->getPoolNode(proxyModel->mapToSource(indexList.first()));
+        if(!poolNode)return;
+        this->showBusyState(true);
+        Async::then(GlobalObjects::danmuManager->benchmarkLoad(poolNode->idInfo), this, [this](const QString &info){
+            this->showBusyState(false);
+            showMessage(info);
+        });
+    });
+    QAction *act_shardStats=new QAction(tr("Shard Stats"),this);
+    QObject::connect(act_shardStats,&QAction::triggered,this,[this](){
+        this->showBusyState(true);
+        Async::then(GlobalObjects::danmuManager->shardStats(), this, [this](const QString &info){
+            this->showBusyState(false);
+            showMessage(info);
+        });
+    });
+    QAction *act_shardCount=new QAction(tr("Set Shard Count"),this);
+    QObject::connect(act_shardCount,&QAction::triggered,this,[this](){
+        InputDialog inputDialog(tr("Set Shard Count"),tr("Danmu Table Count(1-64), pools are moved in background"),
+                                QString::number(GlobalObjects::danmuManager->shardCount()),false,this);
+        if(QDialog::Accepted!=inputDialog.exec()) return;
+        bool ok;
+        int count=inputDialog.text.trimmed().toInt(&ok);
+        if(!ok || count<1 || count>64)
+        {
+            showMessage(tr("Invalid Shard Count"), NM_ERROR | NM_HIDE);
+            return;
+        }
+        GlobalObjects::danmuManager->setShardCount(count);
+    });
+    QAction *act_packedStorage=new QAction(tr("Use Packed Storage"),this);
+    act_packedStorage->setCheckable(true);
+    act_packedStorage->setChecked(GlobalObjects::danmuManager->usePackedStorage());
+    QObject::connect(act_packedStorage,&QAction::toggled,this,[this,poolView](bool checked){
+        GlobalObjects::danmuManager->setPackedStorage(checked);
+        if(!checked) return;
+        poolView->setEnabled(false);
+        this->showBusyState(true);
+        Async::then(GlobalObjects::danmuManager->packAllPools(), this, [this,poolView](int packedCount){
+            this->showBusyState(false);
+            poolView->setEnabled(true);
+            showMessage(tr("%1 Pool(s) Converted to Packed Storage").arg(packedCount));
+        });
+    });
+    QAction *act_searchDanmu=new QAction(tr("Search Danmu"),this);
+    act_searchDanmu->setEnabled(GlobalObjects::danmuManager->useFullTextIndex());
+    QObject::connect(act_searchDanmu,&QAction::triggered,this,[this](){
+        DanmuSearch search(this);
+        if(QDialog::Accepted!=search.exec()) return;
+        playPath=search.playPath;
+        playTime=search.playTime;
+        CFramelessDialog::onAccept();
+    });
+    QAction *act_fullTextIndex=new QAction(tr("Full-text Index"),this);
+    act_fullTextIndex->setCheckable(true);
+    act_fullTextIndex->setChecked(GlobalObjects::danmuManager->useFullTextIndex());
+    QObject::connect(act_fullTextIndex,&QAction::toggled,this,[this,act_fullTextIndex,act_searchDanmu](bool checked){
+        this->showBusyState(true);
+        act_fullTextIndex->setEnabled(false);
+        Async::then(GlobalObjects::danmuManager->setFullTextIndex(checked), this, [this,act_fullTextIndex,act_searchDanmu](bool ret){
+            this->showBusyState(false);
+            act_fullTextIndex->setEnabled(true);
+            if(!ret)
+            {
+                act_fullTextIndex->blockSignals(true);
+                act_fullTextIndex->setChecked(false);
+                act_fullTextIndex->blockSignals(false);
+                showMessage(tr("FTS5 is not Available in SQLite"), NM_ERROR | NM_HIDE);
+            }
+            act_searchDanmu->setEnabled(GlobalObjects::danmuManager->useFullTextIndex());
+        });
+    });
+    QAction *act_maintenanceStats=new QAction(tr("DB Maintenance Stats"),this);
+    QObject::connect(act_maintenanceStats,&QAction::triggered,this,[this](){
+        const DBMaintenance::Stat stat(GlobalObjects::dbMaintenance->stat());
+        QString state(stat.running?(stat.paused?tr("Paused"):tr("Running")):tr("Idle"));
+        QString info(tr("State: %1, Pending Steps: %2\nReclaimed: %3 MB in %4 Vacuum Step(s)")
+                     .arg(state).arg(stat.pendingSteps).arg(stat.reclaimedBytes/1024.0/1024.0,0,'f',2).arg(stat.vacuumSteps));
+        if(!stat.checkResults.isEmpty())
+            info+=tr("\nIntegrity Check: %1").arg(stat.checkResults.join(", "));
+        showMessage(info);
+    });
+    QAction *act_fullTextStats=new QAction(tr("Full-text Index Stats"),this);
+    QObject::connect(act_fullTextStats,&QAction::triggered,this,[this](){
+        this->showBusyState(true);
+        Async::then(GlobalObjects::danmuManager->fullTextStats(), this, [this](const QString &info){
+            this->showBusyState(false);
+            showMessage(info);
+        });
     });
 
     poolView->addAction(actView);
@@ -267,6 +392,19 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
     poolView->addAction(act_copyPoolCode);
     poolView->addAction(act_pastePoolCode);
 
+    QAction *act_separator2=new QAction(this);
+    act_separator2->setSeparator(true);
+    poolView->addAction(act_separator2);
+
+    poolView->addAction(act_loadBenchmark);
+    poolView->addAction(act_shardStats);
+    poolView->addAction(act_shardCount);
+    poolView->addAction(act_packedStorage);
+    poolView->addAction(act_searchDanmu);
+    poolView->addAction(act_fullTextIndex);
+    poolView->addAction(act_fullTextStats);
+    poolView->addAction(act_maintenanceStats);
+
     QPushButton *cancel=new QPushButton(tr("Cancel"),this);
     cancel->hide();
 
@@ -302,23 +440,25 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         cancel->setEnabled(false);
         useTimelineCheck->setEnabled(false);
         useBlockRule->setEnabled(false);
+        auto exportDone=[this,poolView,exportConfirm,cancel,useTimelineCheck,useBlockRule](){
+            this->showBusyState(false);
+            exportConfirm->setText(tr("Export"));
+            exportConfirm->setEnabled(true);
+            poolView->setEnabled(true);
+            cancel->setEnabled(true);
+            useTimelineCheck->setEnabled(true);
+            useBlockRule->setEnabled(true);
+        };
         if(exportKdFile->isChecked())
         {
             InputDialog inputDialog(tr("Set Comment"),tr("Comment(Optional)"),"",true,this);
             inputDialog.exec();
-            managerModel->exportKdFile(directory, inputDialog.text);
+            managerModel->exportKdFile(directory, inputDialog.text, exportDone);
         }
         else
         {
-            managerModel->exportPool(directory,useTimelineCheck->isChecked(),useBlockRule->isChecked());
+            managerModel->exportPool(directory,useTimelineCheck->isChecked(),useBlockRule->isChecked(),exportDone);
         }
-        this->showBusyState(false);
-        exportConfirm->setText(tr("Export"));
-        exportConfirm->setEnabled(true);
-        poolView->setEnabled(true);
-        cancel->setEnabled(true);
-        useTimelineCheck->setEnabled(true);
-        useBlockRule->setEnabled(true);
     });
 
     QWidget *deletePage=new QWidget(this);
@@ -336,13 +476,14 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         deleteConfirm->setEnabled(false);
         poolView->setEnabled(false);
         cancel->setEnabled(false);
-        managerModel->deletePool();
-        this->showBusyState(false);
-        deleteConfirm->setText(tr("Delete"));
-        deleteConfirm->setEnabled(true);
-        poolView->setEnabled(true);
-        cancel->setEnabled(true);
-        stateLabel->setText(tr("Pool: %1 Danmu: %2").arg(managerModel->totalPoolCount()).arg(managerModel->totalDanmuCount()));
+        managerModel->deletePool([this,stateLabel,poolView,managerModel,deleteConfirm,cancel](){
+            this->showBusyState(false);
+            deleteConfirm->setText(tr("Delete"));
+            deleteConfirm->setEnabled(true);
+            poolView->setEnabled(true);
+            cancel->setEnabled(true);
+            stateLabel->setText(tr("Pool: %1 Danmu: %2").arg(managerModel->totalPoolCount()).arg(managerModel->totalDanmuCount()));
+        });
     });
 
     QWidget *updatePage=new QWidget(this);
@@ -360,13 +501,14 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         cancel->setEnabled(false);
         poolView->setEnabled(false);
         updateConfirm->setEnabled(false);
-        managerModel->updatePool();
-        this->showBusyState(false);
-        updateConfirm->setText(tr("Update"));
-        poolView->setEnabled(true);
-        updateConfirm->setEnabled(true);
-        cancel->setEnabled(true);
-        stateLabel->setText(tr("Pool: %1 Danmu: %2").arg(managerModel->totalPoolCount()).arg(managerModel->totalDanmuCount()));
+        managerModel->updatePool([this,stateLabel,poolView,managerModel,updateConfirm,cancel](){
+            this->showBusyState(false);
+            updateConfirm->setText(tr("Update"));
+            poolView->setEnabled(true);
+            updateConfirm->setEnabled(true);
+            cancel->setEnabled(true);
+            stateLabel->setText(tr("Pool: %1 Danmu: %2").arg(managerModel->totalPoolCount()).arg(managerModel->totalDanmuCount()));
+        });
     });
 
     QWidget *mainPage=new QWidget(this);
@@ -415,21 +557,25 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         deletePool->setEnabled(false);
         updatePool->setEnabled(false);
         addDanmuPool->setEnabled(false);
-        bool refreshList=false;
+        //the imports queue up on the writer lane in order, the list is refreshed after the last one
+        QSharedPointer<int> pending(new int(files.size()));
+        QSharedPointer<bool> refreshList(new bool(false));
         for(auto &file:files)
         {
-            if(GlobalObjects::danmuManager->importKdFile(file, this)>0)
-                refreshList=true;
+            Async::then(GlobalObjects::danmuManager->importKdFile(file, this), this, [=](int ret){
+                if(ret>0) *refreshList=true;
+                if(--*pending>0) return;
+                if(*refreshList) managerModel->refreshList();
+                this->showBusyState(false);
+                importKdFile->setText(tr("Import"));
+                poolView->setEnabled(true);
+                importKdFile->setEnabled(true);
+                exportPool->setEnabled(true);
+                deletePool->setEnabled(true);
+                addDanmuPool->setEnabled(true);
+                updatePool->setEnabled(true);
+            });
         }
-        if(refreshList) managerModel->refreshList();
-        this->showBusyState(false);
-        importKdFile->setText(tr("Import"));
-        poolView->setEnabled(true);
-        importKdFile->setEnabled(true);
-        exportPool->setEnabled(true);
-        deletePool->setEnabled(true);
-        addDanmuPool->setEnabled(true);
-        updatePool->setEnabled(true);
     });
     QObject::connect(exportPool,&QPushButton::clicked,[cancel, exportHLayout,funcStackLayout](){
         exportHLayout->addWidget(cancel);
@@ -473,13 +619,15 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
     poolHeader->resizeSection(3, 120*logicalDpiX()/96); //Count
 
 
+    QObject::connect(managerModel,&DanmuManagerModel::listRefreshed,this,[this,importKdFile,addDanmuPool](){
+        this->showBusyState(false);
+        importKdFile->setEnabled(true);
+        addDanmuPool->setEnabled(true);
+    });
     QTimer::singleShot(0,[this,managerModel,importKdFile,addDanmuPool](){
         this->showBusyState(true);
         importKdFile->setEnabled(false);
         addDanmuPool->setEnabled(false);
         managerModel->refreshList();
-        this->showBusyState(false);
-        importKdFile->setEnabled(true);
-        addDanmuPool->setEnabled(true);
     });
 }
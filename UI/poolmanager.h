@@ -8,6 +8,8 @@ class PoolManager : public CFramelessDialog
     Q_OBJECT
 public:
     explicit PoolManager(QWidget *parent = nullptr);
+    QString playPath;
+    int playTime;
 };
 
 #endif // POOLMANAGER_H
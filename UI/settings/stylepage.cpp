@@ -16,7 +16,9 @@
 #include "Common/threadtask.h"
 #include <algorithm>
 
-QHash<QString, QPixmap> StylePage::bgThumb;
+ShardedLRUCache<QString, QPixmap> StylePage::bgThumb(16*1024*1024, 2, [](const QPixmap &thumb){
+    return qint64(thumb.width())*thumb.height()*thumb.depth()/8;
+});
 namespace  {
     class ColorPreview : public QWidget
     {
@@ -238,7 +240,8 @@ void StylePage::updateSetting(const QString &path, bool add)
 
 QPixmap StylePage::getThumb(const QString &path)
 {
-    if(bgThumb.contains(path)) return bgThumb[path];
+    QPixmap cached;
+    if(bgThumb.get(path, cached)) return cached;
     QImage img(path);
     if(img.isNull()) return QPixmap();
     QImage scaled(img.scaled(thumbSize,Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation));
@@ -246,8 +249,9 @@ QPixmap StylePage::getThumb(const QString &path)
     QPainter painter(&thumb);
     painter.drawImage(0,0,scaled);
     painter.end();
-    bgThumb[path]=QPixmap::fromImage(thumb);
-    return bgThumb[path];
+    QPixmap thumbPixmap(QPixmap::fromImage(thumb));
+    bgThumb.put(path, thumbPixmap);
+    return thumbPixmap;
 }
 
 void StylePage::setSlide()
@@ -1,6 +1,7 @@
 #ifndef STYLEPAGE_H
 #define STYLEPAGE_H
 #include "settingpage.h"
+#include "Common/shardedcache.h"
 class ColorSlider;
 class QListWidget;
 class QCheckBox;
@@ -20,7 +21,7 @@ private:
     void updateSetting(const QString &path, bool add = true);
     QPixmap getThumb(const QString &path);
     void setSlide();
-    static QHash<QString, QPixmap> bgThumb;
+    static ShardedLRUCache<QString, QPixmap> bgThumb;
     bool bgChanged = false, bgDarknessChanged = false, colorChanged = false;
     const int maxBgCount = 32;
     QStringList historyBgs;
@@ -14,6 +14,8 @@
 #include "Download/autodownloadmanager.h"
 #include "UI/stylemanager.h"
 #include "Common/notifier.h"
+#include "Common/dbexecutor.h"
+#include "Common/dbmaintenance.h"
 
 #include <QSqlDatabase>
 #include <QSqlQuery>
@@ -27,6 +29,8 @@ DanmuRender *GlobalObjects::danmuRender=nullptr;
 PlayList *GlobalObjects::playlist=nullptr;
 Blocker *GlobalObjects::blocker=nullptr;
 QThread *GlobalObjects::workThread=nullptr;
+DBExecutor *GlobalObjects::dbExecutor=nullptr;
+DBMaintenance *GlobalObjects::dbMaintenance=nullptr;
 QSettings *GlobalObjects::appSetting=nullptr;
 DanmuProvider *GlobalObjects::danmuProvider=nullptr;
 AnimeProvider *GlobalObjects::animeProvider=nullptr;
@@ -42,6 +46,9 @@ QString GlobalObjects::dataPath;
 namespace  {
     const char *mt_db_names[]={"Comment_M", "Bangumi_M","Download_M"};
     const char *wt_db_names[]={"Comment_W", "Bangumi_W","Download_W"};
+    const char *rt_db_names[]={"Comment_R", "Bangumi_R","Download_R"};
+    const char *db_files[]={"comment","bangumi","download"};
+    const int db_count=3;
 }
 void GlobalObjects::init()
 {
@@ -84,6 +91,13 @@ void GlobalObjects::init()
         initDatabase(wt_db_names);
         workObj->deleteLater();
     },Qt::QueuedConnection);
+    int readerCount=appSetting->value("DB/ReaderThreads", qBound(2, QThread::idealThreadCount()/2, 4)).toInt();
+    dbExecutor=new DBExecutor(readerCount);
+    dbMaintenance=new DBMaintenance(workThread);
+    QObject::connect(mpvplayer,&MPVPlayer::stateChanged,[](MPVPlayer::PlayState state){
+        dbMaintenance->setPlaying(state==MPVPlayer::Play);
+    });
+    QMetaObject::invokeMethod(dbMaintenance,"schedule",Qt::QueuedConnection);
     scriptManager=new ScriptManager();
     danmuProvider=new DanmuProvider();
     animeProvider=new AnimeProvider();
@@ -101,8 +115,16 @@ void GlobalObjects::init()
 
 void GlobalObjects::clear()
 { 
-    workThread->quit();
+    //queued on workThread ahead of the quit, so both are done before it exits
+    playlist->flushPlayProgress();
+    danmuManager->flushWrites(true);
+    dbExecutor->shutdown();
+    dbExecutor->writeOnce("GlobalObjects::quit", [](){
+        workThread->quit();
+    });
     workThread->wait();
+    //lives on workThread, a deleteLater would never run now that it has quit
+    delete dbMaintenance;
 	mpvplayer->deleteLater();
 	danmuRender->deleteLater();
 	danmuPool->deleteLater();
@@ -118,28 +140,40 @@ void GlobalObjects::clear()
     scriptManager->deleteLater();
     autoDownloadManager->deleteLater();
     appSetting->deleteLater();
+    dbExecutor->deleteLater();
 }
 
 QSqlDatabase GlobalObjects::getDB(int db)
 {
-    if(QThread::currentThread()->objectName()==QStringLiteral("workThread"))
+    const QString threadName(QThread::currentThread()->objectName());
+    if(threadName==QStringLiteral("workThread"))
     {
         return QSqlDatabase::database(wt_db_names[db]);
     }
+    if(threadName.startsWith(DBExecutor::readerThreadPrefix))
+    {
+        return QSqlDatabase::database(QString("%1_%2").arg(rt_db_names[db], threadName));
+    }
     return QSqlDatabase::database(mt_db_names[db]);
 }
 
 void GlobalObjects::initDatabase(const char *db_names[])
 {
-    const int db_count=3;
-    const char *db_files[]={"comment","bangumi","download"};
     for(int i=0;i<db_count;++i)
     {
         setDatabase(db_names[i],db_files[i]);
     }
 }
 
-void GlobalObjects::setDatabase(const char *name, const char *file)
+void GlobalObjects::initReaderDatabase(const QString &threadName)
+{
+    for(int i=0;i<db_count;++i)
+    {
+        setDatabase(QString("%1_%2").arg(rt_db_names[i], threadName),db_files[i]);
+    }
+}
+
+void GlobalObjects::setDatabase(const QString &name, const char *file)
 {
     QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE",name);
     QString dbFile(dataPath+file+".db");
@@ -148,6 +182,10 @@ void GlobalObjects::setDatabase(const char *name, const char *file)
     database.open();
     QSqlQuery query(database);
     query.exec("PRAGMA foreign_keys = ON;");
+    //only takes effect before the first table is created, existing files are converted by DBMaintenance
+    if(!dbFileExist) query.exec("PRAGMA auto_vacuum = INCREMENTAL;");
+    //readers on other connections are not blocked by the writer
+    query.exec("PRAGMA journal_mode = WAL;");
     if(!dbFileExist)
     {
         QFile sqlFile(QString(":/res/db/%1.sql").arg(file));
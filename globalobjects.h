@@ -21,6 +21,8 @@ class LANServer;
 class ScriptManager;
 class AutoDownloadManager;
 class QMainWindow;
+class DBExecutor;
+class DBMaintenance;
 class GlobalObjects
 {
 public:
@@ -33,6 +35,8 @@ public:
     static Blocker *blocker;
     static QFont iconfont;
     static QThread *workThread;
+    static DBExecutor *dbExecutor;
+    static DBMaintenance *dbMaintenance;
     static QSettings *appSetting;
     static DanmuProvider *danmuProvider;
     static AnimeProvider *animeProvider;
@@ -52,7 +56,9 @@ public:
 
     static constexpr const char *normalFont = "Microsoft Yahei UI";
 private:
+    friend class DBExecutor;
     static void initDatabase(const char *db_names[]);
-    static void setDatabase(const char *name, const char *file);
+    static void initReaderDatabase(const QString &threadName);
+    static void setDatabase(const QString &name, const char *file);
 };
 #endif // GLOBALOBJECTS_H
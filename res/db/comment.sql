@@ -8,6 +8,8 @@ PRIMARY KEY ("PoolID") ON CONFLICT REPLACE
 );
 CREATE UNIQUE INDEX "PoolID"
 ON "pool" ("PoolID" ASC);
+CREATE INDEX "Anime_P"
+ON "pool" ("Anime" ASC);
 
 CREATE TABLE "danmu_0" (
 "PoolID"  TEXT(32) NOT NULL,
@@ -19,10 +21,13 @@ CREATE TABLE "danmu_0" (
 "Source"  INTEGER,
 "User"  TEXT,
 "Text"  TEXT,
+"Hash"  INTEGER,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
 CREATE INDEX "PoolID_0"
 ON "danmu_0" ("PoolID" ASC, "Source" ASC);
+CREATE INDEX "Hash_0"
+ON "danmu_0" ("Hash" ASC);
 
 CREATE TABLE "danmu_1" (
 "PoolID"  TEXT(32) NOT NULL,
@@ -34,10 +39,13 @@ CREATE TABLE "danmu_1" (
 "Source"  INTEGER,
 "User"  TEXT,
 "Text"  TEXT,
+"Hash"  INTEGER,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
 CREATE INDEX "PoolID_1"
 ON "danmu_1" ("PoolID" ASC, "Source" ASC);
+CREATE INDEX "Hash_1"
+ON "danmu_1" ("Hash" ASC);
 
 CREATE TABLE "danmu_2" (
 "PoolID"  TEXT(32) NOT NULL,
@@ -49,10 +57,13 @@ CREATE TABLE "danmu_2" (
 "Source"  INTEGER,
 "User"  TEXT,
 "Text"  TEXT,
+"Hash"  INTEGER,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
 CREATE INDEX "PoolID_2"
 ON "danmu_2" ("PoolID" ASC, "Source" ASC);
+CREATE INDEX "Hash_2"
+ON "danmu_2" ("Hash" ASC);
 
 CREATE TABLE "danmu_3" (
 "PoolID"  TEXT(32) NOT NULL,
@@ -64,10 +75,13 @@ CREATE TABLE "danmu_3" (
 "Source"  INTEGER,
 "User"  TEXT,
 "Text"  TEXT,
+"Hash"  INTEGER,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
 CREATE INDEX "PoolID_3"
 ON "danmu_3" ("PoolID" ASC, "Source" ASC);
+CREATE INDEX "Hash_3"
+ON "danmu_3" ("Hash" ASC);
 
 CREATE TABLE "danmu_4" (
 "PoolID"  TEXT(32) NOT NULL,
@@ -79,10 +93,38 @@ CREATE TABLE "danmu_4" (
 "Source"  INTEGER,
 "User"  TEXT,
 "Text"  TEXT,
+"Hash"  INTEGER,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
 CREATE INDEX "PoolID_4"
 ON "danmu_4" ("PoolID" ASC, "Source" ASC);
+CREATE INDEX "Hash_4"
+ON "danmu_4" ("Hash" ASC);
+
+CREATE TABLE "danmu_pack" (
+"PoolID"  TEXT(32) NOT NULL,
+"Source"  INTEGER,
+"Chunk"  INTEGER,
+"Count"  INTEGER,
+"Data"  BLOB,
+CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
+);
+CREATE INDEX "PoolID_P"
+ON "danmu_pack" ("PoolID" ASC, "Source" ASC, "Chunk" ASC);
+
+CREATE TABLE "pool_version" (
+"PoolID"  TEXT(32) NOT NULL,
+"Version"  INTEGER,
+PRIMARY KEY ("PoolID"),
+CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
+);
+
+CREATE TABLE "pool_shard" (
+"PoolID"  TEXT(32) NOT NULL,
+"Shard"  INTEGER,
+PRIMARY KEY ("PoolID"),
+CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
+);
 
 CREATE TABLE "source" (
 "PoolID"  TEXT(32),
@@ -99,6 +141,23 @@ CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELET
 CREATE INDEX "PoolID_S"
 ON "source" ("PoolID" ASC);
 
+CREATE TABLE "source_count" (
+"PoolID"  TEXT(32) NOT NULL,
+"Source"  INTEGER NOT NULL,
+"Count"  INTEGER,
+PRIMARY KEY ("PoolID", "Source"),
+CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
+);
+
+CREATE TABLE "file_hash" (
+"Path"  TEXT NOT NULL,
+"Size"  INTEGER,
+"MTime"  INTEGER,
+"Inode"  INTEGER,
+"Hash"  TEXT,
+PRIMARY KEY ("Path")
+);
+
 CREATE TABLE "match" (
 "MD5"  TEXT NOT NULL ON CONFLICT REPLACE,
 "PoolID"  TEXT(32) NOT NULL ON CONFLICT IGNORE,